@@ -2,12 +2,18 @@
 #define AES_CTR_H
 
 #define IV_LEN 16   // Initialization Vector
+#define AES_CTR_KEY_LEN      32       // Subclaves HMAC-SHA256(aes_key, etiqueta)
+#define AES_CTR_LABEL_ENC    "enc"    // Cifrado AES-256-CTR de telemetria y comandos
+#define AES_CTR_LABEL_MAC    "mac"    // HMAC de los comandos del topic de control
 
 #include <string.h>
+#include "esp_err.h"
 
 
-void aes_ctr_encrypt_to_base64(const unsigned char *input, size_t input_len,
-                                      unsigned char *iv_out, char *output_base64, size_t output_base64_len);
+esp_err_t aes_ctr_hmac(const unsigned char *data, size_t len, unsigned char mac[32]);
+esp_err_t aes_ctr_encrypt(unsigned char *data, size_t len, unsigned char *iv_out);
+esp_err_t aes_ctr_decrypt_from_base64(const char *input_base64, size_t input_base64_len, const unsigned char *iv,
+                                      unsigned char *output, size_t output_size, size_t *output_len);
 
 
 #endif //AES_CTR_H
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+/* ----- Configuracion ----- */
+#define AGG_SLIDING_SLOTS     8    // Sub-ventanas del anillo de una ventana deslizante (memoria fija)
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Data/fixed.h"
+
+
+/* ----- Tipos de ventana ----- */
+typedef enum {
+    AGG_WINDOW_TUMBLING = 0,   // Se acumula hasta agg_summary, que emite y reinicia
+    AGG_WINDOW_SLIDING         // Cubre los ultimos window_ms (resolucion window_ms / AGG_SLIDING_SLOTS)
+} agg_window_type_t;
+
+
+/* ----- Estadisticos parciales -----
+ * Sumas enteras exactas (sin float ni cancelacion): con valores de 16 bits y hasta 65535 muestras
+ * por ventana, n * sum_sq entra en 64 bits */
+typedef struct {
+    uint32_t count;
+    int64_t sum;        // Suma de los valores
+    int64_t sum_sq;     // Suma de los cuadrados
+    fx_t min;
+    fx_t max;
+} agg_stats_t;
+
+
+/* ----- Sub-ventana del anillo deslizante ----- */
+typedef struct {
+    int64_t epoch;        // Numero de sub-ventana (instante / duracion de la sub-ventana)
+    agg_stats_t stats;
+} agg_slot_t;
+
+
+/* ----- Ventana de una metrica ----- */
+typedef struct {
+    agg_window_type_t type;
+    uint32_t window_ms;                        // Solo ventanas deslizantes
+    agg_stats_t tumbling;                      // Acumulador de la ventana fija
+    agg_slot_t slots[AGG_SLIDING_SLOTS];       // Anillo de la ventana deslizante
+    fx_t last;                                 // Ultimo valor agregado
+    bool has_last;
+} agg_window_t;
+
+
+/* ----- Resumen emitido al momento del reporte ----- */
+typedef struct {
+    uint32_t count;
+    fx_t min;
+    fx_t max;
+    fx_t mean;        // Redondeada a la centesima
+    fx_t stddev;      // Desvio estandar muestral (0 con menos de dos valores)
+    fx_t last;
+} agg_summary_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void agg_init(agg_window_t *window, agg_window_type_t type, uint32_t window_ms);
+void agg_add(agg_window_t *window, int64_t now_us, fx_t value);
+bool agg_summary(agg_window_t *window, int64_t now_us, agg_summary_t *out);
+
+
+#endif //AGGREGATE_H
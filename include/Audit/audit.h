@@ -0,0 +1,50 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+/* ----- Auditoria de pilas y prioridades -----
+ * Las tareas de Placement/placement.h registran su tiempo de respuesta con audit_response (ISR del
+ * KY037 -> fin del procesamiento, despertar planificado -> fin del muestreo, desconexion -> primer
+ * reintento); la marca de agua de cada pila se lee con uxTaskGetStackHighWaterMark.
+ * En modo diagnostico (AUDIT_ENABLED) main lanza audit_start: una tarea que reproduce un perfil de
+ * estres (carga de CPU por nucleo, rafagas de publicaciones y flancos simulados del KY037) y al
+ * terminar emite, por log y en el topic de diagnostico, la pila y la prioridad recomendadas de cada
+ * tarea y la RAM que se podria reasignar (por ejemplo a lotes mas grandes). */
+#ifndef AUDIT_ENABLED
+#define AUDIT_ENABLED            0       // 1: modo diagnostico (-DAUDIT_ENABLED=1 en build_flags)
+#endif
+#define AUDIT_STACK_MARGIN_PCT   25      // Margen sobre la pila maxima usada
+#define AUDIT_STACK_ROUND        256     // Las pilas recomendadas se redondean a este multiplo
+#define AUDIT_STACK_MIN          1536    // Piso de pila recomendada (bytes)
+#define AUDIT_STRESS_PERIOD_MS   50      // Periodo de las tareas de carga de CPU (varios ticks)
+#define AUDIT_STRESS_STEP_MS     10      // Paso de la tarea que reproduce el perfil (un tick)
+#define AUDIT_STRESS_PRIORITY    5       // Compite con las tareas de la tabla de ubicacion
+#define AUDIT_STRESS_STACK       2048
+#define AUDIT_REPORT_MAX         192     // Mensaje JSON por tarea en el topic de diagnostico
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "Placement/placement.h"
+
+
+/* ----- Resultado de la auditoria de una tarea ----- */
+typedef struct {
+    const char *name;
+    uint32_t stack_size;       // Pila configurada
+    uint32_t stack_used;       // Maximo usado (pila - marca de agua)
+    uint32_t stack_recommended;
+    UBaseType_t priority;
+    UBaseType_t priority_recommended;
+    uint32_t response_max_us;  // Peor tiempo de respuesta registrado
+    uint32_t deadline_us;      // Plazo de respuesta de la tarea
+    uint32_t samples;          // Respuestas registradas
+} audit_task_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void audit_response(placement_task_t task, int64_t response_us);
+esp_err_t audit_task(placement_task_t task, audit_task_t *out);
+void audit_report(void);
+esp_err_t audit_start(void);
+
+
+#endif //AUDIT_H
@@ -0,0 +1,38 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+/* ----- Configuracion ----- */
+#define BASELINE_DAYS          7                          // Dias del anillo de picos diarios
+#define BASELINE_DAY_MS        (24UL * 60 * 60 * 1000)    // Duracion de un "dia" del seguimiento
+#define BASELINE_RANK          1                          // Pico usado: 0 = el mayor, 1 = el segundo mayor, ...
+#define BASELINE_MIN_DAYS      2                          // Dias completos antes de emitir linea base
+#define BASELINE_EMA_ALPHA_Q15 3277                       // Suavizado previo al pico (0.1 en Q15)
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* ----- Seguimiento de linea base -----
+ * Mantiene el maximo diario de la senal suavizada en un anillo de BASELINE_DAYS dias y toma como
+ * linea base un percentil alto de esos picos (el BASELINE_RANK-esimo mayor), que descarta picos
+ * aislados. Para un sensor resistivo de gas, la maxima resistencia corresponde a la minima
+ * concentracion, es decir, al aire limpio. Memoria fija y sin guardar las muestras. */
+typedef struct {
+    uint32_t ema;                    // Senal suavizada (EMA Q15)
+    uint32_t day_peak;               // Maximo de ema en el dia en curso
+    uint32_t peaks[BASELINE_DAYS];   // Picos de los ultimos dias completos
+    int64_t day_start_us;            // Inicio del dia en curso (-1: se fija con la proxima muestra)
+    uint8_t head;                    // Proxima posicion a escribir del anillo
+    uint8_t days;                    // Dias completos en el anillo (hasta BASELINE_DAYS)
+    bool has_ema;
+} baseline_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void baseline_init(baseline_t *tracker);
+void baseline_restart_day(baseline_t *tracker);
+bool baseline_update(baseline_t *tracker, int64_t now_us, uint32_t value);
+uint32_t baseline_value(const baseline_t *tracker);
+
+
+#endif //BASELINE_H
@@ -0,0 +1,31 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#define BOOT_MAX_STEPS    16       // Limite de pasos (cada paso usa un bit del event group)
+#define BOOT_DEP(step)    (1UL << (step))
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+
+/* ----- Paso de arranque -----
+ * Cada paso corre en su propia tarea apenas terminan todos los pasos de los que depende,
+ * de modo que los subsistemas independientes se inicializan en paralelo. Las tareas de los pasos
+ * se reservan en el heap aun con MEMORY_STATIC: terminan antes del regimen estacionario */
+typedef struct {
+    const char *name;          // Nombre para el log y la tarea
+    esp_err_t (*run)(void);    // Funcion de inicializacion
+    uint32_t depends;          // Mascara BOOT_DEP() de los pasos previos requeridos
+    uint32_t stack_size;       // Pila de la tarea del paso
+    UBaseType_t priority;      // Prioridad de la tarea del paso
+    BaseType_t core;           // Nucleo de la tarea (PLACEMENT_CORE_* o tskNO_AFFINITY)
+} boot_step_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+esp_err_t boot_run(const boot_step_t *steps, size_t count);
+
+
+#endif //BOOT_H
@@ -0,0 +1,30 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+/* ----- Formato binario de un lote (DATA_FORMAT_DELTA) -----
+ *   byte 0: CODEC_VERSION
+ *   byte 1: cantidad de reportes del lote
+ *   byte 2: mascara de sensores (DATA_SENSOR_BIT) que define las columnas presentes
+ *   columnas: por cada campo presente, el primer valor y luego la diferencia con el anterior,
+ *             cada uno en zigzag + varint (LEB128). El orden por columnas agrupa valores
+ *             correlacionados, de modo que las diferencias son casi siempre de un byte.
+ *             Temperatura, humedad y concentraciones van en centesimas (Data/fixed.h).
+ * Modulo portable (sin dependencias de ESP-IDF): lo comparten el firmware y tools/codec. */
+#define CODEC_VERSION          3      // 3: columnas del MQ135; 2: temperatura/humedad en centesimas
+#define CODEC_HEADER_LEN       3
+#define CODEC_VARINT_MAX       5      // Bytes maximos de un varint de 32 bits
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Data/data.h"
+
+
+/* ----- Declaracion de funciones de la API ----- */
+size_t codec_encode_batch(const data_sensors_t *samples, uint8_t count, uint8_t sensor_mask,
+                          uint8_t *out, size_t out_size);
+int codec_decode_batch(const uint8_t *in, size_t len, data_sensors_t *samples, uint8_t max_count,
+                       uint8_t *sensor_mask);
+int codec_format_json(const data_sensors_t *data, uint8_t sensor_mask, char *json, size_t size);
+
+
+#endif //CODEC_H
@@ -0,0 +1,23 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+/* ----- Topic de control -----
+ * Comandos remotos en "<device_name>/control" (MQTT_TOPIC_CONTROL) con el mismo formato que la telemetria mas un MAC:
+ *   "v1:<IV Base64>:<datos Base64>:<MAC Base64>"
+ * MAC = primeros CONTROL_MAC_LEN bytes de HMAC-SHA256(clave MAC, "v1:<IV Base64>:<datos Base64>"), donde
+ * clave MAC = HMAC-SHA256(aes_key, "mac"); el cifrado usa HMAC-SHA256(aes_key, "enc") (AES-CTR/aes-ctr.h).
+ * El texto plano es un lote "seq=N;clave=valor;..." con las claves PROV_KEY_SAMPLE, PROV_KEY_BATCH,
+ * PROV_KEY_FORMAT y PROV_KEY_SENSORS. seq debe ser mayor que el ultimo aplicado (anti-replay), por
+ * lo que el comando puede publicarse con retain para que lo reciban los equipos que duermen.
+ * Respuesta en "<device_name>/control/ack": "ACK <seq>" o "NAK <seq> <motivo>" (MQTT_TOPIC_CONTROL_ACK). */
+#define CONTROL_MAC_LEN            16
+#define CONTROL_MAX_PLAINTEXT      192
+
+#include "esp_err.h"
+
+
+/* ----- Declaracion de funciones de la API ----- */
+esp_err_t control_init(void);
+
+
+#endif //CONTROL_H
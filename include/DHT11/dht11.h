@@ -5,10 +5,13 @@
 #define DHT11_PIN                GPIO_NUM_4      // Pin 4
 #define DHT11_START_SIGNAL_LOW     20000    // 20 ms señal baja de inicio
 #define DHT11_START_SIGNAL_HIGH    40       // 30 micro seg señal alta de inicio
+#define DHT11_TEMP_NEGATIVE        0x80     // Bit de signo en el byte decimal de temperatura
+#define DHT11_DECIMAL_MASK         0x7F     // Decimal de temperatura/humedad en decimas
 
 
 #include <esp_err.h>
 #include <stdint.h>
+#include "Data/fixed.h"
 
 
 /* ===== Estructura de datos ===== */
@@ -18,6 +21,8 @@ typedef struct {
     uint8_t humidity;       // Parte entera de humedad
     uint8_t hum_decimal;    // Parte decimal de humedad
     uint8_t checksum;       // Checksum recibido
+    fx_t temp_value;        // Temperatura en centesimas de C, con signo
+    fx_t hum_value;         // Humedad en centesimas de %
 } dht11_data_t;
 
 extern dht11_data_t dht11_data;
@@ -4,21 +4,55 @@
 #define ID_KY037 0
 #define ID_DHT11 1
 #define ID_MQ135 2
+#define DATA_SENSOR_COUNT 3
+#define DATA_GAS_COUNT    5      // Gases estimados por el MQ135 (orden de MQ135/mq135.h)
+
+#define DATA_SENSOR_BIT(id)           (1U << (id))
+#define DATA_SENSOR_ALL               (DATA_SENSOR_BIT(ID_KY037) | DATA_SENSOR_BIT(ID_DHT11) | DATA_SENSOR_BIT(ID_MQ135))
+#define DATA_SENSOR_SAMPLED           DATA_SENSOR_ALL    // Sensores con driver
+
+/* ----- Formatos de payload (settings.payload_format) ----- */
+#define DATA_FORMAT_JSON              0        // Un mensaje JSON por reporte
+#define DATA_FORMAT_DELTA             1        // Un mensaje binario por lote (Codec/codec.h)
+#define DATA_FORMAT_COUNT             2
+
+#define DATA_PAYLOAD_VERSION          "v1"     // Formato del payload: "<version>:<IV Base64>:<datos Base64>" (MQTT 5: ver MQTT5_PROP_*)
+#define DATA_PAYLOAD_VERSION_DELTA    "v2"     // Mismo sobre, datos en el formato de Codec/codec.h
+#define DATA_MQTT_CONNECT_TIMEOUT_MS  10000    // Espera maxima de la sesion MQTT antes de publicar
+#define DATA_MQTT_FLUSH_TIMEOUT_MS    5000     // Espera maxima de las confirmaciones QoS1 de la rafaga
+#define DATA_JSON_MAX                 512      // JSON o lote binario de un mensaje (su sobre debe entrar en un bloque de Pool/pool.h)
+#define DATA_TASK_STACK               5120     // Pila de data_json_encrypt_task (bytes)
+#define DATA_QUEUE_LEN                10       // Lecturas en queue_data
+#define DATA_AGG_WINDOW_MS            0        // 0: estadisticas del periodo de reporte; >0: ventana deslizante de ese largo
+#define DATA_ACCUM_MAGIC              0x41434333   // "ACC3", valida el acumulado en memoria RTC
 
 #include <stdint.h>
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "Data/fixed.h"
 
 
 typedef struct {
-    uint32_t ky037_counter;         // Contador de detecciones del microfono
-    uint32_t ky037_max_duration;    // Maxima duracion de pulso de microfono
-    uint8_t dht11_temperature;      // Parte entera de temperatura
-    uint8_t dht11_temp_decimal;     // Parte decimal de temperatura
-    uint8_t dht11_humidity;         // Parte entera de humedad
-    uint8_t dht11_hum_decimal;      // Parte decimal de humedad
+    uint32_t ky037_counter;         // Contador de detecciones del microfono en el periodo de reporte
+    uint32_t ky037_max_duration;    // Maxima duracion de pulso de microfono en el periodo de reporte
+    fx16_t temperature;             // Ultima lectura de temperatura (centesimas de C)
+    fx16_t humidity;                // Ultima lectura de humedad (centesimas de %)
 
     uint8_t air_quality;
+
+    /* Estadisticas del periodo de reporte, en centesimas (Data/fixed.h) */
+    fx16_t temp_min;
+    fx16_t temp_max;
+    fx16_t temp_mean;
+    fx16_t temp_std;                // Desvio estandar muestral
+    fx16_t hum_min;
+    fx16_t hum_max;
+    fx16_t hum_mean;
+    fx16_t hum_std;
+    uint16_t dht11_samples;         // Lecturas validas del DHT11 en el periodo (0: sin estadisticas)
+
+    /* MQ135: media del periodo, compensada con la ultima lectura del DHT11 */
+    fx_t gas_ppm[DATA_GAS_COUNT];   // CO2, CO, NH3, C6H6, NO2 en centesimas de ppm
+    uint16_t mq135_samples;         // Lecturas validas del MQ135 en el periodo (0: sin datos)
+    uint8_t mq135_calibrated;       // 0 mientras R0 sigue siendo el valor por defecto
 } data_sensors_t;
 
 
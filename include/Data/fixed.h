@@ -0,0 +1,77 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+/* ----- Valores de sensores en punto fijo -----
+ * Toda magnitud medida (temperatura, humedad, concentraciones) viaja como entero en centesimas
+ * de su unidad: 23.45 C -> 2345, -0.05 C -> -5. Los drivers la producen, el agregador la acumula
+ * y el codec la serializa sin pasar por float. Las constantes reales se escalan en compilacion
+ * con FX_CONST. Modulo portable (sin dependencias de ESP-IDF). */
+#define FX_SCALE              100                              // Centesimas
+#define FX_DECIMALS           2
+#define FX_STR_MAX            16                               // "-21474836.48" + terminador
+#define FX_FROM_INT(i)        ((fx_t)(i) * FX_SCALE)
+#define FX_FROM_TENTHS(t)     ((fx_t)(t) * (FX_SCALE / 10))
+#define FX_CONST(x)           ((fx_t)((x) * FX_SCALE + ((x) < 0 ? -0.5 : 0.5)))   // Literal real, redondeado
+#define FX16_MIN              INT16_MIN
+#define FX16_MAX              INT16_MAX
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+typedef int32_t fx_t;      // Calculo: centesimas con signo
+typedef int16_t fx16_t;    // Almacenamiento en reportes: -327.68 .. 327.67
+
+
+/**
+ * @brief Division entera redondeada al mas cercano (la division de C trunca hacia cero).
+ */
+static inline int64_t fx_div_round(int64_t num, int64_t den) {
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+    return (num >= 0) ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+
+/**
+ * @brief Producto de dos valores en punto fijo.
+ */
+static inline fx_t fx_mul(fx_t a, fx_t b) {
+    return (fx_t)fx_div_round((int64_t)a * b, FX_SCALE);
+}
+
+
+/**
+ * @brief Cociente de dos valores en punto fijo (b distinto de cero).
+ */
+static inline fx_t fx_div(fx_t a, fx_t b) {
+    return (fx_t)fx_div_round((int64_t)a * FX_SCALE, b);
+}
+
+
+/**
+ * @brief Reduce un valor al rango de almacenamiento, saturando en los extremos.
+ */
+static inline fx16_t fx_to16(fx_t value) {
+    if (value > FX16_MAX) return FX16_MAX;
+    if (value < FX16_MIN) return FX16_MIN;
+    return (fx16_t)value;
+}
+
+
+/**
+ * @brief Formatea un valor como numero decimal ("-0.05", "23.40"), con signo y ceros a la izquierda
+ * en la parte decimal.
+ * @return int  Igual que snprintf.
+ */
+static inline int fx_format(fx_t value, char *buf, size_t size) {
+    uint32_t mag = (value < 0) ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+    return snprintf(buf, size, "%s%lu.%02lu", value < 0 ? "-" : "",
+                    (unsigned long)(mag / FX_SCALE), (unsigned long)(mag % FX_SCALE));
+}
+
+
+#endif //FIXED_H
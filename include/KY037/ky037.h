@@ -3,9 +3,12 @@
 
 #include "esp_err.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 
 #define KY037_PIN GPIO_NUM_5
+#define KY037_STATS_STACK 2048   // Pila de la tarea vStatsTask (bytes)
 
 
 /* ----- Estructura para estadísticas internas (usada por la ISR) ----- */
@@ -26,6 +29,7 @@ extern ky037_stats_t ky037_stats;
 extern SemaphoreHandle_t xStatsMutex;
 
 esp_err_t ky037_init(void);
+void ky037_simulate_edge(void);
 // Declaraciones de tareas (para uso interno)
 void vStatsTask(void *pvParameters);
 void ky037_task(void *);
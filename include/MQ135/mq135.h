@@ -3,16 +3,17 @@
 
 
 /* ----- Configuracion de hardware ----- */
-#define MQ135_ADC_CHANNEL ADC1_CHANNEL_6   // GPIO34
-#define ADC_WIDTH         ADC_WIDTH_BIT_12 // 12 bits: 0–4095
-#define ADC_ATTEN         ADC_ATTEN_DB_12  // permite medir hasta ~3.3V
+#define MQ135_ADC_UNIT      ADC_UNIT_1
+#define MQ135_ADC_CHANNEL   ADC_CHANNEL_6      // GPIO34
+#define MQ135_ADC_BITWIDTH  ADC_BITWIDTH_12    // 12 bits: 0–4095
+#define MQ135_ADC_ATTEN     ADC_ATTEN_DB_12    // permite medir hasta ~3.3V
 #define VREF              3300             // mV (3.3 V ref)
-#define VCC               5.0f             // V (alimentación modulo MQ135)
-#define RLOAD             10000.0f         // ohmios (depende del modulo)
-#define RESOLUTION        4095.0f          // 2^12 - 1
-#define RELATIVE_HUMIDITY 33.0f            // Humedad relativa cuando se calibro el sensor
+#define RESOLUTION        4095             // 2^12 - 1
+#define MQ135_REF_TEMPERATURE  FX_CONST(20.0)   // Condicion de referencia si todavia no hay lectura del DHT11
+#define MQ135_REF_HUMIDITY     FX_CONST(33.0)
 #define DEFAULT_VREF      1100             // mV
 #define NUMBER_OF_SAMPLES  64              // cantidad de lecturas para promediar
+#define MQ135_PPM_MAX      FX_FROM_INT(1000000)   // Tope de la concentracion reportada (centesimas de ppm)
 /* ----- Concentracion atmosferica para cada gas (ppm) ----- */
 #define ATM_CO2 400       // Dioxido de Carbono (CO₂)
 #define ATM_CO 0.1        // Monóxido de Carbono (CO)
@@ -30,58 +31,62 @@
 #define C6H6_B 2.5082
 #define NO2_A 45.0673
 #define NO2_B 3.4835
-/* ----- Resistencia de calibracion a nivel de CO atmosférico ----- */
+/* ----- Resistencia de calibracion a nivel de CO atmosférico (hasta que se calibre) -----
+ * Luego del aprendizaje inicial, R0 sigue la linea base de Baseline/baseline.h */
 #define CO2_R0 930
 #define CO_R0 930
 #define NH3_R0 930
 #define C6H6_R0 930
 #define NO2_R0 930
-/* ----- Coeficientes para correccion ----- */
-#define CORA 0.00035
-#define CORB 0.02718
-#define CORC 1.39538
-#define CORD 0.0018
+/* ----- Calibracion de R0 (aire limpio) ----- */
+#define MQ135_BURNIN_MS         (BASELINE_MIN_DAYS * BASELINE_DAY_MS)   // Aprendizaje: los dias que necesita la linea base
+#define MQ135_NVS_NAMESPACE     "mq135"
+#define MQ135_NVS_CALIB_KEY     "calib"
+#define MQ135_CALIB_MAGIC       0x4D513031                // "MQ01"
+#define MQ135_CALIB_VERSION     4                         // 2: agrega la linea base. 3: R0 como log2 Q16. 4: pedido atendido
+#define MQ135_R0_MAX_STEP       MQ135_Q16(0.0703893)      // log2(1.05): cambio maximo de R0 por dia (5 %)
+#define MQ135_R0_SAVE_DELTA     MQ135_Q16(0.0143553)      // log2(1.01): cambio de R0 que fuerza guardar en NVS
+#define MQ135_CHECKPOINT_DAYS   7                         // Sin cambios de R0, guardar la linea base cada N dias
 /* ----- EMA ----- */
 #define EMA_ALPHA_Q15  3277   // α = 0.1 en Q15 = 0.1 * 32768 aprox 3277
 #define EMA_2_15  32768       // 2^15
 
+#include <stdbool.h>
 #include <stdint.h>
-#include <math.h>
+#include "esp_err.h"
+#include "Data/data.h"
+#include "Baseline/baseline.h"
+#include "MQ135/mq135_model.h"
 
 
-
-/* ----- Estructura para parametros de los gases ----- */
-typedef struct {
-    float A;
-    float B;
-    float ATM;
-    float inv_B;        // Precalculado: 1/B
-    float neg_B;        // Precalculado: -B
-    float atm_div_A;    // Precalculado: ATM/A
-    float R0;
-} gas_t;
-
-extern gas_t co2, co, nh3, c6h6, no2;
+/* ----- Gases estimados, en el orden de data_sensors_t.gas_ppm ----- */
+typedef enum {
+    MQ135_GAS_CO2 = 0,
+    MQ135_GAS_CO,
+    MQ135_GAS_NH3,
+    MQ135_GAS_C6H6,
+    MQ135_GAS_NO2,
+    MQ135_GAS_COUNT
+} mq135_gas_id_t;
 
 
-/* ----- Funciones inline ----- */
-static inline float mq135_get_R0(float resistance, const gas_t* params) {
-    return resistance * powf(params->atm_div_A, params->inv_B);
-}
-
-static inline float mq135_get_ppm(float resistance, float R0, const gas_t* params) {
-    return params->A * powf(resistance / R0, params->neg_B);
-}
+/* ----- Lectura compensada ----- */
+typedef struct {
+    uint32_t resistance;            // Resistencia del sensor corregida por temperatura y humedad (ohmios)
+    fx_t ppm[MQ135_GAS_COUNT];      // Concentraciones estimadas (Data/fixed.h)
+    bool calibrated;                // false: R0 por defecto, todavia en periodo de aprendizaje
+} mq135_reading_t;
 
 
 /* ----- Declaraciones de funciones de la API ----- */
-void mq135_init_gas();
-void mq135_init();
-float mq135_get_corrected_resistance(float, float);
-float mq135_get_corrected_R0(float, float, const gas_t*);
-float mq135_get_corrected_ppm(float, float, const gas_t*);
-void mq135_clear_cache();
+void mq135_init_gas(void);
+esp_err_t mq135_init(void);
+esp_err_t mq135_read_resistance(uint32_t *resistance);
+uint32_t mq135_get_corrected_resistance(uint32_t resistance, fx_t temperature, fx_t humidity);
+esp_err_t mq135_sample(fx_t temperature, fx_t humidity, int64_t now_us, mq135_reading_t *out);
+void mq135_calibration_request(uint32_t seq, int64_t now_us);
+void mq135_clear_cache(void);
 
 
 
-#endif //MQ135_H
\ No newline at end of file
+#endif //MQ135_H
@@ -0,0 +1,54 @@
+#ifndef MQ135_MODEL_H
+#define MQ135_MODEL_H
+
+/* ----- Modelo del MQ135 en punto fijo -----
+ * La curva ppm = A * (Rs/R0)^-B se evalua en el dominio logaritmico con enteros:
+ *   log2(ppm * FX_SCALE) = log2(A * FX_SCALE) - B * (log2 Rs - log2 R0)
+ * con log2 y 2^x en Q16 (16 bits de fraccion). R0 se guarda como log2 en Q16, de modo que el
+ * seguimiento diario limita el paso con una suma en lugar de un producto. La resistencia y el factor
+ * de compensacion se calculan con mV y millonesimas enteras. El aprendizaje inicial y el seguimiento
+ * diario estiman R0 de la misma linea base (Baseline/baseline.h). Modulo portable (sin dependencias de
+ * ESP-IDF): lo usan el firmware y tools/mq135. */
+#define MQ135_Q16_ONE           65536
+#define MQ135_Q16(x)            ((int32_t)((x) * MQ135_Q16_ONE + ((x) < 0 ? -0.5 : 0.5)))   // Literal real
+#define MQ135_MICRO(x)          ((int64_t)((x) * 1000000.0 + ((x) < 0 ? -0.5 : 0.5)))      // Literal real
+#define MQ135_VCC_MV            5000           // Alimentacion del modulo
+#define MQ135_RLOAD_OHM         10000          // Resistencia de carga (depende del modulo)
+#define MQ135_R0_UNLIMITED      INT32_MAX      // Paso de mq135_track_r0 sin limite (fin del aprendizaje)
+/* ----- Coeficientes para correccion -----
+ * factor = CORA * t^2 - CORB * t + CORC - CORD * (h - RELATIVE_HUMIDITY), evaluado en millonesimas */
+#define RELATIVE_HUMIDITY       33.0           // Humedad relativa cuando se calibro el sensor
+#define CORA                    0.00035
+#define CORB                    0.02718
+#define CORC                    1.39538
+#define CORD                    0.0018
+#define COR_K0                  MQ135_MICRO(CORC + CORD * RELATIVE_HUMIDITY)   // Termino independiente precalculado
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Data/fixed.h"
+
+
+/* ----- Parametros de la curva de un gas ----- */
+typedef struct {
+    int32_t log2_a;      // log2(A * FX_SCALE): la curva sale directamente en centesimas de ppm
+    int32_t b;           // Exponente B
+    int32_t log2_k;      // log2((ATM / A)^(1/B)): R0 = Rs en aire limpio * k
+    int32_t log2_r0;     // log2(R0) vigente
+} mq135_curve_t;         // Todos los campos en Q16
+
+
+/* ----- Declaracion de funciones de la API ----- */
+int32_t mq135_log2(uint32_t x);
+uint32_t mq135_exp2(int32_t e);
+void mq135_curve_init(mq135_curve_t *curve, uint32_t a_milli, int32_t b, uint32_t atm_milli, uint32_t r0);
+uint32_t mq135_resistance_from_mv(int mv);
+int32_t mq135_correction_factor(fx_t temperature, fx_t humidity);
+uint32_t mq135_correct_resistance(uint32_t resistance, int32_t factor);
+int32_t mq135_curve_r0(const mq135_curve_t *curve, uint32_t resistance);
+fx_t mq135_curve_ppm(const mq135_curve_t *curve, uint32_t resistance, fx_t ppm_max);
+int32_t mq135_r0_step(int32_t current, int32_t target, int32_t max_step);
+int32_t mq135_track_r0(mq135_curve_t *curves, int count, uint32_t base, int32_t max_step);
+
+
+#endif //MQ135_MODEL_H
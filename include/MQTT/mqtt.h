@@ -4,28 +4,209 @@
 #include "esp_err.h"
 #include "mqtt_client.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_transport.h"
+#include "MQTT/mqtt_outbox.h"
+#include "Memory/memory.h"
+#include "Pool/pool.h"
+
+
+#define MQTT_USE_TLS          1        // 1: conexion TLS con reanudacion de sesion (MQTT/mqtt_tls.h)
+#ifdef CONFIG_MQTT_PROTOCOL_5
+#define MQTT_USE_V5           1        // MQTT 5: alias de topic, expiracion y propiedades de usuario
+#else
+#define MQTT_USE_V5           0
+#endif
+#define MQTT_CONNECTED_BIT    BIT0
+#define MQTT_WINDOW_BIT       BIT1     // Hay lugar en la ventana de mensajes en vuelo
+#define MQTT_IDLE_BIT         BIT2     // No hay mensajes QoS>0 sin confirmar ni en espera
+#define MQTT_INFLIGHT_MAX        8     // Ventana de mensajes QoS>0 sin confirmar
+#define MQTT_WINDOW_TIMEOUT_MS   5000  // Espera maxima por lugar en la ventana antes de encolar
+#define MQTT_OUTBOX_POLICY       MQTT_OUTBOX_DROP_OLDEST   // Politica por defecto de la cola en espera
+#define MQTT_ESP_OUTBOX_LIMIT    (8 * 1024)                // Tope del outbox interno de esp-mqtt (bytes)
+#define MQTT_MAX_SUBSCRIPTIONS   4     // Topics suscritos que se renuevan en cada conexion
+#define MQTT_RECONNECT_STACK     4096  // Pila de la tarea de reconexion (bytes)
+#define MQTT_RECONNECT_DELAY_MS  5000  // Espera entre intentos de reconexion
+#define MQTT_TOPIC_MAX_LEN       128
+
+/* MQTT 5: la telemetria viaja con alias de topic y expiracion; la version y el IV del sobre
+ * "<version>:<IV Base64>:<datos Base64>" pasan a propiedades de usuario y el payload queda solo con los datos */
+#define MQTT5_TELEMETRY_ALIAS     1
+#define MQTT5_TELEMETRY_EXPIRY_S  900      // El broker descarta telemetria no entregada tras este tiempo
+#define MQTT5_PROP_VERSION        "v"
+#define MQTT5_PROP_IV             "iv"
+#define MQTT5_PROP_MAX_LEN        32       // Version o IV Base64 con terminador
+
+/* Sufijos de los topics del dispositivo ("<device_name><sufijo>") */
+#define MQTT_SUFFIX_TELEMETRY    "/telemetry"
+#define MQTT_SUFFIX_DIAGNOSTICS  "/diagnostics"
+#define MQTT_SUFFIX_CONTROL      "/control"
+#define MQTT_SUFFIX_CONTROL_ACK  "/control/ack"
+#define MQTT_SUFFIX_STATUS       "/status"
+
+
+/* ----- Topics del dispositivo (se arman una vez al iniciar) ----- */
+typedef enum {
+    MQTT_TOPIC_TELEMETRY = 0,
+    MQTT_TOPIC_DIAGNOSTICS,
+    MQTT_TOPIC_CONTROL,
+    MQTT_TOPIC_CONTROL_ACK,
+    MQTT_TOPIC_STATUS,
+    MQTT_TOPIC_COUNT
+} mqtt_topic_id_t;
+
+
+typedef struct {
+    char name[MQTT_TOPIC_MAX_LEN];
+    uint8_t len;                  // strlen(name)
+} mqtt_topic_t;
+
+
+/* ----- Callback de mensajes recibidos en un topic suscrito ----- */
+typedef void (*mqtt_message_cb_t)(const char *data, int data_len);
+
+
+typedef struct {
+    char topic[MQTT_TOPIC_MAX_LEN];
+    int qos;
+    mqtt_message_cb_t callback;
+} mqtt_subscription_t;
+
+
+/* ----- Cambio de estado de la sesion: conexion establecida o perdida sin mqtt_client_stop -----
+ * Se ejecuta en la tarea de esp-mqtt */
+typedef void (*mqtt_session_cb_t)(bool connected);
+
+
+/* ----- Mensaje QoS>0 en vuelo ----- */
+typedef struct {
+    int msg_id;          // 0: libre, -1: reservado mientras se publica
+    int64_t sent_us;     // Instante de publicacion (esp_timer)
+    uint32_t len;        // Bytes de payload
+} mqtt_inflight_t;
+
+
+/* ----- Confirmacion que llego antes de registrar su msg_id ----- */
+typedef struct {
+    int msg_id;          // 0: libre
+    int64_t at_us;       // Instante de llegada (esp_timer): solo vale para una publicacion anterior
+} mqtt_early_ack_t;
+
+
+/* ----- Estadisticas de publicacion ----- */
+typedef struct {
+    uint32_t published;          // Mensajes QoS>0 aceptados por esp-mqtt
+    uint32_t acked;              // Confirmados por el broker
+    uint32_t dropped;            // Descartados por esp-mqtt (outbox expirado)
+    uint32_t window_full;        // Publicaciones que esperaron lugar en la ventana
+    uint32_t window_timeouts;    // Publicaciones derivadas a la cola en espera por ventana llena
+    uint32_t latency_last_ms;    // Publicacion -> confirmacion
+    uint32_t latency_max_ms;
+    uint32_t latency_avg_ms;     // Promedio movil (1/8)
+    mqtt_outbox_stats_t outbox;  // Cola en espera (presupuesto y politica)
+} mqtt_stats_t;
 
 
 typedef struct {
     esp_mqtt_client_handle_t client;   // handler de ESP-IDF para el cliente MQTT
     esp_mqtt_client_config_t config;   // configuracion (URI, credenciales, etc.)
-    BaseType_t reconnecting;           // flag para saber si la tarea de reconexión esta activa
+    BaseType_t reconnecting;           // flag para saber si la tarea de reconexión esta reintentando
+    TaskHandle_t reconnect_task;       // Tarea de reconexion (se crea una vez y espera una notificacion)
+    int64_t disconnect_us;             // Ultima desconexion (esp_timer), para el tiempo de respuesta de la reconexion
+    BaseType_t stopped;                // flag de parada voluntaria (no reconectar)
+    esp_transport_handle_t transport;  // transporte TLS propio (NULL si se usa el de esp-mqtt)
+    EventGroupHandle_t events;         // MQTT_CONNECTED_BIT
+    StaticEventGroup_t events_buffer;
+    mqtt_topic_t topics[MQTT_TOPIC_COUNT];   // Tabla de topics del dispositivo
+    mqtt_subscription_t subscriptions[MQTT_MAX_SUBSCRIPTIONS];
+    uint8_t subscription_count;
+    SemaphoreHandle_t lock;            // Protege la tabla de mensajes en vuelo y la cola en espera
+    StaticSemaphore_t lock_buffer;
+    mqtt_inflight_t inflight[MQTT_INFLIGHT_MAX];
+    uint8_t inflight_count;            // Entradas ocupadas (incluye reservadas)
+    uint32_t inflight_bytes;
+    mqtt_early_ack_t early_acks[MQTT_INFLIGHT_MAX];   // Confirmaciones llegadas antes de registrar el msg_id
+    uint8_t early_ack_next;
+    mqtt_outbox_t outbox;              // Mensajes QoS>0 en espera de lugar en la ventana o de conexion
+    mqtt_session_cb_t on_session;      // Aviso de conexion/desconexion (NULL: ninguno)
+    TaskHandle_t event_task;           // Tarea de esp-mqtt (ultima que entrego un evento)
+    bool alias_sent;                   // MQTT 5: el alias de telemetria ya se asocio al topic en esta conexion
+    bool alias_refused;                // MQTT 5: el broker no acepta alias en esta conexion
+    mqtt_stats_t stats;
+#if MEMORY_STATIC
+    StackType_t reconnect_stack[MQTT_RECONNECT_STACK];
+    StaticTask_t reconnect_buffer;
+#endif
 } mqtt_client_t;
 
 
+extern mqtt_client_t mqtt_client;
+
+
 /* ----- Inicializa la estructura y configura el cliente ----- */
 void mqtt_client_init(mqtt_client_t *mqtt, const char *uri,
                       const char *user, const char *pass);
 
+/* ----- Arma la tabla de topics a partir del nombre del dispositivo ----- */
+esp_err_t mqtt_client_set_topics(mqtt_client_t *mqtt, const char *device_name);
+
+/* ----- Topic precalculado ----- */
+const char *mqtt_client_topic(const mqtt_client_t *mqtt, mqtt_topic_id_t id);
+
+/* ----- Last will en un topic de la tabla (antes de mqtt_client_start) ----- */
+esp_err_t mqtt_client_set_will(mqtt_client_t *mqtt, mqtt_topic_id_t id, const char *msg, int qos, int retain);
+
+/* ----- Registra el aviso de conexion/desconexion ----- */
+void mqtt_client_on_session(mqtt_client_t *mqtt, mqtt_session_cb_t callback);
+
+/* ----- Usa TLS con reanudacion de sesion hacia host:port ----- */
+esp_err_t mqtt_client_enable_tls(mqtt_client_t *mqtt, const char *host, uint16_t port);
+
+/* ----- Configura presupuesto y politica de la cola en espera (antes de mqtt_client_start) ----- */
+void mqtt_client_set_outbox(mqtt_client_t *mqtt, uint32_t budget, mqtt_outbox_policy_t policy);
+
 /* ----- Inicia la conexion MQTT ----- */
 esp_err_t mqtt_client_start(mqtt_client_t *mqtt);
 
+/* ----- Espera a que la sesion MQTT este establecida ----- */
+esp_err_t mqtt_client_wait_connected(mqtt_client_t *mqtt, uint32_t timeout_ms);
+
+/* ----- Espera a que no queden mensajes QoS>0 sin confirmar ni en espera ----- */
+esp_err_t mqtt_client_flush(mqtt_client_t *mqtt, uint32_t timeout_ms);
+
+/* ----- Quita de la cola en espera (RAM y NVS) los mensajes de un topic de la tabla ----- */
+uint32_t mqtt_client_discard_topic(mqtt_client_t *mqtt, mqtt_topic_id_t id);
+
+/* ----- Detiene el cliente sin disparar la reconexion ----- */
+void mqtt_client_stop(mqtt_client_t *mqtt);
+
+/* ----- Suscribe un topic (se renueva en cada reconexion) ----- */
+esp_err_t mqtt_client_subscribe(mqtt_client_t *mqtt, const char *topic, int qos,
+                                mqtt_message_cb_t callback);
+
 /* ----- Publica un mensaje ----- */
 esp_err_t mqtt_client_publish(mqtt_client_t *mqtt,
                                   const char *topic,
                                   const char *payload,
                                   int qos, int retain);
 
+/* ----- Publica un mensaje con longitud explicita (len <= 0: strlen del payload) ----- */
+esp_err_t mqtt_client_publish_buffer(mqtt_client_t *mqtt, const char *topic, const char *payload,
+                                     int len, int qos, int retain);
+
+/* ----- Publica en un topic de la tabla con longitud explicita (sin armar strings ni strlen) ----- */
+esp_err_t mqtt_client_publish_topic(mqtt_client_t *mqtt, mqtt_topic_id_t id, const char *payload,
+                                    int len, int qos, int retain);
+
+/* ----- Publica un bloque de Pool/pool.h en un topic de la tabla (el bloque vuelve al pool) ----- */
+esp_err_t mqtt_client_publish_block(mqtt_client_t *mqtt, mqtt_topic_id_t id, pool_handle_t block,
+                                    int qos, int retain);
+
+/* ----- Copia las estadisticas de publicacion ----- */
+void mqtt_client_get_stats(mqtt_client_t *mqtt, mqtt_stats_t *out);
+
 /* ----- Callback de eventos MQTT ----- */
 esp_err_t mqtt_event_handler_cb(mqtt_client_t *mqtt,
                                 esp_mqtt_event_handle_t event);
@@ -0,0 +1,82 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+/* ----- Configuracion ----- */
+#define MQTT_OUTBOX_BUDGET        4096          // Arena de mensajes en espera (bytes, memoria estatica)
+#define MQTT_OUTBOX_RECORD_MAX    1024          // Topic + payload de un mensaje encolable
+#define MQTT_OUTBOX_SPILL_MAX     16            // Bloques derivados a NVS (cada uno con varios mensajes)
+#define MQTT_OUTBOX_NVS_NAMESPACE "mqtt_spill"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "Pool/pool.h"
+
+
+/* ----- Politica cuando un mensaje no entra en el presupuesto ----- */
+typedef enum {
+    MQTT_OUTBOX_DROP_OLDEST = 0,   // Descarta los mensajes mas viejos hasta que entre
+    MQTT_OUTBOX_DROP_NEWEST,       // Rechaza el mensaje nuevo
+    MQTT_OUTBOX_COALESCE,          // Conserva solo el ultimo mensaje de cada topic (y luego descarta el mas viejo)
+    MQTT_OUTBOX_SPILL,             // Deriva los mas viejos a NVS (y, con NVS lleno, descarta el mas viejo)
+    MQTT_OUTBOX_POLICY_COUNT
+} mqtt_outbox_policy_t;
+
+
+/* ----- Contadores ----- */
+typedef struct {
+    uint32_t queued;          // Mensajes que entraron a la cola
+    uint32_t dropped_oldest;  // Descartados por antiguedad
+    uint32_t dropped_newest;  // Rechazados al encolar
+    uint32_t coalesced;       // Reemplazados por uno mas nuevo del mismo topic
+    uint32_t spilled;         // Mensajes derivados a NVS
+    uint32_t spill_writes;    // Bloques escritos en NVS (una escritura por derivacion, no por mensaje)
+    uint32_t unspilled;       // Recuperados de NVS
+    uint32_t spill_errors;    // Fallos de lectura/escritura en NVS (mensajes perdidos)
+    uint32_t discarded;       // Quitados con mqtt_outbox_discard_topic
+    uint32_t peak_bytes;      // Maximo de bytes ocupados en RAM
+} mqtt_outbox_stats_t;
+
+
+/* ----- Mensaje extraido de la cola (apunta a memoria del outbox hasta el proximo pop) ----- */
+typedef struct {
+    const char *topic;        // Terminado en '\0'
+    const char *payload;
+    uint16_t len;
+    uint8_t qos;
+    bool retain;
+} mqtt_outbox_msg_t;
+
+
+/* ----- Cola acotada de mensajes en espera -----
+ * Registros contiguos (cabecera + topic + payload) en una arena fija: el mas viejo al principio.
+ * Con MQTT_OUTBOX_SPILL, los registros mas viejos pasan a NVS de a bloques de hasta POOL_BLOCK_SIZE
+ * bytes: un blob y el indice por derivacion, y el blob se borra al entregar su ultimo mensaje.
+ * No es thread-safe: el cliente MQTT la protege con su lock */
+typedef struct {
+    uint8_t arena[MQTT_OUTBOX_BUDGET];
+    uint32_t used;                  // Bytes ocupados de la arena
+    uint32_t budget;                // Presupuesto vigente (<= MQTT_OUTBOX_BUDGET)
+    uint16_t count;                 // Mensajes en RAM
+    mqtt_outbox_policy_t policy;
+    uint16_t spill_head;            // Proximo bloque a leer de NVS
+    uint16_t spill_tail;            // Proximo bloque a escribir en NVS
+    pool_handle_t spill_block;      // Bloque del pool prestado para leer de NVS (POOL_NONE: ninguno)
+    bool spill_loaded;              // spill_block contiene el bloque spill_head
+    uint16_t spill_offset;          // Bytes ya entregados del bloque cargado
+    uint16_t spill_size;            // Bytes del bloque cargado
+    mqtt_outbox_stats_t stats;
+} mqtt_outbox_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void mqtt_outbox_init(mqtt_outbox_t *box, uint32_t budget, mqtt_outbox_policy_t policy);
+esp_err_t mqtt_outbox_push(mqtt_outbox_t *box, const char *topic, const char *payload,
+                           uint16_t len, uint8_t qos, bool retain);
+bool mqtt_outbox_front(mqtt_outbox_t *box, mqtt_outbox_msg_t *msg);
+void mqtt_outbox_pop(mqtt_outbox_t *box);
+bool mqtt_outbox_empty(const mqtt_outbox_t *box);
+uint32_t mqtt_outbox_discard_topic(mqtt_outbox_t *box, const char *topic);
+
+
+#endif //MQTT_OUTBOX_H
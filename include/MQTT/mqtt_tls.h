@@ -0,0 +1,32 @@
+#ifndef MQTT_TLS_H
+#define MQTT_TLS_H
+
+/* ----- Configuracion ----- */
+#define MQTT_TLS_SESSION_MAX      2048         // Bytes reservados en RTC para la sesion serializada
+#define MQTT_TLS_SESSION_MAGIC    0x544C5331   // "TLS1"
+#define MQTT_TLS_CA_PEM           NULL         // CA propia en PEM; NULL usa el bundle de certificados de ESP-IDF
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_transport.h"
+
+
+/* ----- Contadores de handshakes ----- */
+typedef struct {
+    uint32_t full_handshakes;      // Handshakes completos (verificacion de certificado incluida)
+    uint32_t resumed_handshakes;   // Handshakes abreviados (session ticket / session ID)
+    uint32_t failed_handshakes;    // Handshakes fallidos
+    uint32_t last_handshake_ms;    // Duracion del ultimo handshake
+    uint64_t full_total_ms;        // Tiempo acumulado en handshakes completos
+    uint64_t resumed_total_ms;     // Tiempo acumulado en handshakes reanudados
+} mqtt_tls_stats_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+esp_transport_handle_t mqtt_tls_transport_create(void);
+const mqtt_tls_stats_t *mqtt_tls_get_stats(void);
+void mqtt_tls_forget_session(void);
+
+
+#endif //MQTT_TLS_H
@@ -0,0 +1,51 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+/* ----- Modo de memoria estatica -----
+ * Con MEMORY_STATIC en 1 las tareas y colas permanentes se crean con las APIs *Static de FreeRTOS
+ * sobre memoria reservada en tiempo de compilacion; los semaforos, event groups y contextos de
+ * mbedtls propios son estaticos en ambos modos. Las tareas de arranque (Boot/boot.h) siguen en el
+ * heap: terminan y se liberan antes del regimen estacionario, y reservarles pila fija desperdiciaria
+ * esa RAM para siempre.
+ * En regimen estacionario (desde memory_mark_steady) memory_check compara el heap contra la foto
+ * tomada en ese momento: bloques y bytes en uso no deben crecer ni el bloque libre mas grande
+ * achicarse. Con CONFIG_HEAP_USE_HOOKS ademas se cuentan las reservas hechas desde las tareas
+ * propias registradas con memory_watch_task, que deben ser cero. WiFi, lwIP y esp-mqtt reservan
+ * internamente por paquete: las llamadas a esas bibliotecas se encierran entre memory_exempt_begin y
+ * memory_exempt_end y solo cuentan en el balance. */
+#ifndef MEMORY_STATIC
+#define MEMORY_STATIC          1      // Se puede redefinir con -DMEMORY_STATIC=0 en build_flags
+#endif
+#define MEMORY_WATCH_MAX       4      // Tareas propias vigiladas por los hooks del heap
+#define MEMORY_SLACK_BLOCKS    2      // Tolerancia del balance (timers de lwIP, buffers de log)
+#define MEMORY_SLACK_BYTES     256
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+/* ----- Resultado de la verificacion ----- */
+typedef struct {
+    int32_t blocks_delta;       // Bloques en uso respecto de la foto estacionaria
+    int32_t bytes_delta;        // Bytes en uso respecto de la foto estacionaria
+    uint32_t largest_free;      // Bloque libre mas grande actual
+    uint32_t largest_baseline;  // Bloque libre mas grande en la foto
+    uint32_t task_allocs;       // Reservas desde tareas vigiladas (0 sin CONFIG_HEAP_USE_HOOKS)
+    const char *last_task;      // Tarea vigilada que hizo la ultima reserva (NULL: ninguna)
+    uint32_t last_size;         // Tamaño de esa reserva
+} memory_report_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void memory_watch_task(TaskHandle_t task);
+void memory_exempt_begin(void);
+void memory_exempt_end(void);
+void memory_mark_steady(void);
+bool memory_is_steady(void);
+esp_err_t memory_check(memory_report_t *report);
+
+
+#endif //MEMORY_H
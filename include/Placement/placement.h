@@ -0,0 +1,62 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+/* ----- Ubicacion de tareas en los nucleos -----
+ * WiFi, lwIP (tcpip) y la tarea de esp-mqtt, que hace el handshake TLS, quedan fijos en PRO_CPU por
+ * sdkconfig. El muestreo (seccion critica del DHT11 y ADC del MQ135) se fija en APP_CPU, de modo que
+ * una rafaga de red no demore sus tiempos ni la seccion critica frene al stack de red. El KY037 (tarea
+ * e ISR) queda en PRO_CPU: la seccion critica del DHT11 retendria sus flancos mas que su plazo de
+ * 1 ms. La ISR del GPIO queda en el nucleo del paso de arranque que instala el servicio (boot_sensors).
+ * Con PLACEMENT_PINNED en 0, o en un build de un solo nucleo, todas las tareas quedan sin afinidad. */
+#ifndef PLACEMENT_PINNED
+#define PLACEMENT_PINNED        1      // Se puede redefinir con -DPLACEMENT_PINNED=0 en build_flags
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if PLACEMENT_PINNED && !CONFIG_FREERTOS_UNICORE
+#define PLACEMENT_CORE_SENSORS  APP_CPU_NUM
+#define PLACEMENT_CORE_NETWORK  PRO_CPU_NUM
+#else
+#define PLACEMENT_CORE_SENSORS  tskNO_AFFINITY
+#define PLACEMENT_CORE_NETWORK  tskNO_AFFINITY
+#endif
+
+
+/* ----- Tareas permanentes de la aplicacion ----- */
+typedef enum {
+    PLACEMENT_DATA = 0,        // Muestreo, codificacion, cifrado y encolado de la telemetria
+    PLACEMENT_KY037_STATS,     // Procesa los flancos notificados por la ISR del KY037
+    PLACEMENT_MQTT_RECONNECT,  // Reintentos de conexion al broker
+    PLACEMENT_COUNT
+} placement_task_t;
+
+
+typedef struct {
+    const char *name;          // Nombre de la tarea
+    uint32_t stack_size;       // Pila (bytes)
+    UBaseType_t priority;
+    BaseType_t core;           // PLACEMENT_CORE_* o tskNO_AFFINITY
+} placement_t;
+
+
+/* ----- Carga de cada nucleo desde la medicion anterior ----- */
+typedef struct {
+    uint8_t load_pct[portNUM_PROCESSORS];    // 100 - tiempo de la tarea idle del nucleo
+    uint32_t window_ms;                      // Duracion de la ventana medida
+} placement_load_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+const placement_t *placement_get(placement_task_t task);
+TaskHandle_t placement_create(placement_task_t task, TaskFunction_t fn, void *arg,
+                              StackType_t *stack, StaticTask_t *buffer);
+TaskHandle_t placement_handle(placement_task_t task);
+void placement_delete(placement_task_t task);
+esp_err_t placement_measure_load(placement_load_t *out);
+
+
+#endif //PLACEMENT_H
@@ -0,0 +1,46 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* ----- Pool de buffers de payload -----
+ * Bloques de tamaño fijo en memoria estatica que la cadena de publicacion se pasa por handle: el
+ * codificador escribe el JSON (o el lote binario) en un bloque, el cifrado trabaja sobre ese mismo
+ * bloque, el sobre "<version>:<IV Base64>:<datos Base64>" se arma en un segundo bloque y el cliente
+ * MQTT lo devuelve al pool una vez copiado. La cola en espera toma un bloque mientras entrega un
+ * mensaje derivado a NVS. La memoria usada es constante: si no hay bloques libres pool_take falla.
+ * pool_take y pool_give son lock-free (compare-and-swap sobre un mapa de bits), aptas para
+ * cualquier tarea o ISR. Tamaño y cantidad se pueden redefinir con -D en build_flags. */
+#ifndef POOL_BLOCK_SIZE
+#define POOL_BLOCK_SIZE     1024    // >= MQTT_OUTBOX_RECORD_MAX y >= el sobre de un JSON de DATA_JSON_MAX
+#endif
+#ifndef POOL_BLOCK_COUNT
+#define POOL_BLOCK_COUNT    4       // Texto plano + sobre de la tarea de datos, registro de NVS y reserva (max 32)
+#endif
+#define POOL_NONE           0xFF    // Handle invalido
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef uint8_t pool_handle_t;
+
+
+/* ----- Contadores ----- */
+typedef struct {
+    uint32_t taken;         // Bloques entregados
+    uint32_t exhausted;     // pool_take sin bloques libres
+    uint32_t invalid;       // pool_give con un handle invalido o ya libre
+    uint8_t in_use;         // Bloques prestados ahora
+    uint8_t peak;           // Maximo de bloques prestados a la vez
+} pool_stats_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+pool_handle_t pool_take(void);
+void pool_give(pool_handle_t block);
+uint8_t *pool_data(pool_handle_t block);
+size_t pool_len(pool_handle_t block);
+void pool_set_len(pool_handle_t block, size_t len);
+void pool_get_stats(pool_stats_t *out);
+
+
+#endif //POOL_H
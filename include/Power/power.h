@@ -0,0 +1,63 @@
+#ifndef POWER_H
+#define POWER_H
+
+/* ----- Modos de operacion ----- */
+#define POWER_MODE_ALWAYS_ON     0   // WiFi y perifericos siempre despiertos (comportamiento original)
+#define POWER_MODE_LIGHT_SLEEP   1   // Light sleep entre muestras, la RAM se conserva
+#define POWER_MODE_DEEP_SLEEP    2   // Deep sleep entre muestras, el estado se conserva en memoria RTC
+
+/* ----- Configuracion ----- */
+#ifndef POWER_MODE
+#define POWER_MODE               POWER_MODE_ALWAYS_ON
+#endif
+#define POWER_BURST_SAMPLES      4       // Capacidad del lote en RTC (el tamaño efectivo es settings.batch_size)
+#define POWER_KY037_WAKEUP       0       // 1: despertar tambien por flanco del KY037 (EXT0 / GPIO)
+#define POWER_KY037_SETTLE_MS    50      // Espera maxima a que el KY037 vuelva a bajo antes de dormir
+#define POWER_RTC_MAGIC          0x50575231   // "PWR1", valida el contenido de la memoria RTC
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_sleep.h"
+#include "Data/data.h"
+
+
+/* ----- Marcas de la linea de tiempo de un ciclo despertar-publicar-dormir ----- */
+typedef enum {
+    POWER_MARK_WAKE = 0,     // Arranque de la aplicacion
+    POWER_MARK_READY,        // Configuracion cargada y sensores inicializados
+    POWER_MARK_SAMPLE,       // Lectura de sensores terminada
+    POWER_MARK_NET_UP,       // Red disponible para publicar
+    POWER_MARK_PUBLISHED,    // Rafaga publicada
+    POWER_MARK_SLEEP,        // Entrada a modo de bajo consumo
+    POWER_MARK_COUNT
+} power_mark_t;
+
+
+/* ----- Estado que sobrevive al deep sleep (RTC slow memory) ----- */
+typedef struct {
+    uint32_t magic;                                 // POWER_RTC_MAGIC si el contenido es valido
+    uint32_t cycle_count;                           // Ciclos completos de muestreo
+    int64_t next_sample_us;                         // Instante (reloj RTC) del proximo despertar
+    uint32_t ky037_wakeups;                         // Detecciones del KY037 que despertaron al chip
+    uint64_t awake_total_ms;                        // Tiempo despierto acumulado
+    uint32_t last_cycle_ms;                         // Duracion del ultimo ciclo despierto
+    uint8_t sample_count;                           // Muestras acumuladas en el lote actual
+    data_sensors_t samples[POWER_BURST_SAMPLES];    // Lote pendiente de publicar
+} power_rtc_state_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void power_init(void);
+esp_sleep_wakeup_cause_t power_wakeup_cause(void);
+void power_timeline_mark(power_mark_t mark);
+void power_timeline_report(void);
+uint32_t power_take_ky037_wakeups(void);
+bool power_store_sample(const data_sensors_t *sample, uint8_t burst);
+uint8_t power_get_samples(const data_sensors_t **samples);
+void power_consume_samples(uint8_t count);
+int64_t power_now_us(void);
+void power_sleep_until(int64_t wake_us);
+void power_wake_early(void);
+
+
+#endif //POWER_H
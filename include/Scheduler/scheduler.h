@@ -0,0 +1,40 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* ----- Configuracion ----- */
+#define SCHED_COALESCE_MS     50           // Vencimientos dentro de esta ventana se atienden en el mismo despertar
+#define SCHED_RTC_MAGIC       0x53434831   // "SCH1", valida el estado en memoria RTC
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Data/data.h"
+#include "Setting/settings.h"
+
+
+/* ----- Trabajo a realizar en el despertar actual ----- */
+typedef struct {
+    uint8_t sample_mask;   // DATA_SENSOR_BIT() de los sensores a muestrear
+    bool report;           // Emitir el reporte del periodo
+} sched_due_t;
+
+
+/* ----- Estado del planificador (sobrevive al deep sleep) -----
+ * Todos los vencimientos son multiplos de su intervalo contados desde un mismo epoch, de modo
+ * que los intervalos multiplos entre si coinciden en el mismo despertar */
+typedef struct {
+    uint32_t magic;                                   // SCHED_RTC_MAGIC si el contenido es valido
+    int64_t epoch_us;                                 // Base de tiempo comun (reloj RTC)
+    int64_t next_sample_us[DATA_SENSOR_COUNT];        // Proximo muestreo de cada sensor
+    int64_t next_report_us;                           // Proximo reporte
+    uint32_t sample_interval_ms[DATA_SENSOR_COUNT];   // Intervalos con los que se calcularon los vencimientos
+    uint32_t report_interval_ms;
+    uint8_t sensor_mask;
+} sched_rtc_state_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+void scheduler_poll(int64_t now_us, const settings_runtime_t *runtime, sched_due_t *due);
+int64_t scheduler_next_wake(void);
+
+
+#endif //SCHEDULER_H
@@ -0,0 +1,44 @@
+#ifndef PROVISION_H
+#define PROVISION_H
+
+/* ----- Protocolo de aprovisionamiento en lote (PROV) -----
+ *   "PROV k1=v1;k2=v2;...*CRC"
+ * CRC son 8 digitos hex del CRC32 (IEEE) de todo lo que esta entre "PROV " y '*'. Los valores usan
+ * escapes %XX para ';', '=', '*', '%', espacios y caracteres no imprimibles.
+ * Modulo portable (sin dependencias de ESP-IDF): el firmware lo usa para validar el lote y
+ * tools/provision para armarlo, de modo que ambos lados comparten codificacion, CRC y limites. */
+#define PROV_KEY_MAX       16                         // Clave con terminador
+#define PROV_LINE_MAX      (SETTINGS_LINE_MAX - 1)    // Caracteres que acepta el editor de linea (sin '\n')
+#define PROV_MAX_FIELDS    24
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "Setting/settings.h"
+
+
+/* ----- Resultado de validar un lote ----- */
+typedef enum {
+    PROV_OK = 0,
+    PROV_ERR_FORMAT,       // Falta '*', CRC mal formado o campo sin "clave="
+    PROV_ERR_CRC,          // El CRC no coincide
+    PROV_ERR_FIELD,        // Clave desconocida, escape invalido o valor fuera de rango
+} prov_result_t;
+
+
+typedef struct {
+    char key[PROV_KEY_MAX];
+    char value[SETTINGS_MAX_STRING_LEN];
+} prov_field_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+uint32_t prov_crc32(const uint8_t *data, size_t len);
+size_t prov_encode_value(const char *value, char *out, size_t out_size);
+bool prov_decode_value(const char *src, size_t len, char *dst, size_t dst_size);
+int prov_build_line(const prov_field_t *fields, int count, char *line, size_t size);
+prov_result_t prov_parse_batch(const char *batch, settings_t *staged, char *bad_key, size_t bad_key_size,
+                               uint32_t *crc_out);
+
+
+#endif //PROVISION_H
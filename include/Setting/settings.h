@@ -2,6 +2,7 @@
 #define SETTINGS_H
 
 #include "esp_err.h"
+#include "Data/data.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -11,7 +12,20 @@
 #define SETTINGS_UART_BAUD_RATE       115200
 #define SETTINGS_MAX_STRING_LEN       100
 #define SETTINGS_BUFFER_SIZE          256
+#define SETTINGS_LINE_MAX             768          // Linea maxima del editor (admite un lote PROV completo)
 #define AES_KEY_LEN                   33
+#define SETTINGS_UART_QUEUE_LEN       20           // Eventos en la cola del driver UART
+#define SETTINGS_UART_RX_CHUNK        64           // Bytes leidos por llamada a uart_read_bytes
+#define SETTINGS_PROMPT               "config> "
+#define SETTINGS_MIN_INTERVAL_MS      100          // Intervalo minimo de muestreo de un sensor
+#define SETTINGS_DHT11_MIN_INTERVAL_MS 1000        // El DHT11 admite como maximo una lectura por segundo
+#define SETTINGS_DEFAULT_INTERVAL_MS  60000        // Intervalo por defecto si no hay sample_rate configurado
+
+/* ---- Almacenamiento en NVS ---- */
+#define SETTINGS_NVS_NAMESPACE        "device_setting"
+#define SETTINGS_NVS_BLOB_KEY         "settings"
+#define SETTINGS_BLOB_MAGIC           0x53455431   // "SET1"
+#define SETTINGS_SCHEMA_VERSION       5            // Incrementar al agregar campos (siempre al final de settings_t)
 
 /* ---- Comandos disponibles ---- */
 #define CMD_SET_WIFI_SSID          "SET_SSID"
@@ -24,11 +38,38 @@
 #define CMD_SET_SAMPLE             "SET_SAMPLE"
 #define CMD_SET_AES_KEY             "SET_AES_KEY"
 #define CMD_SHOW_CONFIG            "SHOW"
+#define CMD_ECHO                   "ECHO"
+#define CMD_PROVISION              "PROV"
+
+/* ---- Claves del lote de aprovisionamiento (PROV) ---- */
+#define PROV_KEY_SSID              "ssid"
+#define PROV_KEY_PASS              "pass"
+#define PROV_KEY_HOST              "host"
+#define PROV_KEY_PORT              "port"
+#define PROV_KEY_USER              "user"
+#define PROV_KEY_MQTT_PASS         "mpass"
+#define PROV_KEY_NAME              "name"
+#define PROV_KEY_SAMPLE            "sample"
+#define PROV_KEY_AES               "key"
+#define PROV_KEY_BATCH             "batch"
+#define PROV_KEY_FORMAT            "format"
+#define PROV_KEY_SENSORS           "sensors"
+#define PROV_KEY_REPORT            "report"        // Intervalo de reporte en ms
+#define PROV_KEY_INTERVAL_KY037    "int_ky037"     // Intervalo de muestreo en ms de cada sensor
+#define PROV_KEY_INTERVAL_DHT11    "int_dht11"
+#define PROV_KEY_INTERVAL_MQ135    "int_mq135"
+#define PROV_KEY_DEADBAND_TEMP     "db_temp"       // Banda muerta de temperatura en decimas de C
+#define PROV_KEY_DEADBAND_HUM      "db_hum"        // Banda muerta de humedad en decimas de %
+#define PROV_KEY_DEADBAND_NOISE    "db_noise"      // Banda muerta del contador de pulsos del KY037
+#define PROV_KEY_HEARTBEAT         "heartbeat"     // Silencio maximo en ms (0: reportar siempre)
+#define PROV_KEY_CALIB_MQ135       "calib_mq135"   // "1": reaprender R0 del MQ135 (sensor en aire limpio)
 #define CMD_EXIT                   "EXIT"
 #define CMD_HELP                   "HELP"
 
 
-/* ---- Estructura de configuracion ---- */
+/* ---- Estructura de configuracion ----
+ * Se guarda en NVS como un blob binario: los campos nuevos se agregan solo al final e
+ * incrementan SETTINGS_SCHEMA_VERSION (ver settings_apply_defaults) */
 typedef struct {
     char wifi_ssid[SETTINGS_MAX_STRING_LEN];
     char wifi_password[SETTINGS_MAX_STRING_LEN];
@@ -39,9 +80,39 @@ typedef struct {
     char device_name[SETTINGS_MAX_STRING_LEN];
     uint32_t sample_rate;
     char aes_key[AES_KEY_LEN];
+    /* v2: parametros ajustables en tiempo de ejecucion (topic de control MQTT) */
+    uint8_t batch_size;          // Muestras por rafaga de publicacion (1..POWER_BURST_SAMPLES)
+    uint8_t payload_format;      // DATA_FORMAT_*
+    uint8_t sensor_mask;         // DATA_SENSOR_BIT() de los sensores habilitados
+    uint32_t control_seq;        // Ultima secuencia de comando remoto aplicada (anti-replay)
+    /* v3: intervalos independientes en milisegundos (sample_rate queda como valor de configuracion en minutos) */
+    uint32_t sample_interval_ms[DATA_SENSOR_COUNT];   // Muestreo de cada sensor, indexado por ID_*
+    uint32_t report_interval_ms;                      // Emision de un reporte con las estadisticas del periodo
+    /* v4: reporte por excepcion */
+    uint16_t deadband_temp;      // Decimas de C
+    uint16_t deadband_hum;       // Decimas de %
+    uint32_t deadband_noise;     // Pulsos del KY037 por periodo
+    uint32_t heartbeat_ms;       // Silencio maximo; 0 desactiva la supresion
+    /* v5: recalibracion del MQ135 */
+    uint32_t mq135_calib_seq;    // Pedidos de recalibracion (calib_mq135=1 suma uno)
 } settings_t;
 
 
+/* ---- Copia consistente de los parametros de tiempo de ejecucion ---- */
+typedef struct {
+    uint32_t sample_interval_ms[DATA_SENSOR_COUNT];
+    uint32_t report_interval_ms;
+    uint16_t deadband_temp;
+    uint16_t deadband_hum;
+    uint32_t deadband_noise;
+    uint32_t heartbeat_ms;
+    uint32_t mq135_calib_seq;
+    uint8_t batch_size;
+    uint8_t payload_format;
+    uint8_t sensor_mask;
+} settings_runtime_t;
+
+
 extern settings_t settings;
 
 
@@ -53,6 +124,12 @@ bool setting_is_device_configured(void);
 esp_err_t setting_save_to_nvs(void);
 bool setting_load_from_nvs(void);
 void show_startup_info(void);
+bool setting_set_field(settings_t *dst, const char *key, const char *value);
+void setting_apply_sample_rate(settings_t *dst, uint32_t minutes);
+void setting_lock(void);
+void setting_unlock(void);
+void setting_get_runtime(settings_runtime_t *out);
+uint32_t setting_get_hash(void);
 
 
 #endif //SETTINGS_H
\ No newline at end of file
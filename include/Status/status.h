@@ -0,0 +1,25 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+/* ----- Estado retenido del dispositivo -----
+ * Registro compacto en "<device_name>/status" (MQTT_TOPIC_STATUS), publicado con retain al conectar:
+ *   "on:<version firmware>:<huella config (8 hex)>:<segundos desde el arranque en frio>"
+ * El last will del cliente publica STATUS_OFFLINE con retain en el mismo topic, de modo que el
+ * backend conoce la vida del equipo leyendo un unico topic retenido, sin consultarlo.
+ * Para no repetir trafico en cada despertar, el registro solo se vuelve a publicar si cambio la
+ * configuracion o el firmware, si el broker pudo haber publicado el last will (conexion perdida sin
+ * DISCONNECT) o si pasaron STATUS_REFRESH_MS desde la ultima publicacion. */
+#define STATUS_ONLINE_PREFIX    "on"
+#define STATUS_OFFLINE          "off"
+#define STATUS_REFRESH_MS       (60UL * 60 * 1000)   // Renovacion del uptime publicado
+#define STATUS_MAX_LEN          64
+#define STATUS_RTC_MAGIC        0x53545331           // "STS1", valida el estado en memoria RTC
+
+#include "esp_err.h"
+
+
+/* ----- Declaracion de funciones de la API ----- */
+esp_err_t status_init(void);
+
+
+#endif //STATUS_H
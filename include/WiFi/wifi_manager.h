@@ -0,0 +1,54 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+/* ----- Configuracion ----- */
+#define WIFI_CONNECT_TIMEOUT_MS   10000        // Tiempo maximo para asociar y obtener IP
+#define WIFI_SCAN_MAX_AP          8            // Resultados leidos en el escaneo dirigido
+#define WIFI_LEASE_REUSE_S        3600         // Antiguedad maxima para reutilizar la IP de DHCP cacheada
+#define WIFI_CACHE_MAGIC          0x57494631   // "WIF1"
+#define WIFI_NVS_NAMESPACE        "wifi_cache"
+#define WIFI_NVS_KEY              "ap"
+
+/* ----- IP estatica opcional (cadena vacia = DHCP) ----- */
+#define WIFI_STATIC_IP            ""
+#define WIFI_STATIC_GATEWAY       ""
+#define WIFI_STATIC_NETMASK       "255.255.255.0"
+#define WIFI_STATIC_DNS           ""
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+/* ----- Ultimo AP y concesion DHCP (RTC + NVS) ----- */
+typedef struct {
+    uint32_t magic;          // WIFI_CACHE_MAGIC si el contenido es valido
+    uint8_t bssid[6];        // BSSID del ultimo AP
+    uint8_t channel;         // Canal primario del ultimo AP
+    uint32_t ip;             // Concesion DHCP obtenida (orden de red)
+    uint32_t gateway;
+    uint32_t netmask;
+    uint32_t dns;
+    int64_t lease_time_s;    // Instante (reloj RTC, seg) en que se obtuvo la concesion
+} wifi_cache_t;
+
+
+/* ----- Desglose del tiempo de conexion (ms) ----- */
+typedef struct {
+    uint32_t scan_ms;        // Escaneo dirigido (0 en el camino rapido)
+    uint32_t auth_ms;        // Autenticacion + asociacion + 4-way handshake
+    uint32_t dhcp_ms;        // Obtencion de IP
+    uint32_t total_ms;       // Desde el arranque del radio hasta tener IP
+    bool fast_path;          // true si se uso BSSID/canal cacheados
+} wifi_timing_t;
+
+
+/* ----- Declaracion de funciones de la API ----- */
+esp_err_t wifi_manager_init(void);
+esp_err_t wifi_manager_connect(uint32_t timeout_ms);
+void wifi_manager_disconnect(void);
+bool wifi_manager_is_connected(void);
+const wifi_timing_t *wifi_manager_get_timing(void);
+
+
+#endif //WIFI_MANAGER_H
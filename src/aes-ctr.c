@@ -1,6 +1,7 @@
 #define MBEDTLS_CONFIG_FILE "mbedtls/esp_config.h"
 #include "AES-CTR/aes-ctr.h"
 #include "Setting/settings.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
@@ -9,74 +10,166 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/base64.h"
+#include "mbedtls/md.h"
+#include "mbedtls/platform_util.h"
 
 
 
 static const char *TAG = "AES_CTR";
 
 
+// Generador de IVs: se siembra una sola vez y se reutiliza. Solo lo usa la tarea de datos
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context ctr_drbg;
+static bool rng_ready = false;
+
 
 /**
- * @brief Cifra datos en AES-CTR y devuelve el resultado codificado en Base64.
- *
- * @param input Cadena de entrada (texto plano) a cifrar.
- * @param input_len Longitud de la cadena de entrada.
- * @param iv_out Buffer de salida (16 bytes) donde se genera y guarda el IV usado.
- * @param output_base64 Buffer de salida donde se almacena el texto cifrado en Base64.
- * @param output_base64_len Tamaño máximo del buffer de salida (incluye terminador '\0').
+ * @brief Siembra el generador de IVs en el primer uso.
+ * @return int  0 si el generador esta listo, codigo de error de mbedtls si no.
  */
+static int aes_ctr_rng_init(void) {
+    if (rng_ready) return 0;
 
-void aes_ctr_encrypt_to_base64(const unsigned char *input, size_t input_len,
-                               unsigned char *iv_out, char *output_base64, size_t output_base64_len) {
-    size_t nc_off = 0; // offset del keystream
-    unsigned char stream_block[16];
-    unsigned char ciphertext[256];
-    size_t ciphertext_len = 0;
-    size_t olen;
-
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
     mbedtls_entropy_init(&entropy);
     mbedtls_ctr_drbg_init(&ctr_drbg);
-
     const char *pers = "aes_ctr_iv";
     int ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
-                                (const unsigned char *)pers, strlen(pers));
+                                    (const unsigned char *)pers, strlen(pers));
+    if (ret != 0) {
+        mbedtls_ctr_drbg_free(&ctr_drbg);
+        mbedtls_entropy_free(&entropy);
+        return ret;
+    }
+    rng_ready = true;
+    return 0;
+}
+
+
+/**
+ * @brief Deriva una subclave de la clave compartida: HMAC-SHA256(aes_key, label) (un bloque de
+ * HKDF-Expand). La clave de cifrado y la del MAC del topic de control salen de etiquetas distintas,
+ * de modo que ninguna clave se usa en dos primitivas.
+ * @param label AES_CTR_LABEL_ENC o AES_CTR_LABEL_MAC.
+ * @param key Salida de AES_CTR_KEY_LEN bytes (el llamador la borra al terminar).
+ */
+static esp_err_t aes_ctr_derive_key(const char *label, unsigned char key[AES_CTR_KEY_LEN]) {
+    int ret = mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                              (const unsigned char *)settings.aes_key, strlen(settings.aes_key),
+                              (const unsigned char *)label, strlen(label), key);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Error derivando la clave %s (%d)", label, ret);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+
+/**
+ * @brief HMAC-SHA256 con la clave de autenticacion derivada (AES_CTR_LABEL_MAC).
+ * @param mac Salida de 32 bytes.
+ */
+esp_err_t aes_ctr_hmac(const unsigned char *data, size_t len, unsigned char mac[32]) {
+    unsigned char key[AES_CTR_KEY_LEN];
+
+    esp_err_t err = aes_ctr_derive_key(AES_CTR_LABEL_MAC, key);
+    if (err == ESP_OK && mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                                         key, sizeof(key), data, len, mac) != 0) {
+        err = ESP_FAIL;
+    }
+    mbedtls_platform_zeroize(key, sizeof(key));
+    return err;
+}
+
+
+/**
+ * @brief Cifra datos en AES-CTR sobre el mismo buffer (el texto cifrado tiene la misma longitud),
+ * de modo que el bloque del pool que trae el texto plano sale con el texto cifrado sin copias.
+ *
+ * @param data Texto plano de entrada; al volver contiene el texto cifrado.
+ * @param len Longitud de los datos.
+ * @param iv_out Buffer de salida (16 bytes) donde se genera y guarda el IV usado.
+ * @return esp_err_t  Devuelve ESP_OK si los datos quedaron cifrados.
+ */
+esp_err_t aes_ctr_encrypt(unsigned char *data, size_t len, unsigned char *iv_out) {
+    size_t nc_off = 0; // offset del keystream
+    unsigned char stream_block[16];
+
+    int ret = aes_ctr_rng_init();
     if (ret != 0) {
         ESP_LOGE(TAG, "Error inicializando RNG (%d)", ret);
-        return;
+        return ESP_FAIL;
     }
 
     // Se genera de forma aleatoria el IV
-    mbedtls_ctr_drbg_random(&ctr_drbg, iv_out, IV_LEN);
+    if (mbedtls_ctr_drbg_random(&ctr_drbg, iv_out, IV_LEN) != 0) return ESP_FAIL;
 
-    // Inicializar AES-CTR
+    // Inicializar AES-CTR con la clave de cifrado derivada de aes_key (AES-256)
+    unsigned char key[AES_CTR_KEY_LEN];
+    if (aes_ctr_derive_key(AES_CTR_LABEL_ENC, key) != ESP_OK) return ESP_FAIL;
     mbedtls_aes_context aes;
     mbedtls_aes_init(&aes);
-
-    // Se carga la clave secreta compartida (aes_key). 128 indica que se usa AES-128 (16 bytes de clave).
-    mbedtls_aes_setkey_enc(&aes, (unsigned char*)settings.aes_key, 256); // AES-128
-
-    // AES-CTR genera un keystream usando (clave + IV) y lo combina con el mensaje haciendo un XOR. Como resultado, sale el ciphertext
-    ret = mbedtls_aes_crypt_ctr(&aes, input_len, &nc_off, iv_out, stream_block, input, ciphertext);
+    mbedtls_aes_setkey_enc(&aes, key, AES_CTR_KEY_LEN * 8);
+    mbedtls_platform_zeroize(key, sizeof(key));
+
+    // AES-CTR genera un keystream usando (clave + IV) y lo combina con el mensaje haciendo un XOR. Como resultado, sale el ciphertext.
+    // mbedtls incrementa el contador en el buffer que recibe, por eso se trabaja sobre una copia y iv_out conserva el IV usado
+    unsigned char nonce_counter[IV_LEN];
+    memcpy(nonce_counter, iv_out, IV_LEN);
+    ret = mbedtls_aes_crypt_ctr(&aes, len, &nc_off, nonce_counter, stream_block, data, data);
+    mbedtls_aes_free(&aes);
     if (ret != 0) {
         ESP_LOGE(TAG, "Error cifrando (%d)", ret);
-        return;
+        return ESP_FAIL;
     }
-    ciphertext_len = input_len;
+    return ESP_OK;
+}
+
 
-    // Convierte los bytes cifrados en una cadena de texto ASCII para que se pueda enviar por MQTT
-    ret = mbedtls_base64_encode((unsigned char *)output_base64, output_base64_len,
-                                &olen, ciphertext, ciphertext_len);
+/**
+ * @brief Descifra datos AES-CTR recibidos en Base64 con la clave de cifrado derivada de aes_key.
+ *
+ * @param input_base64 Texto cifrado codificado en Base64 (no requiere terminador).
+ * @param input_base64_len Longitud del texto en Base64.
+ * @param iv IV (16 bytes) con el que se cifro el mensaje.
+ * @param output Buffer de salida para el texto plano (se agrega terminador '\0').
+ * @param output_size Tamaño del buffer de salida (incluye terminador '\0').
+ * @param output_len Longitud del texto plano obtenido.
+ * @return esp_err_t  Devuelve ESP_OK si el mensaje se decodifico y descifro.
+ */
+esp_err_t aes_ctr_decrypt_from_base64(const char *input_base64, size_t input_base64_len, const unsigned char *iv,
+                                      unsigned char *output, size_t output_size, size_t *output_len) {
+    unsigned char nonce_counter[IV_LEN];
+    unsigned char stream_block[16];
+    size_t nc_off = 0;
+    size_t ciphertext_len;
+
+    if (output_size == 0) return ESP_ERR_INVALID_ARG;
+
+    // El texto cifrado se decodifica directo en output y se descifra en el lugar
+    int ret = mbedtls_base64_decode(output, output_size - 1, &ciphertext_len,
+                                    (const unsigned char *)input_base64, input_base64_len);
     if (ret != 0) {
         ESP_LOGE(TAG, "Error base64 (%d)", ret);
-        return;
+        return ESP_ERR_INVALID_ARG;
     }
 
-    output_base64[olen] = '\0';
+    unsigned char key[AES_CTR_KEY_LEN];
+    if (aes_ctr_derive_key(AES_CTR_LABEL_ENC, key) != ESP_OK) return ESP_FAIL;
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, key, AES_CTR_KEY_LEN * 8);   // CTR usa la clave de cifrado en ambos sentidos
+    mbedtls_platform_zeroize(key, sizeof(key));
 
-    // Liberar
+    memcpy(nonce_counter, iv, IV_LEN);
+    ret = mbedtls_aes_crypt_ctr(&aes, ciphertext_len, &nc_off, nonce_counter, stream_block, output, output);
     mbedtls_aes_free(&aes);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
-}
\ No newline at end of file
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Error descifrando (%d)", ret);
+        return ESP_FAIL;
+    }
+
+    output[ciphertext_len] = '\0';
+    *output_len = ciphertext_len;
+    return ESP_OK;
+}
@@ -0,0 +1,158 @@
+#include "Aggregate/aggregate.h"
+#include <string.h>
+
+
+/**
+ * @brief Agrega un valor a un estadistico parcial (una pasada, sin guardar las muestras).
+ */
+static void agg_stats_push(agg_stats_t *stats, fx_t value) {
+    stats->count++;
+    if (stats->count == 1) {
+        stats->min = value;
+        stats->max = value;
+    }
+    else {
+        if (value < stats->min) stats->min = value;
+        if (value > stats->max) stats->max = value;
+    }
+
+    stats->sum += value;
+    stats->sum_sq += (int64_t)value * value;
+}
+
+
+/**
+ * @brief Combina dos estadisticos parciales, para unir las sub-ventanas. Con sumas exactas
+ * alcanza con sumarlas.
+ */
+static void agg_stats_merge(agg_stats_t *dst, const agg_stats_t *src) {
+    if (src->count == 0) return;
+    if (dst->count == 0) {
+        *dst = *src;
+        return;
+    }
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+    dst->sum_sq += src->sum_sq;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+
+/**
+ * @brief Raiz cuadrada entera (redondeada hacia abajo) por el metodo de bits.
+ */
+static uint64_t agg_isqrt(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+
+/**
+ * @brief Duracion de una sub-ventana en micro segundos.
+ */
+static int64_t agg_slot_us(const agg_window_t *window) {
+    int64_t slot_us = (int64_t)window->window_ms * 1000 / AGG_SLIDING_SLOTS;
+    return slot_us > 0 ? slot_us : 1;
+}
+
+
+/**
+ * @brief Inicializa la ventana de una metrica.
+ * @param window Ventana a inicializar.
+ * @param type Ventana fija (se reinicia en cada resumen) o deslizante.
+ * @param window_ms Duracion de la ventana deslizante; se ignora en ventanas fijas.
+ */
+void agg_init(agg_window_t *window, agg_window_type_t type, uint32_t window_ms) {
+    memset(window, 0, sizeof(*window));
+    window->type = type;
+    window->window_ms = window_ms;
+    for (int i = 0; i < AGG_SLIDING_SLOTS; i++) {
+        window->slots[i].epoch = -1;
+    }
+}
+
+
+/**
+ * @brief Agrega una muestra. Costo O(1) y sin memoria adicional.
+ * @param window Ventana de la metrica.
+ * @param now_us Instante de la muestra (misma base de tiempo que agg_summary).
+ * @param value Valor de la muestra (punto fijo).
+ */
+void agg_add(agg_window_t *window, int64_t now_us, fx_t value) {
+    window->last = value;
+    window->has_last = true;
+
+    if (window->type == AGG_WINDOW_TUMBLING) {
+        agg_stats_push(&window->tumbling, value);
+        return;
+    }
+
+    int64_t epoch = now_us / agg_slot_us(window);
+    agg_slot_t *slot = &window->slots[epoch % AGG_SLIDING_SLOTS];
+    if (slot->epoch != epoch) {   // La sub-ventana del anillo quedo fuera de la ventana: reutilizarla
+        memset(&slot->stats, 0, sizeof(slot->stats));
+        slot->epoch = epoch;
+    }
+    agg_stats_push(&slot->stats, value);
+}
+
+
+/**
+ * @brief Emite el resumen de la ventana. Las ventanas fijas se reinician; las deslizantes
+ * combinan las sub-ventanas que siguen dentro de window_ms y no se modifican.
+ * @param window Ventana de la metrica.
+ * @param now_us Instante del reporte.
+ * @param out Resumen de salida.
+ * @return bool  Devuelve false si la ventana no tiene muestras (out->last conserva el ultimo valor).
+ */
+bool agg_summary(agg_window_t *window, int64_t now_us, agg_summary_t *out) {
+    agg_stats_t total = {0};
+
+    if (window->type == AGG_WINDOW_TUMBLING) {
+        total = window->tumbling;
+        memset(&window->tumbling, 0, sizeof(window->tumbling));
+    }
+    else {
+        int64_t current = now_us / agg_slot_us(window);
+        for (int i = 0; i < AGG_SLIDING_SLOTS; i++) {
+            const agg_slot_t *slot = &window->slots[i];
+            if (slot->epoch >= 0 && slot->epoch > current - AGG_SLIDING_SLOTS && slot->epoch <= current) {
+                agg_stats_merge(&total, &slot->stats);
+            }
+        }
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->last = window->last;
+    if (total.count == 0) return false;
+
+    out->count = total.count;
+    out->min = total.min;
+    out->max = total.max;
+    out->mean = (fx_t)fx_div_round(total.sum, total.count);
+    if (total.count > 1) {
+        // Varianza muestral exacta: (n * sum_sq - sum^2) / (n * (n - 1)), en centesimas al cuadrado
+        int64_t n = total.count;
+        int64_t scatter = n * total.sum_sq - total.sum * total.sum;
+        uint64_t variance = (uint64_t)fx_div_round(scatter > 0 ? scatter : 0, n * (n - 1));
+        uint64_t root = agg_isqrt(variance);
+        if (variance - root * root > root) root++;   // Redondeo al mas cercano
+        out->stddev = (fx_t)root;
+    }
+    return true;
+}
@@ -0,0 +1,235 @@
+#include "Audit/audit.h"
+#include "KY037/ky037.h"
+#include "MQTT/mqtt.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *TAG = "AUDIT";
+
+
+/* ----- Plazos de respuesta -----
+ * KY037: flanco -> fin del procesamiento, debe quedar por debajo de la resolucion de 1 ms de la
+ * duracion medida. Datos: despertar planificado -> muestreo completo (incluye la lectura del DHT11
+ * y las muestras del MQ135). Reconexion: desconexion -> primer reintento */
+static const uint32_t audit_deadline_us[PLACEMENT_COUNT] = {
+    [PLACEMENT_DATA]           = 100000,
+    [PLACEMENT_KY037_STATS]    = 1000,
+    [PLACEMENT_MQTT_RECONNECT] = 50000,
+};
+
+
+/* ----- Respuestas registradas (un solo escritor por tarea) ----- */
+typedef struct {
+    volatile uint32_t max_us;
+    volatile uint32_t samples;
+} audit_slot_t;
+
+static audit_slot_t slots[PLACEMENT_COUNT];
+
+
+/**
+ * @brief Registra un tiempo de respuesta de la tarea. Es barato: se llama siempre, no solo en modo
+ * diagnostico, y lo usa cada tarea de la tabla de ubicacion sobre su propia entrada.
+ */
+void audit_response(placement_task_t task, int64_t response_us) {
+    if (task >= PLACEMENT_COUNT || response_us < 0) return;
+    uint32_t us = (response_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)response_us;
+
+    if (us > slots[task].max_us) slots[task].max_us = us;
+    slots[task].samples++;
+}
+
+
+/**
+ * @brief Calcula la pila y la prioridad recomendadas de una tarea a partir de la marca de agua de su
+ * pila y del peor tiempo de respuesta registrado.
+ * @return esp_err_t  ESP_ERR_INVALID_STATE si la tarea no fue creada.
+ */
+esp_err_t audit_task(placement_task_t task, audit_task_t *out) {
+    const placement_t *entry = placement_get(task);
+    TaskHandle_t handle = placement_handle(task);
+
+    memset(out, 0, sizeof(*out));
+    if (entry == NULL) return ESP_ERR_INVALID_ARG;
+    if (handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    out->name = entry->name;
+    out->stack_size = entry->stack_size;
+    out->stack_used = entry->stack_size - (uint32_t)uxTaskGetStackHighWaterMark(handle);   // bytes en ESP-IDF
+    out->deadline_us = audit_deadline_us[task];
+    out->response_max_us = slots[task].max_us;
+    out->samples = slots[task].samples;
+
+    uint32_t stack = out->stack_used + (out->stack_used * AUDIT_STACK_MARGIN_PCT) / 100;
+    stack = ((stack + AUDIT_STACK_ROUND - 1) / AUDIT_STACK_ROUND) * AUDIT_STACK_ROUND;
+    out->stack_recommended = (stack < AUDIT_STACK_MIN) ? AUDIT_STACK_MIN : stack;
+
+    // Se sube un nivel si se excedio el plazo y se baja uno si sobra un orden de magnitud
+    out->priority = uxTaskPriorityGet(handle);
+    out->priority_recommended = out->priority;
+    if (out->samples > 0 && out->response_max_us > out->deadline_us
+        && out->priority < configMAX_PRIORITIES - 1) {
+        out->priority_recommended = out->priority + 1;
+    }
+    else if (out->samples > 0 && out->response_max_us < out->deadline_us / 10 && out->priority > 1) {
+        out->priority_recommended = out->priority - 1;
+    }
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Imprime la recomendacion de cada tarea y la publica en el topic de diagnostico (si hay
+ * conexion). El total es la RAM que se libera aplicando todas las pilas recomendadas.
+ */
+void audit_report(void) {
+    char msg[AUDIT_REPORT_MAX];
+    audit_task_t result;
+    int32_t reclaim = 0;
+    bool online = (mqtt_client_wait_connected(&mqtt_client, 0) == ESP_OK);
+
+    for (placement_task_t task = 0; task < PLACEMENT_COUNT; task++) {
+        if (audit_task(task, &result) != ESP_OK) continue;
+        reclaim += (int32_t)result.stack_size - (int32_t)result.stack_recommended;
+
+        ESP_LOGI(TAG, "%s: pila %lu/%lu B -> %lu B, respuesta max %lu us (plazo %lu us, %lu muestras), prioridad %u -> %u",
+                 result.name, (unsigned long)result.stack_used, (unsigned long)result.stack_size,
+                 (unsigned long)result.stack_recommended, (unsigned long)result.response_max_us,
+                 (unsigned long)result.deadline_us, (unsigned long)result.samples,
+                 (unsigned)result.priority, (unsigned)result.priority_recommended);
+
+        if (!online) continue;
+        int len = snprintf(msg, sizeof(msg),
+                           "{\"task\":\"%s\",\"stack\":%lu,\"used\":%lu,\"rec_stack\":%lu,"
+                           "\"resp_max_us\":%lu,\"deadline_us\":%lu,\"prio\":%u,\"rec_prio\":%u}",
+                           result.name, (unsigned long)result.stack_size, (unsigned long)result.stack_used,
+                           (unsigned long)result.stack_recommended, (unsigned long)result.response_max_us,
+                           (unsigned long)result.deadline_us, (unsigned)result.priority,
+                           (unsigned)result.priority_recommended);
+        if (len > 0 && len < (int)sizeof(msg)
+            && mqtt_client_publish_topic(&mqtt_client, MQTT_TOPIC_DIAGNOSTICS, msg, len, 1, 0) != ESP_OK) {
+            ESP_LOGW(TAG, "No se pudo publicar la auditoria de %s", result.name);
+        }
+    }
+    ESP_LOGI(TAG, "RAM recuperable ajustando las pilas: %ld B", (long)reclaim);
+}
+
+
+#if AUDIT_ENABLED
+
+/* ----- Perfil de estres -----
+ * Cada fase fija la carga de CPU del nucleo de sensores y del de red (Placement/placement.h), la tasa
+ * de publicaciones QoS 1 al topic de diagnostico (ventana en vuelo y cola en espera) y la tasa de
+ * flancos simulados del KY037. En un build de un solo nucleo solo se aplica la carga de red */
+typedef struct {
+    const char *name;
+    uint32_t duration_ms;
+    uint8_t busy_sensors_pct;
+    uint8_t busy_network_pct;
+    uint16_t publish_per_s;
+    uint16_t edges_per_s;      // Hasta 1000 / AUDIT_STRESS_STEP_MS
+} audit_phase_t;
+
+static const audit_phase_t audit_phases[] = {
+    { "reposo",        10000, 0,  0,  0,  0   },
+    { "cpu_sensores",  20000, 80, 0,  0,  0   },
+    { "cpu_red",       20000, 0,  80, 0,  0   },
+    { "flancos",       15000, 0,  0,  0,  100 },
+    { "publicacion",   15000, 0,  0,  10, 0   },
+    { "mixta",         30000, 60, 60, 5,  50  },
+};
+#define AUDIT_PHASE_COUNT   (sizeof(audit_phases) / sizeof(audit_phases[0]))
+
+static volatile uint8_t busy_pct[portNUM_PROCESSORS];    // Carga pedida a la tarea de CPU de cada nucleo
+static TaskHandle_t spinners[portNUM_PROCESSORS];
+
+
+/**
+ * @brief Tarea de carga de un nucleo: espera activa durante busy_pct del periodo y bloquea el resto,
+ * de modo que la tarea idle y el watchdog siguen corriendo.
+ */
+static void audit_spin_task(void *pvParameters) {
+    uint32_t core = (uint32_t)(uintptr_t)pvParameters;
+
+    while (1) {
+        int64_t busy_us = (int64_t)busy_pct[core] * AUDIT_STRESS_PERIOD_MS * 10;
+        int64_t until = esp_timer_get_time() + busy_us;
+        while (esp_timer_get_time() < until) {
+        }
+        TickType_t rest = pdMS_TO_TICKS(AUDIT_STRESS_PERIOD_MS - (uint32_t)(busy_us / 1000));
+        vTaskDelay(rest > 0 ? rest : 1);
+    }
+}
+
+
+/**
+ * @brief Reproduce el perfil de estres, emite el informe y libera las tareas de carga.
+ */
+static void audit_stress_task(void *pvParameters) {
+    char msg[64];
+    uint32_t seq = 0;
+
+    for (size_t p = 0; p < AUDIT_PHASE_COUNT; p++) {
+        const audit_phase_t *phase = &audit_phases[p];
+        uint32_t published = 0, edges = 0;
+
+        ESP_LOGI(TAG, "Fase %s (%lu ms)", phase->name, (unsigned long)phase->duration_ms);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            busy_pct[core] = (core == APP_CPU_NUM) ? phase->busy_sensors_pct : phase->busy_network_pct;
+        }
+
+        for (uint32_t t = 0; t < phase->duration_ms; t += AUDIT_STRESS_STEP_MS) {
+            for (uint32_t due = t * phase->edges_per_s / 1000; edges < due; edges++) {
+                ky037_simulate_edge();
+            }
+            for (uint32_t due = t * phase->publish_per_s / 1000; published < due; published++) {
+                if (mqtt_client_wait_connected(&mqtt_client, 0) != ESP_OK) continue;
+                int len = snprintf(msg, sizeof(msg), "{\"stress\":\"%s\",\"seq\":%lu}", phase->name,
+                                   (unsigned long)seq++);
+                mqtt_client_publish_topic(&mqtt_client, MQTT_TOPIC_DIAGNOSTICS, msg, len, 1, 0);
+            }
+            vTaskDelay(pdMS_TO_TICKS(AUDIT_STRESS_STEP_MS));
+        }
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (spinners[core] != NULL) vTaskDelete(spinners[core]);
+        spinners[core] = NULL;
+    }
+    audit_report();
+    vTaskDelete(NULL);
+}
+
+
+/**
+ * @brief Lanza la reproduccion del perfil de estres (modo diagnostico). Las tareas de estres se
+ * reservan en el heap: solo existen durante la auditoria.
+ */
+esp_err_t audit_start(void) {
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        busy_pct[core] = 0;
+        if (xTaskCreatePinnedToCore(audit_spin_task, "audit_spin", AUDIT_STRESS_STACK, (void *)(uintptr_t)core,
+                                    AUDIT_STRESS_PRIORITY, &spinners[core], core) != pdPASS) {
+            ESP_LOGE(TAG, "- ERROR: Error creando la tarea de carga del nucleo %d -", core);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    // Una prioridad por encima de la carga de CPU para respetar el perfil
+    if (xTaskCreate(audit_stress_task, "audit_stress", AUDIT_STRESS_STACK, NULL,
+                    AUDIT_STRESS_PRIORITY + 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "- ERROR: Error creando la tarea de estres -");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t audit_start(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "Baseline/baseline.h"
+#include <string.h>
+
+
+/**
+ * @brief Inicializa el seguimiento sin historia.
+ */
+void baseline_init(baseline_t *tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->day_start_us = -1;
+}
+
+
+/**
+ * @brief Descarta el dia en curso y el suavizado, conservando los picos de los dias completos. Se usa
+ * al restaurar el estado desde NVS, cuando la base de tiempo anterior ya no es valida.
+ */
+void baseline_restart_day(baseline_t *tracker) {
+    tracker->day_start_us = -1;
+    tracker->day_peak = 0;
+    tracker->has_ema = false;
+}
+
+
+/**
+ * @brief Agrega una muestra. Costo O(1) salvo al cerrar un dia.
+ * @param tracker Estado del seguimiento.
+ * @param now_us Instante de la muestra (reloj que no se reinicia en deep sleep).
+ * @param value Valor de la muestra.
+ * @return bool  Devuelve true si con esta muestra se cerro un dia (la linea base puede haber cambiado).
+ */
+bool baseline_update(baseline_t *tracker, int64_t now_us, uint32_t value) {
+    bool closed = false;
+
+    if (tracker->day_start_us < 0 || now_us < tracker->day_start_us) {
+        tracker->day_start_us = now_us;
+        tracker->day_peak = 0;
+    }
+    else if (now_us - tracker->day_start_us >= (int64_t)BASELINE_DAY_MS * 1000) {
+        tracker->peaks[tracker->head] = tracker->day_peak;
+        tracker->head = (tracker->head + 1) % BASELINE_DAYS;
+        if (tracker->days < BASELINE_DAYS) tracker->days++;
+        tracker->day_start_us = now_us;
+        tracker->day_peak = 0;
+        closed = true;
+    }
+
+    if (!tracker->has_ema) {
+        tracker->ema = value;
+        tracker->has_ema = true;
+    }
+    else {
+        int64_t delta = (int64_t)value - tracker->ema;
+        tracker->ema = (uint32_t)((int64_t)tracker->ema + ((delta * BASELINE_EMA_ALPHA_Q15) >> 15));
+    }
+    if (tracker->ema > tracker->day_peak) tracker->day_peak = tracker->ema;
+    return closed;
+}
+
+
+/**
+ * @brief Linea base actual: el BASELINE_RANK-esimo mayor de los picos diarios.
+ * @return uint32_t  Devuelve 0 si todavia no hay BASELINE_MIN_DAYS dias completos.
+ */
+uint32_t baseline_value(const baseline_t *tracker) {
+    uint32_t sorted[BASELINE_DAYS];
+
+    if (tracker->days < BASELINE_MIN_DAYS) return 0;
+
+    // Insercion ordenada de mayor a menor; el anillo tiene pocos elementos
+    for (uint8_t i = 0; i < tracker->days; i++) {
+        uint32_t v = tracker->peaks[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] < v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+
+    uint8_t rank = (BASELINE_RANK < tracker->days) ? BASELINE_RANK : tracker->days - 1;
+    return sorted[rank];
+}
@@ -0,0 +1,129 @@
+#include "Boot/boot.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *TAG = "BOOT";
+
+
+/* ----- Estado de ejecucion de cada paso ----- */
+typedef struct {
+    int64_t start_us;     // Inicio del paso (esp_timer)
+    int64_t end_us;       // Fin del paso
+    esp_err_t result;     // Resultado de run(), o ESP_ERR_INVALID_STATE si fallo una dependencia
+    uint32_t stack_used;  // Maximo de pila usado por la tarea del paso (bytes)
+} boot_step_state_t;
+
+
+static const boot_step_t *boot_steps = NULL;
+static boot_step_state_t step_state[BOOT_MAX_STEPS];
+static EventGroupHandle_t done_events = NULL;    // Bit n = paso n terminado
+static StaticEventGroup_t done_events_buffer;
+static volatile uint32_t failed_mask = 0;        // Bit n = paso n fallido (se escribe con failed_lock)
+static portMUX_TYPE failed_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/**
+ * @brief Marca un paso como fallido. Los pasos corren en paralelo en ambos nucleos: la lectura-
+ * modificacion-escritura de la mascara va en seccion critica para no perder un fallo simultaneo.
+ * Se llama antes de publicar el bit de fin del paso, de modo que los dependientes lo ven.
+ */
+static void boot_mark_failed(size_t index) {
+    portENTER_CRITICAL(&failed_lock);
+    failed_mask |= BOOT_DEP(index);
+    portEXIT_CRITICAL(&failed_lock);
+}
+
+
+/**
+ * @brief Tarea generica de un paso: espera sus dependencias, ejecuta y publica su finalizacion.
+ * @param pvParameters Indice del paso dentro de la tabla.
+ */
+static void boot_step_task(void *pvParameters) {
+    size_t index = (size_t)pvParameters;
+    const boot_step_t *step = &boot_steps[index];
+
+    if (step->depends != 0) {
+        xEventGroupWaitBits(done_events, step->depends, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    step_state[index].start_us = esp_timer_get_time();
+    if (failed_mask & step->depends) {
+        ESP_LOGE(TAG, "- ERROR: %s omitido, fallo una dependencia -", step->name);
+        step_state[index].result = ESP_ERR_INVALID_STATE;
+    }
+    else {
+        step_state[index].result = step->run();
+    }
+    step_state[index].end_us = esp_timer_get_time();
+
+    if (step_state[index].result != ESP_OK) {
+        boot_mark_failed(index);
+    }
+    step_state[index].stack_used = step->stack_size - (uint32_t)uxTaskGetStackHighWaterMark(NULL);
+    xEventGroupSetBits(done_events, BOOT_DEP(index));
+    vTaskDelete(NULL);
+}
+
+
+/**
+ * @brief Imprime el desglose del arranque: inicio relativo, duracion y pila usada de cada paso
+ * (para ajustar stack_size de la tabla, ver Audit/audit.h).
+ */
+static void boot_report(size_t count, int64_t t0) {
+    char line[384];
+    int len = 0;
+    int64_t t_end = t0;
+
+    for (size_t i = 0; i < count && len < (int)sizeof(line); i++) {
+        len += snprintf(line + len, sizeof(line) - len, " %s %lu+%lu ms %lu/%lu B%s,",
+                        boot_steps[i].name,
+                        (unsigned long)((step_state[i].start_us - t0) / 1000),
+                        (unsigned long)((step_state[i].end_us - step_state[i].start_us) / 1000),
+                        (unsigned long)step_state[i].stack_used, (unsigned long)boot_steps[i].stack_size,
+                        step_state[i].result == ESP_OK ? "" : " (error)");
+        if (step_state[i].end_us > t_end) t_end = step_state[i].end_us;
+    }
+    ESP_LOGI(TAG, "Arranque:%s total %lu ms", line, (unsigned long)((t_end - t0) / 1000));
+}
+
+
+/**
+ * @brief Ejecuta la tabla de pasos de arranque respetando las dependencias y bloquea hasta
+ * que terminan todos. Los pasos sin dependencias entre si corren en paralelo.
+ * @param steps Tabla de pasos. Las dependencias solo pueden apuntar a pasos de la misma tabla.
+ * @param count Cantidad de pasos (maximo BOOT_MAX_STEPS).
+ * @return esp_err_t  Devuelve ESP_OK si todos los pasos terminaron sin error.
+ */
+esp_err_t boot_run(const boot_step_t *steps, size_t count) {
+    if (count == 0 || count > BOOT_MAX_STEPS) return ESP_ERR_INVALID_ARG;
+
+    done_events = xEventGroupCreateStatic(&done_events_buffer);
+
+    boot_steps = steps;
+    failed_mask = 0;
+    memset(step_state, 0, sizeof(step_state));
+    int64_t t0 = esp_timer_get_time();
+    const EventBits_t all = (EventBits_t)(BOOT_DEP(count) - 1);
+
+    for (size_t i = 0; i < count; i++) {
+        if (xTaskCreatePinnedToCore(boot_step_task, steps[i].name, steps[i].stack_size,
+                                    (void *)i, steps[i].priority, NULL, steps[i].core) != pdPASS) {
+            ESP_LOGE(TAG, "- ERROR: Error creando tarea de %s -", steps[i].name);
+            step_state[i].result = ESP_ERR_NO_MEM;
+            boot_mark_failed(i);
+            xEventGroupSetBits(done_events, BOOT_DEP(i));
+        }
+    }
+
+    xEventGroupWaitBits(done_events, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    boot_report(count, t0);
+
+    vEventGroupDelete(done_events);
+    done_events = NULL;
+    return failed_mask ? ESP_FAIL : ESP_OK;
+}
@@ -0,0 +1,248 @@
+#include "Codec/codec.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* ----- Columnas del formato binario ----- */
+typedef enum {
+    COL_KY037_COUNTER = 0,
+    COL_KY037_MAX_DURATION,
+    COL_TEMP_LAST,            // Centesimas (Data/fixed.h)
+    COL_HUM_LAST,
+    COL_TEMP_MIN,
+    COL_TEMP_MAX,
+    COL_TEMP_MEAN,
+    COL_TEMP_STD,
+    COL_HUM_MIN,
+    COL_HUM_MAX,
+    COL_HUM_MEAN,
+    COL_HUM_STD,
+    COL_DHT11_SAMPLES,
+    COL_GAS_FIRST,            // Una columna por gas (centesimas de ppm)
+    COL_MQ135_SAMPLES = COL_GAS_FIRST + DATA_GAS_COUNT,
+    COL_MQ135_CALIBRATED,
+    COL_COUNT
+} codec_column_t;
+
+
+/**
+ * @brief Sensor al que pertenece cada columna (la columna se omite si el sensor esta deshabilitado).
+ */
+static uint8_t codec_column_sensor(codec_column_t col) {
+    if (col <= COL_KY037_MAX_DURATION) return ID_KY037;
+    return (col < COL_GAS_FIRST) ? ID_DHT11 : ID_MQ135;
+}
+
+
+/**
+ * @brief Lee el valor de una columna de un reporte.
+ */
+static int32_t codec_get(const data_sensors_t *d, codec_column_t col) {
+    switch (col) {
+        case COL_KY037_COUNTER:      return (int32_t)d->ky037_counter;
+        case COL_KY037_MAX_DURATION: return (int32_t)d->ky037_max_duration;
+        case COL_TEMP_LAST:          return d->temperature;
+        case COL_HUM_LAST:           return d->humidity;
+        case COL_TEMP_MIN:           return d->temp_min;
+        case COL_TEMP_MAX:           return d->temp_max;
+        case COL_TEMP_MEAN:          return d->temp_mean;
+        case COL_TEMP_STD:           return d->temp_std;
+        case COL_HUM_MIN:            return d->hum_min;
+        case COL_HUM_MAX:            return d->hum_max;
+        case COL_HUM_MEAN:           return d->hum_mean;
+        case COL_HUM_STD:            return d->hum_std;
+        case COL_DHT11_SAMPLES:      return d->dht11_samples;
+        case COL_MQ135_SAMPLES:      return d->mq135_samples;
+        case COL_MQ135_CALIBRATED:   return d->mq135_calibrated;
+        default:                     return (col >= COL_GAS_FIRST) ? d->gas_ppm[col - COL_GAS_FIRST] : 0;
+    }
+}
+
+
+/**
+ * @brief Escribe el valor de una columna en un reporte.
+ */
+static void codec_set(data_sensors_t *d, codec_column_t col, int32_t v) {
+    switch (col) {
+        case COL_KY037_COUNTER:      d->ky037_counter = (uint32_t)v; break;
+        case COL_KY037_MAX_DURATION: d->ky037_max_duration = (uint32_t)v; break;
+        case COL_TEMP_LAST:          d->temperature = fx_to16(v); break;
+        case COL_HUM_LAST:           d->humidity = fx_to16(v); break;
+        case COL_TEMP_MIN:           d->temp_min = fx_to16(v); break;
+        case COL_TEMP_MAX:           d->temp_max = fx_to16(v); break;
+        case COL_TEMP_MEAN:          d->temp_mean = fx_to16(v); break;
+        case COL_TEMP_STD:           d->temp_std = fx_to16(v); break;
+        case COL_HUM_MIN:            d->hum_min = fx_to16(v); break;
+        case COL_HUM_MAX:            d->hum_max = fx_to16(v); break;
+        case COL_HUM_MEAN:           d->hum_mean = fx_to16(v); break;
+        case COL_HUM_STD:            d->hum_std = fx_to16(v); break;
+        case COL_DHT11_SAMPLES:      d->dht11_samples = (uint16_t)v; break;
+        case COL_MQ135_SAMPLES:      d->mq135_samples = (uint16_t)v; break;
+        case COL_MQ135_CALIBRATED:   d->mq135_calibrated = (uint8_t)v; break;
+        default:
+            if (col >= COL_GAS_FIRST) d->gas_ppm[col - COL_GAS_FIRST] = v;
+            break;
+    }
+}
+
+
+/**
+ * @brief Codifica un entero con signo en zigzag + varint.
+ * @return size_t  Bytes escritos, o 0 si no hay espacio.
+ */
+static size_t codec_put_varint(uint8_t *out, size_t space, int32_t value) {
+    uint32_t zz = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);   // Valores chicos de cualquier signo -> pocos bytes
+    size_t n = 0;
+
+    do {
+        if (n >= space) return 0;
+        uint8_t byte = zz & 0x7F;
+        zz >>= 7;
+        out[n++] = byte | (zz ? 0x80 : 0);
+    } while (zz);
+    return n;
+}
+
+
+/**
+ * @brief Decodifica un varint zigzag.
+ * @return size_t  Bytes consumidos, o 0 si el varint esta truncado o es invalido.
+ */
+static size_t codec_get_varint(const uint8_t *in, size_t len, int32_t *value) {
+    uint32_t zz = 0;
+
+    for (size_t n = 0; n < len && n < CODEC_VARINT_MAX; n++) {
+        zz |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            *value = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Codifica un lote de reportes en el formato binario por columnas con deltas.
+ * @param samples Reportes del lote.
+ * @param count Cantidad de reportes.
+ * @param sensor_mask Sensores habilitados (columnas a incluir).
+ * @param out Buffer de salida.
+ * @param out_size Tamaño del buffer de salida.
+ * @return size_t  Bytes escritos, o 0 si no entra en el buffer.
+ */
+size_t codec_encode_batch(const data_sensors_t *samples, uint8_t count, uint8_t sensor_mask,
+                          uint8_t *out, size_t out_size) {
+    if (out_size < CODEC_HEADER_LEN) return 0;
+
+    out[0] = CODEC_VERSION;
+    out[1] = count;
+    out[2] = sensor_mask;
+    size_t len = CODEC_HEADER_LEN;
+
+    for (int col = 0; col < COL_COUNT; col++) {
+        if (!(sensor_mask & DATA_SENSOR_BIT(codec_column_sensor(col)))) continue;
+
+        int32_t prev = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            int32_t value = codec_get(&samples[i], col);
+            size_t n = codec_put_varint(out + len, out_size - len, value - prev);   // El primero es absoluto (prev = 0)
+            if (n == 0) return 0;
+            len += n;
+            prev = value;
+        }
+    }
+    return len;
+}
+
+
+/**
+ * @brief Decodifica un lote codificado con codec_encode_batch.
+ * @param in Datos codificados.
+ * @param len Longitud de los datos.
+ * @param samples Reportes de salida (las columnas ausentes quedan en cero).
+ * @param max_count Capacidad de samples.
+ * @param sensor_mask Salida con la mascara de sensores del lote (puede ser NULL).
+ * @return int  Cantidad de reportes decodificados, o -1 si los datos son invalidos.
+ */
+int codec_decode_batch(const uint8_t *in, size_t len, data_sensors_t *samples, uint8_t max_count,
+                       uint8_t *sensor_mask) {
+    if (len < CODEC_HEADER_LEN || in[0] != CODEC_VERSION || in[1] > max_count) return -1;
+
+    uint8_t count = in[1];
+    uint8_t mask = in[2];
+    size_t pos = CODEC_HEADER_LEN;
+    memset(samples, 0, sizeof(data_sensors_t) * count);
+
+    for (int col = 0; col < COL_COUNT; col++) {
+        if (!(mask & DATA_SENSOR_BIT(codec_column_sensor(col)))) continue;
+
+        int32_t value = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            int32_t delta;
+            size_t n = codec_get_varint(in + pos, len - pos, &delta);
+            if (n == 0) return -1;
+            pos += n;
+            value += delta;
+            codec_set(&samples[i], col, value);
+        }
+    }
+
+    if (pos != len) return -1;
+    if (sensor_mask) *sensor_mask = mask;
+    return count;
+}
+
+
+/**
+ * @brief Serializa un reporte en JSON con los campos de los sensores habilitados (DATA_FORMAT_JSON).
+ * @return int  Longitud del JSON, o -1 si no entra en el buffer.
+ */
+int codec_format_json(const data_sensors_t *data, uint8_t sensor_mask, char *json, size_t size) {
+    int len = snprintf(json, size, "{");
+
+    if (sensor_mask & DATA_SENSOR_BIT(ID_KY037)) {
+        len += snprintf(json + len, size - len,
+                        "\"Contador de pulsos de sonido\": %lu, \"Maxima duracion de pulso\": %lu, ",
+                        (unsigned long) data->ky037_counter,
+                        (unsigned long) data->ky037_max_duration);
+        if (len >= (int)size) return -1;
+    }
+    if ((sensor_mask & DATA_SENSOR_BIT(ID_DHT11)) && data->dht11_samples > 0) {
+        static const char *const names[] = {
+            "Temperatura", "Humedad", "Temperatura min", "Temperatura max", "Temperatura media",
+            "Temperatura desvio", "Humedad min", "Humedad max", "Humedad media", "Humedad desvio"
+        };
+        const fx16_t values[] = {
+            data->temperature, data->humidity, data->temp_min, data->temp_max, data->temp_mean,
+            data->temp_std, data->hum_min, data->hum_max, data->hum_mean, data->hum_std
+        };
+        char number[FX_STR_MAX];
+
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            fx_format(values[i], number, sizeof(number));
+            len += snprintf(json + len, size - len, "\"%s\": %s, ", names[i], number);
+            if (len >= (int)size) return -1;
+        }
+        len += snprintf(json + len, size - len, "\"Lecturas\": %u, ", data->dht11_samples);
+        if (len >= (int)size) return -1;
+    }
+    if ((sensor_mask & DATA_SENSOR_BIT(ID_MQ135)) && data->mq135_samples > 0) {
+        static const char *const gases[DATA_GAS_COUNT] = { "CO2", "CO", "NH3", "C6H6", "NO2" };
+        char number[FX_STR_MAX];
+
+        for (int i = 0; i < DATA_GAS_COUNT; i++) {
+            fx_format(data->gas_ppm[i], number, sizeof(number));
+            len += snprintf(json + len, size - len, "\"%s\": %s, ", gases[i], number);
+            if (len >= (int)size) return -1;
+        }
+        len += snprintf(json + len, size - len, "\"Lecturas MQ135\": %u, \"Calibrado\": %s, ",
+                        data->mq135_samples, data->mq135_calibrated ? "true" : "false");
+        if (len >= (int)size) return -1;
+    }
+
+    if (len > 1) len -= 2;   // Quitar el ultimo ", "
+    len += snprintf(json + len, size - len, "}");
+    return (len < (int)size) ? len : -1;
+}
@@ -0,0 +1,217 @@
+#include "Control/control.h"
+#include "AES-CTR/aes-ctr.h"
+#include "Data/data.h"
+#include "MQTT/mqtt.h"
+#include "Power/power.h"
+#include "Setting/settings.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/constant_time.h"
+#include "esp_log.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+static const char *TAG = "CONTROL";
+
+
+static char plaintext[CONTROL_MAX_PLAINTEXT];
+static settings_t staged;     // Copia de trabajo, fuera de la pila de la tarea de esp-mqtt
+static settings_t previous;   // Valores vigentes, para restaurarlos si falla NVS
+
+// Unicas claves que se aceptan por red: WiFi, broker y clave AES solo se cambian por UART
+static const char *runtime_keys[] = {
+    PROV_KEY_SAMPLE, PROV_KEY_BATCH, PROV_KEY_FORMAT, PROV_KEY_SENSORS,
+    PROV_KEY_REPORT, PROV_KEY_INTERVAL_KY037, PROV_KEY_INTERVAL_DHT11, PROV_KEY_INTERVAL_MQ135,
+    PROV_KEY_DEADBAND_TEMP, PROV_KEY_DEADBAND_HUM, PROV_KEY_DEADBAND_NOISE, PROV_KEY_HEARTBEAT,
+    PROV_KEY_CALIB_MQ135
+};
+
+
+/**
+ * @brief Publica la respuesta a un comando.
+ * @param seq Secuencia del comando.
+ * @param reason Motivo del rechazo, o NULL si se aplico.
+ */
+static void control_reply(uint32_t seq, const char *reason) {
+    char msg[48];
+    int len;
+
+    if (reason == NULL) {
+        len = snprintf(msg, sizeof(msg), "ACK %lu", (unsigned long)seq);
+    }
+    else {
+        len = snprintf(msg, sizeof(msg), "NAK %lu %s", (unsigned long)seq, reason);
+    }
+    if (len >= (int)sizeof(msg)) len = sizeof(msg) - 1;
+    mqtt_client_publish_topic(&mqtt_client, MQTT_TOPIC_CONTROL_ACK, msg, len, 1, 0);
+}
+
+
+/**
+ * @brief Verifica el MAC del mensaje y descifra su contenido en plaintext.
+ * @param data Mensaje recibido "v1:<IV>:<datos>:<MAC>" (sin terminador).
+ * @param len Longitud del mensaje.
+ * @return bool  Devuelve true si el mensaje es autentico y se pudo descifrar.
+ */
+static bool control_open(const char *data, int len) {
+    const size_t prefix_len = strlen(DATA_PAYLOAD_VERSION ":");
+    unsigned char mac[32];
+    unsigned char mac_rx[32];
+    unsigned char iv[IV_LEN];
+    size_t olen;
+
+    if (len <= (int)prefix_len || strncmp(data, DATA_PAYLOAD_VERSION ":", prefix_len) != 0) return false;
+
+    // El MAC cubre todo lo anterior al ultimo ':'
+    const char *mac_sep = NULL;
+    for (int i = len - 1; i >= (int)prefix_len; i--) {
+        if (data[i] == ':') {
+            mac_sep = &data[i];
+            break;
+        }
+    }
+    if (mac_sep == NULL) return false;
+
+    size_t signed_len = (size_t)(mac_sep - data);
+    if (mbedtls_base64_decode(mac_rx, sizeof(mac_rx), &olen, (const unsigned char *)mac_sep + 1,
+                              (size_t)(data + len - mac_sep - 1)) != 0 || olen != CONTROL_MAC_LEN) {
+        return false;
+    }
+    if (aes_ctr_hmac((const unsigned char *)data, signed_len, mac) != ESP_OK) return false;
+    if (mbedtls_ct_memcmp(mac, mac_rx, CONTROL_MAC_LEN) != 0) {
+        ESP_LOGW(TAG, "MAC invalido, comando descartado");
+        return false;
+    }
+
+    // "<IV Base64>:<datos Base64>"
+    const char *iv_b64 = data + prefix_len;
+    const char *ct_b64 = memchr(iv_b64, ':', signed_len - prefix_len);
+    if (ct_b64 == NULL) return false;
+    ct_b64++;
+
+    if (mbedtls_base64_decode(iv, sizeof(iv), &olen, (const unsigned char *)iv_b64,
+                              (size_t)(ct_b64 - 1 - iv_b64)) != 0 || olen != IV_LEN) {
+        return false;
+    }
+    return aes_ctr_decrypt_from_base64(ct_b64, (size_t)(mac_sep - ct_b64), iv, (unsigned char *)plaintext,
+                                       sizeof(plaintext), &olen) == ESP_OK;
+}
+
+
+/**
+ * @brief Indica si una clave puede modificarse desde el topic de control.
+ */
+static bool control_key_allowed(const char *key) {
+    for (size_t i = 0; i < sizeof(runtime_keys) / sizeof(runtime_keys[0]); i++) {
+        if (strcmp(key, runtime_keys[i]) == 0) return true;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Copia los campos de tiempo de ejecucion entre dos configuraciones.
+ */
+static void control_copy_runtime(settings_t *dst, const settings_t *src) {
+    dst->sample_rate = src->sample_rate;
+    dst->batch_size = src->batch_size;
+    dst->payload_format = src->payload_format;
+    dst->sensor_mask = src->sensor_mask;
+    dst->control_seq = src->control_seq;
+    memcpy(dst->sample_interval_ms, src->sample_interval_ms, sizeof(dst->sample_interval_ms));
+    dst->report_interval_ms = src->report_interval_ms;
+    dst->deadband_temp = src->deadband_temp;
+    dst->deadband_hum = src->deadband_hum;
+    dst->deadband_noise = src->deadband_noise;
+    dst->heartbeat_ms = src->heartbeat_ms;
+    dst->mq135_calib_seq = src->mq135_calib_seq;
+}
+
+
+/**
+ * @brief Procesa un comando del topic de control (contexto de la tarea de esp-mqtt).
+ * El lote se valida completo sobre una copia; solo si todos los campos son validos se aplica a
+ * settings bajo el mutex, se guarda en NVS y se despierta a la tarea de datos para que el proximo
+ * ciclo ya use los valores nuevos. Si NVS falla se restauran los valores anteriores.
+ */
+static void control_on_message(const char *data, int len) {
+    char *saveptr = NULL;
+    char *endptr;
+
+    if (!control_open(data, len)) {
+        ESP_LOGW(TAG, "Comando invalido descartado");
+        return;
+    }
+
+    // El primer campo es obligatoriamente "seq=N"
+    char *field = strtok_r(plaintext, ";", &saveptr);
+    if (field == NULL || strncmp(field, "seq=", 4) != 0) {
+        control_reply(0, "FORMAT");
+        return;
+    }
+    errno = 0;
+    unsigned long seq = strtoul(field + 4, &endptr, 10);
+    if (endptr == field + 4 || *endptr != '\0' || errno == ERANGE) {
+        control_reply(0, "FORMAT");
+        return;
+    }
+
+    setting_lock();
+    staged = settings;
+    setting_unlock();
+
+    if (seq <= staged.control_seq) {   // Repeticion (p. ej. mensaje retenido ya aplicado)
+        ESP_LOGI(TAG, "Comando seq=%lu ya aplicado, se ignora", seq);
+        return;
+    }
+
+    while ((field = strtok_r(NULL, ";", &saveptr)) != NULL) {
+        char *eq = strchr(field, '=');
+        if (eq == NULL) {
+            control_reply(seq, "FORMAT");
+            return;
+        }
+        *eq = '\0';
+        if (!control_key_allowed(field) || !setting_set_field(&staged, field, eq + 1)) {
+            char reason[32];
+            snprintf(reason, sizeof(reason), "FIELD %.24s", field);
+            control_reply(seq, reason);
+            return;
+        }
+    }
+
+    staged.control_seq = (uint32_t)seq;
+
+    setting_lock();
+    control_copy_runtime(&previous, &settings);
+    control_copy_runtime(&settings, &staged);
+    esp_err_t ret = setting_save_to_nvs();
+    if (ret != ESP_OK) {
+        control_copy_runtime(&settings, &previous);
+    }
+    setting_unlock();
+
+    if (ret != ESP_OK) {
+        control_reply(seq, "NVS");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Comando seq=%lu aplicado: report=%lu ms batch=%u format=%u sensors=0x%02X", seq,
+             (unsigned long)staged.report_interval_ms, staged.batch_size, staged.payload_format, staged.sensor_mask);
+    power_wake_early();
+    control_reply(seq, NULL);
+}
+
+
+/**
+ * @brief Registra la suscripcion al topic de control del dispositivo. Debe llamarse despues de
+ * mqtt_client_set_topics.
+ * @return esp_err_t  Devuelve ESP_OK si la suscripcion quedo registrada.
+ */
+esp_err_t control_init(void) {
+    return mqtt_client_subscribe(&mqtt_client, mqtt_client_topic(&mqtt_client, MQTT_TOPIC_CONTROL), 1,
+                                 control_on_message);
+}
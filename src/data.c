@@ -1,57 +1,477 @@
 #include "Data/data.h"
+#include "Aggregate/aggregate.h"
+#include "Audit/audit.h"
+#include "Codec/codec.h"
 #include "DHT11/dht11.h"
 #include "KY037/ky037.h"
+#include "Memory/memory.h"
+#include "MQ135/mq135.h"
+#include "Placement/placement.h"
+#include "Power/power.h"
+#include "Scheduler/scheduler.h"
 #include "Setting/settings.h"
+#include "WiFi/wifi_manager.h"
 #include "AES-CTR/aes-ctr.h"
+#include "MQTT/mqtt.h"
+#include "Pool/pool.h"
+#include "mbedtls/base64.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include <stdio.h>
+#include <stdlib.h>
 
 
 static const char *TAG = "JSON";
 
 
-void data_json_encrypt_task(void *pvParameters) {
-    data_sensors_t data;
+// Sobre "<version>:<IV Base64>:<datos Base64>" de DATA_JSON_MAX bytes en claro (32: version, IV y separadores)
+_Static_assert(POOL_BLOCK_SIZE >= 32 + 4 * ((DATA_JSON_MAX + 2) / 3) + 1,
+               "el sobre de un reporte debe entrar en un bloque del pool");
 
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(settings.sample_rate*60000));
-        memset(&data, 0, sizeof(data));
 
+/* ----- Acumulado del periodo de reporte en curso ----- */
+typedef struct {
+    uint32_t magic;              // DATA_ACCUM_MAGIC si las ventanas estan inicializadas
+    uint32_t ky037_counter;      // Totales del KY037 (contadores, no una senal muestreada)
+    uint32_t ky037_max_duration;
+    dht11_data_t last_dht11;     // Ultima lectura valida del DHT11
+    bool has_dht11;              // last_dht11 contiene una lectura (compensacion del MQ135)
+    agg_window_t temperature;    // Centesimas de C
+    agg_window_t humidity;       // Centesimas de %
+    int64_t gas_sum[DATA_GAS_COUNT];   // Suma de concentraciones del periodo (centesimas de ppm)
+    uint16_t mq135_samples;
+    bool mq135_calibrated;
+} data_accum_t;
+
+
+/* ----- Ultimo reporte emitido (referencia del reporte por excepcion) ----- */
+typedef struct {
+    bool valid;                  // Hay un reporte de referencia
+    data_sensors_t last;         // Ultimo reporte que paso el filtro
+    int64_t last_us;             // Instante en que se emitio (reloj RTC)
+    uint32_t suppressed;         // Reportes suprimidos desde el ultimo emitido
+} data_reference_t;
+
+
+static RTC_DATA_ATTR data_accum_t data_accum;   // Se conserva entre muestras aunque se duerma en deep sleep
+static RTC_DATA_ATTR data_reference_t data_reference;
+
+
+/**
+ * @brief Inicializa las ventanas de agregacion si la memoria RTC no las contiene.
+ */
+static void data_accum_init(void) {
+    if (data_accum.magic == DATA_ACCUM_MAGIC) return;
+
+    memset(&data_accum, 0, sizeof(data_accum));
+    agg_window_type_t type = DATA_AGG_WINDOW_MS ? AGG_WINDOW_SLIDING : AGG_WINDOW_TUMBLING;
+    agg_init(&data_accum.temperature, type, DATA_AGG_WINDOW_MS);
+    agg_init(&data_accum.humidity, type, DATA_AGG_WINDOW_MS);
+    data_accum.magic = DATA_ACCUM_MAGIC;
+}
+
+
+/**
+ * @brief Toma una lectura de los sensores indicados por el planificador y la acumula en el periodo.
+ * @param sample_mask Sensores a muestrear (DATA_SENSOR_BIT).
+ */
+static void data_sample_sensors(uint8_t sample_mask) {
+    if (sample_mask & DATA_SENSOR_BIT(ID_DHT11)) {
         esp_err_t ret = dht11_read_data();
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "- ERROR: No se pudieron leer los datos -");
         }
         else {
-            data.dht11_temperature = dht11_data.temperature;
-            data.dht11_humidity = dht11_data.humidity;
-            data.dht11_temp_decimal = dht11_data.temp_decimal;
-            data.dht11_hum_decimal = dht11_data.hum_decimal;
+            int64_t now = power_now_us();
+            data_accum.last_dht11 = dht11_data;
+            data_accum.has_dht11 = true;
+            agg_add(&data_accum.temperature, now, dht11_data.temp_value);
+            agg_add(&data_accum.humidity, now, dht11_data.hum_value);
         }
+    }
 
+    // Despues del DHT11, para compensar con la lectura de este mismo ciclo si la hubo
+    if (sample_mask & DATA_SENSOR_BIT(ID_MQ135)) {
+        mq135_reading_t reading;
+        fx_t temperature = data_accum.has_dht11 ? data_accum.last_dht11.temp_value : MQ135_REF_TEMPERATURE;
+        fx_t humidity = data_accum.has_dht11 ? data_accum.last_dht11.hum_value : MQ135_REF_HUMIDITY;
+
+        if (mq135_sample(temperature, humidity, power_now_us(), &reading) != ESP_OK) {
+            ESP_LOGE(TAG, "- ERROR: No se pudo leer el MQ135 -");
+        }
+        else {
+            for (int i = 0; i < DATA_GAS_COUNT; i++) {
+                data_accum.gas_sum[i] += reading.ppm[i];
+            }
+            data_accum.mq135_samples++;
+            data_accum.mq135_calibrated = reading.calibrated;
+        }
+    }
+
+    if (sample_mask & DATA_SENSOR_BIT(ID_KY037)) {
         if (xSemaphoreTake(xStatsMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            data.ky037_counter = ky037_stats.counter;
-            data.ky037_max_duration = ky037_stats.max_duration;
-            // Reset estadisticas para el siguiente período
+            data_accum.ky037_counter += ky037_stats.counter;
+            if (ky037_stats.max_duration > data_accum.ky037_max_duration) {
+                data_accum.ky037_max_duration = ky037_stats.max_duration;
+            }
+            // Reset estadisticas para el siguiente intervalo
             ky037_stats.counter = 0;
             ky037_stats.max_duration = 0;
             xSemaphoreGive(xStatsMutex);
         }
+    }
+}
+
+
+/**
+ * @brief Cierra el periodo de reporte: vuelca las estadisticas acumuladas en un registro y las reinicia.
+ * @param report Registro de salida.
+ * @param sensor_mask Sensores habilitados (los deshabilitados se reportan en cero).
+ */
+static void data_build_report(data_sensors_t *report, uint8_t sensor_mask) {
+    memset(report, 0, sizeof(*report));
+
+    // Detecciones que ocurrieron mientras el chip dormia
+    data_accum.ky037_counter += power_take_ky037_wakeups();
+
+    if (sensor_mask & DATA_SENSOR_BIT(ID_KY037)) {
+        report->ky037_counter = data_accum.ky037_counter;
+        report->ky037_max_duration = data_accum.ky037_max_duration;
+    }
+
+    int64_t now = power_now_us();
+    agg_summary_t temp;
+    agg_summary_t hum;
+    bool has_dht11 = agg_summary(&data_accum.temperature, now, &temp);
+    agg_summary(&data_accum.humidity, now, &hum);
+
+    if ((sensor_mask & DATA_SENSOR_BIT(ID_DHT11)) && has_dht11) {
+        report->temperature = fx_to16(data_accum.last_dht11.temp_value);
+        report->humidity = fx_to16(data_accum.last_dht11.hum_value);
+        report->temp_min = fx_to16(temp.min);
+        report->temp_max = fx_to16(temp.max);
+        report->temp_mean = fx_to16(temp.mean);
+        report->temp_std = fx_to16(temp.stddev);
+        report->hum_min = fx_to16(hum.min);
+        report->hum_max = fx_to16(hum.max);
+        report->hum_mean = fx_to16(hum.mean);
+        report->hum_std = fx_to16(hum.stddev);
+        report->dht11_samples = (uint16_t)temp.count;
+    }
+
+    if ((sensor_mask & DATA_SENSOR_BIT(ID_MQ135)) && data_accum.mq135_samples > 0) {
+        for (int i = 0; i < DATA_GAS_COUNT; i++) {
+            report->gas_ppm[i] = (fx_t)fx_div_round(data_accum.gas_sum[i], data_accum.mq135_samples);
+        }
+        report->mq135_samples = data_accum.mq135_samples;
+        report->mq135_calibrated = data_accum.mq135_calibrated;
+    }
+
+    // Las ventanas se reinician en agg_summary (fijas) o descartan solas lo viejo (deslizantes)
+    data_accum.ky037_counter = 0;
+    data_accum.ky037_max_duration = 0;
+    memset(data_accum.gas_sum, 0, sizeof(data_accum.gas_sum));
+    data_accum.mq135_samples = 0;
+}
+
+
+/**
+ * @brief Diferencia absoluta entre dos valores sin signo.
+ */
+static uint32_t data_abs_diff(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+
+/**
+ * @brief Reporte por excepcion: decide si el reporte se emite o se suprime. Se emite si alguna
+ * metrica se alejo del ultimo reporte emitido mas que su banda muerta, si cambio la presencia de
+ * datos del DHT11 o del MQ135, o si se cumplio el silencio maximo (heartbeat). Con heartbeat_ms = 0 se emite siempre.
+ * @param report Reporte recien construido.
+ * @param runtime Bandas muertas y heartbeat del ciclo.
+ * @param now_us Instante actual (reloj RTC).
+ * @return bool  Devuelve true si el reporte debe publicarse.
+ */
+static bool data_report_passes(const data_sensors_t *report, const settings_runtime_t *runtime, int64_t now_us) {
+    const data_sensors_t *ref = &data_reference.last;
+    bool emit;
+
+    if (runtime->heartbeat_ms == 0 || !data_reference.valid) {
+        emit = true;
+    }
+    else if (now_us - data_reference.last_us >= (int64_t)runtime->heartbeat_ms * 1000) {
+        emit = true;
+    }
+    else if ((report->dht11_samples > 0) != (ref->dht11_samples > 0)
+             || (report->mq135_samples > 0) != (ref->mq135_samples > 0)) {
+        emit = true;
+    }
+    else {
+        emit = data_abs_diff(report->ky037_counter, ref->ky037_counter) > runtime->deadband_noise;
+        if (report->dht11_samples > 0) {
+            emit = emit
+                   || abs(report->temp_mean - ref->temp_mean) > FX_FROM_TENTHS(runtime->deadband_temp)
+                   || abs(report->hum_mean - ref->hum_mean) > FX_FROM_TENTHS(runtime->deadband_hum);
+        }
+    }
+
+    if (!emit) {
+        data_reference.suppressed++;
+        return false;
+    }
+
+    if (data_reference.suppressed > 0) {
+        ESP_LOGI(TAG, "%lu reportes sin cambios suprimidos", (unsigned long)data_reference.suppressed);
+    }
+    data_reference.valid = true;
+    data_reference.last = *report;
+    data_reference.last_us = now_us;
+    data_reference.suppressed = 0;
+    return true;
+}
+
+
+/**
+ * @brief Levanta WiFi y la sesion MQTT si no estan activas.
+ * @return esp_err_t  Devuelve ESP_OK cuando se puede publicar.
+ */
+static esp_err_t data_network_up(void) {
+    memory_exempt_begin();   // WiFi y esp-mqtt reservan internamente
+    esp_err_t ret = wifi_manager_connect(WIFI_CONNECT_TIMEOUT_MS);
+    if (ret == ESP_OK && mqtt_client.stopped == pdTRUE) {
+        ret = mqtt_client_start(&mqtt_client);
+    }
+    memory_exempt_end();
+    if (ret != ESP_OK) return ret;
+    return mqtt_client_wait_connected(&mqtt_client, DATA_MQTT_CONNECT_TIMEOUT_MS);
+}
+
+
+/**
+ * @brief Cifra un payload y lo publica en el topic de telemetria con el sobre
+ * "<version>:<IV Base64>:<datos Base64>". Los datos se cifran en su bloque y el sobre se arma en un
+ * segundo bloque que se entrega al cliente MQTT.
+ * @param version Version del formato de los datos.
+ * @param plain Bloque del pool con los datos en claro (JSON o binario); vuelve al pool.
+ * @return esp_err_t  Devuelve ESP_OK si el cliente MQTT acepto el mensaje (ventana o cola en espera).
+ */
+static esp_err_t data_publish_encrypted(const char *version, pool_handle_t plain) {
+    unsigned char iv_out[IV_LEN];
+    size_t len = pool_len(plain);
+    pool_handle_t envelope = POOL_NONE;
+    unsigned char *payload;
+    esp_err_t ret = ESP_FAIL;
+    size_t used;
+    size_t olen;
+
+    if (aes_ctr_encrypt(pool_data(plain), len, iv_out) != ESP_OK) goto done;
+
+    envelope = pool_take();
+    if (envelope == POOL_NONE) {
+        ESP_LOGW(TAG, "Pool sin bloques libres, mensaje postergado");
+        ret = ESP_ERR_NO_MEM;
+        goto done;
+    }
+    payload = pool_data(envelope);
+    used = (size_t)snprintf((char *)payload, POOL_BLOCK_SIZE, "%s:", version);
+    if (used >= POOL_BLOCK_SIZE
+        || mbedtls_base64_encode(payload + used, POOL_BLOCK_SIZE - used, &olen, iv_out, IV_LEN) != 0) {
+        goto done;
+    }
+    used += olen;
+    payload[used++] = ':';   // base64_encode dejo lugar para su terminador
+    if (mbedtls_base64_encode(payload + used, POOL_BLOCK_SIZE - used, &olen, pool_data(plain), len) != 0) {
+        goto done;
+    }
+    pool_set_len(envelope, used + olen);
+
+    memory_exempt_begin();   // esp-mqtt copia el mensaje a su outbox
+    ret = mqtt_client_publish_block(&mqtt_client, MQTT_TOPIC_TELEMETRY, envelope, 1, 0);
+    memory_exempt_end();
+    envelope = POOL_NONE;    // el cliente lo devolvio al pool
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Error publicando mensaje MQTT");
+    }
+
+    done:
+        pool_give(plain);
+        pool_give(envelope);
+        return ret;
+}
+
+
+/**
+ * @brief Serializa, cifra y publica un lote de muestras: un mensaje JSON por reporte, o un unico
+ * mensaje binario con todo el lote (DATA_FORMAT_DELTA). Se detiene en el primer mensaje que el
+ * cliente no acepta, de modo que las muestras tomadas son siempre las mas antiguas del lote.
+ * @param samples Muestras a publicar.
+ * @param count Cantidad de muestras.
+ * @param runtime Parametros de publicacion del ciclo.
+ * @return uint8_t  Muestras que el cliente MQTT acepto (o que no se pueden enviar y se descartan).
+ */
+static uint8_t data_publish_burst(const data_sensors_t *samples, uint8_t count, const settings_runtime_t *runtime) {
+    pool_handle_t block;
+    uint8_t taken = 0;
+
+    if (runtime->payload_format == DATA_FORMAT_DELTA) {
+        if ((block = pool_take()) == POOL_NONE) return 0;
+        size_t len = codec_encode_batch(samples, count, runtime->sensor_mask, pool_data(block), DATA_JSON_MAX);
+        if (len > 0) {
+            ESP_LOGI(TAG, "Lote de %u reportes codificado en %u bytes", count, (unsigned)len);
+            pool_set_len(block, len);
+            return (data_publish_encrypted(DATA_PAYLOAD_VERSION_DELTA, block) == ESP_OK) ? count : 0;
+        }
+        pool_give(block);
+        ESP_LOGW(TAG, "Lote demasiado grande para el formato binario, se envia en JSON");
+    }
 
-        char json[128];
-        char output_base64[256];
-        unsigned char iv_out[16];
-        snprintf(json, sizeof(json),
-        "{\"Contador de pulsos de sonido\": %lu, \"Maxima duracion de pulso\": %lu, "
-        "\"Temperatura\": %u.%u, \"Humedad\": %u.%u}",
-        (unsigned long) data.ky037_counter,
-        (unsigned long) data.ky037_max_duration,
-        data.dht11_temperature,
-        data.dht11_temp_decimal,
-        data.dht11_humidity,
-        data.dht11_hum_decimal);
+    for (; taken < count; taken++) {
+        if ((block = pool_take()) == POOL_NONE) {
+            ESP_LOGW(TAG, "Pool sin bloques libres, reporte postergado");
+            break;
+        }
+        char *json = (char *)pool_data(block);
+        int len = codec_format_json(&samples[taken], runtime->sensor_mask, json, DATA_JSON_MAX);
+        if (len < 0) {
+            ESP_LOGE(TAG, "- ERROR: JSON truncado -");   // No entra nunca: se descarta
+            pool_give(block);
+            continue;
+        }
         ESP_LOGI(TAG, "%s", json);
-        aes_ctr_encrypt_to_base64((const unsigned char *)json, sizeof(json), iv_out, output_base64, sizeof(output_base64));
+        pool_set_len(block, (size_t)len);
+        if (data_publish_encrypted(DATA_PAYLOAD_VERSION, block) != ESP_OK) break;
+    }
+    return taken;
+}
+
+
+/**
+ * @brief Informa la latencia publicacion-confirmacion y las perdidas del cliente MQTT.
+ */
+static void data_log_mqtt_stats(void) {
+    mqtt_stats_t stats;
+
+    mqtt_client_get_stats(&mqtt_client, &stats);
+    ESP_LOGI(TAG, "MQTT: %lu/%lu confirmados, latencia %lu ms (media %lu, max %lu), %lu descartados, %lu esperas de ventana",
+             (unsigned long)stats.acked, (unsigned long)stats.published,
+             (unsigned long)stats.latency_last_ms, (unsigned long)stats.latency_avg_ms,
+             (unsigned long)stats.latency_max_ms, (unsigned long)stats.dropped,
+             (unsigned long)stats.window_full);
+    ESP_LOGI(TAG, "MQTT cola: pico %lu B, %lu en espera, %lu viejos/%lu nuevos descartados, %lu fusionados, %lu/%lu a NVS en %lu escrituras (%lu errores)",
+             (unsigned long)stats.outbox.peak_bytes, (unsigned long)stats.outbox.queued,
+             (unsigned long)stats.outbox.dropped_oldest, (unsigned long)stats.outbox.dropped_newest,
+             (unsigned long)stats.outbox.coalesced, (unsigned long)stats.outbox.unspilled,
+             (unsigned long)stats.outbox.spilled, (unsigned long)stats.outbox.spill_writes,
+             (unsigned long)stats.outbox.spill_errors);
+
+    pool_stats_t pool;
+    pool_get_stats(&pool);
+    ESP_LOGI(TAG, "Pool: pico %u/%u bloques, %lu prestamos, %lu sin lugar, %lu devoluciones invalidas",
+             pool.peak, POOL_BLOCK_COUNT, (unsigned long)pool.taken, (unsigned long)pool.exhausted,
+             (unsigned long)pool.invalid);
+}
+
+
+/**
+ * @brief Informa la carga de cada nucleo desde el ciclo con red anterior.
+ */
+static void data_log_cpu_load(void) {
+    placement_load_t load;
+
+    if (placement_measure_load(&load) != ESP_OK) return;   // Primera ventana o sin estadisticas de FreeRTOS
+#if portNUM_PROCESSORS > 1
+    ESP_LOGI(TAG, "Carga: PRO_CPU %u%%, APP_CPU %u%% (ventana %lu ms)",
+             load.load_pct[PRO_CPU_NUM], load.load_pct[APP_CPU_NUM], (unsigned long)load.window_ms);
+#else
+    ESP_LOGI(TAG, "Carga: %u%% (ventana %lu ms)", load.load_pct[0], (unsigned long)load.window_ms);
+#endif
+}
+
+
+/**
+ * @brief Verifica el heap en el mismo punto de cada ciclo con red. El primer ciclo completo toma
+ * la foto de referencia (Memory/memory.h).
+ */
+static void data_check_memory(void) {
+    memory_report_t report;
+
+    if (!memory_is_steady()) {
+        memory_mark_steady();
+        return;
+    }
+    if (memory_check(&report) != ESP_OK) {
+        ESP_LOGW(TAG, "Heap: %ld bloques, %ld B respecto del regimen, bloque libre %lu/%lu B, %lu reservas en tareas propias (ultima: %s, %lu B)",
+                 (long)report.blocks_delta, (long)report.bytes_delta,
+                 (unsigned long)report.largest_free, (unsigned long)report.largest_baseline,
+                 (unsigned long)report.task_allocs, report.last_task ? report.last_task : "-",
+                 (unsigned long)report.last_size);
     }
 }
 
+
+void data_json_encrypt_task(void *pvParameters) {
+    data_sensors_t report;
+    const data_sensors_t *burst;
+    settings_runtime_t runtime;
+    sched_due_t due;
+    int64_t wake_us = 0;   // Despertar planificado del ciclo (0: primer ciclo)
+
+    data_accum_init();
+
+    while (1) {
+        // Una copia por ciclo: un cambio por el topic de control se aplica completo en el ciclo siguiente
+        setting_get_runtime(&runtime);
+        mq135_calibration_request(runtime.mq135_calib_seq, power_now_us());
+        scheduler_poll(power_now_us(), &runtime, &due);
+
+        if (due.sample_mask) {
+            data_sample_sensors(due.sample_mask);
+            power_timeline_mark(POWER_MARK_SAMPLE);
+            if (wake_us != 0) audit_response(PLACEMENT_DATA, power_now_us() - wake_us);   // Despertar -> muestreo completo
+        }
+
+        // La red solo se necesita cuando el lote de reportes que superaron la banda muerta esta completo
+        if (due.report) {
+            data_build_report(&report, runtime.sensor_mask);
+            if (data_report_passes(&report, &runtime, power_now_us())
+                && power_store_sample(&report, runtime.batch_size)) {
+                uint8_t count = power_get_samples(&burst);
+                if (data_network_up() == ESP_OK) {
+                    power_timeline_mark(POWER_MARK_NET_UP);
+                    uint8_t taken = data_publish_burst(burst, count, &runtime);
+                    bool flushed = (mqtt_client_flush(&mqtt_client, DATA_MQTT_FLUSH_TIMEOUT_MS) == ESP_OK);
+                    if (flushed) {
+                        power_timeline_mark(POWER_MARK_PUBLISHED);
+                    }
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP
+                    // La RAM del cliente no sobrevive al deep sleep: el lote en RTC es la unica copia
+                    // hasta la confirmacion. Sin ella se retiran las copias en espera (tambien las de
+                    // NVS) para que el proximo reporte no las entregue dos veces
+                    if (flushed) power_consume_samples(taken);
+                    else mqtt_client_discard_topic(&mqtt_client, MQTT_TOPIC_TELEMETRY);
+#else
+                    // Lo aceptado pasa a ser del cliente (ventana, cola en espera y NVS), que lo
+                    // reintenta; el lote conserva solo lo que no se pudo entregar
+                    power_consume_samples(taken);
+#endif
+                    data_log_mqtt_stats();
+                    data_log_cpu_load();
+                    data_check_memory();
+                }   // Sin red: el lote queda en RTC y se reintenta en el proximo reporte
+
+#if POWER_MODE != POWER_MODE_ALWAYS_ON
+                // El radio solo permanece encendido durante la rafaga
+                memory_exempt_begin();
+                mqtt_client_stop(&mqtt_client);
+                wifi_manager_disconnect();
+                memory_exempt_end();
+#endif
+            }
+        }
+
+        wake_us = scheduler_next_wake();
+        power_sleep_until(wake_us);
+    }
+}
@@ -49,26 +49,38 @@ esp_err_t dht11_read_data(void) {
     // Reiniciar datos
     memset(&dht11_data, 0, sizeof(dht11_data));
 
-    // Deshabilitar interrupciones
-    portENTER_CRITICAL(&mux);
+    // Pulso de inicio fuera de la seccion critica: alargarlo no afecta al sensor y el nucleo queda libre.
+    // Un tick de mas garantiza el minimo de 18 ms con la resolucion de pdMS_TO_TICKS
     gpio_set_direction(DHT11_PIN, GPIO_MODE_OUTPUT);
     gpio_set_level(DHT11_PIN, 0); // Pull down
-    ets_delay_us(DHT11_START_SIGNAL_LOW); // 20 ms
+    vTaskDelay(pdMS_TO_TICKS(DHT11_START_SIGNAL_LOW / 1000) + 1); // >= 20 ms
+
+    // Deshabilitar interrupciones solo durante la respuesta y los 40 bits (~5 ms)
+    portENTER_CRITICAL(&mux);
     gpio_set_level(DHT11_PIN, 1); // Pull up
     ets_delay_us(DHT11_START_SIGNAL_HIGH); // 40 micro s
     gpio_set_direction(DHT11_PIN, GPIO_MODE_INPUT); // Liberar la linea
 
     uint32_t timeout = 0;
     while (gpio_get_level(DHT11_PIN) == 1 && timeout++ < 100) ets_delay_us(1);
-    if (timeout >= 100) return ESP_ERR_TIMEOUT;
+    if (timeout >= 100) {
+        portEXIT_CRITICAL(&mux);
+        return ESP_ERR_TIMEOUT;
+    }
 
     timeout = 0;
     while (gpio_get_level(DHT11_PIN) == 0 && timeout++ < 100) ets_delay_us(1);
-    if (timeout >= 100) return ESP_ERR_TIMEOUT;
+    if (timeout >= 100) {
+        portEXIT_CRITICAL(&mux);
+        return ESP_ERR_TIMEOUT;
+    }
 
     timeout = 0;
     while (gpio_get_level(DHT11_PIN) == 1 && timeout++ < 100) ets_delay_us(1);
-    if (timeout >= 100) return ESP_ERR_TIMEOUT;
+    if (timeout >= 100) {
+        portEXIT_CRITICAL(&mux);
+        return ESP_ERR_TIMEOUT;
+    }
 
     // Leer 40 bits (5 bytes)
     uint8_t data[5] = {0};
@@ -108,6 +120,13 @@ esp_err_t dht11_read_data(void) {
         return ESP_ERR_INVALID_RESPONSE;
     }
 
+    // Punto fijo: el byte decimal esta en decimas y, en la temperatura, lleva el signo en el bit 7
+    dht11_data.hum_value = FX_FROM_INT(data[0]) + FX_FROM_TENTHS(data[1] & DHT11_DECIMAL_MASK);
+    dht11_data.temp_value = FX_FROM_INT(data[2]) + FX_FROM_TENTHS(data[3] & DHT11_DECIMAL_MASK);
+    if (data[3] & DHT11_TEMP_NEGATIVE) {
+        dht11_data.temp_value = -dht11_data.temp_value;
+    }
+
     return ESP_OK;
 }
 
@@ -122,5 +141,7 @@ void dht11_init(void) {
     dht11_data.temperature = 0;
     dht11_data.temp_decimal = 0;
     dht11_data.checksum = 0;
+    dht11_data.temp_value = 0;
+    dht11_data.hum_value = 0;
 }
 
@@ -3,6 +3,9 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "KY037/ky037.h"
+#include "Audit/audit.h"
+#include "Memory/memory.h"
+#include "Placement/placement.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "esp_timer.h"
@@ -14,12 +17,17 @@ static const char *TAG = "KY037";
 
 ky037_stats_t ky037_stats;                // Estructura de estadisticas
 static TaskHandle_t xStatsTaskHandle = NULL;     // Handle de la tarea que procesa eventos (notificaciones desde ISR)
-static TaskHandle_t xGetStatsTaskHandle = NULL;  // Handle de la tarea que consolida estadísticas periódicamente
 SemaphoreHandle_t xStatsMutex = NULL;     // Mutex para proteger acceso concurrente a ky037_stats
+static StaticSemaphore_t xStatsMutexBuffer;
+#if MEMORY_STATIC
+static StackType_t xStatsTaskStack[KY037_STATS_STACK];
+static StaticTask_t xStatsTaskBuffer;
+#endif
 
 // Variables para ISR
 static volatile uint32_t isr_init_high_time = 0;     // Guarda el tiempo de inicio del pulso alto
 static volatile bool isr_service_installed = false;  // Flag que indica si ya se instalo el servicio de ISR del driver GPIO
+static volatile uint32_t isr_edge_us = 0;            // Primer flanco sin atender (us, 32 bits: escritura atomica); 0 = ninguno
 
 
 /**
@@ -36,6 +44,7 @@ static uint32_t get_time_ms(void) {
 static void IRAM_ATTR gpio_isr_handler(void* arg) {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     if (xStatsTaskHandle != NULL) {   // Solo notificar si la tarea existe
+        if (isr_edge_us == 0) isr_edge_us = (uint32_t)esp_timer_get_time() | 1;   // Inicio del tiempo de respuesta
         vTaskNotifyGiveFromISR(xStatsTaskHandle, &xHigherPriorityTaskWoken);  // Despertar a la tarea para que atienda la interrupcion
         if (xHigherPriorityTaskWoken) {   // Si la tarea que estaba ejecutandose es de menor prioridad, minimizar la latencia del context switching
             portYIELD_FROM_ISR();
@@ -70,10 +79,25 @@ void vStatsTask(void *pvParameters) {
             }
             xSemaphoreGive(xStatsMutex);
         }
+
+        uint32_t edge_us = isr_edge_us;
+        isr_edge_us = 0;
+        if (edge_us != 0) audit_response(PLACEMENT_KY037_STATS, (uint32_t)esp_timer_get_time() - edge_us);   // Flanco -> fin del procesamiento
     }
 }
 
 
+/**
+ * @brief Simula un flanco desde una tarea (reproduccion de estres de Audit/audit.h): despierta a
+ * vStatsTask igual que la ISR, que procesa el nivel real del pin.
+ */
+void ky037_simulate_edge(void) {
+    if (xStatsTaskHandle == NULL) return;
+    if (isr_edge_us == 0) isr_edge_us = (uint32_t)esp_timer_get_time() | 1;
+    xTaskNotifyGive(xStatsTaskHandle);
+}
+
+
 
 /**
  * @brief Inicializa el sensor KY037 con interrupciones en ambos flancos
@@ -94,31 +118,23 @@ esp_err_t ky037_init(void) {
         return ret;
     }
 
-    xStatsMutex = xSemaphoreCreateMutex();
-    if (xStatsMutex == NULL) {
-        ESP_LOGE(TAG, "- ERROR: Error creando semaforo -");
-        return ESP_ERR_NO_MEM;
-    }
+    xStatsMutex = xSemaphoreCreateMutexStatic(&xStatsMutexBuffer);
 
     memset(&ky037_stats, 0, sizeof(ky037_stats_t));
 
     isr_init_high_time = 0;
-    BaseType_t task_result;
-
-    // Crear tarea vStatsTask
-    task_result = xTaskCreate(
-        vStatsTask,
-        "ky037_stats",
-        2048,
-        NULL,
-        5,
-        &xStatsTaskHandle
-    );
-
-    if (task_result != pdPASS) {
+
+    // Crear tarea vStatsTask (nucleo de red, lejos de la seccion critica del DHT11: ver Placement/placement.h)
+#if MEMORY_STATIC
+    xStatsTaskHandle = placement_create(PLACEMENT_KY037_STATS, vStatsTask, NULL, xStatsTaskStack, &xStatsTaskBuffer);
+#else
+    xStatsTaskHandle = placement_create(PLACEMENT_KY037_STATS, vStatsTask, NULL, NULL, NULL);
+#endif
+
+    if (xStatsTaskHandle == NULL) {
         ESP_LOGE(TAG, "- ERROR: Error creando tarea vStatsTask -");
         vSemaphoreDelete(xStatsMutex);
-        vTaskDelete(NULL);  // Finaliza esta tarea en caso de error
+        return ESP_ERR_NO_MEM;   // El llamador puede ser una tarea de arranque: no eliminarla
     }
 
     // Instalar servicio ISR si aún no está instalado
@@ -126,10 +142,9 @@ esp_err_t ky037_init(void) {
         ret = gpio_install_isr_service(0);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "- ERROR: Error instalando servicio ISR: %s -", esp_err_to_name(ret));
-            vTaskDelete(xStatsTaskHandle);
-            vTaskDelete(xGetStatsTaskHandle);
+            placement_delete(PLACEMENT_KY037_STATS);
             vSemaphoreDelete(xStatsMutex);
-            vTaskDelete(NULL);
+            return ret;
         }
         isr_service_installed = true;
     }
@@ -138,12 +153,12 @@ esp_err_t ky037_init(void) {
     ret = gpio_isr_handler_add(KY037_PIN, gpio_isr_handler, NULL);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error añadiendo ISR handler: %s", esp_err_to_name(ret));
-        vTaskDelete(xStatsTaskHandle);
-        vTaskDelete(xGetStatsTaskHandle);
+        placement_delete(PLACEMENT_KY037_STATS);
         vSemaphoreDelete(xStatsMutex);
-        vTaskDelete(NULL);
+        return ret;
     }
 
+    memory_watch_task(xStatsTaskHandle);
     return ESP_OK;
 }
 
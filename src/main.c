@@ -3,35 +3,62 @@
 #include "freertos/semphr.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include <stdio.h>
 
+#include "Audit/audit.h"
+#include "Boot/boot.h"
+#include "Control/control.h"
 #include "Data/data.h"
 #include "DHT11/dht11.h"
 #include "KY037/ky037.h"
+#include "Memory/memory.h"
+#include "MQ135/mq135.h"
+#include "Placement/placement.h"
 #include "MQTT/mqtt.h"
+#include "Power/power.h"
 #include "Setting/settings.h"
+#include "Status/status.h"
+#include "WiFi/wifi_manager.h"
 
 
 
 
 static const char *TAG = "MAIN";
-SemaphoreHandle_t config_done_sem;
 QueueHandle_t queue_data = NULL;
+#if MEMORY_STATIC
+static uint8_t queue_data_storage[DATA_QUEUE_LEN * sizeof(data_sensors_t)];
+static StaticQueue_t queue_data_buffer;
+static StackType_t data_task_stack[DATA_TASK_STACK];
+static StaticTask_t data_task_buffer;
+#endif
+#if !MQTT_USE_TLS
+static char mqtt_uri[SETTINGS_MAX_STRING_LEN + 16];
+#endif
+
+
+/* ----- Pasos de arranque ----- */
+enum { STEP_NVS = 0, STEP_CONFIG, STEP_SENSORS, STEP_MQ135, STEP_WIFI, STEP_MQTT, STEP_COUNT };
 
 
 /**
- * @brief Tarea de configuracion del sistema a traves de UART
- * @param pvParameters
+ * @brief Inicializa la particion NVS.
  */
-static void uart_config_task(void *pvParameters) {
-    // 1. Inicializar NVS
+static esp_err_t boot_step_nvs(void) {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
-    ESP_ERROR_CHECK(ret);
+    return ret;
+}
+
+
+/**
+ * @brief Carga la configuracion desde NVS o entra al modo configuracion por UART si no existe.
+ */
+static esp_err_t boot_step_config(void) {
+    esp_err_t ret = ESP_OK;
 
-    // 2. Cargar configuración si existe
     if (!setting_load_from_nvs()) {   //    No existe
         bool flag = false;
         while (!flag) {
@@ -44,34 +71,106 @@ static void uart_config_task(void *pvParameters) {
     }
 
     show_config();
-    xSemaphoreGive(config_done_sem);   // Cuando esta todo listo, liberar el semaforo
-    vTaskDelete(NULL); // Termina esta tarea
+    return ret;
+}
+
+
+/**
+ * @brief Inicializa los sensores. El DHT11 necesita 1 s de estabilizacion, que transcurre en
+ * paralelo con la carga de configuracion y la inicializacion del WiFi.
+ */
+static esp_err_t boot_step_sensors(void) {
+    dht11_init();
+    return ky037_init();
+}
+
+
+/**
+ * @brief Inicializa el ADC del MQ135 y carga su calibracion de R0 desde NVS.
+ */
+static esp_err_t boot_step_mq135(void) {
+    return mq135_init();
+}
+
+
+/**
+ * @brief Inicializa la pila de red y el driver WiFi (sin encender el radio).
+ */
+static esp_err_t boot_step_wifi(void) {
+    return wifi_manager_init();
+}
+
+
+/**
+ * @brief Configura el cliente MQTT con los datos de la configuracion, arma la tabla de topics, el
+ * last will con el estado retenido y registra el topic de control.
+ */
+static esp_err_t boot_step_mqtt(void) {
+    esp_err_t ret;
+
+#if MQTT_USE_TLS
+    mqtt_client_init(&mqtt_client, NULL, settings.mqtt_user, settings.mqtt_password);
+    ret = mqtt_client_enable_tls(&mqtt_client, settings.mqtt_host, settings.mqtt_port);
+    if (ret != ESP_OK) return ret;
+#else
+    snprintf(mqtt_uri, sizeof(mqtt_uri), "mqtt://%s:%u", settings.mqtt_host, settings.mqtt_port);
+    mqtt_client_init(&mqtt_client, mqtt_uri, settings.mqtt_user, settings.mqtt_password);
+#endif
+    ret = mqtt_client_set_topics(&mqtt_client, settings.device_name);
+    if (ret != ESP_OK) return ret;
+    ret = status_init();   // Last will y estado retenido
+    if (ret != ESP_OK) return ret;
+    return control_init();   // Topic de control para reconfiguracion remota
 }
 
 
+static const boot_step_t boot_steps[STEP_COUNT] = {
+    [STEP_NVS]     = { "boot_nvs",     boot_step_nvs,     0,                                       3072, 6, PLACEMENT_CORE_NETWORK },
+    [STEP_CONFIG]  = { "boot_config",  boot_step_config,  BOOT_DEP(STEP_NVS),                      4096, 6, PLACEMENT_CORE_NETWORK },
+    [STEP_SENSORS] = { "boot_sensors", boot_step_sensors, 0,                                       3072, 6, PLACEMENT_CORE_NETWORK },   // ISR del KY037 fuera del nucleo del DHT11
+    [STEP_MQ135]   = { "boot_mq135",   boot_step_mq135,   BOOT_DEP(STEP_NVS),                      3072, 6, PLACEMENT_CORE_SENSORS },
+    [STEP_WIFI]    = { "boot_wifi",    boot_step_wifi,    BOOT_DEP(STEP_NVS),                      4096, 6, PLACEMENT_CORE_NETWORK },
+    [STEP_MQTT]    = { "boot_mqtt",    boot_step_mqtt,    BOOT_DEP(STEP_CONFIG) | BOOT_DEP(STEP_WIFI), 3072, 6, PLACEMENT_CORE_NETWORK },
+};
+
+
 
 
 
 void app_main(void) {
-    config_done_sem = xSemaphoreCreateBinary();
-    if (config_done_sem == NULL) {
-        ESP_LOGE(TAG, "- ERROR: Error creando el semaforo -");
-        return;
-    }
+    power_init();   // Puede volver a dormir directamente si el despertar fue solo por el KY037
 
-    queue_data = xQueueCreate(10, sizeof(data_sensors_t));
+#if MEMORY_STATIC
+    queue_data = xQueueCreateStatic(DATA_QUEUE_LEN, sizeof(data_sensors_t), queue_data_storage, &queue_data_buffer);
+#else
+    queue_data = xQueueCreate(DATA_QUEUE_LEN, sizeof(data_sensors_t));
+#endif
     if (queue_data == NULL) {
         ESP_LOGE(TAG, "- ERROR: Error creando la cola de sensores -");
         return;
     }
 
-    // Crear tarea de configuracion UART
-    xTaskCreate(uart_config_task, "uart_config_task", 4096, NULL, 6, NULL);
+    // Inicializacion en paralelo: sensores, NVS/configuracion y WiFi
+    if (boot_run(boot_steps, STEP_COUNT) != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: Fallo algun paso de arranque -");
+    }
 
-    // Esperar a que la configuracion este lista
-    if (xSemaphoreTake(config_done_sem, portMAX_DELAY)) {
-        dht11_init();
-        ky037_init();
-        xTaskCreate(data_json_encrypt_task, "data_json_encrypt_task", 4096, NULL, 6, NULL);
+    power_timeline_mark(POWER_MARK_READY);
+#if MEMORY_STATIC
+    TaskHandle_t data_task = placement_create(PLACEMENT_DATA, data_json_encrypt_task, NULL,
+                                              data_task_stack, &data_task_buffer);
+#else
+    TaskHandle_t data_task = placement_create(PLACEMENT_DATA, data_json_encrypt_task, NULL, NULL, NULL);
+#endif
+    if (data_task == NULL) {
+        ESP_LOGE(TAG, "- ERROR: Error creando la tarea de datos -");
+        return;
+    }
+    memory_watch_task(data_task);
+
+#if AUDIT_ENABLED
+    if (audit_start() != ESP_OK) {   // Modo diagnostico: reproduccion de estres e informe de pilas y prioridades
+        ESP_LOGE(TAG, "- ERROR: No se pudo iniciar la auditoria -");
     }
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,138 @@
+#include "Memory/memory.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <string.h>
+
+
+static const char *TAG = "MEMORY";
+
+
+/* ----- Tarea vigilada por los hooks del heap ----- */
+typedef struct {
+    TaskHandle_t task;
+    volatile uint8_t exempt;   // Profundidad de memory_exempt_begin (llamadas a bibliotecas)
+} memory_watch_t;
+
+
+static memory_watch_t watched[MEMORY_WATCH_MAX];
+static volatile uint8_t watch_count = 0;
+static volatile bool steady = false;
+static multi_heap_info_t baseline;           // Foto del heap al entrar en regimen estacionario
+static volatile uint32_t task_allocs = 0;    // Diagnostico: los incrementos desde dos nucleos pueden perderse
+static volatile TaskHandle_t last_task = NULL;
+static volatile uint32_t last_size = 0;
+
+
+/**
+ * @brief Entrada de la tarea actual en la tabla de vigiladas, o NULL si no esta registrada.
+ */
+static IRAM_ATTR memory_watch_t *memory_find(TaskHandle_t task) {
+    for (uint8_t i = 0; i < watch_count; i++) {
+        if (watched[i].task == task) return &watched[i];
+    }
+    return NULL;
+}
+
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+/**
+ * @brief Hook del heap de ESP-IDF: se invoca en cada reserva. No puede reservar ni bloquear.
+ */
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    if (!steady) return;
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    memory_watch_t *watch = memory_find(task);
+    if (watch != NULL && watch->exempt == 0) {
+        task_allocs++;
+        last_task = task;
+        last_size = (uint32_t)size;
+    }
+}
+
+
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr) {
+}
+#endif
+
+
+/**
+ * @brief Registra una tarea propia: sus reservas en regimen estacionario cuentan como error.
+ * Debe llamarse antes de memory_mark_steady.
+ */
+void memory_watch_task(TaskHandle_t task) {
+    if (task == NULL || watch_count >= MEMORY_WATCH_MAX || memory_find(task) != NULL) return;
+    watched[watch_count].task = task;
+    watched[watch_count].exempt = 0;
+    watch_count++;
+}
+
+
+/**
+ * @brief Marca el inicio de una llamada a WiFi, lwIP o esp-mqtt desde la tarea actual: sus
+ * reservas internas no se cuentan (si quedan retenidas, aparecen en el balance).
+ */
+void memory_exempt_begin(void) {
+    memory_watch_t *watch = memory_find(xTaskGetCurrentTaskHandle());
+    if (watch != NULL) watch->exempt++;
+}
+
+
+void memory_exempt_end(void) {
+    memory_watch_t *watch = memory_find(xTaskGetCurrentTaskHandle());
+    if (watch != NULL && watch->exempt > 0) watch->exempt--;
+}
+
+
+/**
+ * @brief Toma la foto del heap de referencia. Se llama al terminar el primer ciclo completo,
+ * cuando ya se crearon todos los objetos permanentes y la conexion quedo establecida.
+ */
+void memory_mark_steady(void) {
+    heap_caps_get_info(&baseline, MALLOC_CAP_DEFAULT);
+    task_allocs = 0;
+    last_task = NULL;
+    last_size = 0;
+    steady = true;
+    ESP_LOGI(TAG, "Regimen estacionario: %u bloques, %u B en uso, %u B libres (bloque max %u B)",
+             (unsigned)baseline.allocated_blocks, (unsigned)baseline.total_allocated_bytes,
+             (unsigned)baseline.total_free_bytes, (unsigned)baseline.largest_free_block);
+}
+
+
+bool memory_is_steady(void) {
+    return steady;
+}
+
+
+/**
+ * @brief Compara el heap actual contra la foto estacionaria. Debe llamarse en el mismo punto
+ * de cada ciclo para que el balance sea comparable.
+ * @param report Detalle de la comparacion (se completa aunque falle).
+ * @return esp_err_t  ESP_OK si no hubo reservas en tareas vigiladas ni deriva del heap;
+ * ESP_FAIL si las hubo; ESP_ERR_INVALID_STATE si aun no se llamo a memory_mark_steady.
+ */
+esp_err_t memory_check(memory_report_t *report) {
+    multi_heap_info_t info;
+
+    memset(report, 0, sizeof(*report));
+    if (!steady) return ESP_ERR_INVALID_STATE;
+
+    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+    report->blocks_delta = (int32_t)info.allocated_blocks - (int32_t)baseline.allocated_blocks;
+    report->bytes_delta = (int32_t)info.total_allocated_bytes - (int32_t)baseline.total_allocated_bytes;
+    report->largest_free = (uint32_t)info.largest_free_block;
+    report->largest_baseline = (uint32_t)baseline.largest_free_block;
+    report->task_allocs = task_allocs;
+    report->last_task = last_task ? pcTaskGetName(last_task) : NULL;
+    report->last_size = last_size;
+
+    if (report->task_allocs > 0
+        || report->blocks_delta > MEMORY_SLACK_BLOCKS
+        || report->bytes_delta > MEMORY_SLACK_BYTES
+        || report->largest_free + MEMORY_SLACK_BYTES < report->largest_baseline) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
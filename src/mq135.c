@@ -0,0 +1,433 @@
+#include "MQ135/mq135.h"
+#include "Baseline/baseline.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include <string.h>
+
+
+static const char *TAG = "MQ135";
+
+_Static_assert(MQ135_GAS_COUNT == DATA_GAS_COUNT, "data_sensors_t.gas_ppm debe tener un valor por gas");
+
+
+/* ---- Formato del blob de calibracion en NVS ---- */
+typedef struct {
+    uint32_t magic;      // MQ135_CALIB_MAGIC
+    uint16_t version;    // MQ135_CALIB_VERSION al momento de guardar
+    uint16_t length;     // sizeof(mq135_calib_t) al momento de guardar
+    uint32_t crc;        // CRC32 de data
+} mq135_calib_header_t;
+
+typedef struct {
+    int32_t log2_r0[MQ135_GAS_COUNT];   // R0 aprendido por gas (log2 Q16; v1 y v2: float en ohmios)
+    baseline_t baseline;                // v2: picos diarios de la resistencia corregida
+    uint32_t calib_seq;                 // v4: ultimo pedido de recalibracion atendido (settings_t.mq135_calib_seq)
+} mq135_calib_t;
+
+typedef struct {
+    mq135_calib_header_t header;
+    mq135_calib_t data;
+} mq135_calib_blob_t;
+
+
+/* ----- Aprendizaje de R0 en curso (se conserva en deep sleep) ----- */
+typedef struct {
+    uint32_t magic;      // MQ135_CALIB_MAGIC si el estado es valido
+    bool active;
+    int64_t start_us;    // Inicio del periodo de aprendizaje
+    uint32_t count;      // Muestras tomadas (la resistencia alimenta tracking.baseline)
+    uint32_t seq;        // Pedido de recalibracion que lo inicio (0: aprendizaje del primer arranque)
+} mq135_burnin_t;
+
+
+/* ----- Seguimiento de R0 posterior al aprendizaje (se conserva en deep sleep) ----- */
+typedef struct {
+    uint32_t magic;                  // MQ135_CALIB_MAGIC si el estado es valido
+    baseline_t baseline;
+    int32_t log2_r0[MQ135_GAS_COUNT];   // R0 vigente (puede diferir de NVS en menos de MQ135_R0_SAVE_DELTA)
+    bool has_r0;
+    uint8_t days_since_checkpoint;   // Dias cerrados desde la ultima escritura en NVS
+} mq135_tracking_t;
+
+
+/* ----- Cache del factor de compensacion (depende solo de la ultima lectura del DHT11) ----- */
+typedef struct {
+    bool valid;
+    fx_t temperature;
+    fx_t humidity;
+    int32_t factor;      // Millonesimas
+} mq135_correction_t;
+
+
+static mq135_curve_t gases[MQ135_GAS_COUNT];
+static adc_oneshot_unit_handle_t adc_handle = NULL;
+static adc_cali_handle_t cali_handle = NULL;
+static bool calibrated = false;                  // R0 cargado de NVS o aprendido
+static uint32_t calib_seq = 0;                   // Ultimo pedido de recalibracion atendido
+static mq135_correction_t correction;
+static RTC_DATA_ATTR mq135_burnin_t burnin;
+static RTC_DATA_ATTR mq135_tracking_t tracking;
+
+
+/* ----- Parametros de la curva escalados en compilacion ----- */
+#define MQ135_MILLI(x)   ((uint32_t)((x) * 1000.0 + 0.5))
+#define MQ135_CURVE(curve, gas) \
+    mq135_curve_init((curve), MQ135_MILLI(gas##_A), MQ135_Q16(gas##_B), MQ135_MILLI(ATM_##gas), gas##_R0)
+
+
+/**
+ * @brief log2 en Q16 de un float IEEE 754 positivo guardado por un blob v1 o v2, sin operar en float.
+ * @return bool  Devuelve false si el valor no es un numero finito mayor que 0.
+ */
+static bool mq135_log2_from_float_bits(const int32_t *stored, int32_t *out) {
+    uint32_t bits;
+    memcpy(&bits, stored, sizeof(bits));
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF);
+
+    if ((bits >> 31) != 0 || exponent == 0 || exponent == 0xFF) return false;
+    *out = mq135_log2((bits & 0x7FFFFF) | 0x800000) + (exponent - 127 - 23) * MQ135_Q16_ONE;
+    return true;
+}
+
+
+/**
+ * @brief Inicializa los parametros de los gases con el R0 por defecto.
+ */
+void mq135_init_gas(void) {
+    MQ135_CURVE(&gases[MQ135_GAS_CO2], CO2);
+    MQ135_CURVE(&gases[MQ135_GAS_CO], CO);
+    MQ135_CURVE(&gases[MQ135_GAS_NH3], NH3);
+    MQ135_CURVE(&gases[MQ135_GAS_C6H6], C6H6);
+    MQ135_CURVE(&gases[MQ135_GAS_NO2], NO2);
+}
+
+
+/**
+ * @brief Lee de NVS el R0 de cada gas y el estado de la linea base. Un blob v1 no tiene linea base:
+ * la historia se reinicia. Los blobs v1 y v2 guardaban R0 en float: se convierte a log2.
+ * @return bool  Devuelve true si habia una calibracion valida.
+ */
+static bool mq135_load_calibration(void) {
+    mq135_calib_blob_t blob;
+    size_t size = sizeof(blob);
+    const size_t header_size = sizeof(blob.header);
+    nvs_handle_t nvs_handle;
+
+    memset(&blob, 0, sizeof(blob));   // Un blob de una version anterior es mas corto
+    if (nvs_open(MQ135_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) return false;
+    esp_err_t ret = nvs_get_blob(nvs_handle, MQ135_NVS_CALIB_KEY, &blob, &size);
+    nvs_close(nvs_handle);
+
+    const mq135_calib_header_t *header = &blob.header;
+    if (ret != ESP_OK || size < header_size || header->magic != MQ135_CALIB_MAGIC
+        || header->version > MQ135_CALIB_VERSION || header->length > sizeof(blob.data)
+        || size != header_size + header->length
+        || esp_rom_crc32_le(0, (const uint8_t *)&blob.data, header->length) != header->crc) {
+        return false;
+    }
+
+    int32_t log2_r0[MQ135_GAS_COUNT];
+    for (int i = 0; i < MQ135_GAS_COUNT; i++) {
+        if (header->version >= 3) {
+            log2_r0[i] = blob.data.log2_r0[i];
+        }
+        else if (!mq135_log2_from_float_bits(&blob.data.log2_r0[i], &log2_r0[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < MQ135_GAS_COUNT; i++) {
+        gases[i].log2_r0 = log2_r0[i];
+    }
+    calib_seq = (header->version >= 4) ? blob.data.calib_seq : 0;
+
+    // El estado en RTC es mas reciente que el de NVS si se viene de deep sleep
+    if (tracking.magic != MQ135_CALIB_MAGIC) {
+        memset(&tracking, 0, sizeof(tracking));
+        tracking.magic = MQ135_CALIB_MAGIC;
+        if (header->version >= 2) {
+            tracking.baseline = blob.data.baseline;
+            baseline_restart_day(&tracking.baseline);   // El reloj RTC se reinicio
+        }
+        else {
+            baseline_init(&tracking.baseline);
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Guarda en NVS el R0 actual de cada gas y el estado de la linea base.
+ */
+static esp_err_t mq135_save_calibration(void) {
+    mq135_calib_blob_t blob;
+    nvs_handle_t nvs_handle;
+
+    memset(&blob, 0, sizeof(blob));
+    for (int i = 0; i < MQ135_GAS_COUNT; i++) {
+        blob.data.log2_r0[i] = gases[i].log2_r0;
+    }
+    blob.data.baseline = tracking.baseline;
+    blob.data.calib_seq = calib_seq;
+    blob.header.magic = MQ135_CALIB_MAGIC;
+    blob.header.version = MQ135_CALIB_VERSION;
+    blob.header.length = sizeof(blob.data);
+    blob.header.crc = esp_rom_crc32_le(0, (const uint8_t *)&blob.data, sizeof(blob.data));
+
+    esp_err_t ret = nvs_open(MQ135_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) return ret;
+    ret = nvs_set_blob(nvs_handle, MQ135_NVS_CALIB_KEY, &blob, sizeof(blob));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret == ESP_OK) {
+        tracking.days_since_checkpoint = 0;
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Inicializa el ADC y carga la calibracion de R0. Requiere NVS inicializado. Sin calibracion
+ * guardada, el aprendizaje de R0 arranca con la primera muestra.
+ * @return esp_err_t  Devuelve ESP_OK si el ADC quedo configurado.
+ */
+esp_err_t mq135_init(void) {
+    mq135_init_gas();
+    mq135_clear_cache();
+
+    adc_oneshot_unit_init_cfg_t unit_cfg = { .unit_id = MQ135_ADC_UNIT };
+    esp_err_t ret = adc_oneshot_new_unit(&unit_cfg, &adc_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: Error inicializando el ADC: %s -", esp_err_to_name(ret));
+        return ret;
+    }
+
+    adc_oneshot_chan_cfg_t chan_cfg = { .atten = MQ135_ADC_ATTEN, .bitwidth = MQ135_ADC_BITWIDTH };
+    ret = adc_oneshot_config_channel(adc_handle, MQ135_ADC_CHANNEL, &chan_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: Error configurando el canal: %s -", esp_err_to_name(ret));
+        return ret;
+    }
+
+    adc_cali_line_fitting_config_t cali_cfg = {
+        .unit_id = MQ135_ADC_UNIT,
+        .atten = MQ135_ADC_ATTEN,
+        .bitwidth = MQ135_ADC_BITWIDTH,
+        .default_vref = DEFAULT_VREF,
+    };
+    if (adc_cali_create_scheme_line_fitting(&cali_cfg, &cali_handle) != ESP_OK) {
+        cali_handle = NULL;   // Sin eFuse de calibracion: conversion lineal con VREF
+        ESP_LOGW(TAG, "Sin calibracion de fabrica del ADC, se usa conversion lineal");
+    }
+
+    calibrated = mq135_load_calibration();
+    if (calibrated) {
+        ESP_LOGI(TAG, "R0 cargado de NVS (CO2 %lu ohm)", (unsigned long)mq135_exp2(gases[MQ135_GAS_CO2].log2_r0));
+    }
+    else if (burnin.magic != MQ135_CALIB_MAGIC) {
+        memset(&burnin, 0, sizeof(burnin));
+        burnin.magic = MQ135_CALIB_MAGIC;
+        burnin.active = true;
+        burnin.start_us = -1;   // Se fija con la primera muestra
+    }
+    if (burnin.magic == MQ135_CALIB_MAGIC && burnin.active) {   // Despertar con un aprendizaje en curso
+        calib_seq = burnin.seq;
+    }
+
+    if (tracking.magic != MQ135_CALIB_MAGIC) {
+        memset(&tracking, 0, sizeof(tracking));
+        tracking.magic = MQ135_CALIB_MAGIC;
+        baseline_init(&tracking.baseline);
+    }
+    else if (tracking.has_r0) {   // Despertar de deep sleep: el R0 en RTC es el mas reciente
+        for (int i = 0; i < MQ135_GAS_COUNT; i++) {
+            gases[i].log2_r0 = tracking.log2_r0[i];
+        }
+        calibrated = true;   // Un reaprendizaje pedido sigue en curso con el R0 anterior
+    }
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Lee la resistencia del sensor promediando NUMBER_OF_SAMPLES conversiones.
+ * @param resistance Resistencia de salida en ohmios (sin compensar).
+ * @return esp_err_t  Devuelve ESP_OK si la lectura es valida.
+ */
+esp_err_t mq135_read_resistance(uint32_t *resistance) {
+    int32_t sum = 0;
+    int raw;
+    int mv;
+
+    if (adc_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    for (int i = 0; i < NUMBER_OF_SAMPLES; i++) {
+        esp_err_t ret = adc_oneshot_read(adc_handle, MQ135_ADC_CHANNEL, &raw);
+        if (ret != ESP_OK) return ret;
+        sum += raw;
+    }
+    raw = (int)((sum + NUMBER_OF_SAMPLES / 2) / NUMBER_OF_SAMPLES);
+
+    if (cali_handle == NULL || adc_cali_raw_to_voltage(cali_handle, raw, &mv) != ESP_OK) {
+        mv = (raw * VREF + RESOLUTION / 2) / RESOLUTION;
+    }
+    *resistance = mq135_resistance_from_mv(mv);
+    if (*resistance == 0) return ESP_ERR_INVALID_RESPONSE;   // Sensor desconectado o sin calentar
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Compensa la resistencia por temperatura y humedad. El polinomio se evalua en forma de Horner
+ * con el termino independiente precalculado, y solo cuando cambia la lectura del DHT11.
+ * @param resistance Resistencia medida (ohmios).
+ * @param temperature Temperatura (centesimas de C).
+ * @param humidity Humedad relativa (centesimas de %).
+ * @return uint32_t  Resistencia equivalente en las condiciones de calibracion.
+ */
+uint32_t mq135_get_corrected_resistance(uint32_t resistance, fx_t temperature, fx_t humidity) {
+    if (!correction.valid || correction.temperature != temperature || correction.humidity != humidity) {
+        correction.factor = mq135_correction_factor(temperature, humidity);
+        correction.temperature = temperature;
+        correction.humidity = humidity;
+        correction.valid = true;
+    }
+    return mq135_correct_resistance(resistance, correction.factor);
+}
+
+
+/**
+ * @brief Copia el R0 vigente de cada gas a la memoria RTC.
+ */
+static void mq135_keep_r0(void) {
+    for (int i = 0; i < MQ135_GAS_COUNT; i++) {
+        tracking.log2_r0[i] = gases[i].log2_r0;
+    }
+    tracking.has_r0 = true;
+}
+
+
+/**
+ * @brief Termina el aprendizaje de R0: fija el R0 de cada gas a partir de la linea base acumulada en
+ * aire limpio (concentracion atmosferica), el mismo estimador que usa luego el seguimiento diario, y
+ * lo guarda en NVS.
+ * @param base Linea base (baseline_value) al cerrar el ultimo dia del aprendizaje.
+ */
+static void mq135_burnin_finish(uint32_t base) {
+    mq135_track_r0(gases, MQ135_GAS_COUNT, base, MQ135_R0_UNLIMITED);
+    burnin.active = false;
+    calibrated = true;
+    mq135_keep_r0();
+
+    esp_err_t ret = mq135_save_calibration();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: No se pudo guardar la calibracion: %s -", esp_err_to_name(ret));
+    }
+    ESP_LOGI(TAG, "Calibracion terminada: %lu muestras, linea base %lu ohm, CO2 R0 %lu ohm",
+             (unsigned long)burnin.count, (unsigned long)base, (unsigned long)mq135_exp2(gases[MQ135_GAS_CO2].log2_r0));
+}
+
+
+/**
+ * @brief Alimenta la linea base y, al cerrar cada dia, acerca el R0 de cada gas al que corresponde a la
+ * linea base (aire limpio), con un paso maximo de MQ135_R0_MAX_STEP por dia para absorber la deriva
+ * lenta sin seguir episodios de contaminacion. Durante el aprendizaje la linea base solo se acumula y
+ * R0 se fija al cumplirse MQ135_BURNIN_MS. Guarda en NVS solo si R0 cambio lo suficiente o cada
+ * MQ135_CHECKPOINT_DAYS dias, de modo que la flash se escribe a lo sumo una vez por dia.
+ */
+static void mq135_tracking_update(uint32_t resistance, int64_t now_us) {
+    if (!baseline_update(&tracking.baseline, now_us, resistance)) return;
+
+    tracking.days_since_checkpoint++;
+    uint32_t base = baseline_value(&tracking.baseline);
+    bool changed = false;
+
+    if (burnin.active) {
+        if (base > 0 && now_us - burnin.start_us >= (int64_t)MQ135_BURNIN_MS * 1000) {
+            mq135_burnin_finish(base);   // Guarda en NVS
+        }
+        return;
+    }
+    if (calibrated && base > 0) {
+        changed = mq135_track_r0(gases, MQ135_GAS_COUNT, base, MQ135_R0_MAX_STEP) > MQ135_R0_SAVE_DELTA;
+        mq135_keep_r0();
+    }
+
+    if (changed || tracking.days_since_checkpoint >= MQ135_CHECKPOINT_DAYS) {
+        esp_err_t ret = mq135_save_calibration();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "- ERROR: No se pudo guardar la linea base: %s -", esp_err_to_name(ret));
+        }
+        else {
+            ESP_LOGI(TAG, "Linea base %lu ohm, CO2 R0 %lu ohm", (unsigned long)base,
+                     (unsigned long)mq135_exp2(gases[MQ135_GAS_CO2].log2_r0));
+        }
+    }
+}
+
+
+/**
+ * @brief Toma una muestra completa en una sola pasada: lectura, compensacion, aprendizaje y
+ * seguimiento de R0, y concentracion de cada gas.
+ * @param temperature Ultima temperatura conocida (centesimas de C).
+ * @param humidity Ultima humedad conocida (centesimas de %).
+ * @param now_us Instante de la muestra (reloj que no se reinicia en deep sleep).
+ * @param out Lectura de salida.
+ * @return esp_err_t  Devuelve ESP_OK si la lectura es valida.
+ */
+esp_err_t mq135_sample(fx_t temperature, fx_t humidity, int64_t now_us, mq135_reading_t *out) {
+    uint32_t resistance;
+    esp_err_t ret = mq135_read_resistance(&resistance);
+    if (ret != ESP_OK) return ret;
+
+    out->resistance = mq135_get_corrected_resistance(resistance, temperature, humidity);
+    if (burnin.active) {
+        if (burnin.start_us < 0) burnin.start_us = now_us;
+        burnin.count++;
+    }
+    mq135_tracking_update(out->resistance, now_us);
+
+    for (int i = 0; i < MQ135_GAS_COUNT; i++) {
+        out->ppm[i] = mq135_curve_ppm(&gases[i], out->resistance, MQ135_PPM_MAX);
+    }
+    out->calibrated = calibrated;
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Reinicia el aprendizaje de R0 si seq es un pedido nuevo (clave calib_mq135 por PROV o por el
+ * topic de control). El sensor debe estar en aire limpio: la linea base se descarta para que R0 salga
+ * solo de los picos del periodo de aprendizaje. Hasta terminar se sigue usando el R0 anterior. Si el
+ * aprendizaje se corta por un reinicio, el pedido vuelve a atenderse: NVS guarda seq solo al terminar.
+ * @param seq settings_t.mq135_calib_seq vigente.
+ * @param now_us Inicio del periodo (misma base de tiempo que mq135_sample).
+ */
+void mq135_calibration_request(uint32_t seq, int64_t now_us) {
+    if (seq == calib_seq) return;
+
+    calib_seq = seq;
+    memset(&burnin, 0, sizeof(burnin));
+    burnin.magic = MQ135_CALIB_MAGIC;
+    burnin.active = true;
+    burnin.start_us = now_us;
+    burnin.seq = seq;
+    baseline_init(&tracking.baseline);
+    ESP_LOGI(TAG, "Recalibracion pedida (%lu): aprendizaje de R0 reiniciado", (unsigned long)seq);
+}
+
+
+/**
+ * @brief Invalida el factor de compensacion cacheado.
+ */
+void mq135_clear_cache(void) {
+    memset(&correction, 0, sizeof(correction));
+}
@@ -0,0 +1,176 @@
+#include "MQ135/mq135_model.h"
+
+
+/* ----- 2^(2^-k) en Q30, k = 1..16 (un factor por bit de la fraccion de 2^x) ----- */
+static const uint32_t exp2_table[16] = {
+    1518500250U, 1276901417U, 1170923762U, 1121280436U,
+    1097253708U, 1085434106U, 1079572136U, 1076653033U,
+    1075196443U, 1074468888U, 1074105294U, 1073923544U,
+    1073832680U, 1073787251U, 1073764537U, 1073753181U,
+};
+
+
+/**
+ * @brief Logaritmo en base 2. La parte entera sale de la posicion del bit mas alto y cada bit de la
+ * fraccion de elevar al cuadrado la mantisa normalizada.
+ * @param x Valor (mayor que 0).
+ * @return int32_t  log2(x) en Q16 (INT32_MIN si x es 0).
+ */
+int32_t mq135_log2(uint32_t x) {
+    if (x == 0) return INT32_MIN;
+
+    int n = 31 - __builtin_clz(x);
+    uint64_t m = (uint64_t)x << (31 - n);   // Mantisa en [1, 2), Q31
+    int32_t result = (int32_t)n << 16;
+
+    for (int bit = 15; bit >= 0; bit--) {
+        m = (m * m) >> 31;
+        if (m >= (1ULL << 32)) {
+            m >>= 1;
+            result |= (int32_t)1 << bit;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * @brief Potencia de 2: desplazamiento por la parte entera y producto de la tabla por cada bit de la
+ * fraccion.
+ * @param e Exponente en Q16.
+ * @return uint32_t  2^e redondeado, saturado en UINT32_MAX.
+ */
+uint32_t mq135_exp2(int32_t e) {
+    int32_t n = (e >= 0) ? (e >> 16) : -(int32_t)((0U - (uint32_t)e + 0xFFFF) >> 16);   // Piso
+    uint32_t frac = (uint32_t)(e - n * MQ135_Q16_ONE);
+    uint64_t r = 1ULL << 30;   // Q30
+
+    if (n >= 32) return UINT32_MAX;
+    if (n < -2) return 0;
+    for (int k = 0; k < 16; k++) {
+        if (frac & (0x8000U >> k)) r = (r * exp2_table[k] + (1ULL << 29)) >> 30;
+    }
+
+    int shift = 30 - n;
+    if (shift <= 0) {
+        r <<= -shift;
+        return (r > UINT32_MAX) ? UINT32_MAX : (uint32_t)r;
+    }
+    return (uint32_t)((r + (1ULL << (shift - 1))) >> shift);
+}
+
+
+/**
+ * @brief Precalcula los terminos de la curva de un gas.
+ * @param curve Curva de salida.
+ * @param a_milli Coeficiente A en milesimas.
+ * @param b Exponente B en Q16.
+ * @param atm_milli Concentracion atmosferica en milesimas de ppm.
+ * @param r0 R0 inicial (ohmios).
+ */
+void mq135_curve_init(mq135_curve_t *curve, uint32_t a_milli, int32_t b, uint32_t atm_milli, uint32_t r0) {
+    int32_t log2_a_milli = mq135_log2(a_milli);
+
+    curve->log2_a = log2_a_milli + mq135_log2(FX_SCALE) - mq135_log2(1000);
+    curve->b = b;
+    curve->log2_k = (int32_t)fx_div_round((int64_t)(mq135_log2(atm_milli) - log2_a_milli) * MQ135_Q16_ONE, b);
+    curve->log2_r0 = mq135_log2(r0);
+}
+
+
+/**
+ * @brief Resistencia del sensor a partir de la tension del divisor.
+ * @param mv Tension de salida (mV).
+ * @return uint32_t  Resistencia en ohmios, 0 si la tension esta fuera de rango (sensor desconectado o
+ * sin calentar).
+ */
+uint32_t mq135_resistance_from_mv(int mv) {
+    if (mv <= 0 || mv >= MQ135_VCC_MV) return 0;
+    return (uint32_t)fx_div_round((int64_t)MQ135_RLOAD_OHM * (MQ135_VCC_MV - mv), mv);
+}
+
+
+/**
+ * @brief Factor de compensacion por temperatura y humedad, con el termino independiente precalculado.
+ * Cada termino se divide una sola vez para no acumular redondeos.
+ * @param temperature Temperatura (centesimas de C).
+ * @param humidity Humedad relativa (centesimas de %).
+ * @return int32_t  Factor en millonesimas.
+ */
+int32_t mq135_correction_factor(fx_t temperature, fx_t humidity) {
+    int64_t t = temperature;
+    return (int32_t)(fx_div_round(MQ135_MICRO(CORA) * t * t, FX_SCALE * FX_SCALE)
+                     - fx_div_round(MQ135_MICRO(CORB) * t, FX_SCALE) + COR_K0
+                     - fx_div_round(MQ135_MICRO(CORD) * humidity, FX_SCALE));
+}
+
+
+/**
+ * @brief Aplica el factor de compensacion.
+ * @param resistance Resistencia medida (ohmios).
+ * @param factor Factor en millonesimas (mq135_correction_factor).
+ * @return uint32_t  Resistencia equivalente en las condiciones de calibracion, saturada en UINT32_MAX.
+ */
+uint32_t mq135_correct_resistance(uint32_t resistance, int32_t factor) {
+    if (factor <= 0) return resistance;   // Fuera del rango del polinomio: sin compensar
+    int64_t value = fx_div_round((int64_t)resistance * 1000000, factor);
+    return (value > UINT32_MAX) ? UINT32_MAX : (uint32_t)value;
+}
+
+
+/**
+ * @brief R0 que corresponde a una resistencia medida en aire limpio (concentracion atmosferica).
+ * @return int32_t  log2(R0) en Q16.
+ */
+int32_t mq135_curve_r0(const mq135_curve_t *curve, uint32_t resistance) {
+    return mq135_log2(resistance) + curve->log2_k;
+}
+
+
+/**
+ * @brief Concentracion del gas para una resistencia corregida.
+ * @param ppm_max Tope de la concentracion (centesimas de ppm).
+ * @return fx_t  Concentracion en centesimas de ppm.
+ */
+fx_t mq135_curve_ppm(const mq135_curve_t *curve, uint32_t resistance, fx_t ppm_max) {
+    if (resistance == 0) return ppm_max;
+
+    int64_t ratio = (int64_t)mq135_log2(resistance) - curve->log2_r0;
+    int64_t e = curve->log2_a - fx_div_round((int64_t)curve->b * ratio, MQ135_Q16_ONE);
+    if (e >= (int64_t)31 * MQ135_Q16_ONE) return ppm_max;
+
+    uint32_t ppm = mq135_exp2((int32_t)e);
+    return (ppm > (uint32_t)ppm_max) ? ppm_max : (fx_t)ppm;
+}
+
+
+/**
+ * @brief Acerca R0 al objetivo con un paso acotado (en el dominio log2 el limite relativo es una suma).
+ * @return int32_t  Nuevo log2(R0) en Q16.
+ */
+int32_t mq135_r0_step(int32_t current, int32_t target, int32_t max_step) {
+    if ((int64_t)target > (int64_t)current + max_step) return current + max_step;
+    if ((int64_t)target < (int64_t)current - max_step) return current - max_step;
+    return target;
+}
+
+
+/**
+ * @brief Acerca el R0 de cada gas al que corresponde a la linea base (aire limpio). El aprendizaje
+ * inicial usa MQ135_R0_UNLIMITED y el seguimiento diario un paso acotado: ambos parten del mismo
+ * estimador, de modo que con aire estable R0 no se mueve al terminar el aprendizaje.
+ * @param base Linea base (baseline_value), mayor que 0.
+ * @return int32_t  Mayor cambio de R0 aplicado (log2 Q16, en valor absoluto).
+ */
+int32_t mq135_track_r0(mq135_curve_t *curves, int count, uint32_t base, int32_t max_step) {
+    int32_t moved = 0;
+
+    for (int i = 0; i < count; i++) {
+        int32_t current = curves[i].log2_r0;
+        curves[i].log2_r0 = mq135_r0_step(current, mq135_curve_r0(&curves[i], base), max_step);
+
+        int32_t delta = (curves[i].log2_r0 > current) ? curves[i].log2_r0 - current : current - curves[i].log2_r0;
+        if (delta > moved) moved = delta;
+    }
+    return moved;
+}
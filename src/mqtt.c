@@ -1,10 +1,18 @@
 #include "MQTT/mqtt.h"
+#include "MQTT/mqtt_tls.h"
+#include "Audit/audit.h"
+#include "Placement/placement.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "MQTT";
 
 
+mqtt_client_t mqtt_client;   // Cliente MQTT del dispositivo
+
+
 /* ----- Inicializacion ----- */
 void mqtt_client_init(mqtt_client_t *mqtt, const char *uri,
                       const char *user, const char *pass) {
@@ -21,6 +29,332 @@ void mqtt_client_init(mqtt_client_t *mqtt, const char *uri,
 
     mqtt->client = NULL;   // inicializa el puntero al cliente MQTT como NULL
     mqtt->reconnecting = pdFALSE;   // controla si se esta en modo reconexion
+    mqtt->stopped = pdTRUE;   // el cliente aun no fue iniciado
+    mqtt->events = xEventGroupCreateStatic(&mqtt->events_buffer);
+    mqtt->lock = xSemaphoreCreateMutexStatic(&mqtt->lock_buffer);
+#if MQTT_USE_V5
+    mqtt->config.session.protocol_ver = MQTT_PROTOCOL_V_5;
+#endif
+    mqtt->config.outbox.limit = MQTT_ESP_OUTBOX_LIMIT;   // respaldo: la cola propia ya acota lo que llega a esp-mqtt
+    mqtt_outbox_init(&mqtt->outbox, MQTT_OUTBOX_BUDGET, MQTT_OUTBOX_POLICY);
+    xEventGroupSetBits(mqtt->events, MQTT_WINDOW_BIT);
+    if (mqtt_outbox_empty(&mqtt->outbox)) xEventGroupSetBits(mqtt->events, MQTT_IDLE_BIT);
+}
+
+
+/* ----- Topics -----
+ * Se arman una sola vez: las publicaciones usan el puntero y la longitud ya calculados */
+esp_err_t mqtt_client_set_topics(mqtt_client_t *mqtt, const char *device_name) {
+    static const char *suffixes[MQTT_TOPIC_COUNT] = {
+        [MQTT_TOPIC_TELEMETRY]   = MQTT_SUFFIX_TELEMETRY,
+        [MQTT_TOPIC_DIAGNOSTICS] = MQTT_SUFFIX_DIAGNOSTICS,
+        [MQTT_TOPIC_CONTROL]     = MQTT_SUFFIX_CONTROL,
+        [MQTT_TOPIC_CONTROL_ACK] = MQTT_SUFFIX_CONTROL_ACK,
+        [MQTT_TOPIC_STATUS]      = MQTT_SUFFIX_STATUS,
+    };
+
+    for (int i = 0; i < MQTT_TOPIC_COUNT; i++) {
+        mqtt_topic_t *topic = &mqtt->topics[i];
+        int len = snprintf(topic->name, sizeof(topic->name), "%s%s", device_name, suffixes[i]);
+        if (len < 0 || len >= (int)sizeof(topic->name)) {
+            topic->name[0] = '\0';
+            topic->len = 0;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        topic->len = (uint8_t)len;
+    }
+    return ESP_OK;
+}
+
+
+const char *mqtt_client_topic(const mqtt_client_t *mqtt, mqtt_topic_id_t id) {
+    return mqtt->topics[id].name;
+}
+
+
+/* ----- Last will -----
+ * El broker publica msg en el topic si la conexion se pierde sin DISCONNECT. msg debe seguir
+ * valido mientras exista el cliente */
+esp_err_t mqtt_client_set_will(mqtt_client_t *mqtt, mqtt_topic_id_t id, const char *msg, int qos, int retain) {
+    if (id >= MQTT_TOPIC_COUNT || mqtt->topics[id].len == 0) return ESP_ERR_INVALID_ARG;
+    if (mqtt->client) return ESP_ERR_INVALID_STATE;   // esp-mqtt solo lo toma al crear el cliente
+
+    mqtt->config.session.last_will.topic = mqtt->topics[id].name;
+    mqtt->config.session.last_will.msg = msg;
+    mqtt->config.session.last_will.msg_len = (int)strlen(msg);
+    mqtt->config.session.last_will.qos = qos;
+    mqtt->config.session.last_will.retain = retain;
+    return ESP_OK;
+}
+
+
+void mqtt_client_on_session(mqtt_client_t *mqtt, mqtt_session_cb_t callback) {
+    mqtt->on_session = callback;
+}
+
+
+/* ----- Cola en espera -----
+ * Reinicia la cola con otro presupuesto/politica; los mensajes en RAM se pierden, los derivados a NVS no */
+void mqtt_client_set_outbox(mqtt_client_t *mqtt, uint32_t budget, mqtt_outbox_policy_t policy) {
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    mqtt_outbox_init(&mqtt->outbox, budget, policy);
+    xSemaphoreGive(mqtt->lock);
+}
+
+
+/* ----- Ventana de mensajes en vuelo -----
+ * Cada mensaje QoS>0 ocupa una entrada desde que se publica hasta que el broker lo confirma
+ * (MQTT_EVENT_PUBLISHED) o esp-mqtt lo descarta (MQTT_EVENT_DELETED). Con la ventana llena la
+ * publicacion espera; si no se libera lugar (o no hay conexion) el mensaje pasa a la cola en espera,
+ * que tiene presupuesto fijo, de modo que el outbox de esp-mqtt nunca crece mas alla de la ventana */
+static void mqtt_inflight_update_bits(mqtt_client_t *mqtt) {
+    if (mqtt->inflight_count < MQTT_INFLIGHT_MAX) xEventGroupSetBits(mqtt->events, MQTT_WINDOW_BIT);
+    else xEventGroupClearBits(mqtt->events, MQTT_WINDOW_BIT);
+
+    if (mqtt->inflight_count == 0 && mqtt_outbox_empty(&mqtt->outbox)) xEventGroupSetBits(mqtt->events, MQTT_IDLE_BIT);
+    else xEventGroupClearBits(mqtt->events, MQTT_IDLE_BIT);
+}
+
+
+/* Toma una entrada libre (con el lock tomado); NULL si la ventana esta llena */
+static mqtt_inflight_t *mqtt_inflight_take(mqtt_client_t *mqtt) {
+    if (mqtt->inflight_count >= MQTT_INFLIGHT_MAX) return NULL;
+
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++) {
+        mqtt_inflight_t *entry = &mqtt->inflight[i];
+        if (entry->msg_id != 0) continue;
+        entry->msg_id = -1;
+        mqtt->inflight_count++;
+        mqtt_inflight_update_bits(mqtt);
+        return entry;
+    }
+    return NULL;
+}
+
+
+/* Reserva una entrada para publicar directo, esperando hasta timeout_ms si la ventana esta llena.
+ * Devuelve NULL sin esperar si no hay conexion o si ya hay mensajes en espera (se respeta el orden).
+ * La tarea de esp-mqtt no espera: es la que procesa las confirmaciones que liberan la ventana */
+static mqtt_inflight_t *mqtt_inflight_reserve(mqtt_client_t *mqtt, uint32_t timeout_ms) {
+    TickType_t start = xTaskGetTickCount();
+    bool waited = false;
+
+    if (xTaskGetCurrentTaskHandle() == mqtt->event_task) timeout_ms = 0;
+
+    while (1) {
+        if (!(xEventGroupGetBits(mqtt->events) & MQTT_CONNECTED_BIT)) return NULL;
+
+        xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+        if (!mqtt_outbox_empty(&mqtt->outbox)) {
+            xSemaphoreGive(mqtt->lock);
+            return NULL;
+        }
+        mqtt_inflight_t *entry = mqtt_inflight_take(mqtt);
+        if (entry) {
+            xSemaphoreGive(mqtt->lock);
+            return entry;
+        }
+        if (!waited) {
+            mqtt->stats.window_full++;
+            waited = true;
+        }
+        xSemaphoreGive(mqtt->lock);
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= pdMS_TO_TICKS(timeout_ms)) break;
+        xEventGroupWaitBits(mqtt->events, MQTT_WINDOW_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms) - elapsed);
+    }
+
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    mqtt->stats.window_timeouts++;
+    xSemaphoreGive(mqtt->lock);
+    return NULL;
+}
+
+
+/* Libera una entrada (con el lock tomado) */
+static void mqtt_inflight_free(mqtt_client_t *mqtt, mqtt_inflight_t *entry) {
+    if (entry->msg_id > 0) mqtt->inflight_bytes -= entry->len;
+    memset(entry, 0, sizeof(*entry));
+    mqtt->inflight_count--;
+    mqtt_inflight_update_bits(mqtt);
+}
+
+
+/* Registra la latencia de una confirmacion */
+static void mqtt_inflight_ack_stats(mqtt_client_t *mqtt, int64_t sent_us) {
+    uint32_t latency = (uint32_t)((esp_timer_get_time() - sent_us) / 1000);
+
+    mqtt->stats.acked++;
+    mqtt->stats.latency_last_ms = latency;
+    if (latency > mqtt->stats.latency_max_ms) mqtt->stats.latency_max_ms = latency;
+    mqtt->stats.latency_avg_ms = (mqtt->stats.acked == 1) ? latency
+                                 : (mqtt->stats.latency_avg_ms * 7 + latency) / 8;
+}
+
+
+/* Cierra el mensaje msg_id: confirmado por el broker (acked) o descartado por esp-mqtt */
+static void mqtt_inflight_complete(mqtt_client_t *mqtt, int msg_id, bool acked) {
+    bool found = false;
+
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    for (int i = 0; i < MQTT_INFLIGHT_MAX; i++) {
+        mqtt_inflight_t *entry = &mqtt->inflight[i];
+        if (entry->msg_id != msg_id) continue;
+        if (acked) mqtt_inflight_ack_stats(mqtt, entry->sent_us);
+        else mqtt->stats.dropped++;
+        mqtt_inflight_free(mqtt, entry);
+        found = true;
+        break;
+    }
+    if (!found && acked) {   // La confirmacion le gano a mqtt_client_publish_buffer: se resuelve al registrar
+        mqtt->early_acks[mqtt->early_ack_next].msg_id = msg_id;
+        mqtt->early_acks[mqtt->early_ack_next].at_us = esp_timer_get_time();
+        mqtt->early_ack_next = (mqtt->early_ack_next + 1) % MQTT_INFLIGHT_MAX;
+    }
+    xSemaphoreGive(mqtt->lock);
+}
+
+
+/* ----- Cola en espera -----
+ * Copia el mensaje a la cola (aplicando la politica si no entra) y, si la ventana tiene lugar, pide
+ * a la tarea de esp-mqtt que la vacie */
+static esp_err_t mqtt_client_queue(mqtt_client_t *mqtt, const char *topic, const char *payload,
+                                   int len, int qos, int retain) {
+    size_t payload_len = (len > 0) ? (size_t)len : strlen(payload);
+    bool drain = false;
+    esp_err_t ret;
+
+    if (payload_len > MQTT_OUTBOX_RECORD_MAX) return ESP_ERR_INVALID_SIZE;
+
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    ret = mqtt_outbox_push(&mqtt->outbox, topic, payload, (uint16_t)payload_len, (uint8_t)qos, retain != 0);
+    mqtt_inflight_update_bits(mqtt);
+    drain = (mqtt->inflight_count < MQTT_INFLIGHT_MAX);
+    xSemaphoreGive(mqtt->lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Mensaje a %s descartado por la cola en espera: %s", topic, esp_err_to_name(ret));
+    }
+    else if (drain && (xEventGroupGetBits(mqtt->events) & MQTT_CONNECTED_BIT)) {
+        esp_mqtt_event_t event = { .event_id = MQTT_USER_EVENT };
+        esp_mqtt_dispatch_custom_event(mqtt->client, &event);
+    }
+    return ret;
+}
+
+
+#if MQTT_USE_V5
+/* Copia el campo del sobre que empieza en *cursor hasta ':' y avanza el cursor */
+static bool mqtt5_envelope_field(const char **cursor, const char *end, char *out) {
+    const char *sep = memchr(*cursor, ':', end - *cursor);
+    if (!sep || sep - *cursor >= MQTT5_PROP_MAX_LEN) return false;
+
+    memcpy(out, *cursor, sep - *cursor);
+    out[sep - *cursor] = '\0';
+    *cursor = sep + 1;
+    return true;
+}
+
+
+/* Entrega un mensaje de telemetria con propiedades MQTT 5. Las propiedades valen para el proximo
+ * publish del cliente, por eso solo se llama desde la tarea de esp-mqtt (que tiene su lock).
+ * Solo QoS 0 viaja sin topic: esp-mqtt reenvia los QoS>0 tal como los codifico, y tras una
+ * reconexion el alias ya no esta asociado (el broker cortaria la conexion por Protocol Error) */
+static int mqtt5_enqueue_telemetry(mqtt_client_t *mqtt, const mqtt_outbox_msg_t *msg) {
+    char version[MQTT5_PROP_MAX_LEN];
+    char iv[MQTT5_PROP_MAX_LEN];
+    const char *data = msg->payload;
+    const char *end = msg->payload + msg->len;
+    esp_mqtt5_publish_property_config_t property = {
+        .message_expiry_interval = MQTT5_TELEMETRY_EXPIRY_S,
+    };
+
+    if (mqtt5_envelope_field(&data, end, version) && mqtt5_envelope_field(&data, end, iv)) {
+        esp_mqtt5_user_property_item_t items[] = {
+            { MQTT5_PROP_VERSION, version },
+            { MQTT5_PROP_IV, iv },
+        };
+        if (esp_mqtt5_client_set_user_property(&property.user_property, items, 2) != ESP_OK) {
+            data = msg->payload;   // sin propiedades: se envia el sobre completo
+        }
+    }
+    else {
+        data = msg->payload;
+    }
+
+    const char *topic = msg->topic;
+    if (!mqtt->alias_refused) {
+        property.topic_alias = MQTT5_TELEMETRY_ALIAS;
+        if (esp_mqtt5_client_set_publish_property(mqtt->client, &property) == ESP_OK) {
+            if (mqtt->alias_sent && msg->qos == 0) topic = "";   // el broker ya asocio el alias al topic
+            mqtt->alias_sent = true;
+        }
+        else {   // alias mayor que el maximo del broker (0: no soporta alias)
+            mqtt->alias_refused = true;
+        }
+    }
+    if (mqtt->alias_refused) {
+        property.topic_alias = 0;
+        esp_mqtt5_client_set_publish_property(mqtt->client, &property);
+    }
+
+    int msg_id = esp_mqtt_client_enqueue(mqtt->client, topic, data, end - data, msg->qos, msg->retain, true);
+    if (property.user_property) esp_mqtt5_client_delete_user_property(property.user_property);
+    return msg_id;
+}
+#endif
+
+
+/* Pasa mensajes de la cola a esp-mqtt mientras haya lugar en la ventana. Solo se llama desde el
+ * handler de eventos: la tarea de esp-mqtt ya tiene su lock, asi que encolar con mqtt->lock tomado
+ * no puede cruzarse con un publicador (que nunca llama a esp-mqtt con mqtt->lock tomado) */
+static void mqtt_client_drain(mqtt_client_t *mqtt) {
+    mqtt_outbox_msg_t msg;
+
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    while (mqtt_outbox_front(&mqtt->outbox, &msg)) {
+        mqtt_inflight_t *entry = mqtt_inflight_take(mqtt);
+        if (!entry) break;
+
+#if MQTT_USE_V5
+        int msg_id = (strcmp(msg.topic, mqtt->topics[MQTT_TOPIC_TELEMETRY].name) == 0)
+                     ? mqtt5_enqueue_telemetry(mqtt, &msg)
+                     : esp_mqtt_client_enqueue(mqtt->client, msg.topic, msg.payload, msg.len,
+                                               msg.qos, msg.retain, true);
+#else
+        int msg_id = esp_mqtt_client_enqueue(mqtt->client, msg.topic, msg.payload, msg.len,
+                                             msg.qos, msg.retain, true);
+#endif
+        if (msg_id <= 0) {   // outbox de esp-mqtt lleno: se reintenta con el proximo evento
+            mqtt_inflight_free(mqtt, entry);
+            break;
+        }
+        entry->msg_id = msg_id;
+        entry->sent_us = esp_timer_get_time();
+        entry->len = msg.len;
+        mqtt->inflight_bytes += msg.len;
+        mqtt->stats.published++;
+        mqtt_outbox_pop(&mqtt->outbox);
+    }
+    mqtt_inflight_update_bits(mqtt);
+    xSemaphoreGive(mqtt->lock);
+}
+
+
+/* ----- TLS -----
+ * Reemplaza el transporte SSL de esp-mqtt por uno propio que conserva la sesion TLS entre
+ * reconexiones y deep sleeps, de modo que cada reconexion sea un handshake reanudado */
+esp_err_t mqtt_client_enable_tls(mqtt_client_t *mqtt, const char *host, uint16_t port) {
+    mqtt->transport = mqtt_tls_transport_create();
+    if (!mqtt->transport) return ESP_ERR_NO_MEM;
+
+    mqtt->config.broker.address.uri = NULL;
+    mqtt->config.broker.address.hostname = host;
+    mqtt->config.broker.address.port = port;
+    mqtt->config.broker.address.transport = MQTT_TRANSPORT_OVER_SSL;
+    mqtt->config.network.transport = mqtt->transport;
+    return ESP_OK;
 }
 
 
@@ -32,19 +366,58 @@ esp_err_t mqtt_event_handler_cb(mqtt_client_t *mqtt,
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "Conectado al broker");
             mqtt->reconnecting = pdFALSE;
+            // Los alias valen por conexion: el primer mensaje vuelve a asociarlo al topic
+            mqtt->alias_sent = false;
+            mqtt->alias_refused = false;
+            for (uint8_t i = 0; i < mqtt->subscription_count; i++) {   // la sesion es limpia: volver a suscribir
+                esp_mqtt_client_subscribe(mqtt->client, mqtt->subscriptions[i].topic, mqtt->subscriptions[i].qos);
+            }
+            xEventGroupSetBits(mqtt->events, MQTT_CONNECTED_BIT);
+            if (mqtt->on_session) mqtt->on_session(true);   // puede encolar (p. ej. el estado retenido)
+            mqtt_client_drain(mqtt);
             break;
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "Desconectado del broker");
-            if (mqtt->reconnecting == pdFALSE) {
+            xEventGroupClearBits(mqtt->events, MQTT_CONNECTED_BIT);
+            if (mqtt->stopped == pdFALSE && mqtt->on_session) {   // sin DISCONNECT: el broker publica el last will
+                mqtt->on_session(false);
+            }
+            if (mqtt->reconnecting == pdFALSE && mqtt->stopped == pdFALSE && mqtt->reconnect_task) {
                 mqtt->reconnecting = pdTRUE;
-                xTaskCreate(mqtt_reconnect_task, "mqtt_reconnect_task",
-                            4096, mqtt, 5, NULL);
+                mqtt->disconnect_us = esp_timer_get_time();
+                xTaskNotifyGive(mqtt->reconnect_task);
             }
             break;
 
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI(TAG, "Publicado msg_id=%d", event->msg_id);
+            mqtt_inflight_complete(mqtt, event->msg_id, true);
+            mqtt_client_drain(mqtt);
+            break;
+
+        case MQTT_EVENT_DELETED:   // esp-mqtt descarto un mensaje que vencio en el outbox
+            ESP_LOGW(TAG, "Mensaje msg_id=%d descartado sin confirmar", event->msg_id);
+            mqtt_inflight_complete(mqtt, event->msg_id, false);
+            mqtt_client_drain(mqtt);
+            break;
+
+        case MQTT_USER_EVENT:   // mqtt_client_queue encolo con lugar en la ventana
+            mqtt_client_drain(mqtt);
+            break;
+
+        case MQTT_EVENT_DATA:
+            if (event->data_len != event->total_data_len) {   // los mensajes de control son cortos
+                ESP_LOGW(TAG, "Mensaje fragmentado descartado (%d bytes)", event->total_data_len);
+                break;
+            }
+            for (uint8_t i = 0; i < mqtt->subscription_count; i++) {
+                const mqtt_subscription_t *sub = &mqtt->subscriptions[i];
+                if ((int)strlen(sub->topic) == event->topic_len
+                    && strncmp(sub->topic, event->topic, event->topic_len) == 0) {
+                    sub->callback(event->data, event->data_len);
+                    break;
+                }
+            }
             break;
 
         default:   // ignorar otros eventos
@@ -64,37 +437,200 @@ void mqtt_event_handler(void *handler_args,
     mqtt_client_t *mqtt = (mqtt_client_t *)handler_args;
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
 
+    mqtt->event_task = xTaskGetCurrentTaskHandle();
     mqtt_event_handler_cb(mqtt, event);
 }
 
 
 /* ----- Start ----- */
 esp_err_t mqtt_client_start(mqtt_client_t *mqtt) {
-    mqtt->client = esp_mqtt_client_init(&mqtt->config);
-    if (!mqtt->client) return ESP_FAIL;
+    if (!mqtt->client) {   // el cliente se crea una sola vez y se reutiliza tras mqtt_client_stop
+        mqtt->client = esp_mqtt_client_init(&mqtt->config);
+        if (!mqtt->client) return ESP_FAIL;
+
+        // registramos el callback y pasamos mqtt como handler_args
+        esp_mqtt_client_register_event(mqtt->client,
+                                       ESP_EVENT_ANY_ID,
+                                       mqtt_event_handler,
+                                       mqtt);
+    }
 
-    // registramos el callback y pasamos mqtt como handler_args
-    esp_mqtt_client_register_event(mqtt->client,
-                                   ESP_EVENT_ANY_ID,
-                                   mqtt_event_handler,
-                                   mqtt);
+    if (!mqtt->reconnect_task) {   // una sola tarea para todas las desconexiones: espera una notificacion
+#if MEMORY_STATIC
+        mqtt->reconnect_task = placement_create(PLACEMENT_MQTT_RECONNECT, mqtt_reconnect_task, mqtt,
+                                                mqtt->reconnect_stack, &mqtt->reconnect_buffer);
+#else
+        mqtt->reconnect_task = placement_create(PLACEMENT_MQTT_RECONNECT, mqtt_reconnect_task, mqtt, NULL, NULL);
+#endif
+        if (!mqtt->reconnect_task) return ESP_ERR_NO_MEM;
+        memory_watch_task(mqtt->reconnect_task);
+    }
 
+    mqtt->stopped = pdFALSE;
     return esp_mqtt_client_start(mqtt->client);
 }
 
 
+/* ----- Espera de conexion ----- */
+esp_err_t mqtt_client_wait_connected(mqtt_client_t *mqtt, uint32_t timeout_ms) {
+    EventBits_t bits = xEventGroupWaitBits(mqtt->events, MQTT_CONNECTED_BIT,
+                                           pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & MQTT_CONNECTED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+
+/* ----- Flush -----
+ * Espera a que el broker confirme todos los mensajes QoS>0 en vuelo y en espera */
+esp_err_t mqtt_client_flush(mqtt_client_t *mqtt, uint32_t timeout_ms) {
+    if (!mqtt->client) return ESP_FAIL;
+
+    EventBits_t bits = xEventGroupWaitBits(mqtt->events, MQTT_IDLE_BIT,
+                                           pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & MQTT_IDLE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+
+/* ----- Descarte -----
+ * Los mensajes ya entregados a esp-mqtt (ventana) no se pueden retirar: solo los que esperan en la
+ * cola propia o en NVS */
+uint32_t mqtt_client_discard_topic(mqtt_client_t *mqtt, mqtt_topic_id_t id) {
+    if (id >= MQTT_TOPIC_COUNT || mqtt->topics[id].len == 0) return 0;
+
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    uint32_t removed = mqtt_outbox_discard_topic(&mqtt->outbox, mqtt->topics[id].name);
+    mqtt_inflight_update_bits(mqtt);
+    xSemaphoreGive(mqtt->lock);
+    return removed;
+}
+
+
+/* ----- Stop ----- */
+void mqtt_client_stop(mqtt_client_t *mqtt) {
+    mqtt->stopped = pdTRUE;   // evita que el evento de desconexion lance la tarea de reconexion
+    mqtt->reconnecting = pdFALSE;
+    if (mqtt->client) {
+        esp_mqtt_client_stop(mqtt->client);
+    }
+    xEventGroupClearBits(mqtt->events, MQTT_CONNECTED_BIT);
+}
+
+
+/* ----- Subscribe -----
+ * Registra el topic en la tabla del cliente; si la sesion ya esta activa se suscribe de inmediato */
+esp_err_t mqtt_client_subscribe(mqtt_client_t *mqtt, const char *topic, int qos,
+                                mqtt_message_cb_t callback) {
+    if (mqtt->subscription_count >= MQTT_MAX_SUBSCRIPTIONS || strlen(topic) >= MQTT_TOPIC_MAX_LEN) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mqtt_subscription_t *sub = &mqtt->subscriptions[mqtt->subscription_count++];
+    strlcpy(sub->topic, topic, sizeof(sub->topic));
+    sub->qos = qos;
+    sub->callback = callback;
+
+    if (mqtt->client && (xEventGroupGetBits(mqtt->events) & MQTT_CONNECTED_BIT)) {
+        esp_mqtt_client_subscribe(mqtt->client, sub->topic, sub->qos);
+    }
+    return ESP_OK;
+}
+
+
 /* ----- Publish ----- */
 esp_err_t mqtt_client_publish(mqtt_client_t *mqtt,
                               const char *topic,
                               const char *payload,
                               int qos, int retain) {
-    if (!mqtt->client) return ESP_FAIL;
+    return mqtt_client_publish_buffer(mqtt, topic, payload, 0, qos, retain);
+}
+
+
+/* ----- Publish con seguimiento -----
+ * Los mensajes QoS>0 ocupan un lugar de la ventana hasta su confirmacion; si la ventana sigue llena
+ * tras MQTT_WINDOW_TIMEOUT_MS, o no hay conexion, se copian a la cola en espera y se devuelve el
+ * resultado de encolar. esp-mqtt o la cola copian el payload: el buffer vuelve al llamador al retornar */
+esp_err_t mqtt_client_publish_buffer(mqtt_client_t *mqtt, const char *topic, const char *payload,
+                                     int len, int qos, int retain) {
+    mqtt_inflight_t *entry = NULL;
+    esp_err_t ret = ESP_OK;
+
+    if (!mqtt->client) {
+        ret = ESP_FAIL;
+    }
+#if MQTT_USE_V5
+    else if (qos > 0 && strcmp(topic, mqtt->topics[MQTT_TOPIC_TELEMETRY].name) == 0) {
+        // Solo la tarea de esp-mqtt fija propiedades: la telemetria pasa por la cola sin reservar lugar
+        ret = mqtt_client_queue(mqtt, topic, payload, len, qos, retain);
+    }
+#endif
+    else if (qos > 0 && (entry = mqtt_inflight_reserve(mqtt, MQTT_WINDOW_TIMEOUT_MS)) == NULL) {
+        ret = mqtt_client_queue(mqtt, topic, payload, len, qos, retain);
+    }
+    if (ret != ESP_OK || (qos > 0 && entry == NULL)) return ret;
+
+    int64_t sent_us = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(mqtt->client, topic, payload, len, qos, retain);
+    if (entry == NULL) return (msg_id >= 0) ? ESP_OK : ESP_FAIL;   // QoS 0: sin confirmacion
+
+    // Una confirmacion anterior a esta publicacion es de otro mensaje con el mismo msg_id (el contador
+    // de esp-mqtt da la vuelta): se descarta en lugar de liberar este mensaje sin confirmar
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    bool early = false;
+    for (int i = 0; msg_id > 0 && i < MQTT_INFLIGHT_MAX; i++) {
+        mqtt_early_ack_t *ack = &mqtt->early_acks[i];
+        if (ack->msg_id != msg_id) continue;
+        early = early || (ack->at_us >= sent_us);
+        ack->msg_id = 0;
+    }
 
-    int msg_id = esp_mqtt_client_publish(mqtt->client,
-                                         topic,
-                                         payload,
-                                         0, qos, retain);
-    return (msg_id >= 0) ? ESP_OK : ESP_FAIL;
+    if (msg_id <= 0 || early) {
+        if (msg_id > 0) {
+            mqtt->stats.published++;
+            mqtt_inflight_ack_stats(mqtt, sent_us);
+        }
+        mqtt_inflight_free(mqtt, entry);
+    }
+    else {
+        entry->msg_id = msg_id;
+        entry->sent_us = sent_us;
+        entry->len = (len > 0) ? (uint32_t)len : (uint32_t)strlen(payload);
+        mqtt->inflight_bytes += entry->len;
+        mqtt->stats.published++;
+    }
+    xSemaphoreGive(mqtt->lock);
+    return (msg_id > 0) ? ESP_OK : ESP_FAIL;
+}
+
+
+/* ----- Publish rapido -----
+ * Topic de la tabla y longitud del payload conocida por el llamador */
+esp_err_t mqtt_client_publish_topic(mqtt_client_t *mqtt, mqtt_topic_id_t id, const char *payload,
+                                    int len, int qos, int retain) {
+    if (id >= MQTT_TOPIC_COUNT || mqtt->topics[id].len == 0 || len <= 0) return ESP_ERR_INVALID_ARG;
+    return mqtt_client_publish_buffer(mqtt, mqtt->topics[id].name, payload, len, qos, retain);
+}
+
+
+/* ----- Publish de un bloque del pool -----
+ * El bloque pasa a ser del cliente: esp-mqtt o la cola en espera copian el payload y el bloque
+ * vuelve al pool antes de retornar, tambien si la publicacion falla */
+esp_err_t mqtt_client_publish_block(mqtt_client_t *mqtt, mqtt_topic_id_t id, pool_handle_t block,
+                                    int qos, int retain) {
+    esp_err_t ret = ESP_ERR_INVALID_ARG;
+
+    if (pool_data(block) != NULL) {
+        ret = mqtt_client_publish_topic(mqtt, id, (const char *)pool_data(block), (int)pool_len(block), qos, retain);
+    }
+    pool_give(block);
+    return ret;
+}
+
+
+/* ----- Estadisticas ----- */
+void mqtt_client_get_stats(mqtt_client_t *mqtt, mqtt_stats_t *out) {
+    xSemaphoreTake(mqtt->lock, portMAX_DELAY);
+    *out = mqtt->stats;
+    out->outbox = mqtt->outbox.stats;
+    xSemaphoreGive(mqtt->lock);
 }
 
 
@@ -102,18 +638,23 @@ esp_err_t mqtt_client_publish(mqtt_client_t *mqtt,
 void mqtt_reconnect_task(void *arg) {
     mqtt_client_t *mqtt = (mqtt_client_t *)arg;
 
-    while (mqtt->reconnecting == pdTRUE) {
-        ESP_LOGI(TAG, "Intentando reconectar al broker...");
-        esp_err_t err = esp_mqtt_client_reconnect(mqtt->client);
-        if (err == ESP_OK) {
-            ESP_LOGI(TAG, "Reconexión exitosa");
-            mqtt->reconnecting = pdFALSE;
-            break;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);   // MQTT_EVENT_DISCONNECTED
+        audit_response(PLACEMENT_MQTT_RECONNECT, esp_timer_get_time() - mqtt->disconnect_us);
+
+        while (mqtt->reconnecting == pdTRUE) {
+            ESP_LOGI(TAG, "Intentando reconectar al broker...");
+            memory_exempt_begin();
+            esp_err_t err = esp_mqtt_client_reconnect(mqtt->client);
+            memory_exempt_end();
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "Reconexión exitosa");
+                mqtt->reconnecting = pdFALSE;
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(MQTT_RECONNECT_DELAY_MS));
         }
-        vTaskDelay(pdMS_TO_TICKS(5000));   // espera 5 segundos
     }
-
-    vTaskDelete(NULL);
 }
 
 
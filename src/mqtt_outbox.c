@@ -0,0 +1,429 @@
+#include "MQTT/mqtt_outbox.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *TAG = "MQTT_OUTBOX";
+
+
+_Static_assert(POOL_BLOCK_SIZE >= MQTT_OUTBOX_RECORD_MAX, "un registro derivado a NVS debe entrar en un bloque del pool");
+_Static_assert(POOL_BLOCK_SIZE <= UINT16_MAX, "el desplazamiento dentro de un bloque derivado es de 16 bits");
+
+#define MQTT_OUTBOX_RETAIN_FLAG   0x04
+#define MQTT_OUTBOX_QOS_MASK      0x03
+#define MQTT_OUTBOX_NVS_INDEX_KEY "idx"
+
+
+/* ----- Cabecera de cada registro (seguida del topic con '\0' y del payload) ----- */
+typedef struct {
+    uint16_t len;         // Bytes de payload
+    uint8_t topic_len;    // Bytes del topic incluyendo '\0'
+    uint8_t flags;        // QoS (bits 0-1) y retain (bit 2)
+} mqtt_outbox_record_t;
+
+
+/**
+ * @brief Tamaño total de un registro a partir de su cabecera.
+ */
+static uint32_t mqtt_outbox_record_size(const mqtt_outbox_record_t *record) {
+    return sizeof(mqtt_outbox_record_t) + record->topic_len + record->len;
+}
+
+
+/**
+ * @brief Lee la cabecera del registro que empieza en offset.
+ */
+static mqtt_outbox_record_t mqtt_outbox_record_at(const mqtt_outbox_t *box, uint32_t offset) {
+    mqtt_outbox_record_t record;
+    memcpy(&record, box->arena + offset, sizeof(record));
+    return record;
+}
+
+
+/**
+ * @brief Quita de la arena el registro que empieza en offset, compactando el resto.
+ */
+static void mqtt_outbox_remove_at(mqtt_outbox_t *box, uint32_t offset) {
+    mqtt_outbox_record_t record = mqtt_outbox_record_at(box, offset);
+    uint32_t size = mqtt_outbox_record_size(&record);
+
+    memmove(box->arena + offset, box->arena + offset + size, box->used - offset - size);
+    box->used -= size;
+    box->count--;
+}
+
+
+/**
+ * @brief Clave NVS del bloque derivado con indice index.
+ */
+static void mqtt_outbox_spill_key(uint16_t index, char *key, size_t size) {
+    snprintf(key, size, "m%u", (unsigned)(index % MQTT_OUTBOX_SPILL_MAX));
+}
+
+
+/**
+ * @brief Cantidad de bloques derivados a NVS.
+ */
+static uint16_t mqtt_outbox_spill_count(const mqtt_outbox_t *box) {
+    return (uint16_t)(box->spill_tail - box->spill_head);
+}
+
+
+/**
+ * @brief Guarda en NVS los indices de lectura/escritura y, si se indica, un bloque.
+ * @param key Clave del bloque (NULL: solo indices).
+ * @param erase true borra la clave en lugar de escribirla.
+ */
+static esp_err_t mqtt_outbox_spill_store(mqtt_outbox_t *box, const char *key, const void *data,
+                                         size_t size, bool erase) {
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(MQTT_OUTBOX_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) return ret;
+
+    if (key != NULL) {
+        ret = erase ? nvs_erase_key(nvs_handle, key) : nvs_set_blob(nvs_handle, key, data, size);
+    }
+    if (ret == ESP_OK || (erase && ret == ESP_ERR_NVS_NOT_FOUND)) {
+        ret = nvs_set_u32(nvs_handle, MQTT_OUTBOX_NVS_INDEX_KEY,
+                          ((uint32_t)box->spill_head << 16) | box->spill_tail);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return ret;
+}
+
+
+/**
+ * @brief Deriva a NVS, en un solo blob, los registros mas viejos de la arena: tantos como entren en
+ * un bloque del pool (al menos uno). La flash se escribe una vez por derivacion y no por mensaje.
+ * @return uint16_t  Mensajes derivados (quitados de la arena), 0 si fallo la escritura.
+ */
+static uint16_t mqtt_outbox_spill_oldest(mqtt_outbox_t *box) {
+    char key[8];
+    uint32_t size = 0;
+    uint16_t count = 0;
+
+    while (count < box->count) {
+        mqtt_outbox_record_t record = mqtt_outbox_record_at(box, size);
+        uint32_t record_size = mqtt_outbox_record_size(&record);
+        if (size + record_size > POOL_BLOCK_SIZE) break;
+        size += record_size;
+        count++;
+    }
+
+    mqtt_outbox_spill_key(box->spill_tail, key, sizeof(key));
+    box->spill_tail++;
+    if (mqtt_outbox_spill_store(box, key, box->arena, size, false) != ESP_OK) {
+        box->spill_tail--;
+        return 0;
+    }
+    box->stats.spill_writes++;
+    memmove(box->arena, box->arena + size, box->used - size);
+    box->used -= size;
+    box->count -= count;
+    return count;
+}
+
+
+/**
+ * @brief Verifica que un bloque leido de NVS este formado por registros completos.
+ */
+static bool mqtt_outbox_block_valid(const uint8_t *data, size_t size) {
+    size_t offset = 0;
+
+    while (offset + sizeof(mqtt_outbox_record_t) <= size) {
+        mqtt_outbox_record_t record;
+        memcpy(&record, data + offset, sizeof(record));
+        offset += mqtt_outbox_record_size(&record);
+    }
+    return size > 0 && offset == size;
+}
+
+
+/**
+ * @brief Quita de un bloque los registros del topic, compactando el resto.
+ * @param size Bytes del bloque; se actualiza.
+ * @return uint32_t  Registros quitados.
+ */
+static uint32_t mqtt_outbox_block_filter(uint8_t *data, size_t *size, const char *topic) {
+    size_t offset = 0;
+    size_t kept = 0;
+    uint32_t removed = 0;
+
+    while (offset < *size) {
+        mqtt_outbox_record_t record;
+        memcpy(&record, data + offset, sizeof(record));
+        uint32_t record_size = mqtt_outbox_record_size(&record);
+
+        if (strcmp((const char *)data + offset + sizeof(record), topic) == 0) {
+            removed++;
+        }
+        else {
+            memmove(data + kept, data + offset, record_size);
+            kept += record_size;
+        }
+        offset += record_size;
+    }
+    *size = kept;
+    return removed;
+}
+
+
+/**
+ * @brief Inicializa la cola. Recupera los indices de los mensajes que hayan quedado en NVS.
+ * @param budget Bytes de RAM para mensajes en espera (se limita a MQTT_OUTBOX_BUDGET).
+ * @param policy Politica cuando un mensaje no entra.
+ */
+void mqtt_outbox_init(mqtt_outbox_t *box, uint32_t budget, mqtt_outbox_policy_t policy) {
+    nvs_handle_t nvs_handle;
+    uint32_t index = 0;
+
+    memset(box, 0, sizeof(*box));
+    box->spill_block = POOL_NONE;
+    box->budget = (budget > 0 && budget <= MQTT_OUTBOX_BUDGET) ? budget : MQTT_OUTBOX_BUDGET;
+    box->policy = (policy < MQTT_OUTBOX_POLICY_COUNT) ? policy : MQTT_OUTBOX_DROP_OLDEST;
+
+    if (nvs_open(MQTT_OUTBOX_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        if (nvs_get_u32(nvs_handle, MQTT_OUTBOX_NVS_INDEX_KEY, &index) == ESP_OK) {
+            box->spill_head = (uint16_t)(index >> 16);
+            box->spill_tail = (uint16_t)index;
+            if (mqtt_outbox_spill_count(box) > MQTT_OUTBOX_SPILL_MAX) {   // Indices corruptos
+                box->spill_head = box->spill_tail;
+            }
+        }
+        nvs_close(nvs_handle);
+    }
+    if (mqtt_outbox_spill_count(box) > 0) {
+        ESP_LOGI(TAG, "%u mensajes pendientes en NVS", mqtt_outbox_spill_count(box));
+    }
+}
+
+
+/**
+ * @brief Encola un mensaje aplicando la politica si no entra en el presupuesto.
+ * @return esp_err_t  ESP_OK si quedo encolado; ESP_ERR_NO_MEM si la politica lo rechazo;
+ * ESP_ERR_INVALID_SIZE si el mensaje supera MQTT_OUTBOX_RECORD_MAX o el presupuesto.
+ */
+esp_err_t mqtt_outbox_push(mqtt_outbox_t *box, const char *topic, const char *payload,
+                           uint16_t len, uint8_t qos, bool retain) {
+    size_t topic_len = strlen(topic) + 1;
+    mqtt_outbox_record_t record = {
+        .len = len,
+        .topic_len = (uint8_t)topic_len,
+        .flags = (uint8_t)((qos & MQTT_OUTBOX_QOS_MASK) | (retain ? MQTT_OUTBOX_RETAIN_FLAG : 0)),
+    };
+    uint32_t size = sizeof(record) + topic_len + len;
+
+    if (topic_len > UINT8_MAX || size > MQTT_OUTBOX_RECORD_MAX || size > box->budget) {
+        box->stats.dropped_newest++;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (box->policy == MQTT_OUTBOX_COALESCE) {   // Un mensaje mas nuevo del mismo topic reemplaza al anterior
+        uint32_t offset = 0;
+        while (offset < box->used) {
+            mqtt_outbox_record_t other = mqtt_outbox_record_at(box, offset);
+            if (strcmp((const char *)box->arena + offset + sizeof(other), topic) == 0) {
+                mqtt_outbox_remove_at(box, offset);
+                box->stats.coalesced++;
+                continue;
+            }
+            offset += mqtt_outbox_record_size(&other);
+        }
+    }
+
+    while (box->used + size > box->budget) {
+        if (box->policy == MQTT_OUTBOX_DROP_NEWEST) {
+            box->stats.dropped_newest++;
+            return ESP_ERR_NO_MEM;
+        }
+        if (box->policy == MQTT_OUTBOX_SPILL && mqtt_outbox_spill_count(box) < MQTT_OUTBOX_SPILL_MAX) {
+            uint16_t spilled = mqtt_outbox_spill_oldest(box);
+            if (spilled > 0) {
+                box->stats.spilled += spilled;
+                continue;
+            }
+            box->stats.spill_errors++;
+        }
+        else {
+            box->stats.dropped_oldest++;
+        }
+        mqtt_outbox_remove_at(box, 0);
+    }
+
+    uint8_t *dst = box->arena + box->used;
+    memcpy(dst, &record, sizeof(record));
+    memcpy(dst + sizeof(record), topic, topic_len);
+    memcpy(dst + sizeof(record) + topic_len, payload, len);
+    box->used += size;
+    box->count++;
+    box->stats.queued++;
+    if (box->used > box->stats.peak_bytes) box->stats.peak_bytes = box->used;
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Decodifica un registro almacenado en data.
+ */
+static void mqtt_outbox_decode(const uint8_t *data, mqtt_outbox_msg_t *msg) {
+    mqtt_outbox_record_t record;
+    memcpy(&record, data, sizeof(record));
+    msg->topic = (const char *)data + sizeof(record);
+    msg->payload = (const char *)data + sizeof(record) + record.topic_len;
+    msg->len = record.len;
+    msg->qos = record.flags & MQTT_OUTBOX_QOS_MASK;
+    msg->retain = (record.flags & MQTT_OUTBOX_RETAIN_FLAG) != 0;
+}
+
+
+/**
+ * @brief Mensaje mas viejo de la cola: primero los derivados a NVS (se carga un bloque por vez),
+ * luego los de RAM.
+ * @param msg Mensaje de salida, valido hasta el proximo mqtt_outbox_pop o mqtt_outbox_push.
+ * @return bool  Devuelve false si la cola esta vacia.
+ */
+bool mqtt_outbox_front(mqtt_outbox_t *box, mqtt_outbox_msg_t *msg) {
+    while (mqtt_outbox_spill_count(box) > 0 && !box->spill_loaded) {
+        char key[8];
+        size_t size = POOL_BLOCK_SIZE;
+        nvs_handle_t nvs_handle;
+        esp_err_t ret;
+
+        if (box->spill_block == POOL_NONE && (box->spill_block = pool_take()) == POOL_NONE) {
+            return false;   // Pool agotado: se reintenta en la proxima entrega sin alterar el orden
+        }
+        uint8_t *buffer = pool_data(box->spill_block);
+
+        mqtt_outbox_spill_key(box->spill_head, key, sizeof(key));
+        ret = nvs_open(MQTT_OUTBOX_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+        if (ret == ESP_OK) {
+            ret = nvs_get_blob(nvs_handle, key, buffer, &size);
+            nvs_close(nvs_handle);
+        }
+
+        if (ret == ESP_OK && mqtt_outbox_block_valid(buffer, size)) {
+            box->spill_loaded = true;
+            box->spill_offset = 0;
+            box->spill_size = (uint16_t)size;
+            break;
+        }
+        if (ret != ESP_ERR_NVS_NOT_FOUND) {   // Vaciado por mqtt_outbox_discard_topic: no es un error
+            box->stats.spill_errors++;        // Bloque ilegible: se saltea
+        }
+        box->spill_head++;
+        mqtt_outbox_spill_store(box, key, NULL, 0, true);
+    }
+
+    if (box->spill_loaded) {
+        mqtt_outbox_decode(pool_data(box->spill_block) + box->spill_offset, msg);
+        return true;
+    }
+    pool_give(box->spill_block);   // Sin registros en NVS: el bloque no hace falta
+    box->spill_block = POOL_NONE;
+    if (box->count == 0) return false;
+    mqtt_outbox_decode(box->arena, msg);
+    return true;
+}
+
+
+/**
+ * @brief Quita el mensaje devuelto por mqtt_outbox_front. Un bloque de NVS se borra al entregar su
+ * ultimo mensaje: tras un reinicio a mitad de bloque sus mensajes se reenvian (al menos una vez).
+ */
+void mqtt_outbox_pop(mqtt_outbox_t *box) {
+    if (box->spill_loaded) {
+        mqtt_outbox_record_t record;
+        memcpy(&record, pool_data(box->spill_block) + box->spill_offset, sizeof(record));
+        box->spill_offset += (uint16_t)mqtt_outbox_record_size(&record);
+        box->stats.unspilled++;
+        if (box->spill_offset < box->spill_size) return;
+
+        char key[8];
+        mqtt_outbox_spill_key(box->spill_head, key, sizeof(key));
+        box->spill_head++;
+        box->spill_loaded = false;
+        pool_give(box->spill_block);
+        box->spill_block = POOL_NONE;
+        mqtt_outbox_spill_store(box, key, NULL, 0, true);
+        return;
+    }
+    if (box->count > 0) {
+        mqtt_outbox_remove_at(box, 0);
+    }
+}
+
+
+/**
+ * @brief Indica si no quedan mensajes en RAM ni en NVS.
+ */
+bool mqtt_outbox_empty(const mqtt_outbox_t *box) {
+    return box->count == 0 && mqtt_outbox_spill_count(box) == 0;
+}
+
+
+/**
+ * @brief Quita de la cola (RAM y NVS) los mensajes de un topic. Lo usa quien conserva su propia copia
+ * de esos mensajes y los va a volver a publicar, para que no se entreguen dos veces.
+ * @return uint32_t  Mensajes quitados.
+ */
+uint32_t mqtt_outbox_discard_topic(mqtt_outbox_t *box, const char *topic) {
+    uint32_t removed = 0;
+    uint32_t offset = 0;
+
+    while (offset < box->used) {
+        mqtt_outbox_record_t record = mqtt_outbox_record_at(box, offset);
+        if (strcmp((const char *)box->arena + offset + sizeof(record), topic) == 0) {
+            mqtt_outbox_remove_at(box, offset);
+            removed++;
+            continue;
+        }
+        offset += mqtt_outbox_record_size(&record);
+    }
+
+    if (mqtt_outbox_spill_count(box) > 0 && box->spill_block == POOL_NONE) {
+        box->spill_block = pool_take();
+    }
+    if (box->spill_block != POOL_NONE) {
+        uint8_t *buffer = pool_data(box->spill_block);
+
+        for (uint16_t index = box->spill_head; index != box->spill_tail; index++) {
+            char key[8];
+            size_t size = POOL_BLOCK_SIZE;
+            size_t start = 0;
+            esp_err_t ret = ESP_OK;
+
+            mqtt_outbox_spill_key(index, key, sizeof(key));
+            if (index == box->spill_head && box->spill_loaded) {   // Ya en memoria: sin lo entregado
+                size = box->spill_size;
+                start = box->spill_offset;
+            }
+            else {
+                nvs_handle_t nvs_handle;
+                ret = nvs_open(MQTT_OUTBOX_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+                if (ret == ESP_OK) {
+                    ret = nvs_get_blob(nvs_handle, key, buffer, &size);
+                    nvs_close(nvs_handle);
+                }
+            }
+            if (ret != ESP_OK || !mqtt_outbox_block_valid(buffer, size)) continue;   // Lo resuelve front
+
+            memmove(buffer, buffer + start, size - start);
+            size -= start;
+            uint32_t dropped = mqtt_outbox_block_filter(buffer, &size, topic);
+            if (dropped == 0 && start == 0) continue;
+            removed += dropped;
+            mqtt_outbox_spill_store(box, key, buffer, size, size == 0);
+        }
+        box->spill_loaded = false;   // front vuelve a leer el primer bloque
+        pool_give(box->spill_block);
+        box->spill_block = POOL_NONE;
+    }
+
+    box->stats.discarded += removed;
+    return removed;
+}
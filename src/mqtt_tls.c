@@ -0,0 +1,356 @@
+#include "MQTT/mqtt_tls.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_crt_bundle.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <string.h>
+#include <stdio.h>
+
+
+static const char *TAG = "MQTT_TLS";
+
+
+/* ----- Sesion TLS serializada (sobrevive al deep sleep) -----
+ * Lleva el ticket y, con CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE, el certificado DER completo del
+ * broker, que puede no entrar en MQTT_TLS_SESSION_MAX. sdkconfig lo deshabilita: la sesion guarda
+ * solo el digest del certificado */
+#if CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
+#error "Deshabilitar CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE: la sesion serializada no entraria en MQTT_TLS_SESSION_MAX"
+#endif
+typedef struct {
+    uint32_t magic;                        // MQTT_TLS_SESSION_MAGIC si el contenido es valido
+    uint32_t len;                          // Bytes validos en data
+    uint8_t data[MQTT_TLS_SESSION_MAX];    // Salida de mbedtls_ssl_session_save()
+} tls_session_blob_t;
+
+
+/* ----- Contexto del transporte ----- */
+typedef struct {
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt ca;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_ssl_session session;   // Ultima sesion negociada, se ofrece en el proximo handshake
+    bool session_valid;
+    bool conf_ready;               // conf/drbg configurados (se reutilizan entre conexiones)
+    bool ssl_ready;                // ssl configurado: sus buffers de registro se conservan entre conexiones
+    bool connected;
+    bool cert_verified;            // El servidor envio su certificado: el handshake fue completo
+} tls_ctx_t;
+
+
+static tls_ctx_t tls_ctx;
+static RTC_DATA_ATTR tls_session_blob_t rtc_session;
+static mqtt_tls_stats_t stats;
+static const char *ca_pem = MQTT_TLS_CA_PEM;
+
+// Callback de verificacion original (bundle de certificados), encadenado desde tls_verify_cb
+static int (*chained_verify)(void *, mbedtls_x509_crt *, int, uint32_t *) = NULL;
+static void *chained_verify_ctx = NULL;
+
+
+/**
+ * @brief Callback de verificacion de certificados. mbedtls solo lo invoca cuando el servidor
+ * envia su cadena de certificados, es decir, en un handshake completo; en una reanudacion
+ * no se llama. Se usa para distinguir ambos casos.
+ */
+static int tls_verify_cb(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags) {
+    tls_ctx.cert_verified = true;
+    return chained_verify ? chained_verify(chained_verify_ctx, crt, depth, flags) : 0;
+}
+
+
+/**
+ * @brief Configuracion TLS compartida por todas las conexiones (RNG, CA, tickets).
+ * @return int  0 si la configuracion fue exitosa, codigo de error de mbedtls si no.
+ */
+static int tls_conf_setup(tls_ctx_t *ctx) {
+    const char *pers = "mqtt_tls";
+    int ret = mbedtls_ctr_drbg_seed(&ctx->drbg, mbedtls_entropy_func, &ctx->entropy,
+                                    (const unsigned char *)pers, strlen(pers));
+    if (ret != 0) return ret;
+
+    ret = mbedtls_ssl_config_defaults(&ctx->conf, MBEDTLS_SSL_IS_CLIENT,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) return ret;
+
+    mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&ctx->conf, mbedtls_ctr_drbg_random, &ctx->drbg);
+    mbedtls_ssl_conf_max_tls_version(&ctx->conf, MBEDTLS_SSL_VERSION_TLS1_2);
+    mbedtls_ssl_conf_session_tickets(&ctx->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    if (ca_pem != NULL) {
+        ret = mbedtls_x509_crt_parse(&ctx->ca, (const unsigned char *)ca_pem, strlen(ca_pem) + 1);
+        if (ret != 0) return ret;
+        mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->ca, NULL);
+    }
+    else {
+        esp_err_t err = esp_crt_bundle_attach(&ctx->conf);
+        if (err != ESP_OK) return -1;
+        // El bundle instala su propio callback: se conserva para encadenarlo
+        chained_verify = ctx->conf.MBEDTLS_PRIVATE(f_vrfy);
+        chained_verify_ctx = ctx->conf.MBEDTLS_PRIVATE(p_vrfy);
+    }
+    mbedtls_ssl_conf_verify(&ctx->conf, tls_verify_cb, NULL);
+
+    ctx->conf_ready = true;
+    return 0;
+}
+
+
+/**
+ * @brief Recupera la sesion guardada en memoria RTC tras un deep sleep.
+ */
+static void session_restore(tls_ctx_t *ctx) {
+    if (ctx->session_valid || rtc_session.magic != MQTT_TLS_SESSION_MAGIC) return;
+
+    if (mbedtls_ssl_session_load(&ctx->session, rtc_session.data, rtc_session.len) == 0) {
+        ctx->session_valid = true;
+    }
+    else {
+        rtc_session.magic = 0;
+        mbedtls_ssl_session_free(&ctx->session);
+        mbedtls_ssl_session_init(&ctx->session);
+    }
+}
+
+
+/**
+ * @brief Guarda la sesion recien negociada en RAM y serializada en memoria RTC.
+ */
+static void session_save(tls_ctx_t *ctx) {
+    mbedtls_ssl_session_free(&ctx->session);
+    mbedtls_ssl_session_init(&ctx->session);
+    ctx->session_valid = (mbedtls_ssl_get_session(&ctx->ssl, &ctx->session) == 0);
+    if (!ctx->session_valid) return;
+
+    size_t olen = 0;
+    if (mbedtls_ssl_session_save(&ctx->session, rtc_session.data, sizeof(rtc_session.data), &olen) == 0) {
+        rtc_session.len = (uint32_t)olen;
+        rtc_session.magic = MQTT_TLS_SESSION_MAGIC;
+    }
+    else {
+        ESP_LOGW(TAG, "- WARNING: La sesion no entra en MQTT_TLS_SESSION_MAX (%u bytes) -", (unsigned)olen);
+        rtc_session.magic = 0;
+    }
+}
+
+
+/**
+ * @brief Espera a que el socket este listo para leer o escribir.
+ * @return int  >0 listo, 0 timeout, <0 error.
+ */
+static int tls_select(int fd, bool read, int timeout_ms) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+
+    return select(fd + 1, read ? &fds : NULL, read ? NULL : &fds, NULL, timeout_ms < 0 ? NULL : &tv);
+}
+
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    if (mbedtls_ssl_get_bytes_avail(&ctx->ssl) > 0) return 1;   // Datos ya descifrados en el buffer
+    return tls_select(ctx->net.fd, true, timeout_ms);
+}
+
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    return tls_select(ctx->net.fd, false, timeout_ms);
+}
+
+
+/**
+ * @brief Cierra el socket y deja el contexto ssl listo para otra conexion. mbedtls_ssl_session_reset
+ * conserva los buffers de registro (MBEDTLS_SSL_IN/OUT_CONTENT_LEN), de modo que las reconexiones no
+ * vuelven a reservarlos en el heap; si el reinicio falla se libera el contexto y se reserva de nuevo.
+ */
+static void tls_reset(tls_ctx_t *ctx) {
+    mbedtls_net_free(&ctx->net);
+    if (ctx->ssl_ready && mbedtls_ssl_session_reset(&ctx->ssl) == 0) return;
+    mbedtls_ssl_free(&ctx->ssl);
+    mbedtls_ssl_init(&ctx->ssl);
+    ctx->ssl_ready = false;
+}
+
+
+/**
+ * @brief Conecta por TCP y realiza el handshake, ofreciendo la sesion cacheada si existe.
+ */
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    char port_str[8];
+    int ret;
+
+    if (!ctx->conf_ready && (ret = tls_conf_setup(ctx)) != 0) {
+        ESP_LOGE(TAG, "- ERROR: Error configurando TLS (-0x%04x) -", -ret);
+        return -1;
+    }
+
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    ret = mbedtls_net_connect(&ctx->net, host, port_str, MBEDTLS_NET_PROTO_TCP);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "- ERROR: Error conectando a %s:%d (-0x%04x) -", host, port, -ret);
+        goto fail;
+    }
+
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(ctx->net.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(ctx->net.fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (!ctx->ssl_ready) {   // reserva los buffers de registro una sola vez (ver tls_reset)
+        if ((ret = mbedtls_ssl_setup(&ctx->ssl, &ctx->conf)) != 0) goto fail;
+        ctx->ssl_ready = true;
+    }
+    if ((ret = mbedtls_ssl_set_hostname(&ctx->ssl, host)) != 0) goto fail;
+    mbedtls_ssl_set_bio(&ctx->ssl, &ctx->net, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    session_restore(ctx);
+    bool offered = ctx->session_valid && mbedtls_ssl_set_session(&ctx->ssl, &ctx->session) == 0;
+
+    ctx->cert_verified = false;
+    int64_t t_start = esp_timer_get_time();
+    while ((ret = mbedtls_ssl_handshake(&ctx->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGE(TAG, "- ERROR: Handshake fallido (-0x%04x) -", -ret);
+            stats.failed_handshakes++;
+            mqtt_tls_forget_session();
+            goto fail;
+        }
+    }
+
+    stats.last_handshake_ms = (uint32_t)((esp_timer_get_time() - t_start) / 1000);
+    if (offered && !ctx->cert_verified) {
+        stats.resumed_handshakes++;
+        stats.resumed_total_ms += stats.last_handshake_ms;
+    }
+    else {
+        stats.full_handshakes++;
+        stats.full_total_ms += stats.last_handshake_ms;
+    }
+    ESP_LOGI(TAG, "Handshake %s en %lu ms (completos %lu, reanudados %lu)",
+             (offered && !ctx->cert_verified) ? "reanudado" : "completo",
+             (unsigned long)stats.last_handshake_ms, (unsigned long)stats.full_handshakes,
+             (unsigned long)stats.resumed_handshakes);
+
+    session_save(ctx);
+    ctx->connected = true;
+    return 0;
+
+    fail:
+        tls_reset(ctx);
+        return -1;
+}
+
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    int poll = tls_poll_read(t, timeout_ms);
+    if (poll <= 0) return poll;
+
+    int ret = mbedtls_ssl_read(&ctx->ssl, (unsigned char *)buffer, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+    if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    return ret < 0 ? -1 : ret;
+}
+
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    int poll = tls_poll_write(t, timeout_ms);
+    if (poll <= 0) return poll;
+
+    int ret = mbedtls_ssl_write(&ctx->ssl, (const unsigned char *)buffer, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+    return ret < 0 ? -1 : ret;
+}
+
+
+static int tls_close(esp_transport_handle_t t) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    if (ctx->connected) {
+        mbedtls_ssl_close_notify(&ctx->ssl);
+        ctx->connected = false;
+    }
+    tls_reset(ctx);
+    return 0;
+}
+
+
+static int tls_destroy(esp_transport_handle_t t) {
+    tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    tls_close(t);
+    mbedtls_ssl_free(&ctx->ssl);
+    mbedtls_ssl_init(&ctx->ssl);
+    ctx->ssl_ready = false;
+    mbedtls_ssl_session_free(&ctx->session);
+    mbedtls_ssl_config_free(&ctx->conf);
+    mbedtls_x509_crt_free(&ctx->ca);
+    mbedtls_ctr_drbg_free(&ctx->drbg);
+    mbedtls_entropy_free(&ctx->entropy);
+    ctx->session_valid = false;
+    ctx->conf_ready = false;
+    return 0;
+}
+
+
+/**
+ * @brief Crea el transporte TLS con reanudacion de sesion para esp-mqtt.
+ * La sesion (ticket o session ID) se conserva entre reconexiones y, serializada en memoria
+ * RTC, entre despertares del deep sleep.
+ * @return esp_transport_handle_t  Handle del transporte, o NULL si no hay memoria.
+ */
+esp_transport_handle_t mqtt_tls_transport_create(void) {
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == NULL) return NULL;
+
+    memset(&tls_ctx, 0, sizeof(tls_ctx));
+    mbedtls_net_init(&tls_ctx.net);
+    mbedtls_ssl_init(&tls_ctx.ssl);
+    mbedtls_ssl_config_init(&tls_ctx.conf);
+    mbedtls_x509_crt_init(&tls_ctx.ca);
+    mbedtls_entropy_init(&tls_ctx.entropy);
+    mbedtls_ctr_drbg_init(&tls_ctx.drbg);
+    mbedtls_ssl_session_init(&tls_ctx.session);
+
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close,
+                           tls_poll_read, tls_poll_write, tls_destroy);
+    esp_transport_set_context_data(t, &tls_ctx);
+    esp_transport_set_default_port(t, 8883);
+    return t;
+}
+
+
+/**
+ * @brief Devuelve los contadores de handshakes.
+ */
+const mqtt_tls_stats_t *mqtt_tls_get_stats(void) {
+    return &stats;
+}
+
+
+/**
+ * @brief Descarta la sesion cacheada (RAM y RTC). El proximo handshake sera completo.
+ */
+void mqtt_tls_forget_session(void) {
+    mbedtls_ssl_session_free(&tls_ctx.session);
+    mbedtls_ssl_session_init(&tls_ctx.session);
+    tls_ctx.session_valid = false;
+    rtc_session.magic = 0;
+}
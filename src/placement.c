@@ -0,0 +1,113 @@
+#include "Placement/placement.h"
+#include "Data/data.h"
+#include "KY037/ky037.h"
+#include "MQTT/mqtt.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <string.h>
+
+
+/* ----- Tabla de ubicacion -----
+ * La tarea de datos va con los sensores: ejecuta la lectura del DHT11 en seccion critica y el
+ * muestreo del MQ135. Su parte de red solo copia el mensaje a la cola del cliente MQTT; el envio y
+ * el TLS ocurren en la tarea de esp-mqtt (PRO_CPU).
+ * El KY037 (ISR y tarea de estadisticas) va en el otro nucleo: la seccion critica del DHT11 deja
+ * ~5 ms sin interrupciones en APP_CPU, mas que el plazo de 1 ms de un flanco. En PRO_CPU su
+ * prioridad supera a la de la tarea de esp-mqtt, asi que el handshake TLS no lo demora */
+static const placement_t placement_table[PLACEMENT_COUNT] = {
+    [PLACEMENT_DATA]           = { "data_json_encrypt_task", DATA_TASK_STACK,      6, PLACEMENT_CORE_SENSORS },
+    [PLACEMENT_KY037_STATS]    = { "ky037_stats",            KY037_STATS_STACK,    7, PLACEMENT_CORE_NETWORK },
+    [PLACEMENT_MQTT_RECONNECT] = { "mqtt_reconnect_task",    MQTT_RECONNECT_STACK, 5, PLACEMENT_CORE_NETWORK },
+};
+
+static TaskHandle_t placement_handles[PLACEMENT_COUNT];   // Tareas creadas (marca de agua de la pila)
+
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static configRUN_TIME_COUNTER_TYPE last_idle[portNUM_PROCESSORS];   // Tiempo acumulado de cada idle (us)
+static int64_t last_us = 0;                                         // Inicio de la ventana (esp_timer)
+#endif
+
+
+/**
+ * @brief Entrada de la tabla de ubicacion de una tarea, o NULL si no existe.
+ */
+const placement_t *placement_get(placement_task_t task) {
+    return (task < PLACEMENT_COUNT) ? &placement_table[task] : NULL;
+}
+
+
+/**
+ * @brief Crea una tarea con el nombre, pila, prioridad y nucleo de la tabla.
+ * @param stack Pila estatica de placement_get(task)->stack_size bytes; NULL la reserva en el heap.
+ * @param buffer TCB estatico (NULL junto con stack).
+ * @return TaskHandle_t  Handle de la tarea, o NULL si no se pudo crear.
+ */
+TaskHandle_t placement_create(placement_task_t task, TaskFunction_t fn, void *arg,
+                              StackType_t *stack, StaticTask_t *buffer) {
+    const placement_t *entry = placement_get(task);
+    TaskHandle_t handle = NULL;
+
+    if (entry == NULL) return NULL;
+    if (stack != NULL && buffer != NULL) {
+        handle = xTaskCreateStaticPinnedToCore(fn, entry->name, entry->stack_size, arg, entry->priority,
+                                               stack, buffer, entry->core);
+    }
+    else if (xTaskCreatePinnedToCore(fn, entry->name, entry->stack_size, arg, entry->priority,
+                                     &handle, entry->core) != pdPASS) {
+        handle = NULL;
+    }
+    placement_handles[task] = handle;
+    return handle;
+}
+
+
+/**
+ * @brief Handle de la tarea creada con placement_create, o NULL si no existe.
+ */
+TaskHandle_t placement_handle(placement_task_t task) {
+    return (task < PLACEMENT_COUNT) ? placement_handles[task] : NULL;
+}
+
+
+/**
+ * @brief Elimina una tarea creada con placement_create (p. ej. si falla la inicializacion del modulo).
+ */
+void placement_delete(placement_task_t task) {
+    TaskHandle_t handle = placement_handle(task);
+
+    if (handle == NULL) return;
+    placement_handles[task] = NULL;
+    vTaskDelete(handle);
+}
+
+
+/**
+ * @brief Mide la carga de cada nucleo desde la llamada anterior a partir del tiempo que corrio su
+ * tarea idle (estadisticas de tiempo de ejecucion de FreeRTOS, reloj esp_timer).
+ * @return esp_err_t  ESP_OK con la medicion; ESP_ERR_INVALID_STATE en la primera llamada (abre la
+ * ventana); ESP_ERR_NOT_SUPPORTED sin CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ */
+esp_err_t placement_measure_load(placement_load_t *out) {
+    memset(out, 0, sizeof(*out));
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    int64_t now = esp_timer_get_time();
+    bool first = (last_us == 0);
+    uint64_t window = (uint64_t)(now - last_us);
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        configRUN_TIME_COUNTER_TYPE idle = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(core));
+        uint64_t idle_delta = (uint64_t)(idle - last_idle[core]);
+        last_idle[core] = idle;
+        if (!first && window > 0) {
+            uint64_t idle_pct = (idle_delta * 100) / window;
+            out->load_pct[core] = (uint8_t)(idle_pct >= 100 ? 0 : 100 - idle_pct);
+        }
+    }
+    out->window_ms = first ? 0 : (uint32_t)(window / 1000);
+    last_us = now;
+    return first ? ESP_ERR_INVALID_STATE : ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,101 @@
+#include "Pool/pool.h"
+#include <stdbool.h>
+
+
+_Static_assert(POOL_BLOCK_COUNT > 0 && POOL_BLOCK_COUNT <= 32, "el mapa de bits del pool es de 32 bits");
+
+#define POOL_ALL_FREE   ((uint32_t)(POOL_BLOCK_COUNT == 32 ? 0xFFFFFFFFUL : ((1UL << POOL_BLOCK_COUNT) - 1)))
+
+
+static uint8_t blocks[POOL_BLOCK_COUNT][POOL_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint16_t lengths[POOL_BLOCK_COUNT];       // Bytes validos de cada bloque (los fija el dueño)
+static uint32_t free_mask = POOL_ALL_FREE;       // Bit n = bloque n libre
+static pool_stats_t stats;                       // taken, exhausted, invalid
+static uint32_t in_use = 0;                      // Contadores de 32 bits: CAS nativo en Xtensa
+static uint32_t peak = 0;
+
+
+/**
+ * @brief Registra un nuevo maximo de bloques prestados.
+ */
+static void pool_note_in_use(uint32_t mask) {
+    uint32_t now = POOL_BLOCK_COUNT - (uint32_t)__builtin_popcount(mask);
+    uint32_t max = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&in_use, now, __ATOMIC_RELAXED);
+    while (now > max && !__atomic_compare_exchange_n(&peak, &max, now, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+/**
+ * @brief Presta un bloque libre (el de menor indice).
+ * @return pool_handle_t  Handle del bloque, con longitud 0, o POOL_NONE si no hay bloques libres.
+ */
+pool_handle_t pool_take(void) {
+    uint32_t mask = __atomic_load_n(&free_mask, __ATOMIC_ACQUIRE);
+
+    while (mask != 0) {
+        uint32_t bit = mask & (~mask + 1);
+        if (__atomic_compare_exchange_n(&free_mask, &mask, mask & ~bit, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {   // si falla, mask trae el valor vigente
+            pool_handle_t block = (pool_handle_t)__builtin_ctz(bit);
+            lengths[block] = 0;
+            __atomic_fetch_add(&stats.taken, 1, __ATOMIC_RELAXED);
+            pool_note_in_use(mask & ~bit);
+            return block;
+        }
+    }
+    __atomic_fetch_add(&stats.exhausted, 1, __ATOMIC_RELAXED);
+    return POOL_NONE;
+}
+
+
+/**
+ * @brief Devuelve un bloque al pool. El handle deja de ser valido para quien lo devuelve.
+ */
+void pool_give(pool_handle_t block) {
+    if (block >= POOL_BLOCK_COUNT) {
+        if (block != POOL_NONE) __atomic_fetch_add(&stats.invalid, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t bit = 1UL << block;
+    uint32_t previous = __atomic_fetch_or(&free_mask, bit, __ATOMIC_RELEASE);
+    if (previous & bit) {   // Ya estaba libre: doble devolucion
+        __atomic_fetch_add(&stats.invalid, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_store_n(&in_use, POOL_BLOCK_COUNT - (uint32_t)__builtin_popcount(previous | bit), __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Memoria del bloque (POOL_BLOCK_SIZE bytes), o NULL si el handle es invalido.
+ */
+uint8_t *pool_data(pool_handle_t block) {
+    return (block < POOL_BLOCK_COUNT) ? blocks[block] : NULL;
+}
+
+
+size_t pool_len(pool_handle_t block) {
+    return (block < POOL_BLOCK_COUNT) ? lengths[block] : 0;
+}
+
+
+/**
+ * @brief Fija los bytes validos del bloque (se limita a POOL_BLOCK_SIZE).
+ */
+void pool_set_len(pool_handle_t block, size_t len) {
+    if (block >= POOL_BLOCK_COUNT) return;
+    lengths[block] = (uint16_t)(len <= POOL_BLOCK_SIZE ? len : POOL_BLOCK_SIZE);
+}
+
+
+void pool_get_stats(pool_stats_t *out) {
+    out->taken = __atomic_load_n(&stats.taken, __ATOMIC_RELAXED);
+    out->exhausted = __atomic_load_n(&stats.exhausted, __ATOMIC_RELAXED);
+    out->invalid = __atomic_load_n(&stats.invalid, __ATOMIC_RELAXED);
+    out->in_use = (uint8_t)__atomic_load_n(&in_use, __ATOMIC_RELAXED);
+    out->peak = (uint8_t)__atomic_load_n(&peak, __ATOMIC_RELAXED);
+}
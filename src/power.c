@@ -0,0 +1,303 @@
+#include "Power/power.h"
+#include "KY037/ky037.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *TAG = "POWER";
+
+
+static RTC_DATA_ATTR power_rtc_state_t rtc_state;    // Estado conservado durante el deep sleep
+static esp_sleep_wakeup_cause_t wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static int64_t timeline[POWER_MARK_COUNT];            // Marcas de tiempo del ciclo actual (micro seg, esp_timer)
+static TaskHandle_t sleeping_task = NULL;             // Tarea esperando en power_sleep_until (modo ALWAYS_ON)
+
+static const char *mark_names[POWER_MARK_COUNT] = {
+    "wake", "ready", "sample", "net_up", "published", "sleep"
+};
+
+
+/**
+ * @brief Obtiene el tiempo del reloj RTC en micro segundos. A diferencia de esp_timer,
+ * este reloj sigue avanzando durante el deep sleep.
+ */
+static int64_t rtc_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+
+/**
+ * @brief Reinicia las marcas de la linea de tiempo y registra el inicio de un ciclo.
+ */
+static void timeline_reset(void) {
+    for (int i = 0; i < POWER_MARK_COUNT; i++) {
+        timeline[i] = -1;
+    }
+    timeline[POWER_MARK_WAKE] = esp_timer_get_time();
+}
+
+
+#if POWER_KY037_WAKEUP && POWER_MODE != POWER_MODE_ALWAYS_ON
+/**
+ * @brief Espera (acotado) a que la salida del KY037 vuelva a nivel bajo. Dormir con la linea en
+ * alto provocaria un despertar inmediato por nivel.
+ */
+static void ky037_wait_idle(void) {
+    int64_t deadline = esp_timer_get_time() + (int64_t)POWER_KY037_SETTLE_MS * 1000;
+    while (gpio_get_level(KY037_PIN) == 1 && esp_timer_get_time() < deadline) {
+        vTaskDelay(1);
+    }
+}
+#endif
+
+
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP
+/**
+ * @brief Entra en deep sleep durante el tiempo indicado. No retorna.
+ * @param sleep_us Tiempo a dormir en micro segundos.
+ */
+static void enter_deep_sleep(uint64_t sleep_us) {
+    esp_sleep_enable_timer_wakeup(sleep_us);
+
+#if POWER_KY037_WAKEUP
+    if (rtc_gpio_is_valid_gpio(KY037_PIN)) {
+        ky037_wait_idle();
+        esp_sleep_enable_ext0_wakeup(KY037_PIN, 1);
+    }
+    else {
+        ESP_LOGW(TAG, "- WARNING: KY037_PIN no es un GPIO RTC, se omite el despertar por EXT0 -");
+    }
+#endif
+
+    esp_deep_sleep_start();
+}
+#endif
+
+
+#if POWER_MODE == POWER_MODE_LIGHT_SLEEP
+/**
+ * @brief Duerme en light sleep hasta el instante de la proxima muestra. Si el KY037 despierta al
+ * chip, se contabiliza la deteccion y se vuelve a dormir el tiempo restante.
+ */
+static void enter_light_sleep(void) {
+    int64_t remaining;
+
+    while ((remaining = rtc_state.next_sample_us - rtc_time_us()) > 0) {
+        esp_sleep_enable_timer_wakeup((uint64_t)remaining);
+
+#if POWER_KY037_WAKEUP
+        ky037_wait_idle();
+        gpio_wakeup_enable(KY037_PIN, GPIO_INTR_HIGH_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+#endif
+
+        esp_light_sleep_start();
+        wakeup_cause = esp_sleep_get_wakeup_cause();
+
+#if POWER_KY037_WAKEUP
+        // Restaurar la interrupcion por ambos flancos que usa el driver del KY037
+        gpio_wakeup_disable(KY037_PIN);
+        gpio_set_intr_type(KY037_PIN, GPIO_INTR_ANYEDGE);
+        if (wakeup_cause == ESP_SLEEP_WAKEUP_GPIO) {
+            rtc_state.ky037_wakeups++;
+        }
+#endif
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+    }
+}
+#endif
+
+
+/**
+ * @brief Inicializa el modulo de energia. Debe llamarse al comienzo de app_main.
+ * Valida el estado RTC y, si el despertar fue solo por una deteccion del KY037 antes de que
+ * corresponda muestrear, la contabiliza y vuelve a dormir sin inicializar el resto del sistema.
+ */
+void power_init(void) {
+    timeline_reset();
+    wakeup_cause = esp_sleep_get_wakeup_cause();
+
+    if (rtc_state.magic != POWER_RTC_MAGIC || wakeup_cause == ESP_SLEEP_WAKEUP_UNDEFINED) {
+        memset(&rtc_state, 0, sizeof(rtc_state));
+        rtc_state.magic = POWER_RTC_MAGIC;
+        rtc_state.next_sample_us = rtc_time_us();
+        ESP_LOGI(TAG, "Arranque en frio, estado RTC reiniciado");
+        return;
+    }
+
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP && POWER_KY037_WAKEUP
+    if (wakeup_cause == ESP_SLEEP_WAKEUP_EXT0) {
+        rtc_state.ky037_wakeups++;
+        int64_t remaining = rtc_state.next_sample_us - rtc_time_us();
+        if (remaining > 0) {
+            enter_deep_sleep((uint64_t)remaining);
+        }
+    }
+#endif
+
+    ESP_LOGI(TAG, "Despertar (causa %d), ciclo %lu, %u muestras en RTC",
+             wakeup_cause, (unsigned long)rtc_state.cycle_count, rtc_state.sample_count);
+}
+
+
+/**
+ * @brief Devuelve la causa del ultimo despertar.
+ */
+esp_sleep_wakeup_cause_t power_wakeup_cause(void) {
+    return wakeup_cause;
+}
+
+
+/**
+ * @brief Registra una marca en la linea de tiempo del ciclo actual.
+ * @param mark Etapa alcanzada.
+ */
+void power_timeline_mark(power_mark_t mark) {
+    if (mark < POWER_MARK_COUNT) {
+        timeline[mark] = esp_timer_get_time();
+    }
+}
+
+
+/**
+ * @brief Imprime la linea de tiempo despertar-publicar-dormir del ciclo actual, con la
+ * duracion de cada etapa respecto de la anterior marca registrada.
+ */
+void power_timeline_report(void) {
+    char line[160];
+    int len = 0;
+    int64_t prev = timeline[POWER_MARK_WAKE];
+
+    for (int i = POWER_MARK_WAKE + 1; i < POWER_MARK_COUNT && len < (int)sizeof(line); i++) {
+        if (timeline[i] < 0) continue;
+        len += snprintf(line + len, sizeof(line) - len, " %s +%lu ms,",
+                        mark_names[i], (unsigned long)((timeline[i] - prev) / 1000));
+        prev = timeline[i];
+    }
+
+    uint32_t avg_ms = rtc_state.cycle_count ? (uint32_t)(rtc_state.awake_total_ms / rtc_state.cycle_count) : 0;
+    ESP_LOGI(TAG, "Timeline:%s total %lu ms (promedio %lu ms en %lu ciclos)",
+             len > 0 ? line : "", (unsigned long)rtc_state.last_cycle_ms,
+             (unsigned long)avg_ms, (unsigned long)rtc_state.cycle_count);
+}
+
+
+/**
+ * @brief Devuelve y reinicia la cantidad de detecciones del KY037 que despertaron al chip.
+ */
+uint32_t power_take_ky037_wakeups(void) {
+    uint32_t count = rtc_state.ky037_wakeups;
+    rtc_state.ky037_wakeups = 0;
+    return count;
+}
+
+
+/**
+ * @brief Agrega una muestra al lote guardado en memoria RTC.
+ * @param sample Muestra a guardar.
+ * @param burst Muestras que completan el lote (1..POWER_BURST_SAMPLES).
+ * @return bool  Devuelve true cuando el lote esta completo y debe publicarse.
+ */
+bool power_store_sample(const data_sensors_t *sample, uint8_t burst) {
+    if (burst == 0 || burst > POWER_BURST_SAMPLES) burst = POWER_BURST_SAMPLES;
+
+    if (rtc_state.sample_count < POWER_BURST_SAMPLES) {
+        rtc_state.samples[rtc_state.sample_count++] = *sample;
+    }
+    else {   // Lote lleno sin publicar (fallo de red): descartar la muestra mas antigua
+        memmove(&rtc_state.samples[0], &rtc_state.samples[1], sizeof(data_sensors_t) * (POWER_BURST_SAMPLES - 1));
+        rtc_state.samples[POWER_BURST_SAMPLES - 1] = *sample;
+    }
+    return rtc_state.sample_count >= burst;
+}
+
+
+/**
+ * @brief Devuelve el lote de muestras acumulado.
+ * @param samples Puntero de salida al primer elemento del lote.
+ * @return uint8_t  Cantidad de muestras del lote.
+ */
+uint8_t power_get_samples(const data_sensors_t **samples) {
+    *samples = rtc_state.samples;
+    return rtc_state.sample_count;
+}
+
+
+/**
+ * @brief Quita del lote las count muestras mas antiguas, una vez publicadas (o tomadas por el
+ * cliente MQTT, que se encarga de reintentarlas).
+ */
+void power_consume_samples(uint8_t count) {
+    if (count >= rtc_state.sample_count) {
+        rtc_state.sample_count = 0;
+        return;
+    }
+    memmove(&rtc_state.samples[0], &rtc_state.samples[count],
+            sizeof(data_sensors_t) * (rtc_state.sample_count - count));
+    rtc_state.sample_count -= count;
+}
+
+
+/**
+ * @brief Devuelve el tiempo del reloj RTC en micro segundos (base de tiempo del planificador,
+ * sigue avanzando durante el deep sleep).
+ */
+int64_t power_now_us(void) {
+    return rtc_time_us();
+}
+
+
+/**
+ * @brief Cierra el ciclo actual y espera, segun POWER_MODE, hasta el instante indicado.
+ * @param wake_us Instante del proximo despertar sobre el reloj RTC (ver power_now_us).
+ */
+void power_sleep_until(int64_t wake_us) {
+    power_timeline_mark(POWER_MARK_SLEEP);
+
+    rtc_state.last_cycle_ms = (uint32_t)((timeline[POWER_MARK_SLEEP] - timeline[POWER_MARK_WAKE]) / 1000);
+    rtc_state.awake_total_ms += rtc_state.last_cycle_ms;
+    rtc_state.cycle_count++;
+    if (timeline[POWER_MARK_NET_UP] >= 0) {   // Solo los ciclos que levantaron la red (evita un log por muestra)
+        power_timeline_report();
+    }
+
+    int64_t now = rtc_time_us();
+    rtc_state.next_sample_us = (wake_us > now) ? wake_us : now;
+    int64_t remaining = rtc_state.next_sample_us - now;
+
+#if POWER_MODE == POWER_MODE_DEEP_SLEEP
+    enter_deep_sleep((uint64_t)remaining);
+#elif POWER_MODE == POWER_MODE_LIGHT_SLEEP
+    enter_light_sleep();
+#else
+    // Espera interrumpible por power_wake_early (cambio de configuracion en tiempo de ejecucion)
+    sleeping_task = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(remaining / 1000));
+    sleeping_task = NULL;
+#endif
+
+    timeline_reset();
+}
+
+
+/**
+ * @brief Interrumpe la espera de power_sleep_until para que el planificador se reevalue de
+ * inmediato con la configuracion nueva. Solo tiene efecto en POWER_MODE_ALWAYS_ON: en los modos
+ * de bajo consumo el radio esta apagado mientras se duerme y el cambio se aplica al despertar.
+ */
+void power_wake_early(void) {
+    TaskHandle_t task = sleeping_task;
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
@@ -0,0 +1,273 @@
+#include "Setting/provision.h"
+#include "Power/power.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief CRC32 IEEE (reflejado, polinomio 0xEDB88320), equivalente a esp_rom_crc32_le(0, ...).
+ */
+uint32_t prov_crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+
+/**
+ * @brief Escribe un valor con escapes %XX para los caracteres reservados del protocolo.
+ * @return size_t  Longitud escrita, o 0 si no entra en out.
+ */
+size_t prov_encode_value(const char *value, char *out, size_t out_size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+
+    for (const unsigned char *p = (const unsigned char *)value; *p; p++) {
+        int escape = (*p == ';' || *p == '=' || *p == '*' || *p == '%' || *p <= ' ' || *p >= 0x7F);
+        if (n + (escape ? 3 : 1) >= out_size) return 0;
+        if (escape) {
+            out[n++] = '%';
+            out[n++] = hex[*p >> 4];
+            out[n++] = hex[*p & 0x0F];
+        }
+        else {
+            out[n++] = (char)*p;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+
+/**
+ * @brief Decodifica un valor con escapes %XX del protocolo de aprovisionamiento.
+ * @param src Inicio del valor codificado.
+ * @param len Longitud del valor codificado.
+ * @param dst Buffer de salida (terminado en '\0').
+ * @param dst_size Tamaño del buffer de salida.
+ * @return bool  Devuelve false si hay un escape invalido o el valor no entra en dst.
+ */
+bool prov_decode_value(const char *src, size_t len, char *dst, size_t dst_size) {
+    size_t out = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+        if (c == '%') {
+            char hex[3] = {0};
+            char *endptr;
+            if (i + 2 >= len) return false;
+            hex[0] = src[i + 1];
+            hex[1] = src[i + 2];
+            c = (char)strtoul(hex, &endptr, 16);
+            if (endptr != hex + 2) return false;
+            i += 2;
+        }
+        if (out + 1 >= dst_size) return false;
+        dst[out++] = c;
+    }
+    dst[out] = '\0';
+    return true;
+}
+
+
+/**
+ * @brief Copia un string acotado al destino (siempre terminado en '\0').
+ */
+static void prov_copy(char *dst, const char *src, size_t size) {
+    snprintf(dst, size, "%s", src);
+}
+
+
+/**
+ * @brief Aplica sample_rate (minutos): un reporte por periodo con una lectura de cada sensor, igual
+ * que la migracion v2 -> v3. Los intervalos por sensor se ajustan despues con int_* si hace falta.
+ */
+void setting_apply_sample_rate(settings_t *dst, uint32_t minutes) {
+    dst->sample_rate = minutes;
+    dst->report_interval_ms = minutes * 60000UL;
+    for (int i = 0; i < DATA_SENSOR_COUNT; i++) {
+        dst->sample_interval_ms[i] = dst->report_interval_ms;
+    }
+}
+
+
+/**
+ * @brief Aplica un campo key=value sobre una configuracion en preparacion, con las mismas
+ * reglas de validacion que los comandos SET_*. Lo usan el lote PROV y el topic de control MQTT.
+ * @return bool  Devuelve false si la clave es desconocida o el valor es invalido.
+ */
+bool setting_set_field(settings_t *dst, const char *key, const char *value) {
+    char *endptr;
+    unsigned long val;
+
+    if (strcmp(key, PROV_KEY_SSID) == 0) {
+        prov_copy(dst->wifi_ssid, value, sizeof(dst->wifi_ssid));
+    }
+    else if (strcmp(key, PROV_KEY_PASS) == 0) {
+        prov_copy(dst->wifi_password, value, sizeof(dst->wifi_password));
+    }
+    else if (strcmp(key, PROV_KEY_HOST) == 0) {
+        prov_copy(dst->mqtt_host, value, sizeof(dst->mqtt_host));
+    }
+    else if (strcmp(key, PROV_KEY_PORT) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val == 0 || val > UINT16_MAX) return false;
+        dst->mqtt_port = (uint16_t)val;
+    }
+    else if (strcmp(key, PROV_KEY_USER) == 0) {
+        prov_copy(dst->mqtt_user, value, sizeof(dst->mqtt_user));
+    }
+    else if (strcmp(key, PROV_KEY_MQTT_PASS) == 0) {
+        prov_copy(dst->mqtt_password, value, sizeof(dst->mqtt_password));
+    }
+    else if (strcmp(key, PROV_KEY_NAME) == 0) {
+        prov_copy(dst->device_name, value, sizeof(dst->device_name));
+    }
+    else if (strcmp(key, PROV_KEY_SAMPLE) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val == 0 || val > UINT16_MAX) return false;
+        setting_apply_sample_rate(dst, (uint32_t)val);
+    }
+    else if (strcmp(key, PROV_KEY_REPORT) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val < SETTINGS_MIN_INTERVAL_MS) return false;
+        dst->report_interval_ms = val;
+    }
+    else if (strcmp(key, PROV_KEY_INTERVAL_KY037) == 0 || strcmp(key, PROV_KEY_INTERVAL_DHT11) == 0
+             || strcmp(key, PROV_KEY_INTERVAL_MQ135) == 0) {
+        int id = (strcmp(key, PROV_KEY_INTERVAL_KY037) == 0) ? ID_KY037
+               : (strcmp(key, PROV_KEY_INTERVAL_DHT11) == 0) ? ID_DHT11 : ID_MQ135;
+        unsigned long min = (id == ID_DHT11) ? SETTINGS_DHT11_MIN_INTERVAL_MS : SETTINGS_MIN_INTERVAL_MS;
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val < min) return false;
+        dst->sample_interval_ms[id] = val;
+    }
+    else if (strcmp(key, PROV_KEY_DEADBAND_TEMP) == 0 || strcmp(key, PROV_KEY_DEADBAND_HUM) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val > UINT16_MAX) return false;
+        if (strcmp(key, PROV_KEY_DEADBAND_TEMP) == 0) dst->deadband_temp = (uint16_t)val;
+        else dst->deadband_hum = (uint16_t)val;
+    }
+    else if (strcmp(key, PROV_KEY_DEADBAND_NOISE) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE) return false;
+        dst->deadband_noise = val;
+    }
+    else if (strcmp(key, PROV_KEY_HEARTBEAT) == 0) {   // 0 o un valor no menor al intervalo minimo
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || (val != 0 && val < SETTINGS_MIN_INTERVAL_MS)) return false;
+        dst->heartbeat_ms = val;
+    }
+    else if (strcmp(key, PROV_KEY_CALIB_MQ135) == 0) {   // Accion: la tarea de datos reinicia el aprendizaje
+        if (strcmp(value, "1") != 0) return false;
+        dst->mq135_calib_seq++;
+    }
+    else if (strcmp(key, PROV_KEY_AES) == 0) {
+        if (strlen(value) != AES_KEY_LEN - 1) return false;
+        prov_copy(dst->aes_key, value, sizeof(dst->aes_key));
+    }
+    else if (strcmp(key, PROV_KEY_BATCH) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val == 0 || val > POWER_BURST_SAMPLES) return false;
+        dst->batch_size = (uint8_t)val;
+    }
+    else if (strcmp(key, PROV_KEY_FORMAT) == 0) {
+        errno = 0;
+        val = strtoul(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val >= DATA_FORMAT_COUNT) return false;
+        dst->payload_format = (uint8_t)val;
+    }
+    else if (strcmp(key, PROV_KEY_SENSORS) == 0) {   // Mascara DATA_SENSOR_BIT(), admite "0x.."
+        errno = 0;
+        val = strtoul(value, &endptr, 0);
+        if (endptr == value || *endptr != '\0' || errno == ERANGE || val > DATA_SENSOR_ALL) return false;
+        dst->sensor_mask = (uint8_t)val;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Construye la linea "PROV k=v;...*CRC\n" que acepta el editor de linea del firmware.
+ * @return int  Longitud de la linea (incluye '\n'), o -1 si un valor no se puede codificar o la
+ * linea supera PROV_LINE_MAX caracteres.
+ */
+int prov_build_line(const prov_field_t *fields, int count, char *line, size_t size) {
+    char body[PROV_LINE_MAX + 1];
+    char encoded[3 * SETTINGS_MAX_STRING_LEN];
+    size_t len = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (prov_encode_value(fields[i].value, encoded, sizeof(encoded)) == 0 && fields[i].value[0] != '\0') return -1;
+        int w = snprintf(body + len, sizeof(body) - len, "%s%s=%s", i ? ";" : "", fields[i].key, encoded);
+        if (w < 0 || (size_t)w >= sizeof(body) - len) return -1;
+        len += (size_t)w;
+    }
+
+    int w = snprintf(line, size, "PROV %s*%08X\n", body, (unsigned)prov_crc32((const uint8_t *)body, len));
+    if (w < 0 || (size_t)w >= size || w - 1 > PROV_LINE_MAX) return -1;
+    return w;
+}
+
+
+/**
+ * @brief Valida un lote y aplica sus campos sobre staged (la configuracion actual no se toca).
+ * @param batch Texto posterior a "PROV ".
+ * @param staged Copia de trabajo de la configuracion.
+ * @param bad_key Clave del campo rechazado con PROV_ERR_FIELD.
+ * @param crc_out CRC del lote (para el ACK).
+ */
+prov_result_t prov_parse_batch(const char *batch, settings_t *staged, char *bad_key, size_t bad_key_size,
+                               uint32_t *crc_out) {
+    char key[PROV_KEY_MAX];
+    char value[SETTINGS_MAX_STRING_LEN];
+
+    const char *star = strrchr(batch, '*');
+    if (star == NULL || strlen(star + 1) != 8) return PROV_ERR_FORMAT;
+
+    char *endptr;
+    uint32_t expected = (uint32_t)strtoul(star + 1, &endptr, 16);
+    if (*endptr != '\0') return PROV_ERR_FORMAT;
+    uint32_t crc = prov_crc32((const uint8_t *)batch, (size_t)(star - batch));
+    if (crc != expected) return PROV_ERR_CRC;
+
+    const char *field = batch;
+    while (field < star) {
+        const char *end = memchr(field, ';', (size_t)(star - field));
+        if (end == NULL) end = star;
+        const char *eq = memchr(field, '=', (size_t)(end - field));
+        size_t key_len = eq ? (size_t)(eq - field) : 0;
+
+        if (eq == NULL || key_len == 0 || key_len >= sizeof(key)) return PROV_ERR_FORMAT;
+        memcpy(key, field, key_len);
+        key[key_len] = '\0';
+
+        if (!prov_decode_value(eq + 1, (size_t)(end - eq - 1), value, sizeof(value))
+            || !setting_set_field(staged, key, value)) {
+            prov_copy(bad_key, key, bad_key_size);
+            return PROV_ERR_FIELD;
+        }
+        field = end + 1;
+    }
+
+    *crc_out = crc;
+    return PROV_OK;
+}
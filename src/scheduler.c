@@ -0,0 +1,127 @@
+#include "Scheduler/scheduler.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include <string.h>
+
+
+static const char *TAG = "SCHED";
+
+
+static RTC_DATA_ATTR sched_rtc_state_t sched_state;   // Vencimientos conservados durante el deep sleep
+
+
+/**
+ * @brief Calcula el primer vencimiento posterior a now sobre la grilla epoch + k * interval.
+ * Si se perdieron periodos (despertar tardio) no se recuperan: se salta al siguiente.
+ * Al avanzar un vencimiento atendido se pasa el horizonte de agrupamiento como now, asi un
+ * vencimiento adelantado no se repite a los pocos milisegundos.
+ */
+static int64_t sched_next_aligned(int64_t now_us, uint32_t interval_ms) {
+    int64_t interval_us = (int64_t)(interval_ms ? interval_ms : SETTINGS_DEFAULT_INTERVAL_MS) * 1000;
+    int64_t elapsed = now_us - sched_state.epoch_us;
+    return sched_state.epoch_us + (elapsed / interval_us + 1) * interval_us;
+}
+
+
+/**
+ * @brief Mascara de sensores que se muestrean: habilitados y con driver.
+ */
+static uint8_t sched_active_mask(const settings_runtime_t *runtime) {
+    return runtime->sensor_mask & DATA_SENSOR_SAMPLED;
+}
+
+
+/**
+ * @brief Reinicia el planificador: todos los sensores se muestrean en el despertar actual.
+ */
+static void sched_reset(int64_t now_us, const settings_runtime_t *runtime) {
+    memset(&sched_state, 0, sizeof(sched_state));
+    sched_state.magic = SCHED_RTC_MAGIC;
+    sched_state.epoch_us = now_us;
+    for (int i = 0; i < DATA_SENSOR_COUNT; i++) {
+        sched_state.next_sample_us[i] = now_us;
+        sched_state.sample_interval_ms[i] = runtime->sample_interval_ms[i];
+    }
+    sched_state.report_interval_ms = runtime->report_interval_ms;
+    sched_state.next_report_us = sched_next_aligned(now_us, runtime->report_interval_ms);
+    sched_state.sensor_mask = sched_active_mask(runtime);
+}
+
+
+/**
+ * @brief Aplica un cambio de intervalos o sensores habilitados: solo se recalculan los
+ * vencimientos afectados, sobre la misma grilla para no perder la alineacion con el resto.
+ */
+static void sched_apply_changes(int64_t now_us, const settings_runtime_t *runtime) {
+    uint8_t mask = sched_active_mask(runtime);
+
+    for (int i = 0; i < DATA_SENSOR_COUNT; i++) {
+        bool enabled_now = (mask & ~sched_state.sensor_mask) & DATA_SENSOR_BIT(i);
+        if (enabled_now) {   // Sensor recien habilitado: primera muestra inmediata
+            sched_state.next_sample_us[i] = now_us;
+        }
+        else if (runtime->sample_interval_ms[i] != sched_state.sample_interval_ms[i]) {
+            sched_state.next_sample_us[i] = sched_next_aligned(now_us, runtime->sample_interval_ms[i]);
+        }
+        sched_state.sample_interval_ms[i] = runtime->sample_interval_ms[i];
+    }
+
+    if (runtime->report_interval_ms != sched_state.report_interval_ms) {
+        sched_state.report_interval_ms = runtime->report_interval_ms;
+        sched_state.next_report_us = sched_next_aligned(now_us, runtime->report_interval_ms);
+    }
+    sched_state.sensor_mask = mask;
+}
+
+
+/**
+ * @brief Determina que hay que hacer en el despertar actual y avanza los vencimientos atendidos.
+ * Los sensores que vencen dentro de SCHED_COALESCE_MS se adelantan al despertar actual para
+ * no provocar otro despertar a los pocos milisegundos.
+ * @param now_us Instante actual (power_now_us).
+ * @param runtime Intervalos y sensores habilitados del ciclo.
+ * @param due Salida con los sensores a muestrear y si corresponde reportar.
+ */
+void scheduler_poll(int64_t now_us, const settings_runtime_t *runtime, sched_due_t *due) {
+    const int64_t horizon = now_us + (int64_t)SCHED_COALESCE_MS * 1000;
+
+    if (sched_state.magic != SCHED_RTC_MAGIC || now_us < sched_state.epoch_us) {
+        sched_reset(now_us, runtime);
+        ESP_LOGI(TAG, "Planificador reiniciado");
+    }
+    else if (memcmp(runtime->sample_interval_ms, sched_state.sample_interval_ms, sizeof(sched_state.sample_interval_ms)) != 0
+             || runtime->report_interval_ms != sched_state.report_interval_ms
+             || sched_active_mask(runtime) != sched_state.sensor_mask) {
+        sched_apply_changes(now_us, runtime);
+        ESP_LOGI(TAG, "Intervalos actualizados");
+    }
+
+    due->sample_mask = 0;
+    for (int i = 0; i < DATA_SENSOR_COUNT; i++) {
+        if ((sched_state.sensor_mask & DATA_SENSOR_BIT(i)) && sched_state.next_sample_us[i] <= horizon) {
+            due->sample_mask |= DATA_SENSOR_BIT(i);
+            sched_state.next_sample_us[i] = sched_next_aligned(horizon, sched_state.sample_interval_ms[i]);
+        }
+    }
+
+    due->report = (sched_state.next_report_us <= horizon);
+    if (due->report) {
+        sched_state.next_report_us = sched_next_aligned(horizon, sched_state.report_interval_ms);
+    }
+}
+
+
+/**
+ * @brief Devuelve el instante del proximo despertar: el vencimiento mas cercano entre los
+ * sensores habilitados y el reporte.
+ */
+int64_t scheduler_next_wake(void) {
+    int64_t next = sched_state.next_report_us;
+
+    for (int i = 0; i < DATA_SENSOR_COUNT; i++) {
+        if ((sched_state.sensor_mask & DATA_SENSOR_BIT(i)) && sched_state.next_sample_us[i] < next) {
+            next = sched_state.next_sample_us[i];
+        }
+    }
+    return next;
+}
@@ -1,11 +1,17 @@
 #include "Setting/settings.h"
+#include "Setting/provision.h"
+#include "Data/data.h"
+#include "Power/power.h"
 #include "driver/uart.h"
 #include "esp_log.h"
 #include "nvs.h"
+#include "esp_rom_crc.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include <errno.h>
 #include <stdint.h>
 
@@ -16,8 +22,33 @@ static const char *TAG = "SETTINGS";
 
 
 
+/* ---- Formato del blob en NVS ---- */
+typedef struct {
+    uint32_t magic;      // SETTINGS_BLOB_MAGIC
+    uint16_t version;    // Version de esquema de settings_t al momento de guardar
+    uint16_t length;     // sizeof(settings_t) al momento de guardar
+    uint32_t crc;        // CRC32 de los primeros length bytes de data
+} settings_blob_header_t;
+
+typedef struct {
+    settings_blob_header_t header;
+    uint8_t data[sizeof(settings_t)];
+} settings_blob_t;
+
+
+
 settings_t settings;     // Configuracion global del dispositivo
-static char uart_buffer[SETTINGS_BUFFER_SIZE];   // Variables internas
+static char uart_buffer[SETTINGS_LINE_MAX];      // Variables internas
+static size_t line_len = 0;                      // Caracteres en edicion dentro de uart_buffer
+static bool last_was_cr = false;                 // Ultimo byte fue '\r' (para tratar CRLF como un solo fin de linea)
+static uint8_t escape_state = 0;                 // 0: normal, 1: ESC recibido, 2: dentro de una secuencia CSI
+static bool echo_enabled = true;                 // Eco de caracteres (se desactiva con "ECHO 0" desde scripts)
+static QueueHandle_t uart_queue = NULL;          // Cola de eventos del driver UART
+static settings_blob_t settings_blob;            // Buffer de lectura/escritura del blob NVS
+static uint32_t stored_crc = 0;                  // CRC de la configuracion que esta en flash
+static bool stored_valid = false;                // stored_crc corresponde a un blob valido en flash
+static SemaphoreHandle_t settings_mutex = NULL;  // Protege settings frente a cambios remotos en tiempo de ejecucion
+static StaticSemaphore_t settings_mutex_buffer;
 
 
 
@@ -35,7 +66,12 @@ esp_err_t uart_init(void) {
         .source_clk = UART_SCLK_DEFAULT,
     };
 
-    esp_err_t ret = uart_driver_install(SETTINGS_UART_PORT_NUM, SETTINGS_BUFFER_SIZE * 2, 0, 0, NULL, 0);
+    if (uart_is_driver_installed(SETTINGS_UART_PORT_NUM)) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = uart_driver_install(SETTINGS_UART_PORT_NUM, SETTINGS_BUFFER_SIZE * 2, SETTINGS_BUFFER_SIZE * 2,
+                                        SETTINGS_UART_QUEUE_LEN, &uart_queue, 0);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error instalando driver UART: %s", esp_err_to_name(ret));
         return ret;
@@ -46,6 +82,10 @@ esp_err_t uart_init(void) {
         ESP_LOGE(TAG, "Error configurando UART: %s", esp_err_to_name(ret));
         return ret;
     }
+
+    // Evento por cada fin de linea para leer comandos completos en bloque
+    uart_enable_pattern_det_baud_intr(SETTINGS_UART_PORT_NUM, '\n', 1, 9, 0, 0);
+    uart_pattern_queue_reset(SETTINGS_UART_PORT_NUM, SETTINGS_UART_QUEUE_LEN);
     return ESP_OK;
 }
 
@@ -75,10 +115,14 @@ static void show_help(void) {
     uart_send_text("| SET_SAMPLE <rate>         - Configura frecuencia de envio de datos |\r\n");
     uart_send_text("| SET_AES_KEY <key>         - Configura clave de cifrado de AES-CTR  |\r\n");
     uart_send_text("| SHOW                      - Muestra configuracion actual           |\r\n");
+    uart_send_text("| ECHO <0|1>                - Desactiva/activa el eco (scripts)      |\r\n");
+    uart_send_text("| PROV k=v;...*CRC          - Aprovisionamiento completo en un lote  |\r\n");
     uart_send_text("| EXIT                      - Salir                                  |\r\n");
     uart_send_text("| HELP                      - Muestra mensaje de ayuda               |\r\n");
     uart_send_text("| ================================================================== |\r\n");
-    uart_send_text("| Info: SET_SAMPLE setea cada cuantos minutos se envian los datos    |\r\n");
+    uart_send_text("| Info: SET_SAMPLE setea cada cuantos minutos se leen y envian datos |\r\n");
+    uart_send_text("| Intervalos en ms por sensor: PROV sample=..;int_dht11=..;... (int_*|\r\n");
+    uart_send_text("| despues de sample, que fija todos los intervalos)                  |\r\n");
     uart_send_text("| ================================================================== |\r\n\r\n");
 }
 
@@ -109,6 +153,21 @@ void show_config(void) {
     uart_send_text(temp_buffer);
     sprintf(temp_buffer,"| AES Key:           %s\r\n", strlen(settings.aes_key) > 0 ? "**configurado**" : "no configurado");
     uart_send_text(temp_buffer);
+    sprintf(temp_buffer, "| Report Interval:  %lu ms\r\n", settings.report_interval_ms);
+    uart_send_text(temp_buffer);
+    sprintf(temp_buffer, "| Sample Interval:  KY037 %lu / DHT11 %lu / MQ135 %lu ms\r\n",
+            settings.sample_interval_ms[ID_KY037], settings.sample_interval_ms[ID_DHT11],
+            settings.sample_interval_ms[ID_MQ135]);
+    uart_send_text(temp_buffer);
+    sprintf(temp_buffer, "| Deadband:         T %u / H %u / KY037 %lu, heartbeat %lu ms\r\n",
+            settings.deadband_temp, settings.deadband_hum, settings.deadband_noise, settings.heartbeat_ms);
+    uart_send_text(temp_buffer);
+    sprintf(temp_buffer, "| Batch Size:       %u\r\n", settings.batch_size);
+    uart_send_text(temp_buffer);
+    sprintf(temp_buffer, "| Payload Format:   %u\r\n", settings.payload_format);
+    uart_send_text(temp_buffer);
+    sprintf(temp_buffer, "| Sensor Mask:      0x%02X\r\n", settings.sensor_mask);
+    uart_send_text(temp_buffer);
     uart_send_text("|========================================|\r\n\r\n");
 }
 
@@ -131,6 +190,71 @@ static void show_menu(void) {
 }
 
 
+/**
+ * @brief Verifica que todos los campos de una configuracion esten completos.
+ */
+static bool settings_complete(const settings_t *s) {
+    return strlen(s->wifi_ssid) > 0 && strlen(s->wifi_password) > 0
+           && strlen(s->mqtt_host) > 0 && s->mqtt_port != 0
+           && strlen(s->mqtt_user) > 0 && strlen(s->mqtt_password) > 0
+           && strlen(s->device_name) > 0 && s->sample_rate > 0
+           && strlen(s->aes_key) > 0;
+}
+
+
+/**
+ * @brief Aprovisionamiento en una sola transaccion (modo maquina).
+ * El formato y la validacion de los campos estan en Setting/provision.h. Se valida el lote completo sobre una copia; solo si es valido y completo se aplica, se escribe
+ * NVS una unica vez y se responde "ACK <CRC>". Ante cualquier error se responde "NAK <motivo>"
+ * y la configuracion actual no se modifica.
+ * @param batch Texto posterior a "PROV ".
+ * @return bool  Devuelve true si la configuracion se aplico y guardo (finaliza el modo configuracion).
+ */
+static bool provision_batch(const char *batch) {
+    static settings_t staged;   // Copia de trabajo, fuera de la pila de la tarea
+    char key[PROV_KEY_MAX];
+    char reply[48];
+    uint32_t crc = 0;
+
+    setting_lock();
+    staged = settings;
+    setting_unlock();
+
+    switch (prov_parse_batch(batch, &staged, key, sizeof(key), &crc)) {
+        case PROV_OK:
+            break;
+        case PROV_ERR_CRC:
+            uart_send_text("NAK CRC\r\n");
+            return false;
+        case PROV_ERR_FIELD:
+            snprintf(reply, sizeof(reply), "NAK FIELD %s\r\n", key);
+            uart_send_text(reply);
+            return false;
+        default:
+            uart_send_text("NAK FORMAT\r\n");
+            return false;
+    }
+
+    if (!settings_complete(&staged)) {
+        uart_send_text("NAK INCOMPLETE\r\n");
+        return false;
+    }
+
+    setting_lock();
+    settings = staged;
+    esp_err_t ret = setting_save_to_nvs();
+    setting_unlock();
+    if (ret != ESP_OK) {
+        uart_send_text("NAK NVS\r\n");
+        return false;
+    }
+
+    snprintf(reply, sizeof(reply), "ACK %08lX\r\n", (unsigned long)crc);
+    uart_send_text(reply);
+    return true;
+}
+
+
 /**
  * @brief Procesa un comando recibido por parametro.
  * @param command String ingresado en UART que corresponde a un comando con su correspondiente parametro.
@@ -142,6 +266,11 @@ static bool process_command(const char *command) {
     char param[SETTINGS_MAX_STRING_LEN];
     char *endptr;
 
+    // Lote de aprovisionamiento: la linea completa es el parametro
+    if (strncmp(command, CMD_PROVISION " ", strlen(CMD_PROVISION) + 1) == 0) {
+        return provision_batch(command + strlen(CMD_PROVISION) + 1);
+    }
+
     // Parsear comando y parámetro
     int parsed = sscanf(command, "%31s %99s", cmd, param);
 
@@ -157,6 +286,10 @@ static bool process_command(const char *command) {
     else if (strcmp(cmd, CMD_SHOW_CONFIG) == 0) {
         show_config();
     }
+    else if (strcmp(cmd, CMD_ECHO) == 0) {
+        echo_enabled = (parsed < 2) || (strcmp(param, "0") != 0);
+        uart_send_text(echo_enabled ? "- INFO: Eco activado -\r\n" : "- INFO: Eco desactivado -\r\n");
+    }
     else if (strcmp(cmd, CMD_SET_WIFI_SSID) == 0) {
         if (parsed < 2) {
             uart_send_text("- ERROR: Falta parametro <SSID> -\r\n");
@@ -236,14 +369,12 @@ static bool process_command(const char *command) {
         else {
             errno = 0;
             unsigned long val = strtoul(param, &endptr, 10);
-            if (endptr == param || (errno == ERANGE) || (val > UINT16_MAX)) {
+            if (endptr == param || (errno == ERANGE) || val == 0 || (val > UINT16_MAX)) {
                 uart_send_text("- ERROR: Ingrese un numero de muestreo valido -\r\n");
             }
-            if (val > 0) {
-                settings.sample_rate = val;
+            else {
+                setting_apply_sample_rate(&settings, (uint32_t)val);
                 uart_send_text("- INFO: Muestreo configurado correctamente -\r\n");
-            } else {
-                uart_send_text("- ERROR: Ingrese un numero de muestreo valido -\r\n");
             }
         }
     }
@@ -281,13 +412,109 @@ static bool process_command(const char *command) {
 }
 
 
+/**
+ * @brief Reinicia el editor de linea.
+ */
+static void editor_reset(void) {
+    line_len = 0;
+    uart_buffer[0] = '\0';
+    last_was_cr = false;
+    escape_state = 0;
+}
+
+
+/**
+ * @brief Procesa un bloque de bytes recibidos con el editor de linea. El eco se acumula y se
+ * envia con una sola escritura por bloque; solo se redibuja lo que cambia (sin repetir el prompt
+ * ni el menu). Soporta backspace/DEL, Ctrl-U (borrar linea) y descarta secuencias de escape.
+ * @param data Bytes recibidos.
+ * @param len Cantidad de bytes.
+ * @return bool  Devuelve true cuando un comando EXIT finalizo la configuracion.
+ */
+static bool editor_feed(const uint8_t *data, size_t len) {
+    char echo[SETTINGS_UART_RX_CHUNK * 3 + 8];
+    size_t echo_len = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+
+        if (escape_state == 1) {   // ESC recibido: esperar '[' o descartar
+            escape_state = (c == '[') ? 2 : 0;
+            continue;
+        }
+        if (escape_state == 2) {   // ESC [ ... : descartar hasta el byte final
+            if (c >= 0x40 && c <= 0x7E) escape_state = 0;
+            continue;
+        }
+
+        if (c == '\n' && last_was_cr) {   // CRLF: el CR ya cerro la linea
+            last_was_cr = false;
+            continue;
+        }
+        last_was_cr = (c == '\r');
+
+        if (c == '\r' || c == '\n') {
+            if (echo_enabled) {
+                memcpy(echo + echo_len, "\r\n", 2);
+                echo_len += 2;
+            }
+            uart_write_bytes(SETTINGS_UART_PORT_NUM, echo, echo_len);
+            echo_len = 0;
+
+            uart_buffer[line_len] = '\0';
+            bool done = (line_len > 0) && process_command(uart_buffer);
+            line_len = 0;
+            uart_buffer[0] = '\0';
+            if (done) return true;
+            if (echo_enabled) uart_send_text(SETTINGS_PROMPT);
+        }
+        else if (c == 0x08 || c == 0x7F) {   // Backspace / DEL
+            if (line_len > 0) {
+                line_len--;
+                if (echo_enabled) {
+                    memcpy(echo + echo_len, "\b \b", 3);
+                    echo_len += 3;
+                }
+            }
+        }
+        else if (c == 0x15) {   // Ctrl-U: borrar la linea en edicion
+            line_len = 0;
+            if (echo_enabled) {
+                uart_write_bytes(SETTINGS_UART_PORT_NUM, echo, echo_len);
+                echo_len = 0;
+                uart_send_text("\r\033[K" SETTINGS_PROMPT);
+            }
+        }
+        else if (c == 0x1B) {
+            escape_state = 1;
+        }
+        else if (c >= 0x20 && c < 0x7F) {
+            if (line_len < SETTINGS_LINE_MAX - 1) {   // Linea acotada al buffer
+                uart_buffer[line_len++] = (char)c;
+                if (echo_enabled) echo[echo_len++] = (char)c;
+            }
+            else if (echo_enabled) {
+                echo[echo_len++] = '\a';
+            }
+        }
+    }
+
+    if (echo_len > 0) {
+        uart_write_bytes(SETTINGS_UART_PORT_NUM, echo, echo_len);
+    }
+    return false;
+}
+
+
 /**
  * @brief Configuracion manual del sistema a traves de UART.
+ * Usa la cola de eventos del driver: los datos se leen en bloque y la deteccion de patron
+ * ('\n') permite leer una linea completa en una sola llamada cuando llega desde un script.
  * @return bool Devuelve true cuando el proceso termina con exito, sino retorna false.
  */
 bool setting_mode_start(void) {
-    char buffer_aux[SETTINGS_MAX_STRING_LEN];
-    char c;
+    uint8_t rx[SETTINGS_UART_RX_CHUNK];
+    uart_event_t event;
     bool flag = false;
 
     // Inicializar UART
@@ -296,30 +523,49 @@ bool setting_mode_start(void) {
         return false;
     }
 
+    editor_reset();
     show_menu();
-    strcpy(buffer_aux, "config>  ");
-    uart_send_text(buffer_aux);
+    uart_send_text(SETTINGS_PROMPT);
 
     while (!flag) {
-        int bytes = uart_read_bytes(SETTINGS_UART_PORT_NUM, (uint8_t*)&c, 1, portMAX_DELAY);
-
-        if (bytes > 0) {
-            if (c == '\n') {
-                flag = process_command(uart_buffer);
-                memset(uart_buffer, 0, sizeof(uart_buffer));
-                memset(uart_buffer, 0, sizeof(uart_buffer));
-                memset(buffer_aux, 0, sizeof(buffer_aux));
-                strcpy(buffer_aux, "config>  ");
-                show_menu();
-                uart_send_text(buffer_aux);
+        if (xQueueReceive(uart_queue, &event, portMAX_DELAY) != pdTRUE) continue;
+
+        switch (event.type) {
+            case UART_DATA: {   // Lectura en bloque de todo lo disponible
+                size_t pending = event.size;
+                while (pending > 0 && !flag) {
+                    int bytes = uart_read_bytes(SETTINGS_UART_PORT_NUM, rx,
+                                                pending < sizeof(rx) ? pending : sizeof(rx), 0);
+                    if (bytes <= 0) break;
+                    flag = editor_feed(rx, (size_t)bytes);
+                    pending -= (size_t)bytes;
+                }
+                break;
             }
-            else {
-                char tmp[2] = {c,'\0'};   // convierte el char en un string de 1 char
-                strcat(uart_buffer, tmp);
-                strcat(buffer_aux, tmp);
-                uart_send_text("\r");
-                uart_send_text(buffer_aux);
+
+            case UART_PATTERN_DET: {   // Fin de linea: leer la linea completa de una vez
+                int pos = uart_pattern_pop_pos(SETTINGS_UART_PORT_NUM);
+                int remaining = pos + 1;   // pos < 0: la linea ya fue consumida por UART_DATA
+                while (remaining > 0 && !flag) {
+                    int bytes = uart_read_bytes(SETTINGS_UART_PORT_NUM, rx,
+                                                remaining < (int)sizeof(rx) ? remaining : (int)sizeof(rx), 0);
+                    if (bytes <= 0) break;
+                    flag = editor_feed(rx, (size_t)bytes);
+                    remaining -= bytes;
+                }
+                break;
             }
+
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                uart_flush_input(SETTINGS_UART_PORT_NUM);
+                xQueueReset(uart_queue);
+                editor_reset();
+                uart_send_text("\r\n- ERROR: Desborde del buffer UART, linea descartada -\r\n" SETTINGS_PROMPT);
+                break;
+
+            default:
+                break;
         }
     }
 
@@ -330,105 +576,218 @@ bool setting_mode_start(void) {
 
 
 /**
- * @brief Guardar en memoria no volatil (NVS) la configuracion.
- * @return esp_err_t  Devuelve ESP_OK cuando el almacenamiento fue correcto.
+ * @brief Completa con valores por defecto los campos que no existian en la version de esquema
+ * con la que se guardo el blob. settings_t solo crece agregando campos al final, de modo que los
+ * bytes de una version anterior siempre son un prefijo valido de la version actual.
+ * @param from_version Version de esquema del blob leido (0 = claves individuales heredadas).
  */
-esp_err_t setting_save_to_nvs(void) {
-    nvs_handle_t nvs_handle;
-
-    esp_err_t ret = nvs_open("device_setting", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Error abriendo NVS: %s", esp_err_to_name(ret));
-        return ret;
+static void settings_apply_defaults(uint16_t from_version) {
+    switch (from_version) {
+        case 0:   // v0 (una clave NVS por campo) -> v1: mismo contenido, solo cambia el formato
+            /* fall through */
+        case 1:   // v1 -> v2: parametros de tiempo de ejecucion
+            settings.batch_size = (POWER_MODE == POWER_MODE_ALWAYS_ON) ? 1 : POWER_BURST_SAMPLES;
+            settings.payload_format = DATA_FORMAT_JSON;
+            settings.sensor_mask = DATA_SENSOR_ALL;
+            settings.control_seq = 0;
+            /* fall through */
+        case 2:   // v2 -> v3: intervalos en ms; por defecto una lectura de cada sensor por reporte
+            if (settings.sample_rate) {
+                setting_apply_sample_rate(&settings, settings.sample_rate);
+            }
+            else {
+                settings.report_interval_ms = SETTINGS_DEFAULT_INTERVAL_MS;
+                for (int i = 0; i < DATA_SENSOR_COUNT; i++) {
+                    settings.sample_interval_ms[i] = SETTINGS_DEFAULT_INTERVAL_MS;
+                }
+            }
+            /* fall through */
+        case 3:   // v3 -> v4: reporte por excepcion desactivado (se publica cada reporte)
+            settings.deadband_temp = 0;
+            settings.deadband_hum = 0;
+            settings.deadband_noise = 0;
+            settings.heartbeat_ms = 0;
+            /* fall through */
+        case 4:   // v4 -> v5: sin pedidos de recalibracion del MQ135
+            settings.mq135_calib_seq = 0;
+            /* fall through */
+        default:
+            break;
     }
-
-    ret = nvs_set_str(nvs_handle, "wifi_ssid", settings.wifi_ssid);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_str(nvs_handle, "wifi_password", settings.wifi_password);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_str(nvs_handle, "mqtt_host", settings.mqtt_host);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_u16(nvs_handle, "mqtt_port", settings.mqtt_port);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_str(nvs_handle, "mqtt_user", settings.mqtt_user);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_str(nvs_handle, "mqtt_password", settings.mqtt_password);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_str(nvs_handle, "device_name", settings.device_name);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_u32(nvs_handle, "sample_rate", settings.sample_rate);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_set_str(nvs_handle, "aes_key", settings.aes_key);
-    if (ret != ESP_OK) goto exit;
-
-    ret = nvs_commit(nvs_handle);
-
-    exit:
-        nvs_close(nvs_handle);
-        return ret;
 }
 
 
 /**
- * @brief Cargar configuracion desde la memoria no volatil (NVS).
- * @return bool  Devuelve true cuando se ha cargado correctamente la configuracion.
- * Sino retorna false.
+ * @brief Lee la configuracion en el formato heredado (una clave NVS por campo).
+ * @return bool  Devuelve true si todas las claves existian.
  */
-bool setting_load_from_nvs(void) {
-    nvs_handle_t nvs_handle;
+static bool setting_load_legacy(nvs_handle_t nvs_handle) {
     size_t required_size;
-
-    esp_err_t ret = nvs_open("device_setting", NVS_READONLY, &nvs_handle);
-    if (ret != ESP_OK) return false;
+    esp_err_t ret;
 
     required_size = sizeof(settings.wifi_ssid);
     ret = nvs_get_str(nvs_handle, "wifi_ssid", settings.wifi_ssid, &required_size);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     required_size = sizeof(settings.wifi_password);
     ret = nvs_get_str(nvs_handle, "wifi_password", settings.wifi_password, &required_size);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     required_size = sizeof(settings.mqtt_host);
     ret = nvs_get_str(nvs_handle, "mqtt_host", settings.mqtt_host, &required_size);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     ret = nvs_get_u16(nvs_handle, "mqtt_port", &settings.mqtt_port);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     required_size = sizeof(settings.mqtt_user);
     ret = nvs_get_str(nvs_handle, "mqtt_user", settings.mqtt_user, &required_size);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     required_size = sizeof(settings.mqtt_password);
     ret = nvs_get_str(nvs_handle, "mqtt_password", settings.mqtt_password, &required_size);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     required_size = sizeof(settings.device_name);
     ret = nvs_get_str(nvs_handle, "device_name", settings.device_name, &required_size);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     ret = nvs_get_u32(nvs_handle, "sample_rate", &settings.sample_rate);
-    if (ret != ESP_OK) goto exit;
+    if (ret != ESP_OK) return false;
 
     required_size = sizeof(settings.aes_key);
     ret = nvs_get_str(nvs_handle, "aes_key", settings.aes_key, &required_size);
+    return ret == ESP_OK;
+}
+
+
+/**
+ * @brief Borra las claves del formato heredado una vez migradas al blob.
+ */
+static void setting_erase_legacy(void) {
+    static const char *legacy_keys[] = {
+        "wifi_ssid", "wifi_password", "mqtt_host", "mqtt_port", "mqtt_user",
+        "mqtt_password", "device_name", "sample_rate", "aes_key"
+    };
+    nvs_handle_t nvs_handle;
+
+    if (nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) return;
+    for (size_t i = 0; i < sizeof(legacy_keys) / sizeof(legacy_keys[0]); i++) {
+        nvs_erase_key(nvs_handle, legacy_keys[i]);
+    }
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+
+/**
+ * @brief Guardar en memoria no volatil (NVS) la configuracion, como un unico blob versionado
+ * con CRC. Si el contenido no cambio respecto de lo que ya esta en flash, no se escribe.
+ * @return esp_err_t  Devuelve ESP_OK cuando el almacenamiento fue correcto.
+ */
+esp_err_t setting_save_to_nvs(void) {
+    nvs_handle_t nvs_handle;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&settings, sizeof(settings_t));
+
+    if (stored_valid && stored_crc == crc) {
+        ESP_LOGI(TAG, "Configuracion sin cambios, no se escribe NVS");
+        return ESP_OK;
+    }
+
+    esp_err_t ret = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error abriendo NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    settings_blob.header.magic = SETTINGS_BLOB_MAGIC;
+    settings_blob.header.version = SETTINGS_SCHEMA_VERSION;
+    settings_blob.header.length = sizeof(settings_t);
+    settings_blob.header.crc = crc;
+    memcpy(settings_blob.data, &settings, sizeof(settings_t));
+
+    ret = nvs_set_blob(nvs_handle, SETTINGS_NVS_BLOB_KEY, &settings_blob,
+                       sizeof(settings_blob.header) + sizeof(settings_t));
     if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret == ESP_OK) {
+        stored_crc = crc;
+        stored_valid = true;
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Cargar configuracion desde la memoria no volatil (NVS) con una sola lectura del blob.
+ * Si el blob es de una version de esquema anterior se migra y se vuelve a guardar; si no existe
+ * pero hay configuracion en el formato heredado, se convierte al blob y se borran las claves viejas.
+ * @return bool  Devuelve true cuando se ha cargado correctamente la configuracion.
+ * Sino retorna false.
+ */
+bool setting_load_from_nvs(void) {
+    nvs_handle_t nvs_handle;
+    size_t size = sizeof(settings_blob);
+    const size_t header_size = sizeof(settings_blob.header);
+
+    if (settings_mutex == NULL) {
+        settings_mutex = xSemaphoreCreateMutexStatic(&settings_mutex_buffer);
+    }
+
+    // Valores por defecto para los campos que el modo configuracion no pide
+    memset(&settings, 0, sizeof(settings_t));
+    settings_apply_defaults(0);
+
+    esp_err_t ret = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (ret != ESP_OK) return false;
+
+    ret = nvs_get_blob(nvs_handle, SETTINGS_NVS_BLOB_KEY, &settings_blob, &size);
+
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {   // Formato heredado
+        bool loaded = setting_load_legacy(nvs_handle);
         nvs_close(nvs_handle);
+        if (!loaded) return false;
+
+        settings_apply_defaults(0);
+        if (setting_save_to_nvs() == ESP_OK) {
+            setting_erase_legacy();
+            ESP_LOGI(TAG, "Configuracion migrada al blob v%u", SETTINGS_SCHEMA_VERSION);
+        }
         return true;
     }
+    nvs_close(nvs_handle);
 
-    exit:
-        nvs_close(nvs_handle);
+    if (ret != ESP_OK || size < header_size) {
+        ESP_LOGE(TAG, "Error leyendo configuracion: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    const settings_blob_header_t *header = &settings_blob.header;
+    if (header->magic != SETTINGS_BLOB_MAGIC || header->version > SETTINGS_SCHEMA_VERSION
+        || header->length > sizeof(settings_t) || size != header_size + header->length
+        || esp_rom_crc32_le(0, settings_blob.data, header->length) != header->crc) {
+        ESP_LOGE(TAG, "Blob de configuracion invalido (v%u, %u bytes)", header->version, header->length);
         return false;
+    }
+
+    memset(&settings, 0, sizeof(settings_t));
+    memcpy(&settings, settings_blob.data, header->length);
+
+    if (header->version < SETTINGS_SCHEMA_VERSION) {
+        uint16_t from = header->version;
+        settings_apply_defaults(from);
+        if (setting_save_to_nvs() == ESP_OK) {
+            ESP_LOGI(TAG, "Configuracion migrada de v%u a v%u", from, SETTINGS_SCHEMA_VERSION);
+        }
+    }
+    else {
+        stored_crc = header->crc;
+        stored_valid = true;
+    }
+    return true;
 }
 
 
@@ -437,16 +796,61 @@ bool setting_load_from_nvs(void) {
  * @return bool  Devuelve true cuando la configuracion esta completa. Sino retorna false.
  */
 bool setting_is_device_configured(void) {
-    if (strlen(settings.wifi_ssid) > 0 && strlen(settings.wifi_password) > 0
-        && strlen(settings.mqtt_host) > 0 && settings.mqtt_port != 0
-        && strlen(settings.mqtt_user) > 0 && strlen(settings.mqtt_password) > 0
-        && strlen(settings.device_name) > 0 && settings.sample_rate > 0
-        && strlen(settings.aes_key) > 0) {
-        return true;
+    return settings_complete(&settings);
+}
+
+
+/**
+ * @brief Toma el mutex de la configuracion. Debe rodear toda modificacion de settings posterior
+ * al arranque y su guardado en NVS.
+ */
+void setting_lock(void) {
+    if (settings_mutex != NULL) {
+        xSemaphoreTake(settings_mutex, portMAX_DELAY);
+    }
+}
+
+
+/**
+ * @brief Libera el mutex de la configuracion.
+ */
+void setting_unlock(void) {
+    if (settings_mutex != NULL) {
+        xSemaphoreGive(settings_mutex);
     }
-    return false;
 }
 
 
+/**
+ * @brief Obtiene una copia consistente de los parametros que pueden cambiar en tiempo de
+ * ejecucion. Las tareas la toman una vez por ciclo, de modo que un cambio remoto se aplica
+ * completo y nunca a mitad de un ciclo.
+ * @param out Copia de salida.
+ */
+void setting_get_runtime(settings_runtime_t *out) {
+    setting_lock();
+    memcpy(out->sample_interval_ms, settings.sample_interval_ms, sizeof(out->sample_interval_ms));
+    out->report_interval_ms = settings.report_interval_ms;
+    out->deadband_temp = settings.deadband_temp;
+    out->deadband_hum = settings.deadband_hum;
+    out->deadband_noise = settings.deadband_noise;
+    out->heartbeat_ms = settings.heartbeat_ms;
+    out->mq135_calib_seq = settings.mq135_calib_seq;
+    out->batch_size = settings.batch_size;
+    out->payload_format = settings.payload_format;
+    out->sensor_mask = settings.sensor_mask;
+    setting_unlock();
+}
+
 
+/**
+ * @brief Huella (CRC32) de los parametros de tiempo de ejecucion, para que el backend verifique la
+ * configuracion vigente sin consultarla. No incluye credenciales ni la clave AES.
+ */
+uint32_t setting_get_hash(void) {
+    settings_runtime_t runtime;
 
+    memset(&runtime, 0, sizeof(runtime));   // relleno en cero: la huella depende solo de los campos
+    setting_get_runtime(&runtime);
+    return esp_rom_crc32_le(0, (const uint8_t *)&runtime, sizeof(runtime));
+}
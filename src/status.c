@@ -0,0 +1,93 @@
+#include "Status/status.h"
+#include "MQTT/mqtt.h"
+#include "Power/power.h"
+#include "Setting/settings.h"
+#include "esp_app_desc.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *TAG = "STATUS";
+
+
+/* ----- Ultimo registro publicado (sobrevive al deep sleep) ----- */
+typedef struct {
+    uint32_t magic;            // STATUS_RTC_MAGIC si el contenido es valido
+    int64_t boot_us;           // Arranque en frio (reloj RTC, ver power_now_us)
+    int64_t published_us;      // Ultima publicacion del registro
+    uint32_t cfg_hash;         // Huella de configuracion publicada
+    uint32_t fw_hash;          // CRC de la version de firmware publicada
+    bool stale;                // El registro retenido pudo reemplazarse por el last will
+} status_rtc_t;
+
+
+static RTC_DATA_ATTR status_rtc_t rtc_status;
+
+
+/**
+ * @brief Arma y encola el registro de estado si cambio algo desde la ultima publicacion.
+ * Se ejecuta en la tarea de esp-mqtt al establecerse la sesion.
+ */
+static void status_publish(void) {
+    const char *version = esp_app_get_description()->version;
+    uint32_t fw_hash = esp_rom_crc32_le(0, (const uint8_t *)version, strlen(version));
+    uint32_t cfg_hash = setting_get_hash();
+    int64_t now = power_now_us();
+    char record[STATUS_MAX_LEN];
+
+    if (!rtc_status.stale && rtc_status.published_us > 0
+        && rtc_status.cfg_hash == cfg_hash && rtc_status.fw_hash == fw_hash
+        && now - rtc_status.published_us < (int64_t)STATUS_REFRESH_MS * 1000) {
+        return;   // El registro retenido en el broker sigue vigente
+    }
+
+    int len = snprintf(record, sizeof(record), STATUS_ONLINE_PREFIX ":%s:%08lX:%lu", version,
+                       (unsigned long)cfg_hash, (unsigned long)((now - rtc_status.boot_us) / 1000000));
+    if (len < 0 || len >= (int)sizeof(record)) return;
+
+    if (mqtt_client_publish_topic(&mqtt_client, MQTT_TOPIC_STATUS, record, len, 1, 1) == ESP_OK) {
+        rtc_status.published_us = now;
+        rtc_status.cfg_hash = cfg_hash;
+        rtc_status.fw_hash = fw_hash;
+        rtc_status.stale = false;
+        ESP_LOGI(TAG, "Estado publicado: %s", record);
+    }
+}
+
+
+/**
+ * @brief Aviso de sesion del cliente MQTT.
+ * @param connected true al conectar; false si la conexion se perdio sin DISCONNECT.
+ */
+static void status_on_session(bool connected) {
+    if (connected) {
+        status_publish();
+    }
+    else {
+        rtc_status.stale = true;
+    }
+}
+
+
+/**
+ * @brief Configura el last will y la publicacion del estado al conectar. Debe llamarse despues de
+ * mqtt_client_set_topics y antes de mqtt_client_start.
+ * @return esp_err_t  Devuelve ESP_OK si el last will quedo configurado.
+ */
+esp_err_t status_init(void) {
+    if (rtc_status.magic != STATUS_RTC_MAGIC) {   // Arranque en frio: el registro se publica al conectar
+        memset(&rtc_status, 0, sizeof(rtc_status));
+        rtc_status.magic = STATUS_RTC_MAGIC;
+        rtc_status.boot_us = power_now_us();
+    }
+    if (power_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED) {   // Reinicio sin deep sleep: la conexion previa no cerro
+        rtc_status.stale = true;
+    }
+
+    mqtt_client_on_session(&mqtt_client, status_on_session);
+    return mqtt_client_set_will(&mqtt_client, MQTT_TOPIC_STATUS, STATUS_OFFLINE, 1, 1);
+}
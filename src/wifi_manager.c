@@ -0,0 +1,436 @@
+#include "WiFi/wifi_manager.h"
+#include "Setting/settings.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include <string.h>
+#include <sys/time.h>
+
+
+#define WIFI_CONNECTED_BIT   BIT0
+#define WIFI_GOT_IP_BIT      BIT1
+#define WIFI_FAIL_BIT        BIT2
+
+
+static const char *TAG = "WIFI";
+
+
+static RTC_DATA_ATTR wifi_cache_t rtc_cache;          // Cache del ultimo AP, sobrevive al deep sleep
+static EventGroupHandle_t wifi_events = NULL;
+static StaticEventGroup_t wifi_events_buffer;
+static esp_netif_t *sta_netif = NULL;
+static wifi_timing_t timing;
+static wifi_ap_record_t scan_records[WIFI_SCAN_MAX_AP];
+
+static volatile bool connecting = false;             // Intento de conexion en curso
+static volatile bool keep_connected = false;         // Reconectar ante desconexiones inesperadas
+static bool radio_started = false;
+static bool cached_lease = false;                    // La IP actual proviene de la cache, no de DHCP
+static int64_t t_auth_start = 0;
+static int64_t t_connected = 0;
+static int64_t t_got_ip = 0;
+
+
+/**
+ * @brief Obtiene el tiempo del reloj RTC en segundos (avanza durante el deep sleep).
+ */
+static int64_t rtc_time_s(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec;
+}
+
+
+/**
+ * @brief Carga la cache del AP. Tras un deep sleep se usa la copia en RTC, en un arranque
+ * en frio se lee la copia de NVS.
+ * @return bool  Devuelve true si hay una cache valida.
+ */
+static bool cache_load(void) {
+    if (rtc_cache.magic == WIFI_CACHE_MAGIC) {
+        return true;
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t size = sizeof(rtc_cache);
+    esp_err_t ret = nvs_get_blob(nvs_handle, WIFI_NVS_KEY, &rtc_cache, &size);
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK || size != sizeof(rtc_cache) || rtc_cache.magic != WIFI_CACHE_MAGIC) {
+        memset(&rtc_cache, 0, sizeof(rtc_cache));
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Actualiza la cache. La copia RTC se actualiza siempre; la de NVS solo cuando cambia
+ * el AP o la concesion, para no desgastar la flash en cada conexion.
+ * @param cache Nuevo contenido de la cache.
+ */
+static void cache_store(const wifi_cache_t *cache) {
+    bool changed = memcmp(rtc_cache.bssid, cache->bssid, sizeof(cache->bssid)) != 0
+                   || rtc_cache.channel != cache->channel || rtc_cache.ip != cache->ip
+                   || rtc_cache.gateway != cache->gateway || rtc_cache.netmask != cache->netmask
+                   || rtc_cache.dns != cache->dns || rtc_cache.magic != WIFI_CACHE_MAGIC;
+
+    rtc_cache = *cache;
+    rtc_cache.magic = WIFI_CACHE_MAGIC;
+    if (!changed) return;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: Error abriendo NVS: %s -", esp_err_to_name(ret));
+        return;
+    }
+    ret = nvs_set_blob(nvs_handle, WIFI_NVS_KEY, &rtc_cache, sizeof(rtc_cache));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: No se pudo guardar la cache WiFi: %s -", esp_err_to_name(ret));
+    }
+}
+
+
+/**
+ * @brief Invalida la cache (el AP cambio de canal o BSSID, o la concesion ya no es valida).
+ */
+static void cache_invalidate(void) {
+    memset(&rtc_cache, 0, sizeof(rtc_cache));
+    nvs_handle_t nvs_handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) == ESP_OK) {
+        nvs_erase_key(nvs_handle, WIFI_NVS_KEY);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+}
+
+
+/**
+ * @brief Fija una configuracion IP estatica en la interfaz STA.
+ */
+static esp_err_t set_static_ip(uint32_t ip, uint32_t gateway, uint32_t netmask, uint32_t dns) {
+    esp_err_t ret = esp_netif_dhcpc_stop(sta_netif);
+    if (ret != ESP_OK && ret != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        return ret;
+    }
+
+    esp_netif_ip_info_t info = {0};
+    info.ip.addr = ip;
+    info.gw.addr = gateway;
+    info.netmask.addr = netmask;
+    ret = esp_netif_set_ip_info(sta_netif, &info);
+    if (ret != ESP_OK) return ret;
+
+    if (dns != 0) {
+        esp_netif_dns_info_t dns_info = {0};
+        dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+        dns_info.ip.u_addr.ip4.addr = dns;
+        ret = esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Elige la fuente de la configuracion IP: estatica por configuracion, concesion DHCP
+ * cacheada (solo en el camino rapido y si no es demasiado antigua) o DHCP.
+ * @param fast true si se esta usando el camino rapido.
+ */
+static void apply_ip_config(bool fast) {
+    cached_lease = false;
+
+    if (strlen(WIFI_STATIC_IP) > 0) {
+        esp_ip4_addr_t ip = {0}, gw = {0}, mask = {0}, dns = {0};
+        esp_netif_str_to_ip4(WIFI_STATIC_IP, &ip);
+        esp_netif_str_to_ip4(WIFI_STATIC_GATEWAY, &gw);
+        esp_netif_str_to_ip4(WIFI_STATIC_NETMASK, &mask);
+        esp_netif_str_to_ip4(WIFI_STATIC_DNS, &dns);
+        if (set_static_ip(ip.addr, gw.addr, mask.addr, dns.addr) != ESP_OK) {
+            ESP_LOGE(TAG, "- ERROR: IP estatica invalida -");
+        }
+        return;
+    }
+
+    if (fast && rtc_cache.ip != 0 && (rtc_time_s() - rtc_cache.lease_time_s) < WIFI_LEASE_REUSE_S) {
+        if (set_static_ip(rtc_cache.ip, rtc_cache.gateway, rtc_cache.netmask, rtc_cache.dns) == ESP_OK) {
+            cached_lease = true;
+            return;
+        }
+    }
+
+    esp_err_t ret = esp_netif_dhcpc_start(sta_netif);
+    if (ret != ESP_OK && ret != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+        ESP_LOGE(TAG, "- ERROR: No se pudo iniciar DHCP: %s -", esp_err_to_name(ret));
+    }
+}
+
+
+/**
+ * @brief Callback de eventos WiFi e IP.
+ */
+static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        t_connected = esp_timer_get_time();
+        xEventGroupSetBits(wifi_events, WIFI_CONNECTED_BIT);
+    }
+    else if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        xEventGroupClearBits(wifi_events, WIFI_CONNECTED_BIT | WIFI_GOT_IP_BIT);
+
+        if (connecting) {
+            ESP_LOGW(TAG, "Fallo de conexion (razon %d)", event->reason);
+            xEventGroupSetBits(wifi_events, WIFI_FAIL_BIT);
+        }
+        else if (keep_connected) {
+            ESP_LOGW(TAG, "Desconectado (razon %d), reconectando...", event->reason);
+            esp_wifi_connect();
+        }
+    }
+    else if (base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        t_got_ip = esp_timer_get_time();
+        xEventGroupSetBits(wifi_events, WIFI_GOT_IP_BIT);
+    }
+}
+
+
+/**
+ * @brief Escaneo dirigido al SSID configurado. Elige el AP de mayor RSSI.
+ * @param config Configuracion STA donde se cargan BSSID y canal del AP elegido.
+ * @return esp_err_t  Devuelve ESP_OK si se encontro el AP.
+ */
+static esp_err_t scan_for_ap(wifi_config_t *config) {
+    wifi_scan_config_t scan_config = {
+        .ssid = (uint8_t *)settings.wifi_ssid,
+        .show_hidden = true,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+    };
+
+    esp_err_t ret = esp_wifi_scan_start(&scan_config, true);
+    if (ret != ESP_OK) return ret;
+
+    uint16_t count = WIFI_SCAN_MAX_AP;
+    ret = esp_wifi_scan_get_ap_records(&count, scan_records);
+    if (ret != ESP_OK || count == 0) return ESP_ERR_NOT_FOUND;
+
+    uint16_t best = 0;
+    for (uint16_t i = 1; i < count; i++) {
+        if (scan_records[i].rssi > scan_records[best].rssi) best = i;
+    }
+
+    memcpy(config->sta.bssid, scan_records[best].bssid, sizeof(config->sta.bssid));
+    config->sta.bssid_set = true;
+    config->sta.channel = scan_records[best].primary;
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Un intento de conexion completo (escaneo opcional, asociacion y obtencion de IP).
+ * @param fast true para usar BSSID/canal cacheados y saltear el escaneo.
+ * @param timeout_ms Tiempo maximo de espera de la IP.
+ * @return esp_err_t  Devuelve ESP_OK si se obtuvo IP.
+ */
+static esp_err_t connect_attempt(bool fast, uint32_t timeout_ms) {
+    wifi_config_t config = {0};
+    strncpy((char *)config.sta.ssid, settings.wifi_ssid, sizeof(config.sta.ssid) - 1);
+    strncpy((char *)config.sta.password, settings.wifi_password, sizeof(config.sta.password) - 1);
+    config.sta.scan_method = WIFI_FAST_SCAN;
+    config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+
+    memset(&timing, 0, sizeof(timing));
+    timing.fast_path = fast;
+
+    if (fast) {
+        memcpy(config.sta.bssid, rtc_cache.bssid, sizeof(config.sta.bssid));
+        config.sta.bssid_set = true;
+        config.sta.channel = rtc_cache.channel;
+    }
+    else {
+        int64_t t_scan = esp_timer_get_time();
+        if (scan_for_ap(&config) != ESP_OK) {   // Sin resultado: que el driver recorra todos los canales
+            config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        }
+        timing.scan_ms = (uint32_t)((esp_timer_get_time() - t_scan) / 1000);
+    }
+
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &config);
+    if (ret != ESP_OK) return ret;
+    apply_ip_config(fast);
+
+    xEventGroupClearBits(wifi_events, WIFI_CONNECTED_BIT | WIFI_GOT_IP_BIT | WIFI_FAIL_BIT);
+    connecting = true;
+    t_auth_start = esp_timer_get_time();
+    ret = esp_wifi_connect();
+    if (ret != ESP_OK) {
+        connecting = false;
+        return ret;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(wifi_events, WIFI_GOT_IP_BIT | WIFI_FAIL_BIT,
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    connecting = false;
+
+    if (!(bits & WIFI_GOT_IP_BIT)) {
+        esp_wifi_disconnect();
+        return (bits & WIFI_FAIL_BIT) ? ESP_FAIL : ESP_ERR_TIMEOUT;
+    }
+
+    timing.auth_ms = (uint32_t)((t_connected - t_auth_start) / 1000);
+    timing.dhcp_ms = (uint32_t)((t_got_ip - t_connected) / 1000);
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Guarda en la cache el AP y la concesion de la conexion actual.
+ */
+static void cache_update_from_link(void) {
+    wifi_cache_t cache = rtc_cache;
+    wifi_ap_record_t ap;
+
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+        cache.channel = ap.primary;
+    }
+
+    if (!cached_lease && strlen(WIFI_STATIC_IP) == 0) {   // Concesion nueva obtenida por DHCP
+        esp_netif_ip_info_t info;
+        esp_netif_dns_info_t dns_info;
+        if (esp_netif_get_ip_info(sta_netif, &info) == ESP_OK) {
+            cache.ip = info.ip.addr;
+            cache.gateway = info.gw.addr;
+            cache.netmask = info.netmask.addr;
+            cache.lease_time_s = rtc_time_s();
+        }
+        if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info) == ESP_OK) {
+            cache.dns = dns_info.ip.u_addr.ip4.addr;
+        }
+    }
+
+    cache_store(&cache);
+}
+
+
+/**
+ * @brief Inicializa la pila de red y el driver WiFi en modo STA. No enciende el radio.
+ * @return esp_err_t  Devuelve ESP_OK si la inicializacion fue exitosa.
+ */
+esp_err_t wifi_manager_init(void) {
+    esp_err_t ret = esp_netif_init();
+    if (ret != ESP_OK) return ret;
+
+    ret = esp_event_loop_create_default();
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) return ret;
+
+    sta_netif = esp_netif_create_default_wifi_sta();
+    if (sta_netif == NULL) return ESP_FAIL;
+
+    wifi_init_config_t init_config = WIFI_INIT_CONFIG_DEFAULT();
+    ret = esp_wifi_init(&init_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: Error inicializando WiFi: %s -", esp_err_to_name(ret));
+        return ret;
+    }
+
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);   // La configuracion ya vive en settings, evitar escrituras en flash
+    esp_wifi_set_mode(WIFI_MODE_STA);
+
+    wifi_events = xEventGroupCreateStatic(&wifi_events_buffer);
+
+    esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL);
+    esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL);
+
+    if (cache_load()) {
+        ESP_LOGI(TAG, "Cache de AP disponible (canal %u)", rtc_cache.channel);
+    }
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Enciende el radio y conecta al AP configurado. Usa el camino rapido (BSSID/canal y
+ * concesion cacheados) si hay cache, y recurre al escaneo completo si falla.
+ * @param timeout_ms Tiempo maximo por intento.
+ * @return esp_err_t  Devuelve ESP_OK cuando hay conexion con IP.
+ */
+esp_err_t wifi_manager_connect(uint32_t timeout_ms) {
+    if (wifi_events == NULL) return ESP_ERR_INVALID_STATE;
+    if (wifi_manager_is_connected()) return ESP_OK;
+
+    int64_t t_start = esp_timer_get_time();
+    if (!radio_started) {
+        esp_err_t ret = esp_wifi_start();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "- ERROR: Error iniciando WiFi: %s -", esp_err_to_name(ret));
+            return ret;
+        }
+        radio_started = true;
+    }
+
+    bool fast = (rtc_cache.magic == WIFI_CACHE_MAGIC);
+    esp_err_t ret = connect_attempt(fast, timeout_ms);
+    if (ret != ESP_OK && fast) {
+        ESP_LOGW(TAG, "Camino rapido fallido, escaneo completo");
+        cache_invalidate();
+        ret = connect_attempt(false, timeout_ms);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "- ERROR: No se pudo conectar a %s -", settings.wifi_ssid);
+        return ret;
+    }
+
+    timing.total_ms = (uint32_t)((t_got_ip - t_start) / 1000);
+    keep_connected = true;
+    cache_update_from_link();
+
+    ESP_LOGI(TAG, "Conectado (%s): scan %lu ms, auth %lu ms, dhcp %lu ms, total %lu ms",
+             timing.fast_path ? "rapido" : "completo", (unsigned long)timing.scan_ms,
+             (unsigned long)timing.auth_ms, (unsigned long)timing.dhcp_ms, (unsigned long)timing.total_ms);
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Desconecta y apaga el radio.
+ */
+void wifi_manager_disconnect(void) {
+    keep_connected = false;
+    if (!radio_started) return;
+
+    esp_wifi_disconnect();
+    esp_wifi_stop();
+    radio_started = false;
+    xEventGroupClearBits(wifi_events, WIFI_CONNECTED_BIT | WIFI_GOT_IP_BIT);
+}
+
+
+/**
+ * @brief Indica si hay conexion con IP asignada.
+ */
+bool wifi_manager_is_connected(void) {
+    return wifi_events != NULL && (xEventGroupGetBits(wifi_events) & WIFI_GOT_IP_BIT);
+}
+
+
+/**
+ * @brief Devuelve el desglose de tiempos de la ultima conexion.
+ */
+const wifi_timing_t *wifi_manager_get_timing(void) {
+    return &timing;
+}
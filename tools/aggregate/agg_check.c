@@ -0,0 +1,186 @@
+/*
+ * Verificacion (host) del agregador de ventanas (src/aggregate.c) contra una referencia de dos
+ * pasadas en long double.
+ *
+ * Compilar (desde la raiz del repositorio):
+ *   cc -O2 -Iinclude -o agg_check tools/aggregate/agg_check.c src/aggregate.c -lm
+ *
+ * Uso:
+ *   agg_check [iteraciones]     (por defecto 500 secuencias aleatorias por caso)
+ *
+ * Casos: ventana vacia y con una sola muestra, ventanas fijas (acumulacion en una pasada y reinicio
+ * tras el resumen), ventanas deslizantes (union de sub-ventanas, descarte de las vencidas) y el
+ * peor caso de rango: 65535 muestras en los extremos de 16 bits.
+ *
+ * Codigo de salida: 0 si todos los casos pasan, 1 si alguno falla.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Aggregate/aggregate.h"
+
+
+#define MAX_SAMPLES   65535
+
+
+static int failures = 0;
+static fx_t values[MAX_SAMPLES];
+static int64_t times[MAX_SAMPLES];
+
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FALLA: " __VA_ARGS__); printf("\n"); } } while (0)
+
+
+/**
+ * @brief Referencia de dos pasadas sobre las muestras seleccionadas (mask NULL: todas).
+ */
+static void reference(const fx_t *v, const bool *mask, int n, agg_summary_t *out, long double *std_exact) {
+    long double sum = 0, scatter = 0;
+    int count = 0;
+
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < n; i++) {
+        if (mask && !mask[i]) continue;
+        if (count == 0 || v[i] < out->min) out->min = v[i];
+        if (count == 0 || v[i] > out->max) out->max = v[i];
+        sum += v[i];
+        count++;
+    }
+    out->count = (uint32_t)count;
+    *std_exact = 0;
+    if (count == 0) return;
+
+    long double mean = sum / count;
+    out->mean = (fx_t)llroundl(mean);
+    for (int i = 0; i < n; i++) {
+        if (mask && !mask[i]) continue;
+        scatter += (v[i] - mean) * (v[i] - mean);
+    }
+    if (count > 1) *std_exact = sqrtl(scatter / (count - 1));
+}
+
+
+static void compare(const char *name, int it, bool has, const agg_summary_t *got, const agg_summary_t *ref,
+                    long double std_exact) {
+    CHECK(has == (ref->count > 0), "%s %d: resumen %s", name, it, has ? "con muestras inesperadas" : "vacio");
+    CHECK(got->count == ref->count, "%s %d: count %u != %u", name, it, got->count, ref->count);
+    if (ref->count == 0) return;
+    CHECK(got->min == ref->min && got->max == ref->max, "%s %d: min/max %ld/%ld != %ld/%ld", name, it,
+          (long)got->min, (long)got->max, (long)ref->min, (long)ref->max);
+    CHECK(got->mean == ref->mean, "%s %d: media %ld != %ld", name, it, (long)got->mean, (long)ref->mean);
+    CHECK(fabsl(got->stddev - std_exact) <= 1.0L, "%s %d: desvio %ld vs %.3Lf", name, it, (long)got->stddev, std_exact);
+}
+
+
+static fx_t random_value(void) {
+    switch (rand() % 3) {
+        case 0:  return (fx_t)(rand() % 6001) - 1000;                   // Temperatura: -10.00 .. 50.00
+        case 1:  return (fx_t)(rand() % 10001);                         // Humedad: 0.00 .. 100.00
+        default: return (fx_t)(rand() % 65536) + FX16_MIN;              // Rango completo de 16 bits
+    }
+}
+
+
+static void check_edges(void) {
+    agg_window_t w;
+    agg_summary_t s;
+
+    agg_init(&w, AGG_WINDOW_TUMBLING, 0);
+    CHECK(!agg_summary(&w, 0, &s) && s.count == 0 && s.stddev == 0, "ventana vacia con resumen");
+
+    agg_add(&w, 0, -1234);
+    CHECK(agg_summary(&w, 0, &s) && s.count == 1 && s.mean == -1234 && s.min == -1234 && s.max == -1234
+          && s.stddev == 0, "una muestra: media %ld desvio %ld", (long)s.mean, (long)s.stddev);
+    CHECK(!agg_summary(&w, 0, &s) && s.last == -1234, "la ventana fija no se reinicio o perdio el ultimo valor");
+
+    agg_init(&w, AGG_WINDOW_SLIDING, 8000);
+    CHECK(!agg_summary(&w, 0, &s), "ventana deslizante vacia con resumen");
+    agg_add(&w, 500000, 42);
+    CHECK(agg_summary(&w, 500000, &s) && s.count == 1 && s.stddev == 0, "deslizante con una muestra");
+    CHECK(!agg_summary(&w, 9000000, &s) && s.last == 42, "muestra vencida sigue en la ventana");
+}
+
+
+static void check_tumbling(int iterations) {
+    agg_window_t w;
+    agg_summary_t got, ref;
+    long double std_exact;
+
+    for (int it = 0; it < iterations; it++) {
+        int n = 1 + rand() % 2000;
+        agg_init(&w, AGG_WINDOW_TUMBLING, 0);
+        for (int i = 0; i < n; i++) {
+            values[i] = random_value();
+            agg_add(&w, i, values[i]);
+        }
+        bool has = agg_summary(&w, n, &got);
+        reference(values, NULL, n, &ref, &std_exact);
+        compare("fija", it, has, &got, &ref, std_exact);
+    }
+}
+
+
+/**
+ * @brief Muestras repartidas en el tiempo: el resumen une las sub-ventanas vigentes. La referencia
+ * selecciona las mismas muestras por sub-ventana (epoch > actual - AGG_SLIDING_SLOTS).
+ */
+static void check_sliding(int iterations) {
+    static bool mask[MAX_SAMPLES];
+    agg_window_t w;
+    agg_summary_t got, ref;
+    long double std_exact;
+
+    for (int it = 0; it < iterations; it++) {
+        uint32_t window_ms = 800 + (uint32_t)(rand() % 20000);
+        int64_t slot_us = (int64_t)window_ms * 1000 / AGG_SLIDING_SLOTS;
+        int n = 1 + rand() % 2000;
+        int64_t t = rand() % 1000000;
+
+        agg_init(&w, AGG_WINDOW_SLIDING, window_ms);
+        for (int i = 0; i < n; i++) {
+            t += rand() % (slot_us / 4 + 1);
+            times[i] = t;
+            values[i] = random_value();
+            agg_add(&w, t, values[i]);
+        }
+        int64_t now = t + rand() % (slot_us * 2);
+        int64_t current = now / slot_us;
+        for (int i = 0; i < n; i++) {
+            mask[i] = (times[i] / slot_us) > current - AGG_SLIDING_SLOTS;
+        }
+        bool has = agg_summary(&w, now, &got);
+        reference(values, mask, n, &ref, &std_exact);
+        compare("deslizante", it, has, &got, &ref, std_exact);
+    }
+}
+
+
+static void check_range(void) {
+    agg_window_t w;
+    agg_summary_t got, ref;
+    long double std_exact;
+
+    agg_init(&w, AGG_WINDOW_TUMBLING, 0);
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+        values[i] = (i & 1) ? FX16_MAX : FX16_MIN;
+        agg_add(&w, i, values[i]);
+    }
+    bool has = agg_summary(&w, MAX_SAMPLES, &got);
+    reference(values, NULL, MAX_SAMPLES, &ref, &std_exact);
+    compare("extremos", 0, has, &got, &ref, std_exact);
+}
+
+
+int main(int argc, char **argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 500;
+
+    srand(4321);
+    check_edges();
+    check_tumbling(iterations);
+    check_sliding(iterations);
+    check_range();
+
+    printf("%s (%d fallas)\n", failures ? "FALLA" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Decodificador y banco de pruebas (host) del formato binario por lotes (DATA_FORMAT_DELTA).
+ * Usa el mismo src/codec.c que el firmware.
+ *
+ * Compilar (desde la raiz del repositorio):
+ *   cc -O2 -Iinclude -o codec_tool tools/codec/codec_tool.c src/codec.c
+ *
+ * Uso:
+ *   codec_tool decode <hex>                 Decodifica un lote (datos ya descifrados) y lo imprime en JSON
+ *   codec_tool encode <traza.csv> [lote]    Codifica la traza en lotes e imprime un lote hex por linea
+ *   codec_tool bench <traza.csv> [lote]     Compara bytes JSON vs. binario y verifica la ida y vuelta
+ *
+ * Traza CSV (una fila por reporte, valores de temperatura/humedad en centesimas, '#' comenta):
+ *   ky037_counter,ky037_max_duration,temp,hum,temp_min,temp_max,temp_mean,temp_std,
+ *   hum_min,hum_max,hum_mean,hum_std,dht11_samples
+ * y opcionalmente, con el MQ135 (concentraciones en centesimas de ppm):
+ *   ,co2,co,nh3,c6h6,no2,mq135_samples,mq135_calibrated
+ * Todas las filas deben tener la misma cantidad de campos; define los sensores del lote.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Codec/codec.h"
+
+
+#define MAX_BATCH      255
+#define MAX_ROWS       100000
+#define TRACE_FIELDS   13     // KY037 + DHT11
+#define TRACE_FIELDS_MQ135   (TRACE_FIELDS + DATA_GAS_COUNT + 2)
+
+
+static data_sensors_t rows[MAX_ROWS];
+static uint8_t trace_mask;     // Sensores presentes en la traza
+
+
+static int load_trace(const char *path) {
+    char line[512];
+    int count = 0;
+    int fields = 0;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) && count < MAX_ROWS) {
+        long v[TRACE_FIELDS_MQ135];
+        char *p = line;
+        int n = 0;
+
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+        while (n < TRACE_FIELDS_MQ135) {
+            char *end;
+            v[n] = strtol(p, &end, 10);
+            if (end == p) break;
+            n++;
+            p = (*end == ',') ? end + 1 : end;
+        }
+        if (count == 0) fields = n;
+        if ((n != TRACE_FIELDS && n != TRACE_FIELDS_MQ135) || n != fields) {
+            fprintf(stderr, "Fila %d invalida: %s", count + 1, line);
+            fclose(f);
+            return -1;
+        }
+
+        data_sensors_t *d = &rows[count++];
+        memset(d, 0, sizeof(*d));
+        d->ky037_counter = (uint32_t)v[0];
+        d->ky037_max_duration = (uint32_t)v[1];
+        d->temperature = fx_to16(v[2]);
+        d->humidity = fx_to16(v[3]);
+        d->temp_min = fx_to16(v[4]);
+        d->temp_max = fx_to16(v[5]);
+        d->temp_mean = fx_to16(v[6]);
+        d->temp_std = fx_to16(v[7]);
+        d->hum_min = fx_to16(v[8]);
+        d->hum_max = fx_to16(v[9]);
+        d->hum_mean = fx_to16(v[10]);
+        d->hum_std = fx_to16(v[11]);
+        d->dht11_samples = (uint16_t)v[12];
+        if (n == TRACE_FIELDS_MQ135) {
+            for (int i = 0; i < DATA_GAS_COUNT; i++) {
+                d->gas_ppm[i] = (fx_t)v[TRACE_FIELDS + i];
+            }
+            d->mq135_samples = (uint16_t)v[TRACE_FIELDS + DATA_GAS_COUNT];
+            d->mq135_calibrated = (uint8_t)v[TRACE_FIELDS + DATA_GAS_COUNT + 1];
+        }
+    }
+    fclose(f);
+
+    trace_mask = DATA_SENSOR_BIT(ID_KY037) | DATA_SENSOR_BIT(ID_DHT11);
+    if (fields == TRACE_FIELDS_MQ135) trace_mask |= DATA_SENSOR_BIT(ID_MQ135);
+    return count;
+}
+
+
+static int print_batch_json(const data_sensors_t *batch, int count, uint8_t mask) {
+    char json[DATA_JSON_MAX];
+    for (int i = 0; i < count; i++) {
+        if (codec_format_json(&batch[i], mask, json, sizeof(json)) < 0) return -1;
+        printf("%s\n", json);
+    }
+    return 0;
+}
+
+
+static int cmd_decode(const char *hex) {
+    static uint8_t buf[4096];
+    static data_sensors_t batch[MAX_BATCH];
+    size_t len = strlen(hex) / 2;
+    uint8_t mask;
+
+    if (strlen(hex) % 2 != 0 || len > sizeof(buf)) {
+        fprintf(stderr, "Hex invalido\n");
+        return 2;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            fprintf(stderr, "Hex invalido\n");
+            return 2;
+        }
+        buf[i] = (uint8_t)byte;
+    }
+
+    int count = codec_decode_batch(buf, len, batch, MAX_BATCH, &mask);
+    if (count < 0) {
+        fprintf(stderr, "Lote invalido\n");
+        return 1;
+    }
+    return print_batch_json(batch, count, mask) == 0 ? 0 : 1;
+}
+
+
+static int cmd_encode(const char *path, int batch_size, int bench) {
+    static uint8_t buf[4096];
+    static data_sensors_t decoded[MAX_BATCH];
+    char json[DATA_JSON_MAX];
+    size_t json_bytes = 0, json_messages = 0, bin_bytes = 0, bin_messages = 0;
+
+    int total = load_trace(path);
+    if (total <= 0) return 2;
+    const uint8_t mask = trace_mask;
+
+    for (int start = 0; start < total; start += batch_size) {
+        int count = (total - start < batch_size) ? total - start : batch_size;
+        size_t len = codec_encode_batch(&rows[start], (uint8_t)count, mask, buf, sizeof(buf));
+        if (len == 0) {
+            fprintf(stderr, "Lote %d no entra en el buffer\n", start / batch_size);
+            return 1;
+        }
+
+        if (!bench) {
+            for (size_t i = 0; i < len; i++) printf("%02X", buf[i]);
+            printf("\n");
+            continue;
+        }
+
+        // Ida y vuelta exacta
+        if (codec_decode_batch(buf, len, decoded, MAX_BATCH, NULL) != count
+            || memcmp(decoded, &rows[start], sizeof(data_sensors_t) * count) != 0) {
+            fprintf(stderr, "ERROR: la decodificacion del lote %d no coincide\n", start / batch_size);
+            return 1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int n = codec_format_json(&rows[start + i], mask, json, sizeof(json));
+            if (n < 0) return 1;
+            json_bytes += (size_t)n;
+            json_messages++;
+        }
+        bin_bytes += len;
+        bin_messages++;
+    }
+
+    if (bench) {
+        printf("reportes:        %d (lotes de %d)\n", total, batch_size);
+        printf("JSON:            %zu bytes en %zu mensajes (%.1f bytes/reporte)\n",
+               json_bytes, json_messages, (double)json_bytes / total);
+        printf("binario (delta): %zu bytes en %zu mensajes (%.1f bytes/reporte)\n",
+               bin_bytes, bin_messages, (double)bin_bytes / total);
+        printf("relacion:        %.1fx\n", (double)json_bytes / (double)bin_bytes);
+    }
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && strcmp(argv[1], "decode") == 0) {
+        return cmd_decode(argv[2]);
+    }
+    if (argc >= 3 && (strcmp(argv[1], "encode") == 0 || strcmp(argv[1], "bench") == 0)) {
+        int batch = (argc >= 4) ? atoi(argv[3]) : 4;
+        if (batch < 1 || batch > MAX_BATCH) {
+            fprintf(stderr, "Lote invalido (1..%d)\n", MAX_BATCH);
+            return 2;
+        }
+        return cmd_encode(argv[2], batch, strcmp(argv[1], "bench") == 0);
+    }
+
+    fprintf(stderr, "Uso: %s decode <hex> | encode <traza.csv> [lote] | bench <traza.csv> [lote]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,223 @@
+/*
+ * Verificacion (host) del modelo del MQ135 en punto fijo (src/mq135_model.c) contra la curva
+ * evaluada en double con libm.
+ *
+ * Compilar (desde la raiz del repositorio):
+ *   cc -O2 -Iinclude -Itools/mqtt_sim/host -o mq135_check tools/mq135/mq135_check.c src/mq135_model.c \
+ *      src/baseline.c -lm
+ *
+ * Uso:
+ *   mq135_check [iteraciones]     (por defecto 100000 muestras aleatorias por caso)
+ *
+ * Casos: log2 y 2^x en todo el rango, resistencia a partir de la tension, factor de compensacion en
+ * el rango del DHT11, R0 en aire limpio, concentracion de cada gas (incluido el tope) y la secuencia
+ * aprendizaje -> seguimiento diario de R0 con aire estable (R0 no debe moverse al terminar el
+ * aprendizaje).
+ *
+ * Codigo de salida: 0 si todos los casos pasan, 1 si alguno falla.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "MQ135/mq135.h"
+
+
+#define REL_TOLERANCE   2e-4      // Error relativo admitido ademas del redondeo a entero
+#define DAY_US          ((int64_t)BASELINE_DAY_MS * 1000)
+#define SAMPLE_US       ((int64_t)10 * 60 * 1000000)   // Una muestra cada 10 minutos
+#define TRACK_DAYS      30
+
+
+static int failures = 0;
+
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FALLA: " __VA_ARGS__); printf("\n"); } } while (0)
+
+
+typedef struct {
+    const char *name;
+    double a, b, atm;
+} gas_ref_t;
+
+static const gas_ref_t gas_refs[MQ135_GAS_COUNT] = {
+    { "CO2",  CO2_A,  CO2_B,  ATM_CO2  },
+    { "CO",   CO_A,   CO_B,   ATM_CO   },
+    { "NH3",  NH3_A,  NH3_B,  ATM_NH3  },
+    { "C6H6", C6H6_A, C6H6_B, ATM_C6H6 },
+    { "NO2",  NO2_A,  NO2_B,  ATM_NO2  },
+};
+
+
+static void curve_init(mq135_curve_t *curve, const gas_ref_t *ref, uint32_t r0) {
+    mq135_curve_init(curve, (uint32_t)(ref->a * 1000.0 + 0.5), MQ135_Q16(ref->b), (uint32_t)(ref->atm * 1000.0 + 0.5), r0);
+}
+
+
+static uint32_t random_u32(void) {
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+
+static void check_log_exp(int iterations) {
+    double worst_log = 0, worst_exp = 0;
+
+    CHECK(mq135_log2(1) == 0 && mq135_log2(1024) == 10 * MQ135_Q16_ONE, "log2 de potencias de 2");
+    CHECK(mq135_exp2(0) == 1 && mq135_exp2(20 * MQ135_Q16_ONE) == 1U << 20, "2^x de enteros");
+    CHECK(mq135_exp2(40 * MQ135_Q16_ONE) == UINT32_MAX && mq135_exp2(-5 * MQ135_Q16_ONE) == 0, "2^x sin saturar");
+
+    for (int it = 0; it < iterations; it++) {
+        uint32_t x = 1 + random_u32() % UINT32_MAX;
+        double err = fabs(mq135_log2(x) / 65536.0 - log2((double)x));
+        if (err > worst_log) worst_log = err;
+
+        int32_t e = (int32_t)(random_u32() % (31U * MQ135_Q16_ONE));
+        double exact = exp2(e / 65536.0);
+        err = (fabs(mq135_exp2(e) - exact) - 0.5) / exact;   // Sin el redondeo a entero
+        if (err > worst_exp) worst_exp = err;
+    }
+    CHECK(worst_log <= 2.0 / 65536.0, "log2: error %.3g", worst_log);
+    CHECK(worst_exp <= 1e-6, "2^x: error relativo %.3g", worst_exp);
+    printf("log2: error max %.3g, 2^x: error relativo max %.3g\n", worst_log, worst_exp);
+}
+
+
+static void check_resistance(void) {
+    for (int mv = 1; mv < MQ135_VCC_MV; mv++) {
+        double exact = MQ135_RLOAD_OHM * (MQ135_VCC_MV - mv) / (double)mv;
+        uint32_t got = mq135_resistance_from_mv(mv);
+        CHECK(fabs(got - exact) <= 0.5, "resistencia a %d mV: %lu vs %.2f", mv, (unsigned long)got, exact);
+    }
+    CHECK(mq135_resistance_from_mv(0) == 0 && mq135_resistance_from_mv(MQ135_VCC_MV) == 0, "tension fuera de rango aceptada");
+}
+
+
+static void check_correction(void) {
+    double worst = 0;
+
+    for (fx_t t = FX_CONST(-10.0); t <= FX_CONST(50.0); t += 7) {
+        for (fx_t h = 0; h <= FX_CONST(100.0); h += 13) {
+            double tc = t / 100.0, hc = h / 100.0;
+            double exact = CORA * tc * tc - CORB * tc + CORC + CORD * RELATIVE_HUMIDITY - CORD * hc;
+            double err = fabs(mq135_correction_factor(t, h) / 1e6 - exact);
+            if (err > worst) worst = err;
+        }
+    }
+    CHECK(worst <= 1e-6, "factor de compensacion: error %.3g", worst);
+
+    int32_t factor = mq135_correction_factor(FX_CONST(25.0), FX_CONST(60.0));
+    CHECK(mq135_correct_resistance(30000, factor) == (uint32_t)llround(30000 * 1e6 / factor), "resistencia corregida");
+}
+
+
+/**
+ * @brief Concentracion y R0 de cada gas contra la curva en double, con resistencias y R0 aleatorios
+ * en el rango util del sensor (100 ohm .. 1 Mohm).
+ */
+static void check_curves(int iterations) {
+    for (int g = 0; g < MQ135_GAS_COUNT; g++) {
+        const gas_ref_t *ref = &gas_refs[g];
+        double worst = 0, worst_r0 = 0;
+        mq135_curve_t curve;
+
+        for (int it = 0; it < iterations; it++) {
+            uint32_t r0 = 100 + random_u32() % 1000000;
+            uint32_t rs = 100 + random_u32() % 1000000;
+            curve_init(&curve, ref, r0);
+
+            double r0_exact = rs * pow(ref->atm / ref->a, 1.0 / ref->b);
+            double r0_err = fabs(exp2(mq135_curve_r0(&curve, rs) / 65536.0) / r0_exact - 1.0);
+            if (r0_err > worst_r0) worst_r0 = r0_err;
+
+            double ppm = ref->a * pow((double)rs / r0, -ref->b) * FX_SCALE;
+            fx_t got = mq135_curve_ppm(&curve, rs, MQ135_PPM_MAX);
+            if (ppm >= MQ135_PPM_MAX) {
+                CHECK(got == MQ135_PPM_MAX, "%s: sin tope (%ld)", ref->name, (long)got);
+            }
+            else {
+                double err = (fabs(got - ppm) - 0.5) / ppm;   // Sin el redondeo a centesimas
+                if (err > worst) worst = err;
+            }
+        }
+        CHECK(worst <= REL_TOLERANCE, "%s: error relativo de ppm %.3g", ref->name, worst);
+        CHECK(worst_r0 <= REL_TOLERANCE, "%s: error relativo de R0 %.3g", ref->name, worst_r0);
+        printf("%s: error relativo max ppm %.3g, R0 %.3g\n", ref->name, worst, worst_r0);
+
+        // En aire limpio la curva devuelve la concentracion atmosferica
+        curve_init(&curve, ref, 930);
+        curve.log2_r0 = mq135_curve_r0(&curve, 40000);
+        double atm = ref->atm * FX_SCALE;
+        CHECK(fabs(mq135_curve_ppm(&curve, 40000, MQ135_PPM_MAX) - atm) <= atm * REL_TOLERANCE + 1.0,
+              "%s: aire limpio %ld vs %.0f", ref->name, (long)mq135_curve_ppm(&curve, 40000, MQ135_PPM_MAX), atm);
+    }
+}
+
+
+static uint32_t constant_air(int64_t t_us) {
+    (void)t_us;
+    return 40000;
+}
+
+
+/**
+ * @brief Aire estable con ciclo diario (temperatura, ventilacion): la media y el pico del dia difieren.
+ */
+static uint32_t daily_cycle(int64_t t_us) {
+    return (uint32_t)lround(40000.0 + 6000.0 * sin(2.0 * M_PI * (double)(t_us % DAY_US) / (double)DAY_US));
+}
+
+
+/**
+ * @brief Reproduce la secuencia de mq135_sample: la linea base se alimenta desde la primera muestra,
+ * al cumplirse MQ135_BURNIN_MS el aprendizaje fija R0 y despues cada dia cerrado lo acerca a la
+ * linea base con paso acotado.
+ * @param max_drift Cambio admitido de R0 tras el aprendizaje (log2 Q16).
+ */
+static void check_tracking(const char *name, uint32_t (*signal)(int64_t t_us), int32_t max_drift) {
+    mq135_curve_t curves[MQ135_GAS_COUNT];
+    int32_t learned[MQ135_GAS_COUNT];
+    int32_t drift = 0;
+    bool learning = true;
+    baseline_t tracker;
+
+    for (int g = 0; g < MQ135_GAS_COUNT; g++) curve_init(&curves[g], &gas_refs[g], CO2_R0);
+    baseline_init(&tracker);
+
+    for (int64_t t = 0; t <= (int64_t)TRACK_DAYS * DAY_US; t += SAMPLE_US) {
+        if (!baseline_update(&tracker, t, signal(t))) continue;
+        uint32_t base = baseline_value(&tracker);
+
+        if (learning) {
+            if (base > 0 && t >= (int64_t)MQ135_BURNIN_MS * 1000) {
+                mq135_track_r0(curves, MQ135_GAS_COUNT, base, MQ135_R0_UNLIMITED);
+                for (int g = 0; g < MQ135_GAS_COUNT; g++) learned[g] = curves[g].log2_r0;
+                learning = false;
+            }
+            continue;
+        }
+        if (base > 0) mq135_track_r0(curves, MQ135_GAS_COUNT, base, MQ135_R0_MAX_STEP);
+        for (int g = 0; g < MQ135_GAS_COUNT; g++) {
+            int32_t d = abs(curves[g].log2_r0 - learned[g]);
+            if (d > drift) drift = d;
+        }
+    }
+
+    CHECK(!learning, "%s: el aprendizaje no termino", name);
+    CHECK(drift <= max_drift, "%s: R0 se movio %.3f %% tras el aprendizaje", name, (exp2(drift / 65536.0) - 1.0) * 100.0);
+    printf("Seguimiento (%s): R0 se movio %.4f %% en %d dias\n", name, (exp2(drift / 65536.0) - 1.0) * 100.0, TRACK_DAYS);
+}
+
+
+int main(int argc, char **argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    srand(135);
+    check_log_exp(iterations);
+    check_resistance();
+    check_correction();
+    check_curves(iterations);
+    check_tracking("constante", constant_air, 0);
+    check_tracking("ciclo diario", daily_cycle, MQ135_R0_SAVE_DELTA / 10);
+
+    printf("%s (%d fallas)\n", failures ? "FALLA" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+/* Reemplazo minimo de esp_err.h para compilar en host los modulos portables del firmware */
+#ifndef HOST_ESP_ERR_H
+#define HOST_ESP_ERR_H
+
+#include <stddef.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                 0
+#define ESP_FAIL               -1
+#define ESP_ERR_NO_MEM         0x101
+#define ESP_ERR_INVALID_ARG    0x102
+#define ESP_ERR_INVALID_STATE  0x103
+#define ESP_ERR_INVALID_SIZE   0x104
+#define ESP_ERR_TIMEOUT        0x107
+#define ESP_ERR_NVS_NOT_FOUND  0x1102
+
+const char *esp_err_to_name(esp_err_t code);
+
+/* newlib (ESP-IDF) declara strlcpy en string.h; glibc anterior a 2.38 no la tiene (ver mqtt_sim.c) */
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#endif //HOST_ESP_ERR_H
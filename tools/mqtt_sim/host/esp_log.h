@@ -0,0 +1,10 @@
+/* Reemplazo minimo de esp_log.h: los logs del firmware se descartan en el simulador */
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#define ESP_LOGE(tag, ...) ((void)(tag))
+#define ESP_LOGW(tag, ...) ((void)(tag))
+#define ESP_LOGI(tag, ...) ((void)(tag))
+#define ESP_LOGD(tag, ...) ((void)(tag))
+
+#endif //HOST_ESP_LOG_H
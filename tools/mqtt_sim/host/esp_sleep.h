@@ -0,0 +1,7 @@
+/* Reemplazo minimo de esp_sleep.h: solo el tipo que declara Power/power.h */
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+typedef int esp_sleep_wakeup_cause_t;
+
+#endif //HOST_ESP_SLEEP_H
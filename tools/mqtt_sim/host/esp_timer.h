@@ -0,0 +1,9 @@
+/* Reemplazo minimo de esp_timer.h: tiempo virtual del simulador (ver sim_rtos.c) */
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif //HOST_ESP_TIMER_H
@@ -0,0 +1,7 @@
+/* Reemplazo minimo de esp_transport.h: el simulador no abre sockets */
+#ifndef HOST_ESP_TRANSPORT_H
+#define HOST_ESP_TRANSPORT_H
+
+typedef struct esp_transport_item_t *esp_transport_handle_t;
+
+#endif //HOST_ESP_TRANSPORT_H
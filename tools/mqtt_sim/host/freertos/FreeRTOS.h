@@ -0,0 +1,30 @@
+/* Reemplazo minimo de FreeRTOS.h: planificador cooperativo sobre tiempo virtual (ver sim_rtos.c).
+ * Un tick es 1 ms */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  pdTRUE
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFU)
+#define portNUM_PROCESSORS      2
+#define PRO_CPU_NUM             0
+#define APP_CPU_NUM             1
+#define tskNO_AFFINITY          0x7FFFFFFF
+#define configTICK_RATE_HZ      1000
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+
+#define BIT0                    0x00000001
+#define BIT1                    0x00000002
+#define BIT2                    0x00000004
+#define BIT3                    0x00000008
+
+#endif //HOST_FREERTOS_H
@@ -0,0 +1,7 @@
+/* Reemplazo minimo de mbedtls: las primitivas que usa src/aes-ctr.c, sobre OpenSSL (ver sim_crypto.c) */
+#ifndef HOST_MBEDTLS_PLATFORM_H
+#define HOST_MBEDTLS_PLATFORM_H
+
+#include <stddef.h>
+
+#endif //HOST_MBEDTLS_PLATFORM_H
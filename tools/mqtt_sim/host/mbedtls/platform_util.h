@@ -0,0 +1,8 @@
+#ifndef HOST_MBEDTLS_PLATFORM_UTIL_H
+#define HOST_MBEDTLS_PLATFORM_UTIL_H
+
+#include <stddef.h>
+
+void mbedtls_platform_zeroize(void *buf, size_t len);
+
+#endif //HOST_MBEDTLS_PLATFORM_UTIL_H
@@ -0,0 +1,616 @@
+/*
+ * Simulador (host) de la cadena de publicacion MQTT del firmware frente a un broker de reemplazo en el
+ * mismo proceso. Compila sin cambios src/mqtt.c (ventana de mensajes en vuelo, cola en espera, drenado
+ * desde la tarea de esp-mqtt, confirmaciones y mqtt_reconnect_task), src/mqtt_outbox.c, src/pool.c,
+ * src/codec.c y src/aes-ctr.c contra reemplazos de FreeRTOS (sim_rtos.c, tiempo virtual), esp-mqtt
+ * (sim_esp_mqtt.c: outbox, reenvio, reconexion, RTT, ancho de banda y cortes del broker) y mbedtls
+ * (sim_crypto.c, sobre OpenSSL). Una tarea genera lecturas simuladas y las publica como la tarea de
+ * datos: codifica el lote, lo cifra con aes_ctr_encrypt y arma el sobre "<version>:<IV>:<datos>". El
+ * broker resuelve el alias de topic, toma version e IV del sobre o de las propiedades de usuario
+ * (MQTT 5), descifra con aes_ctr_decrypt_from_base64, decodifica y registra cada mensaje.
+ *
+ * Compilar (desde la raiz del repositorio):
+ *   cc -O2 -Iinclude -Itools/mqtt_sim/host -Itools/mqtt_sim -o mqtt_sim tools/mqtt_sim/mqtt_sim.c \
+ *      tools/mqtt_sim/sim_rtos.c tools/mqtt_sim/sim_esp_mqtt.c tools/mqtt_sim/sim_crypto.c src/mqtt.c \
+ *      src/mqtt_outbox.c src/pool.c src/codec.c src/aes-ctr.c -lcrypto
+ *   (agregar -DCONFIG_MQTT_PROTOCOL_5=1 para el camino MQTT 5 de src/mqtt.c)
+ *
+ * Uso:
+ *   mqtt_sim [-r reportes/s] [-b lote] [-f json|delta] [-d segundos] [-t rtt_ms] [-k kbit/s]
+ *            [-c cada_s:durante_s] [-B presupuesto] [-p oldest|newest|coalesce|spill]
+ *
+ *   -r  Reportes simulados por segundo (por defecto 10)
+ *   -b  Reportes por publicacion (settings.batch_size, por defecto 4)
+ *   -f  Formato de los datos (por defecto delta)
+ *   -d  Duracion simulada (por defecto 600 s)
+ *   -t  RTT hacia el broker (por defecto 80 ms)
+ *   -k  Ancho de banda de subida (por defecto 256 kbit/s)
+ *   -c  Corte del broker cada N s durante M s (por defecto sin cortes)
+ *   -B  Presupuesto de la cola en bytes (por defecto MQTT_OUTBOX_BUDGET)
+ *   -p  Politica de la cola (por defecto spill)
+ *
+ * Informa mensajes/s y reportes/s entregados, bytes/mensaje en el cable (PUBLISH, reenvios incluidos),
+ * latencia publicacion -> broker (p50/p99/max), contadores del cliente y de la cola, y el balance de
+ * mensajes: perdidos (aceptados por el cliente y nunca entregados), duplicados y errores de descifrado o
+ * decodificacion. Los mensajes que el cliente rechaza al publicar no cuentan como perdidos: el firmware
+ * conserva esas muestras.
+ *
+ * Codigo de salida: 0 si todo mensaje aceptado llego una sola vez y se descifro y decodifico, salvo los
+ * que descarta por diseño una politica con perdida (oldest, newest, coalesce); 1 si hubo duplicados,
+ * errores de descifrado o decodificacion, alias sin asociar en la conexion, o mensajes perdidos fuera
+ * de la politica (vencidos en esp-mqtt, NVS lleno con spill, errores del cliente); 2 error de uso.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "AES-CTR/aes-ctr.h"
+#include "Audit/audit.h"
+#include "Codec/codec.h"
+#include "MQTT/mqtt.h"
+#include "MQTT/mqtt_tls.h"
+#include "Setting/settings.h"
+#include "mbedtls/base64.h"
+#include "nvs.h"
+#include "sim.h"
+
+
+#define SIM_DEVICE            "sim-device"
+#define SIM_AES_KEY           "0123456789abcdef0123456789abcdef"
+#define SIM_NVS_SLOTS         (MQTT_OUTBOX_SPILL_MAX + 2)
+#define SIM_FLUSH_FACTOR      10       // La simulacion termina a lo sumo a duracion * SIM_FLUSH_FACTOR
+
+
+/* ----- NVS en memoria para la derivacion de la cola ----- */
+typedef struct {
+    char key[16];
+    uint8_t data[POOL_BLOCK_SIZE];
+    size_t len;
+    bool used;
+} sim_nvs_entry_t;
+
+static sim_nvs_entry_t nvs_entries[SIM_NVS_SLOTS];
+
+static sim_nvs_entry_t *nvs_find(const char *key, bool create) {
+    for (int i = 0; i < SIM_NVS_SLOTS; i++) {
+        if (nvs_entries[i].used && strcmp(nvs_entries[i].key, key) == 0) return &nvs_entries[i];
+    }
+    for (int i = 0; create && i < SIM_NVS_SLOTS; i++) {
+        if (nvs_entries[i].used) continue;
+        nvs_entries[i].used = true;
+        snprintf(nvs_entries[i].key, sizeof(nvs_entries[i].key), "%s", key);
+        return &nvs_entries[i];
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    (void)name; (void)mode;
+    *handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) { (void)handle; }
+
+esp_err_t nvs_commit(nvs_handle_t handle) { (void)handle; return ESP_OK; }
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    sim_nvs_entry_t *entry = nvs_find(key, true);
+    (void)handle;
+    if (!entry || length > sizeof(entry->data)) return ESP_ERR_NO_MEM;
+    memcpy(entry->data, value, length);
+    entry->len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length) {
+    sim_nvs_entry_t *entry = nvs_find(key, false);
+    (void)handle;
+    if (!entry) return ESP_ERR_NVS_NOT_FOUND;
+    if (*length < entry->len) return ESP_ERR_INVALID_SIZE;
+    memcpy(out, entry->data, entry->len);
+    *length = entry->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out) {
+    size_t len = sizeof(*out);
+    return nvs_get_blob(handle, key, out, &len);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    sim_nvs_entry_t *entry = nvs_find(key, false);
+    (void)handle;
+    if (!entry) return ESP_ERR_NVS_NOT_FOUND;
+    entry->used = false;
+    return ESP_OK;
+}
+
+
+/* ----- Dependencias de src/mqtt.c y src/aes-ctr.c que no se simulan ----- */
+settings_t settings;
+
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = (len < size - 1) ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+        default:                    return "ESP_FAIL";
+    }
+}
+
+TaskHandle_t placement_create(placement_task_t task, TaskFunction_t fn, void *arg,
+                              StackType_t *stack, StaticTask_t *buffer) {
+    TaskHandle_t handle = NULL;
+    (void)task; (void)stack; (void)buffer;
+    return (xTaskCreate(fn, "mqtt_reconnect", MQTT_RECONNECT_STACK, arg, 4, &handle) == pdPASS) ? handle : NULL;
+}
+
+void audit_response(placement_task_t task, int64_t response_us) { (void)task; (void)response_us; }
+
+void memory_watch_task(TaskHandle_t task) { (void)task; }
+
+void memory_exempt_begin(void) {}
+
+void memory_exempt_end(void) {}
+
+esp_transport_handle_t mqtt_tls_transport_create(void) { return NULL; }
+
+
+/* ----- Parametros ----- */
+typedef struct {
+    double rate;             // Reportes por segundo
+    int batch;
+    bool delta;
+    int64_t duration_ms;
+    uint32_t budget;
+    mqtt_outbox_policy_t policy;
+} sim_config_t;
+
+
+/* ----- Registro de mensajes publicados (para el balance en el broker) ----- */
+typedef enum {
+    SIM_MSG_PENDING = 0,     // Dentro de mqtt_client_publish_block
+    SIM_MSG_ACCEPTED,        // El cliente lo acepto (ventana o cola en espera)
+    SIM_MSG_REJECTED,        // El cliente devolvio error
+} sim_msg_state_t;
+
+typedef struct {
+    uint8_t iv[IV_LEN];
+    uint32_t hash;           // FNV-1a del texto plano
+    int64_t publish_ms;
+    uint16_t reports;
+    uint8_t state;
+    uint16_t received;       // Veces que llego al broker
+} sim_message_t;
+
+
+static sim_config_t cfg;
+static sim_message_t *messages;
+static uint32_t message_count, message_max;
+static int32_t *message_index;       // Tabla hash IV -> mensaje (-1: libre)
+static uint32_t index_mask;
+static uint32_t *latencies;
+static uint32_t delivered, delivered_reports, duplicates, unexpected, decode_errors, alias_errors;
+static char alias_topics[SIM_BROKER_ALIAS_MAX + 1][MQTT_TOPIC_MAX_LEN];
+static bool app_done;
+
+
+static uint32_t fnv1a(const uint8_t *data, size_t len) {
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; i++) h = (h ^ data[i]) * 16777619U;
+    return h;
+}
+
+
+static uint32_t iv_slot(const uint8_t *iv) {
+    return fnv1a(iv, IV_LEN) & index_mask;
+}
+
+
+static sim_message_t *message_add(const uint8_t *iv, uint32_t hash, uint16_t reports) {
+    if (message_count == message_max) return NULL;
+
+    sim_message_t *msg = &messages[message_count];
+    memcpy(msg->iv, iv, IV_LEN);
+    msg->hash = hash;
+    msg->reports = reports;
+    msg->publish_ms = sim_rtos_now_ms();
+    msg->state = SIM_MSG_PENDING;
+
+    uint32_t slot = iv_slot(iv);
+    while (message_index[slot] >= 0) slot = (slot + 1) & index_mask;
+    message_index[slot] = (int32_t)message_count++;
+    return msg;
+}
+
+
+static sim_message_t *message_find(const uint8_t *iv) {
+    for (uint32_t slot = iv_slot(iv); message_index[slot] >= 0; slot = (slot + 1) & index_mask) {
+        sim_message_t *msg = &messages[message_index[slot]];
+        if (memcmp(msg->iv, iv, IV_LEN) == 0) return msg;
+    }
+    return NULL;
+}
+
+
+/* ----- Broker de reemplazo ----- */
+void sim_broker_session(void) {
+    memset(alias_topics, 0, sizeof(alias_topics));   // Los alias valen por conexion
+}
+
+
+static const char *broker_property(const sim_publish_t *pub, const char *key) {
+    for (int i = 0; i < pub->property_count; i++) {
+        if (strcmp(pub->property_key[i], key) == 0) return pub->property_value[i];
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Separa version, IV y datos del mensaje: de las propiedades de usuario (MQTT 5) o del sobre
+ * "<version>:<IV Base64>:<datos Base64>".
+ */
+static bool broker_envelope(const sim_publish_t *pub, char *version, uint8_t *iv, const char **data, size_t *data_len) {
+    const char *prop_version = broker_property(pub, MQTT5_PROP_VERSION);
+    const char *prop_iv = broker_property(pub, MQTT5_PROP_IV);
+    const char *iv_b64;
+    size_t iv_b64_len, iv_len;
+
+    if (prop_version && prop_iv) {
+        snprintf(version, MQTT5_PROP_MAX_LEN, "%s", prop_version);
+        iv_b64 = prop_iv;
+        iv_b64_len = strlen(prop_iv);
+        *data = pub->payload;
+        *data_len = pub->len;
+    }
+    else {
+        const char *end = pub->payload + pub->len;
+        const char *sep = memchr(pub->payload, ':', pub->len);
+        const char *sep2 = sep ? memchr(sep + 1, ':', end - sep - 1) : NULL;
+        if (!sep2 || sep - pub->payload >= MQTT5_PROP_MAX_LEN) return false;
+        memcpy(version, pub->payload, sep - pub->payload);
+        version[sep - pub->payload] = '\0';
+        iv_b64 = sep + 1;
+        iv_b64_len = sep2 - iv_b64;
+        *data = sep2 + 1;
+        *data_len = end - *data;
+    }
+    return mbedtls_base64_decode(iv, IV_LEN, &iv_len, (const unsigned char *)iv_b64, iv_b64_len) == 0 && iv_len == IV_LEN;
+}
+
+
+/**
+ * @brief Recibe un PUBLISH: resuelve el alias, descifra, decodifica y registra la entrega.
+ * @return bool  true si el broker lo acepta (PUBACK); false ante un alias desconocido.
+ */
+bool sim_broker_receive(const sim_publish_t *pub) {
+    static uint8_t plain[POOL_BLOCK_SIZE];
+    static data_sensors_t batch[255];
+    char version[MQTT5_PROP_MAX_LEN];
+    uint8_t iv[IV_LEN];
+    const char *topic = pub->topic;
+    const char *data;
+    size_t data_len, plain_len;
+    int reports;
+
+    if (pub->alias > SIM_BROKER_ALIAS_MAX) return false;
+    if (pub->alias && topic[0] != '\0') {
+        snprintf(alias_topics[pub->alias], MQTT_TOPIC_MAX_LEN, "%s", topic);
+    }
+    else if (pub->alias) {
+        topic = alias_topics[pub->alias];
+        if (topic[0] == '\0') {   // Alias de otra conexion: Protocol Error (un broker real corta la conexion)
+            alias_errors++;
+            return false;
+        }
+    }
+    if (strcmp(topic, mqtt_client_topic(&mqtt_client, MQTT_TOPIC_TELEMETRY)) != 0) {
+        decode_errors++;
+        return true;
+    }
+
+    if (!broker_envelope(pub, version, iv, &data, &data_len)) {
+        decode_errors++;
+        return true;
+    }
+    sim_message_t *msg = message_find(iv);
+    if (!msg || aes_ctr_decrypt_from_base64(data, data_len, iv, plain, sizeof(plain), &plain_len) != ESP_OK
+        || fnv1a(plain, plain_len) != msg->hash) {
+        decode_errors++;
+        return true;
+    }
+    if (strcmp(version, DATA_PAYLOAD_VERSION_DELTA) == 0) {
+        reports = codec_decode_batch(plain, plain_len, batch, 255, NULL);
+    }
+    else {
+        reports = (plain_len > 1 && plain[0] == '{' && plain[plain_len - 1] == '}') ? 1 : -1;
+    }
+    if (reports != msg->reports) {
+        decode_errors++;
+        return true;
+    }
+
+    if (msg->state == SIM_MSG_REJECTED) unexpected++;
+    if (msg->received++ > 0) {
+        duplicates++;
+        return true;
+    }
+    latencies[delivered++] = (uint32_t)(sim_rtos_now_ms() - msg->publish_ms);
+    delivered_reports += (uint32_t)reports;
+    return true;
+}
+
+
+/* ----- Tarea de datos simulada ----- */
+
+/* Lectura simulada: paseo aleatorio alrededor de valores tipicos de interior */
+static void sensors_sample(data_sensors_t *d) {
+    static fx_t temp = FX_CONST(22.0), hum = FX_CONST(45.0), co2 = FX_CONST(420.0);
+
+    temp += (rand() % 21) - 10;
+    hum += (rand() % 41) - 20;
+    co2 += (rand() % 201) - 100;
+    if (co2 < FX_CONST(350.0)) co2 = FX_CONST(350.0);
+
+    memset(d, 0, sizeof(*d));
+    d->ky037_counter = (uint32_t)(rand() % 8);
+    d->ky037_max_duration = d->ky037_counter ? (uint32_t)(rand() % 400) : 0;
+    d->temperature = d->temp_mean = fx_to16(temp);
+    d->temp_min = fx_to16(temp - 20);
+    d->temp_max = fx_to16(temp + 20);
+    d->temp_std = 8;
+    d->humidity = d->hum_mean = fx_to16(hum);
+    d->hum_min = fx_to16(hum - 50);
+    d->hum_max = fx_to16(hum + 50);
+    d->hum_std = 20;
+    d->dht11_samples = 4;
+    d->gas_ppm[0] = co2;
+    d->gas_ppm[1] = FX_CONST(2.5) + rand() % 50;
+    d->gas_ppm[2] = FX_CONST(3.0) + rand() % 50;
+    d->gas_ppm[3] = FX_CONST(1.2) + rand() % 20;
+    d->gas_ppm[4] = FX_CONST(0.8) + rand() % 10;
+    d->mq135_samples = 4;
+    d->mq135_calibrated = 1;
+}
+
+
+/**
+ * @brief Como data_publish_encrypted: cifra el bloque en el lugar, arma el sobre en otro bloque del
+ * pool y lo publica en el topic de telemetria con QoS 1. El bloque plain vuelve al pool.
+ */
+static esp_err_t sim_publish_encrypted(const char *version, pool_handle_t plain, uint16_t reports) {
+    unsigned char iv[IV_LEN];
+    size_t len = pool_len(plain);
+    uint32_t hash = fnv1a(pool_data(plain), len);
+    pool_handle_t envelope = pool_take();
+    esp_err_t ret = ESP_FAIL;
+    size_t used, olen;
+
+    if (envelope == POOL_NONE || aes_ctr_encrypt(pool_data(plain), len, iv) != ESP_OK) goto done;
+
+    unsigned char *payload = pool_data(envelope);
+    used = (size_t)snprintf((char *)payload, POOL_BLOCK_SIZE, "%s:", version);
+    if (mbedtls_base64_encode(payload + used, POOL_BLOCK_SIZE - used, &olen, iv, IV_LEN) != 0) goto done;
+    used += olen;
+    payload[used++] = ':';
+    if (mbedtls_base64_encode(payload + used, POOL_BLOCK_SIZE - used, &olen, pool_data(plain), len) != 0) goto done;
+    pool_set_len(envelope, used + olen);
+
+    sim_message_t *msg = message_add(iv, hash, reports);
+    if (!msg) goto done;
+    ret = mqtt_client_publish_block(&mqtt_client, MQTT_TOPIC_TELEMETRY, envelope, 1, 0);
+    envelope = POOL_NONE;   // el cliente lo devolvio al pool
+    msg->state = (ret == ESP_OK) ? SIM_MSG_ACCEPTED : SIM_MSG_REJECTED;
+
+    done:
+        pool_give(plain);
+        pool_give(envelope);
+        return ret;
+}
+
+
+static void sim_publish_batch(const data_sensors_t *batch, int count) {
+    const uint8_t mask = DATA_SENSOR_SAMPLED;
+    pool_handle_t block;
+
+    if (cfg.delta && (block = pool_take()) != POOL_NONE) {
+        size_t len = codec_encode_batch(batch, (uint8_t)count, mask, pool_data(block), DATA_JSON_MAX);
+        if (len > 0) {
+            pool_set_len(block, len);
+            sim_publish_encrypted(DATA_PAYLOAD_VERSION_DELTA, block, (uint16_t)count);
+            return;
+        }
+        pool_give(block);
+    }
+    for (int i = 0; i < count; i++) {
+        if ((block = pool_take()) == POOL_NONE) return;
+        int len = codec_format_json(&batch[i], mask, (char *)pool_data(block), DATA_JSON_MAX);
+        if (len < 0) {
+            pool_give(block);
+            continue;
+        }
+        pool_set_len(block, (size_t)len);
+        sim_publish_encrypted(DATA_PAYLOAD_VERSION, block, 1);
+    }
+}
+
+
+/**
+ * @brief Inicia el cliente como el firmware, publica durante la duracion simulada y espera a que el
+ * broker confirme todo (mqtt_client_flush).
+ */
+static void sim_app_task(void *arg) {
+    static data_sensors_t batch[255];
+    int batch_count = 0;
+    double next_report_ms = 0;
+    (void)arg;
+
+    mqtt_client_init(&mqtt_client, "mqtt://sim-broker", NULL, NULL);
+    mqtt_client_set_topics(&mqtt_client, SIM_DEVICE);
+    mqtt_client_set_outbox(&mqtt_client, cfg.budget, cfg.policy);
+    mqtt_client_start(&mqtt_client);
+
+    while (sim_rtos_now_ms() < cfg.duration_ms) {
+        if (sim_rtos_now_ms() < (int64_t)next_report_ms) {
+            vTaskDelay(pdMS_TO_TICKS((int64_t)next_report_ms - sim_rtos_now_ms()));
+            continue;
+        }
+        sensors_sample(&batch[batch_count++]);
+        next_report_ms += 1000.0 / cfg.rate;
+        if (batch_count == cfg.batch) {
+            sim_publish_batch(batch, batch_count);
+            batch_count = 0;
+        }
+    }
+
+    mqtt_client_flush(&mqtt_client, (uint32_t)(cfg.duration_ms * (SIM_FLUSH_FACTOR - 1)));
+    app_done = true;
+}
+
+
+static bool sim_finished(void) {
+    return app_done;
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+static int parse_args(int argc, char **argv) {
+    cfg = (sim_config_t){ .rate = 10, .batch = 4, .delta = true, .duration_ms = 600000,
+                          .budget = MQTT_OUTBOX_BUDGET, .policy = MQTT_OUTBOX_SPILL };
+    sim_link = (sim_link_t){ .rtt_ms = 80, .kbps = 256 };
+    static const char *policies[MQTT_OUTBOX_POLICY_COUNT] = { "oldest", "newest", "coalesce", "spill" };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || !val) return -1;
+        i++;
+        switch (arg[1]) {
+            case 'r': cfg.rate = atof(val); break;
+            case 'b': cfg.batch = atoi(val); break;
+            case 'f': cfg.delta = (strcmp(val, "delta") == 0); break;
+            case 'd': cfg.duration_ms = (int64_t)atoi(val) * 1000; break;
+            case 't': sim_link.rtt_ms = atoi(val); break;
+            case 'k': sim_link.kbps = atoi(val); break;
+            case 'B': cfg.budget = (uint32_t)atoi(val); break;
+            case 'c': {
+                int every, during;
+                if (sscanf(val, "%d:%d", &every, &during) != 2 || every <= during || during <= 0) return -1;
+                sim_link.cut_every_ms = (int64_t)every * 1000;
+                sim_link.cut_for_ms = (int64_t)during * 1000;
+                break;
+            }
+            case 'p': {
+                int p = 0;
+                while (p < MQTT_OUTBOX_POLICY_COUNT && strcmp(val, policies[p]) != 0) p++;
+                if (p == MQTT_OUTBOX_POLICY_COUNT) return -1;
+                cfg.policy = (mqtt_outbox_policy_t)p;
+                break;
+            }
+            default: return -1;
+        }
+    }
+    if (cfg.rate <= 0 || cfg.batch < 1 || cfg.batch > 255 || cfg.duration_ms <= 0 || sim_link.rtt_ms < 0
+        || sim_link.kbps <= 0 || cfg.budget == 0) return -1;
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    clock_t cpu_start = clock();
+
+    if (parse_args(argc, argv) != 0) {
+        fprintf(stderr, "Uso: mqtt_sim [-r reportes/s] [-b lote] [-f json|delta] [-d s] [-t rtt_ms] [-k kbit/s]\n"
+                        "                [-c cada_s:durante_s] [-B bytes] [-p oldest|newest|coalesce|spill]\n");
+        return 2;
+    }
+
+    message_max = (uint32_t)(cfg.rate * (double)cfg.duration_ms / 1000.0) + 2;
+    index_mask = 1;
+    while (index_mask < message_max * 2) index_mask <<= 1;
+    messages = calloc(message_max, sizeof(*messages));
+    latencies = calloc(message_max, sizeof(*latencies));
+    message_index = malloc(index_mask * sizeof(*message_index));
+    if (!messages || !latencies || !message_index) return 2;
+    memset(message_index, 0xFF, index_mask * sizeof(*message_index));
+    index_mask--;
+
+    srand(1);
+    snprintf(settings.aes_key, sizeof(settings.aes_key), "%s", SIM_AES_KEY);
+    TaskHandle_t app;
+    if (xTaskCreate(sim_app_task, "data", 8192, NULL, 3, &app) != pdPASS) return 2;
+    sim_rtos_run(sim_finished, cfg.duration_ms * SIM_FLUSH_FACTOR);
+
+    uint32_t accepted = 0, rejected = 0, lost = 0;
+    for (uint32_t i = 0; i < message_count; i++) {
+        if (messages[i].state == SIM_MSG_REJECTED) rejected++;
+        if (messages[i].state != SIM_MSG_ACCEPTED) continue;
+        accepted++;
+        if (messages[i].received == 0) lost++;
+    }
+
+    mqtt_stats_t stats;
+    sim_client_stats_t client;
+    mqtt_client_get_stats(&mqtt_client, &stats);
+    sim_client_get_stats(&client);
+
+    double seconds = (double)sim_rtos_now_ms() / 1000.0;
+    qsort(latencies, delivered, sizeof(*latencies), cmp_u32);
+    uint32_t p50 = delivered ? latencies[delivered / 2] : 0;
+    uint32_t p99 = delivered ? latencies[(size_t)((delivered - 1) * 0.99)] : 0;
+    uint32_t max = delivered ? latencies[delivered - 1] : 0;
+    // Con oldest/newest/coalesce la cola descarta por diseño; spill solo al llenarse NVS (sobrecarga)
+    uint32_t policy_drops = (cfg.policy != MQTT_OUTBOX_SPILL) ? stats.outbox.dropped_oldest + stats.outbox.coalesced : 0;
+
+    printf("simulado:        %.1f s%s, %u mensajes (%u aceptados, %u rechazados por el cliente)\n",
+           seconds, app_done ? "" : " (sin vaciar la cola)", message_count, accepted, rejected);
+    printf("conexion:        %u sesiones, %u intentos fallidos, %u reenvios\n",
+           client.connects, client.connect_failures, client.resent);
+    printf("entregados:      %u mensajes (%.2f msg/s), %u reportes (%.2f reportes/s)\n",
+           delivered, delivered / seconds, delivered_reports, delivered_reports / seconds);
+    printf("bytes/mensaje:   %.1f en el cable (%s), %.1f bytes/reporte\n",
+           delivered ? (double)client.wire_bytes / delivered : 0.0, MQTT_USE_V5 ? "MQTT 5" : "MQTT 3.1.1",
+           delivered_reports ? (double)client.wire_bytes / delivered_reports : 0.0);
+    printf("latencia:        p50 %u ms, p99 %u ms, max %u ms (publicacion -> broker)\n", p50, p99, max);
+    printf("cliente:         %u/%u confirmados, %u vencidos en esp-mqtt, %u esperas de ventana (%u vencidas)\n",
+           stats.acked, stats.published, stats.dropped, stats.window_full, stats.window_timeouts);
+    printf("cola:            pico %u B, %u encolados, %u/%u descartados (viejos/nuevos), %u fusionados, %u/%u a NVS en %u escrituras (%u errores)\n",
+           stats.outbox.peak_bytes, stats.outbox.queued, stats.outbox.dropped_oldest,
+           stats.outbox.dropped_newest, stats.outbox.coalesced, stats.outbox.unspilled, stats.outbox.spilled,
+           stats.outbox.spill_writes, stats.outbox.spill_errors);
+    printf("balance:         %u perdidos (%u por la politica de la cola), %u duplicados, %u entregados tras un rechazo, %u sin PUBACK por alias\n",
+           lost, policy_drops, duplicates, unexpected, alias_errors);
+    printf("descifrado:      %u errores\n", decode_errors);
+    printf("CPU host:        %.2f s\n", (double)(clock() - cpu_start) / CLOCKS_PER_SEC);
+
+    bool failed = duplicates || unexpected || decode_errors || alias_errors || lost > policy_drops;
+    printf("%s\n", failed ? "FALLA" : "OK");
+
+    free(messages);
+    free(latencies);
+    free(message_index);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+/* Interfaz entre las piezas del simulador: planificador (sim_rtos.c), esp-mqtt y enlace
+ * (sim_esp_mqtt.c) y broker de reemplazo (mqtt_sim.c) */
+#ifndef MQTT_SIM_H
+#define MQTT_SIM_H
+
+#define SIM_CONNECT_TIMEOUT_MS     10000    // network_timeout_ms de esp-mqtt: intento contra un broker caido
+#define SIM_AUTO_RECONNECT_MS      10000    // reconnect_timeout_ms de esp-mqtt
+#define SIM_OUTBOX_EXPIRED_MS      30000    // CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS
+#define SIM_BROKER_ALIAS_MAX       10       // Topic Alias Maximum del CONNACK (MQTT 5)
+#define SIM_USER_PROPERTY_MAX      4        // Propiedades de usuario por PUBLISH (MQTT 5)
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* ----- Enlace con el broker ----- */
+typedef struct {
+    int rtt_ms;
+    int kbps;                  // Ancho de banda de subida
+    int64_t cut_every_ms;      // Corte del broker cada cut_every_ms durante cut_for_ms (0: sin cortes)
+    int64_t cut_for_ms;
+} sim_link_t;
+
+
+/* ----- Contadores del cliente esp-mqtt de reemplazo ----- */
+typedef struct {
+    uint64_t wire_bytes;       // PUBLISH en el cable, reenvios incluidos
+    uint32_t sent;             // PUBLISH transmitidos
+    uint32_t resent;           // Reenvios tras una reconexion
+    uint32_t rejected;         // PUBLISH sin PUBACK (el broker no los acepto)
+    uint32_t expired;          // Descartados por vencimiento del outbox (MQTT_EVENT_DELETED)
+    uint32_t outbox_full;      // Publicaciones rechazadas por outbox.limit
+    uint32_t connects;         // Sesiones establecidas
+    uint32_t connect_failures; // Intentos contra el broker caido
+} sim_client_stats_t;
+
+
+/* ----- PUBLISH tal como llega al broker ----- */
+typedef struct {
+    const char *topic;         // Puede ser "" (MQTT 5: solo alias)
+    uint16_t alias;            // 0: sin alias
+    const char *payload;
+    size_t len;
+    int qos;
+    bool dup;
+    uint8_t property_count;    // Propiedades de usuario (MQTT 5)
+    const char *property_key[SIM_USER_PROPERTY_MAX];
+    const char *property_value[SIM_USER_PROPERTY_MAX];
+} sim_publish_t;
+
+
+/* ----- Planificador (sim_rtos.c) ----- */
+void sim_rtos_run(bool (*finished)(void), int64_t limit_ms);
+int64_t sim_rtos_now_ms(void);
+
+/* ----- esp-mqtt de reemplazo (sim_esp_mqtt.c) ----- */
+extern sim_link_t sim_link;
+bool sim_link_up(int64_t t_ms);
+void sim_client_get_stats(sim_client_stats_t *out);
+
+/* ----- Broker de reemplazo (mqtt_sim.c) ----- */
+void sim_broker_session(void);
+bool sim_broker_receive(const sim_publish_t *msg);
+
+#endif //MQTT_SIM_H
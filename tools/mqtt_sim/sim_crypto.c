@@ -0,0 +1,194 @@
+/*
+ * Primitivas de mbedtls que usa src/aes-ctr.c, implementadas sobre OpenSSL (libcrypto) para compilar
+ * el modulo sin cambios en host. El modo CTR y Base64 siguen la semantica de mbedtls (contador de 128
+ * bits big-endian, offset en el bloque de keystream, terminador y errores de Base64).
+ */
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include "mbedtls/aes.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/md.h"
+#include "mbedtls/platform_util.h"
+
+
+struct mbedtls_md_info_t {
+    mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha256_info = { MBEDTLS_MD_SHA256 };
+static const char b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+void mbedtls_platform_zeroize(void *buf, size_t len) {
+    OPENSSL_cleanse(buf, len);
+}
+
+
+/* ----- AES ----- */
+void mbedtls_aes_init(mbedtls_aes_context *ctx) {
+    ctx->cipher = NULL;
+}
+
+
+void mbedtls_aes_free(mbedtls_aes_context *ctx) {
+    EVP_CIPHER_CTX_free(ctx->cipher);
+    ctx->cipher = NULL;
+}
+
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits) {
+    const EVP_CIPHER *type = (keybits == 128) ? EVP_aes_128_ecb() : (keybits == 192) ? EVP_aes_192_ecb()
+                             : (keybits == 256) ? EVP_aes_256_ecb() : NULL;
+    if (!type) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+
+    EVP_CIPHER_CTX_free(ctx->cipher);
+    ctx->cipher = EVP_CIPHER_CTX_new();
+    if (!ctx->cipher || EVP_EncryptInit_ex(ctx->cipher, type, NULL, key, NULL) != 1) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    EVP_CIPHER_CTX_set_padding(ctx->cipher, 0);
+    return 0;
+}
+
+
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context *ctx, size_t length, size_t *nc_off, unsigned char nonce_counter[16],
+                          unsigned char stream_block[16], const unsigned char *input, unsigned char *output) {
+    size_t n = *nc_off;
+    int out_len;
+
+    if (n > 15) return -1;
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            if (EVP_EncryptUpdate(ctx->cipher, stream_block, &out_len, nonce_counter, 16) != 1) return -1;
+            for (int j = 15; j >= 0 && ++nonce_counter[j] == 0; j--) {}
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 0x0F;
+    }
+    *nc_off = n;
+    return 0;
+}
+
+
+/* ----- Generador (sin DRBG propio: RAND_bytes de OpenSSL) ----- */
+void mbedtls_entropy_init(mbedtls_entropy_context *ctx) {
+    ctx->unused = 0;
+}
+
+
+void mbedtls_entropy_free(mbedtls_entropy_context *ctx) {
+    (void)ctx;
+}
+
+
+int mbedtls_entropy_func(void *data, unsigned char *output, size_t len) {
+    (void)data;
+    return (RAND_bytes(output, (int)len) == 1) ? 0 : MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *ctx) {
+    ctx->seeded = 0;
+}
+
+
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context *ctx) {
+    ctx->seeded = 0;
+}
+
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *ctx, int (*f_entropy)(void *, unsigned char *, size_t),
+                          void *p_entropy, const unsigned char *custom, size_t len) {
+    unsigned char seed[32];
+    (void)custom; (void)len;
+
+    if (f_entropy(p_entropy, seed, sizeof(seed)) != 0) return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+    OPENSSL_cleanse(seed, sizeof(seed));
+    ctx->seeded = 1;
+    return 0;
+}
+
+
+int mbedtls_ctr_drbg_random(void *p_rng, unsigned char *output, size_t output_len) {
+    const mbedtls_ctr_drbg_context *ctx = p_rng;
+    if (!ctx->seeded) return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+    return (RAND_bytes(output, (int)output_len) == 1) ? 0 : MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+
+/* ----- HMAC ----- */
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type) {
+    return (md_type == MBEDTLS_MD_SHA256) ? &sha256_info : NULL;
+}
+
+
+int mbedtls_md_hmac(const mbedtls_md_info_t *md_info, const unsigned char *key, size_t keylen,
+                    const unsigned char *input, size_t ilen, unsigned char *output) {
+    unsigned int out_len = 0;
+
+    if (!md_info) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    return HMAC(EVP_sha256(), key, (int)keylen, input, ilen, output, &out_len) ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+
+/* ----- Base64 ----- */
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+    size_t needed = (slen + 2) / 3 * 4;
+    size_t o = 0;
+
+    if (dlen < needed + 1) {
+        *olen = needed + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    for (size_t i = 0; i < slen; i += 3) {
+        unsigned long v = (unsigned long)src[i] << 16;
+        if (i + 1 < slen) v |= (unsigned long)src[i + 1] << 8;
+        if (i + 2 < slen) v |= src[i + 2];
+        dst[o++] = b64_alphabet[(v >> 18) & 0x3F];
+        dst[o++] = b64_alphabet[(v >> 12) & 0x3F];
+        dst[o++] = (i + 1 < slen) ? b64_alphabet[(v >> 6) & 0x3F] : '=';
+        dst[o++] = (i + 2 < slen) ? b64_alphabet[v & 0x3F] : '=';
+    }
+    dst[o] = '\0';
+    *olen = o;
+    return 0;
+}
+
+
+static int b64_value(unsigned char c) {
+    const char *p = (c != '\0') ? strchr(b64_alphabet, c) : NULL;
+    return p ? (int)(p - b64_alphabet) : -1;
+}
+
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+    size_t pad = 0;
+    size_t o = 0;
+
+    if (slen % 4 != 0) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    while (pad < 2 && pad < slen && src[slen - 1 - pad] == '=') pad++;
+    for (size_t i = 0; i < slen - pad; i++) {
+        if (b64_value(src[i]) < 0) return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    }
+
+    size_t needed = slen / 4 * 3 - pad;
+    if (!dst || dlen < needed) {
+        *olen = needed;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    for (size_t i = 0; i < slen; i += 4) {
+        unsigned long v = 0;
+        for (int j = 0; j < 4; j++) {
+            int d = (i + j < slen - pad) ? b64_value(src[i + j]) : 0;
+            v = (v << 6) | (unsigned long)d;
+        }
+        dst[o++] = (unsigned char)(v >> 16);
+        if (o < needed) dst[o++] = (unsigned char)(v >> 8);
+        if (o < needed) dst[o++] = (unsigned char)v;
+    }
+    *olen = o;
+    return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * esp-mqtt de reemplazo: la API que usa src/mqtt.c sobre un enlace simulado con el broker de
+ * reemplazo. Como esp-mqtt, tiene su propia tarea que entrega los eventos al handler registrado, un
+ * outbox con los mensajes QoS>0 hasta su PUBACK (acotado por outbox.limit), reenvio de lo pendiente
+ * al reconectar, reconexion automatica y vencimiento del outbox (MQTT_EVENT_DELETED). El broker
+ * procesa cada PUBLISH en el instante de su PUBACK, de modo que un corte nunca pierde solo el PUBACK:
+ * un duplicado en el broker es siempre un error del cliente.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+
+#define SIM_ITEM_MAX        32
+#define SIM_EVENT_MAX       32
+#define SIM_PROPERTY_LEN    64
+#define SIM_NEVER           INT64_MAX
+
+
+typedef enum {
+    SIM_STOPPED = 0,
+    SIM_CONNECTING,
+    SIM_CONNECTED,
+    SIM_WAIT_RECONNECT,
+} sim_state_t;
+
+
+struct mqtt5_user_property_list_t {
+    uint8_t count;
+    char key[SIM_USER_PROPERTY_MAX][SIM_PROPERTY_LEN];
+    char value[SIM_USER_PROPERTY_MAX][SIM_PROPERTY_LEN];
+};
+
+
+/* ----- Mensaje del outbox ----- */
+typedef struct {
+    int msg_id;
+    int qos;
+    bool in_transit;                 // Transmitido en la conexion actual, esperando PUBACK
+    bool sent;                       // Ya se transmitio alguna vez (el proximo envio es un reenvio)
+    int64_t tick_ms;                 // Ultima transmision o alta (vencimiento del outbox)
+    int64_t ack_ms;                  // Llegada del PUBACK (SIM_NEVER: el broker no lo acepto)
+    uint16_t alias;
+    uint32_t expiry_s;
+    struct mqtt5_user_property_list_t properties;
+    char *topic;
+    char *data;
+    size_t len;
+} sim_item_t;
+
+
+struct esp_mqtt_client {
+    esp_mqtt_protocol_ver_t protocol;
+    uint64_t outbox_limit;
+    esp_event_handler_t handler;
+    void *handler_args;
+    TaskHandle_t task;
+    sim_state_t state;
+    int64_t state_ms;                // CONNECTING: fin del intento; WAIT_RECONNECT: reintento automatico
+    bool attempt_ok;                 // El broker estaba disponible al iniciar el intento
+    int64_t link_free_ms;            // Fin de la transmision en curso
+    int next_msg_id;
+    sim_item_t items[SIM_ITEM_MAX];  // En orden de alta
+    int item_count;
+    esp_mqtt_event_t events[SIM_EVENT_MAX];
+    int event_head;
+    int event_count;
+    esp_mqtt5_publish_property_config_t property;   // Propiedades del proximo PUBLISH (MQTT 5)
+    struct mqtt5_user_property_list_t property_list;
+    bool property_set;
+};
+
+
+sim_link_t sim_link;
+static struct esp_mqtt_client instance;
+static sim_client_stats_t stats;
+
+
+bool sim_link_up(int64_t t_ms) {
+    return sim_link.cut_every_ms == 0 || t_ms < sim_link.cut_every_ms || t_ms % sim_link.cut_every_ms >= sim_link.cut_for_ms;
+}
+
+
+/* Proximo cambio de estado del broker (-1: nunca) */
+static int64_t sim_link_next_change(int64_t t_ms) {
+    if (sim_link.cut_every_ms == 0) return -1;
+    if (t_ms < sim_link.cut_every_ms) return sim_link.cut_every_ms;
+
+    int64_t phase = t_ms % sim_link.cut_every_ms;
+    return (phase < sim_link.cut_for_ms) ? t_ms - phase + sim_link.cut_for_ms : t_ms - phase + sim_link.cut_every_ms;
+}
+
+
+void sim_client_get_stats(sim_client_stats_t *out) {
+    *out = stats;
+}
+
+
+static size_t sim_varint_len(size_t value) {
+    size_t n = 1;
+    while (value >= 128) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+
+/**
+ * @brief Bytes del PUBLISH en el cable (cabecera fija, topic, packet id, propiedades y payload).
+ */
+static uint32_t sim_wire_size(const struct esp_mqtt_client *client, const sim_item_t *item) {
+    size_t remaining = 2 + strlen(item->topic) + (item->qos > 0 ? 2 : 0) + item->len;
+
+    if (client->protocol == MQTT_PROTOCOL_V_5) {
+        size_t props = (item->expiry_s ? 5 : 0) + (item->alias ? 3 : 0);
+        for (int i = 0; i < item->properties.count; i++) {
+            props += 1 + 2 + strlen(item->properties.key[i]) + 2 + strlen(item->properties.value[i]);
+        }
+        remaining += sim_varint_len(props) + props;
+    }
+    return (uint32_t)(1 + sim_varint_len(remaining) + remaining);
+}
+
+
+static void sim_post_event(struct esp_mqtt_client *client, esp_mqtt_event_id_t id, int msg_id) {
+    if (client->event_count == SIM_EVENT_MAX) {
+        fprintf(stderr, "sim_esp_mqtt: cola de eventos llena\n");
+        exit(2);
+    }
+    esp_mqtt_event_t *event = &client->events[(client->event_head + client->event_count) % SIM_EVENT_MAX];
+    memset(event, 0, sizeof(*event));
+    event->event_id = id;
+    event->client = client;
+    event->msg_id = msg_id;
+    client->event_count++;
+    if (client->task) xTaskNotifyGive(client->task);
+}
+
+
+static void sim_item_remove(struct esp_mqtt_client *client, int index) {
+    free(client->items[index].topic);
+    free(client->items[index].data);
+    memmove(&client->items[index], &client->items[index + 1], (client->item_count - index - 1) * sizeof(sim_item_t));
+    client->item_count--;
+}
+
+
+/**
+ * @brief Entrega el PUBLISH al broker de reemplazo. QoS 0 no espera PUBACK.
+ * @return bool  true si el broker lo acepto.
+ */
+static bool sim_broker_deliver(const sim_item_t *item) {
+    sim_publish_t msg = {
+        .topic = item->topic,
+        .alias = item->alias,
+        .payload = item->data,
+        .len = item->len,
+        .qos = item->qos,
+        .dup = item->sent,
+        .property_count = item->properties.count,
+    };
+    for (int i = 0; i < item->properties.count; i++) {
+        msg.property_key[i] = item->properties.key[i];
+        msg.property_value[i] = item->properties.value[i];
+    }
+    return sim_broker_receive(&msg);
+}
+
+
+/**
+ * @brief Transmite un mensaje: ocupa el enlace segun su tamaño y el PUBACK llega un RTT despues.
+ */
+static void sim_transmit(struct esp_mqtt_client *client, sim_item_t *item) {
+    int64_t now = sim_rtos_now_ms();
+    int64_t start = (client->link_free_ms > now) ? client->link_free_ms : now;
+    uint32_t wire = sim_wire_size(client, item);
+
+    client->link_free_ms = start + ((int64_t)wire * 8 + sim_link.kbps - 1) / sim_link.kbps;
+    item->ack_ms = client->link_free_ms + sim_link.rtt_ms;
+    item->tick_ms = now;
+    if (item->sent) stats.resent++;
+    item->in_transit = true;
+    stats.sent++;
+    stats.wire_bytes += wire;
+}
+
+
+/**
+ * @brief Agrega un mensaje al outbox con las propiedades fijadas para este PUBLISH.
+ * @return int  msg_id, o -2 si el outbox no tiene lugar (como esp-mqtt).
+ */
+static int sim_store(struct esp_mqtt_client *client, const char *topic, const char *data, int len, int qos) {
+    size_t size = (len > 0) ? (size_t)len : strlen(data);
+    uint64_t used = 0;
+
+    for (int i = 0; i < client->item_count; i++) used += client->items[i].len;
+    if (client->item_count == SIM_ITEM_MAX || (client->outbox_limit && used + size > client->outbox_limit)) {
+        stats.outbox_full++;
+        client->property_set = false;
+        return -2;
+    }
+
+    sim_item_t *item = &client->items[client->item_count++];
+    memset(item, 0, sizeof(*item));
+    client->next_msg_id = (client->next_msg_id % 65535) + 1;
+    item->msg_id = client->next_msg_id;
+    item->qos = qos;
+    item->tick_ms = sim_rtos_now_ms();
+    item->topic = strdup(topic);
+    item->data = malloc(size ? size : 1);
+    memcpy(item->data, data, size);
+    item->len = size;
+    if (client->property_set) {   // esp-mqtt arma el paquete con las propiedades vigentes y las descarta
+        item->alias = client->property.topic_alias;
+        item->expiry_s = client->property.message_expiry_interval;
+        item->properties = client->property_list;
+        client->property_set = false;
+    }
+    return item->msg_id;
+}
+
+
+/* ----- Conexion ----- */
+static void sim_connect_attempt(struct esp_mqtt_client *client) {
+    int64_t now = sim_rtos_now_ms();
+
+    client->state = SIM_CONNECTING;
+    client->attempt_ok = sim_link_up(now);
+    client->state_ms = now + (client->attempt_ok ? sim_link.rtt_ms : SIM_CONNECT_TIMEOUT_MS);
+}
+
+
+/* Conexion perdida o intento fallido: como esp_mqtt_abort_connection */
+static void sim_abort_connection(struct esp_mqtt_client *client) {
+    client->state = SIM_WAIT_RECONNECT;
+    client->state_ms = sim_rtos_now_ms() + SIM_AUTO_RECONNECT_MS;
+    for (int i = 0; i < client->item_count; i++) client->items[i].in_transit = false;
+    sim_post_event(client, MQTT_EVENT_DISCONNECTED, 0);
+}
+
+
+/**
+ * @brief Procesa lo que vence en el enlace: conexion, cortes, PUBACK y vencimiento del outbox.
+ */
+static void sim_client_poll(struct esp_mqtt_client *client) {
+    int64_t now = sim_rtos_now_ms();
+
+    switch (client->state) {
+        case SIM_CONNECTING:
+            if (now < client->state_ms) break;
+            if (client->attempt_ok && sim_link_up(now)) {
+                client->state = SIM_CONNECTED;
+                client->link_free_ms = now;
+                stats.connects++;
+                sim_broker_session();
+                sim_post_event(client, MQTT_EVENT_CONNECTED, 0);
+            }
+            else {
+                stats.connect_failures++;
+                sim_abort_connection(client);
+            }
+            break;
+
+        case SIM_WAIT_RECONNECT:
+            if (now >= client->state_ms) sim_connect_attempt(client);
+            break;
+
+        case SIM_CONNECTED:
+            if (!sim_link_up(now)) {
+                sim_abort_connection(client);
+                break;
+            }
+            for (int i = 0; i < client->item_count;) {
+                sim_item_t *item = &client->items[i];
+                if (item->tick_ms + SIM_OUTBOX_EXPIRED_MS <= now) {
+                    stats.expired++;
+                    sim_post_event(client, MQTT_EVENT_DELETED, item->msg_id);
+                    sim_item_remove(client, i);
+                    continue;
+                }
+                if (item->in_transit && item->ack_ms <= now) {
+                    if (sim_broker_deliver(item)) {
+                        sim_post_event(client, MQTT_EVENT_PUBLISHED, item->msg_id);
+                        sim_item_remove(client, i);
+                        continue;
+                    }
+                    item->ack_ms = SIM_NEVER;   // Sin PUBACK: queda hasta vencer
+                    stats.rejected++;
+                }
+                i++;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/* Transmite lo encolado y, tras reconectar, reenvia lo que no se confirmo */
+static void sim_client_send_pending(struct esp_mqtt_client *client) {
+    if (client->state != SIM_CONNECTED) return;
+
+    for (int i = 0; i < client->item_count; i++) {
+        if (!client->items[i].in_transit) sim_transmit(client, &client->items[i]);
+        client->items[i].sent = true;
+    }
+}
+
+
+static int64_t sim_client_next_ms(const struct esp_mqtt_client *client) {
+    int64_t next = -1;
+
+    switch (client->state) {
+        case SIM_CONNECTING:
+        case SIM_WAIT_RECONNECT:
+            return client->state_ms;
+
+        case SIM_CONNECTED:
+            next = sim_link_next_change(sim_rtos_now_ms());
+            for (int i = 0; i < client->item_count; i++) {
+                const sim_item_t *item = &client->items[i];
+                int64_t due = item->tick_ms + SIM_OUTBOX_EXPIRED_MS;
+                if (item->in_transit && item->ack_ms < due) due = item->ack_ms;
+                if (next < 0 || due < next) next = due;
+            }
+            return next;
+
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * @brief Tarea de esp-mqtt: entrega los eventos en orden y atiende el enlace.
+ */
+static void sim_client_task(void *arg) {
+    struct esp_mqtt_client *client = (struct esp_mqtt_client *)arg;
+
+    while (1) {
+        sim_client_poll(client);
+        while (client->event_count > 0) {
+            esp_mqtt_event_t event = client->events[client->event_head];
+            client->event_head = (client->event_head + 1) % SIM_EVENT_MAX;
+            client->event_count--;
+            if (client->handler) client->handler(client->handler_args, "MQTT_EVENTS", event.event_id, &event);
+        }
+        sim_client_send_pending(client);
+        if (client->event_count > 0) continue;
+
+        int64_t next = sim_client_next_ms(client);
+        int64_t wait = (next < 0) ? -1 : next - sim_rtos_now_ms();
+        ulTaskNotifyTake(pdTRUE, (wait < 0) ? portMAX_DELAY : (TickType_t)(wait > 0 ? wait : 1));
+    }
+}
+
+
+/* ----- API ----- */
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    struct esp_mqtt_client *client = &instance;
+
+    memset(client, 0, sizeof(*client));
+    client->protocol = (config->session.protocol_ver == MQTT_PROTOCOL_V_5) ? MQTT_PROTOCOL_V_5 : MQTT_PROTOCOL_V_3_1_1;
+    client->outbox_limit = config->outbox.limit;
+    return client;
+}
+
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args) {
+    (void)event;
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    if (client->state != SIM_STOPPED) return ESP_FAIL;
+    if (!client->task && xTaskCreate(sim_client_task, "mqtt_task", 6144, client, 5, &client->task) != pdPASS) {
+        return ESP_FAIL;
+    }
+    sim_connect_attempt(client);
+    xTaskNotifyGive(client->task);
+    return ESP_OK;
+}
+
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+    if (client->state == SIM_STOPPED) return ESP_FAIL;
+    client->state = SIM_STOPPED;
+    for (int i = 0; i < client->item_count; i++) client->items[i].in_transit = false;
+    return ESP_OK;
+}
+
+
+/* Como esp-mqtt: solo adelanta el proximo intento si el cliente espera para reconectar */
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client) {
+    if (client->state != SIM_WAIT_RECONNECT) return ESP_FAIL;
+    sim_connect_attempt(client);
+    xTaskNotifyGive(client->task);
+    return ESP_OK;
+}
+
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos) {
+    (void)topic; (void)qos;
+    if (client->state != SIM_CONNECTED) return -1;
+    client->next_msg_id = (client->next_msg_id % 65535) + 1;
+    return client->next_msg_id;
+}
+
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain) {
+    (void)retain;
+    if (qos == 0 && client->state != SIM_CONNECTED) return -1;
+
+    int msg_id = sim_store(client, topic, data, len, qos);
+    if (msg_id < 0) return msg_id;
+
+    sim_item_t *item = &client->items[client->item_count - 1];
+    if (client->state == SIM_CONNECTED) {
+        sim_transmit(client, item);
+        item->sent = true;
+    }
+    if (qos == 0) {   // Sin PUBACK: llega al broker y sale del outbox
+        sim_broker_deliver(item);
+        sim_item_remove(client, client->item_count - 1);
+        return 0;
+    }
+    xTaskNotifyGive(client->task);
+    return msg_id;
+}
+
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain, bool store) {
+    (void)retain; (void)store;
+    int msg_id = sim_store(client, topic, data, len, qos);
+    if (msg_id >= 0 && client->task) xTaskNotifyGive(client->task);
+    return msg_id;
+}
+
+
+esp_err_t esp_mqtt_dispatch_custom_event(esp_mqtt_client_handle_t client, esp_mqtt_event_t *event) {
+    sim_post_event(client, MQTT_USER_EVENT, event->msg_id);
+    return ESP_OK;
+}
+
+
+/* ----- MQTT 5 ----- */
+esp_err_t esp_mqtt5_client_set_user_property(mqtt5_user_property_handle_t *user_property,
+                                             esp_mqtt5_user_property_item_t items[], uint8_t count) {
+    if (!*user_property) {
+        *user_property = calloc(1, sizeof(struct mqtt5_user_property_list_t));
+        if (!*user_property) return ESP_ERR_NO_MEM;
+    }
+    struct mqtt5_user_property_list_t *list = *user_property;
+    for (uint8_t i = 0; i < count; i++) {
+        if (list->count == SIM_USER_PROPERTY_MAX || strlen(items[i].key) >= SIM_PROPERTY_LEN
+            || strlen(items[i].value) >= SIM_PROPERTY_LEN) {
+            return ESP_ERR_NO_MEM;
+        }
+        strcpy(list->key[list->count], items[i].key);
+        strcpy(list->value[list->count], items[i].value);
+        list->count++;
+    }
+    return ESP_OK;
+}
+
+
+void esp_mqtt5_client_delete_user_property(mqtt5_user_property_handle_t user_property) {
+    free(user_property);
+}
+
+
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t *property) {
+    if (client->protocol != MQTT_PROTOCOL_V_5) return ESP_FAIL;
+    if (property->topic_alias > SIM_BROKER_ALIAS_MAX) return ESP_FAIL;
+
+    client->property = *property;
+    memset(&client->property_list, 0, sizeof(client->property_list));
+    if (property->user_property) client->property_list = *property->user_property;
+    client->property.user_property = NULL;
+    client->property_set = true;
+    return ESP_OK;
+}
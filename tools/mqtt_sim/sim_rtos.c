@@ -0,0 +1,259 @@
+/*
+ * Planificador cooperativo del simulador: cada tarea de FreeRTOS es una corrutina (ucontext) que corre
+ * hasta bloquearse (retardo, notificacion, bits de un event group o mutex tomado). Cuando ninguna tarea
+ * esta lista el tiempo virtual salta al proximo vencimiento. Un tick es 1 ms y esp_timer_get_time
+ * devuelve el mismo reloj. No hay expropiacion: el orden entre tareas es el de la lista.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "sim.h"
+
+
+#define SIM_TASK_MAX        8
+#define SIM_STACK_BYTES     (256 * 1024)   // La pila pedida por el firmware no alcanza para libc en host
+
+
+typedef enum {
+    SIM_READY = 0,
+    SIM_DELAY,
+    SIM_NOTIFY,
+    SIM_BITS,
+    SIM_MUTEX,
+    SIM_DONE,
+} sim_wait_t;
+
+
+struct sim_task {
+    const char *name;
+    TaskFunction_t fn;
+    void *arg;
+    ucontext_t ctx;
+    void *stack;
+    sim_wait_t wait;
+    int64_t wake_ms;               // Vencimiento de la espera (-1: sin limite)
+    uint32_t notify;
+    EventGroupHandle_t group;
+    EventBits_t bits;
+    BaseType_t all;
+    SemaphoreHandle_t mutex;
+};
+
+
+static struct sim_task tasks[SIM_TASK_MAX];
+static int task_count;
+static struct sim_task *current;
+static ucontext_t scheduler;
+static int64_t now_ms;
+
+
+int64_t sim_rtos_now_ms(void) {
+    return now_ms;
+}
+
+
+int64_t esp_timer_get_time(void) {
+    return now_ms * 1000;
+}
+
+
+/* ----- Tareas ----- */
+static void sim_task_entry(void) {
+    current->fn(current->arg);
+    current->wait = SIM_DONE;   // uc_link vuelve al planificador
+}
+
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg,
+                       UBaseType_t priority, TaskHandle_t *out) {
+    (void)stack_size; (void)priority;
+    if (task_count >= SIM_TASK_MAX) return pdFALSE;
+
+    struct sim_task *task = &tasks[task_count];
+    task->stack = malloc(SIM_STACK_BYTES);
+    if (!task->stack) return pdFALSE;
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    task->wait = SIM_READY;
+    getcontext(&task->ctx);
+    task->ctx.uc_stack.ss_sp = task->stack;
+    task->ctx.uc_stack.ss_size = SIM_STACK_BYTES;
+    task->ctx.uc_link = &scheduler;
+    makecontext(&task->ctx, sim_task_entry, 0);
+    task_count++;
+    if (out) *out = task;
+    return pdPASS;
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current;
+}
+
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)now_ms;
+}
+
+
+/**
+ * @brief Bloquea la tarea actual hasta que el planificador la vuelva a elegir.
+ */
+static void sim_block(sim_wait_t wait, TickType_t ticks) {
+    if (!current) {
+        fprintf(stderr, "sim_rtos: espera fuera de una tarea\n");
+        exit(2);
+    }
+    current->wait = wait;
+    current->wake_ms = (ticks == portMAX_DELAY) ? -1 : now_ms + (int64_t)ticks;
+    swapcontext(&current->ctx, &scheduler);
+}
+
+
+static bool sim_bits_match(const struct sim_task *task) {
+    EventBits_t bits = task->group->bits & task->bits;
+    return task->all ? (bits == task->bits) : (bits != 0);
+}
+
+
+static bool sim_task_ready(const struct sim_task *task) {
+    bool expired = task->wake_ms >= 0 && now_ms >= task->wake_ms;
+
+    switch (task->wait) {
+        case SIM_READY:  return true;
+        case SIM_DELAY:  return expired;
+        case SIM_NOTIFY: return task->notify > 0 || expired;
+        case SIM_BITS:   return sim_bits_match(task) || expired;
+        case SIM_MUTEX:  return !task->mutex->taken || expired;
+        default:         return false;
+    }
+}
+
+
+void vTaskDelay(TickType_t ticks) {
+    sim_block(SIM_DELAY, ticks);
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    if (current->notify == 0 && ticks > 0) sim_block(SIM_NOTIFY, ticks);
+
+    uint32_t value = current->notify;
+    if (value > 0) current->notify = clear ? 0 : value - 1;
+    return value;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notify++;
+    return pdPASS;
+}
+
+
+/* ----- Mutex ----- */
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    buffer->owner = NULL;
+    buffer->taken = false;
+    return buffer;
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks) {
+    if (mutex->taken && mutex->owner == current) {
+        fprintf(stderr, "sim_rtos: la tarea %s vuelve a tomar un mutex que ya tiene\n", current ? current->name : "main");
+        exit(2);
+    }
+    if (mutex->taken && ticks > 0) {
+        current->mutex = mutex;
+        sim_block(SIM_MUTEX, ticks);
+    }
+    if (mutex->taken) return pdFALSE;
+    mutex->taken = true;
+    mutex->owner = current;
+    return pdTRUE;
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    if (!mutex->taken || mutex->owner != current) return pdFALSE;
+    mutex->taken = false;
+    mutex->owner = NULL;
+    return pdTRUE;
+}
+
+
+/* ----- Event groups ----- */
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer) {
+    buffer->bits = 0;
+    return buffer;
+}
+
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    return group->bits;
+}
+
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t ticks) {
+    current->group = group;
+    current->bits = bits;
+    current->all = all;
+    if (!sim_bits_match(current) && ticks > 0) sim_block(SIM_BITS, ticks);
+
+    EventBits_t value = group->bits;
+    if (clear && sim_bits_match(current)) group->bits &= ~bits;
+    return value;
+}
+
+
+/**
+ * @brief Corre las tareas hasta que finished() sea verdadero o el reloj llegue a limit_ms.
+ */
+void sim_rtos_run(bool (*finished)(void), int64_t limit_ms) {
+    while (!finished() && now_ms < limit_ms) {
+        bool ran = false;
+
+        for (int i = 0; i < task_count; i++) {
+            struct sim_task *task = &tasks[i];
+            if (!sim_task_ready(task)) continue;
+            task->wait = SIM_READY;
+            current = task;
+            swapcontext(&scheduler, &task->ctx);
+            current = NULL;
+            ran = true;
+        }
+        if (ran) continue;
+
+        int64_t next = -1;   // Ninguna tarea lista: salta al proximo vencimiento
+        for (int i = 0; i < task_count; i++) {
+            const struct sim_task *task = &tasks[i];
+            if (task->wait == SIM_DONE || task->wake_ms < 0) continue;
+            if (next < 0 || task->wake_ms < next) next = task->wake_ms;
+        }
+        if (next < 0) {
+            fprintf(stderr, "sim_rtos: todas las tareas esperan sin limite (bloqueo)\n");
+            return;
+        }
+        now_ms = (next < limit_ms) ? next : limit_ms;
+    }
+}
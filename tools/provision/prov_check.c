@@ -0,0 +1,177 @@
+/*
+ * Prueba de ida y vuelta (host) del protocolo de aprovisionamiento: arma lineas PROV como
+ * provision_client y las valida con el mismo parser que el firmware (src/provision.c).
+ *
+ * Compilar (desde la raiz del repositorio):
+ *   cc -O2 -Iinclude -Itools/mqtt_sim/host -o prov_check tools/provision/prov_check.c src/provision.c
+ *
+ * Uso:
+ *   prov_check [iteraciones]     (por defecto 2000 lotes aleatorios)
+ *
+ * Casos: lote completo con valores que requieren escapes, valores del largo maximo, lotes aleatorios
+ * con bytes 0x01..0xFF, CRC alterado, campo fuera de rango, clave desconocida y linea que excede el
+ * editor del firmware (debe rechazarla el cliente, no el dispositivo).
+ *
+ * Codigo de salida: 0 si todos los casos pasan, 1 si alguno falla.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Setting/provision.h"
+
+
+static int failures = 0;
+
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FALLA: " __VA_ARGS__); printf("\n"); } } while (0)
+
+
+static void set_field(prov_field_t *f, const char *key, const char *value) {
+    snprintf(f->key, sizeof(f->key), "%s", key);
+    snprintf(f->value, sizeof(f->value), "%s", value);
+}
+
+
+/**
+ * @brief Arma la linea y la pasa por el parser como lo hace el editor del firmware: sin "PROV " ni '\n'.
+ */
+static prov_result_t round_trip(const prov_field_t *fields, int count, settings_t *out, char *bad_key) {
+    char line[PROV_LINE_MAX + 2];
+    uint32_t crc = 0;
+    int len = prov_build_line(fields, count, line, sizeof(line));
+
+    if (len < 0) return (prov_result_t)-1;
+    CHECK(len - 1 <= PROV_LINE_MAX, "linea de %d caracteres supera el editor", len - 1);
+    line[len - 1] = '\0';
+    memset(out, 0, sizeof(*out));
+    return prov_parse_batch(line + strlen("PROV "), out, bad_key, PROV_KEY_MAX, &crc);
+}
+
+
+static void check_full_batch(void) {
+    prov_field_t f[PROV_MAX_FIELDS];
+    settings_t s;
+    char bad[PROV_KEY_MAX];
+    char longest[SETTINGS_MAX_STRING_LEN];
+    int n = 0;
+
+    memset(longest, 'x', sizeof(longest) - 1);
+    longest[sizeof(longest) - 1] = '\0';
+
+    set_field(&f[n++], PROV_KEY_SSID, "mi red;2=*%");
+    set_field(&f[n++], PROV_KEY_PASS, "clave con espacios\tytab");
+    set_field(&f[n++], PROV_KEY_HOST, "broker.local");
+    set_field(&f[n++], PROV_KEY_PORT, "8883");
+    set_field(&f[n++], PROV_KEY_USER, "\xC3\xB1" "and" "\xC3\xBA");
+    set_field(&f[n++], PROV_KEY_MQTT_PASS, longest);
+    set_field(&f[n++], PROV_KEY_NAME, "hub-01");
+    set_field(&f[n++], PROV_KEY_SAMPLE, "5");
+    set_field(&f[n++], PROV_KEY_AES, "0123456789abcdef0123456789abcdef");
+    set_field(&f[n++], PROV_KEY_BATCH, "4");
+    set_field(&f[n++], PROV_KEY_SENSORS, "0x7");
+    set_field(&f[n++], PROV_KEY_INTERVAL_DHT11, "2000");
+    set_field(&f[n++], PROV_KEY_HEARTBEAT, "0");
+    set_field(&f[n++], PROV_KEY_CALIB_MQ135, "1");
+
+    prov_result_t r = round_trip(f, n, &s, bad);
+    CHECK(r == PROV_OK, "lote completo rechazado (%d, clave %s)", r, r == PROV_ERR_FIELD ? bad : "-");
+    if (r != PROV_OK) return;
+    CHECK(strcmp(s.wifi_ssid, f[0].value) == 0, "ssid: '%s'", s.wifi_ssid);
+    CHECK(strcmp(s.wifi_password, f[1].value) == 0, "pass: '%s'", s.wifi_password);
+    CHECK(strcmp(s.mqtt_host, f[2].value) == 0, "host: '%s'", s.mqtt_host);
+    CHECK(s.mqtt_port == 8883, "port: %u", s.mqtt_port);
+    CHECK(strcmp(s.mqtt_user, f[4].value) == 0, "user: '%s'", s.mqtt_user);
+    CHECK(strcmp(s.mqtt_password, longest) == 0, "mpass de largo maximo");
+    CHECK(strcmp(s.device_name, f[6].value) == 0, "name: '%s'", s.device_name);
+    CHECK(s.sample_rate == 5 && s.report_interval_ms == 300000, "sample: %lu", (unsigned long)s.sample_rate);
+    CHECK(s.sample_interval_ms[ID_KY037] == 300000, "sample no fijo int_ky037: %lu", (unsigned long)s.sample_interval_ms[ID_KY037]);
+    CHECK(strcmp(s.aes_key, f[8].value) == 0, "key: '%s'", s.aes_key);
+    CHECK(s.batch_size == 4, "batch: %u", s.batch_size);
+    CHECK(s.sensor_mask == 0x7, "sensors: %u", s.sensor_mask);
+    CHECK(s.sample_interval_ms[ID_DHT11] == 2000, "int_dht11: %lu", (unsigned long)s.sample_interval_ms[ID_DHT11]);
+    CHECK(s.heartbeat_ms == 0, "heartbeat: %lu", (unsigned long)s.heartbeat_ms);
+    CHECK(s.mq135_calib_seq == 1, "calib_mq135: %lu", (unsigned long)s.mq135_calib_seq);
+}
+
+
+static void check_rejections(void) {
+    prov_field_t f[2];
+    settings_t s;
+    char bad[PROV_KEY_MAX];
+    char line[PROV_LINE_MAX + 2];
+    uint32_t crc;
+
+    set_field(&f[0], PROV_KEY_HOST, "broker");
+    set_field(&f[1], PROV_KEY_PORT, "0");
+    CHECK(round_trip(f, 2, &s, bad) == PROV_ERR_FIELD && strcmp(bad, PROV_KEY_PORT) == 0, "port=0 aceptado");
+
+    set_field(&f[1], "nope", "1");
+    CHECK(round_trip(f, 2, &s, bad) == PROV_ERR_FIELD && strcmp(bad, "nope") == 0, "clave desconocida aceptada");
+
+    set_field(&f[1], PROV_KEY_CALIB_MQ135, "2");
+    CHECK(round_trip(f, 2, &s, bad) == PROV_ERR_FIELD && strcmp(bad, PROV_KEY_CALIB_MQ135) == 0, "calib_mq135=2 aceptado");
+
+    set_field(&f[1], PROV_KEY_PORT, "1883");
+    int len = prov_build_line(f, 2, line, sizeof(line));
+    CHECK(len > 0, "lote valido no se pudo armar");
+    if (len > 0) {
+        line[len - 1] = '\0';
+        line[strlen("PROV ")] ^= 1;   // Un bit del cuerpo
+        CHECK(prov_parse_batch(line + strlen("PROV "), &s, bad, sizeof(bad), &crc) == PROV_ERR_CRC, "CRC alterado aceptado");
+    }
+    CHECK(prov_parse_batch("host=broker", &s, bad, sizeof(bad), &crc) == PROV_ERR_FORMAT, "lote sin CRC aceptado");
+
+    // Valores del largo maximo formados solo por caracteres que se escapan: la linea no entra en el editor
+    prov_field_t big[4];
+    char escaped[SETTINGS_MAX_STRING_LEN];
+    memset(escaped, ';', sizeof(escaped) - 1);
+    escaped[sizeof(escaped) - 1] = '\0';
+    set_field(&big[0], PROV_KEY_SSID, escaped);
+    set_field(&big[1], PROV_KEY_PASS, escaped);
+    set_field(&big[2], PROV_KEY_USER, escaped);
+    set_field(&big[3], PROV_KEY_MQTT_PASS, escaped);
+    CHECK(prov_build_line(big, 4, line, sizeof(line)) < 0, "linea excedida aceptada por el cliente");
+}
+
+
+/**
+ * @brief Lotes aleatorios de campos de texto con cualquier byte distinto de 0.
+ */
+static void check_random(int iterations) {
+    static const char *keys[] = { PROV_KEY_SSID, PROV_KEY_PASS, PROV_KEY_HOST, PROV_KEY_USER, PROV_KEY_MQTT_PASS, PROV_KEY_NAME };
+    prov_field_t f[6];
+    settings_t s;
+    char bad[PROV_KEY_MAX];
+    int accepted = 0;
+
+    srand(1234);
+    for (int it = 0; it < iterations; it++) {
+        for (int k = 0; k < 6; k++) {
+            int len = rand() % SETTINGS_MAX_STRING_LEN;
+            snprintf(f[k].key, sizeof(f[k].key), "%s", keys[k]);
+            for (int i = 0; i < len; i++) f[k].value[i] = (char)(1 + rand() % 255);
+            f[k].value[len] = '\0';
+        }
+        prov_result_t r = round_trip(f, 6, &s, bad);
+        if ((int)r == -1) continue;   // No entra en el editor: el cliente lo rechaza
+        accepted++;
+        CHECK(r == PROV_OK, "lote aleatorio %d rechazado (%d)", it, r);
+        const char *got[6] = { s.wifi_ssid, s.wifi_password, s.mqtt_host, s.mqtt_user, s.mqtt_password, s.device_name };
+        for (int k = 0; k < 6 && r == PROV_OK; k++) {
+            CHECK(strcmp(got[k], f[k].value) == 0, "lote aleatorio %d, campo %s distinto", it, keys[k]);
+        }
+    }
+    printf("Lotes aleatorios: %d de %d entran en la linea del firmware\n", accepted, iterations);
+}
+
+
+int main(int argc, char **argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 2000;
+
+    check_full_batch();
+    check_rejections();
+    check_random(iterations);
+
+    printf("%s (%d fallas)\n", failures ? "FALLA" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Cliente de referencia (host, POSIX) para el aprovisionamiento en lote por UART.
+ *
+ * Compilar (desde la raiz del repositorio; usa el mismo src/provision.c que el firmware):
+ *   cc -O2 -Iinclude -Itools/mqtt_sim/host -o provision_client tools/provision/provision_client.c src/provision.c
+ * Uso:       provision_client -p /dev/ttyUSB0 [-b 115200] [-t 5] [-f archivo] [-n] [clave=valor ...]
+ *
+ *   -p  Puerto serie del dispositivo
+ *   -b  Baudios (por defecto 115200, igual a SETTINGS_UART_BAUD_RATE)
+ *   -t  Tiempo maximo de espera del ACK/NAK en segundos
+ *   -f  Archivo con una linea clave=valor por campo (lineas vacias y '#' se ignoran)
+ *   -n  No abrir el puerto: solo imprimir la linea PROV generada
+ *
+ * Claves: ssid, pass, host, port, user, mpass, name, sample, key (ver PROV_KEY_* en settings.h).
+ * Los valores de la linea de comandos tienen prioridad sobre los del archivo.
+ *
+ * Codigo de salida: 0 ACK, 1 NAK, 2 error de uso / puerto / timeout.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Setting/provision.h"
+
+
+static prov_field_t fields[PROV_MAX_FIELDS];
+static int field_count = 0;
+
+
+/**
+ * @brief Agrega o reemplaza un campo "clave=valor".
+ */
+static int add_field(const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL || eq == arg || (size_t)(eq - arg) >= sizeof(fields[0].key)) return -1;
+    if (strlen(eq + 1) >= sizeof(fields[0].value)) return -1;   // El firmware no admite valores mas largos
+
+    size_t key_len = (size_t)(eq - arg);
+    int index = field_count;
+    for (int i = 0; i < field_count; i++) {
+        if (strlen(fields[i].key) == key_len && strncmp(fields[i].key, arg, key_len) == 0) index = i;
+    }
+    if (index == PROV_MAX_FIELDS) return -1;
+
+    memcpy(fields[index].key, arg, key_len);
+    fields[index].key[key_len] = '\0';
+    snprintf(fields[index].value, sizeof(fields[index].value), "%s", eq + 1);
+    if (index == field_count) field_count++;
+    return 0;
+}
+
+
+/**
+ * @brief Carga campos desde un archivo clave=valor.
+ */
+static int load_file(const char *path) {
+    char line[256];
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "No se pudo abrir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        if (add_field(line) != 0) {
+            fprintf(stderr, "Linea invalida en %s: %s\n", path, line);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+
+static speed_t baud_to_speed(long baud) {
+    switch (baud) {
+        case 9600:   return B9600;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return 0;
+    }
+}
+
+
+static int open_port(const char *path, long baud) {
+    speed_t speed = baud_to_speed(baud);
+    if (speed == 0) {
+        fprintf(stderr, "Baudios no soportados: %ld\n", baud);
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "No se pudo abrir %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        len -= (size_t)w;
+    }
+    return tcdrain(fd);
+}
+
+
+/**
+ * @brief Lee lineas hasta encontrar una que empiece con "ACK " o "NAK ", o hasta el timeout.
+ * @return int  0 ACK, 1 NAK, 2 timeout/error.
+ */
+static int wait_reply(int fd, int timeout_s, uint32_t expected_crc) {
+    char line[256];
+    size_t len = 0;
+    time_t deadline = time(NULL) + timeout_s;
+
+    while (time(NULL) < deadline) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+        if (select(fd + 1, &fds, NULL, NULL, &tv) <= 0) continue;
+
+        char c;
+        while (read(fd, &c, 1) == 1) {
+            if (c == '\r') continue;
+            if (c != '\n') {
+                if (len < sizeof(line) - 1) line[len++] = c;
+                continue;
+            }
+            line[len] = '\0';
+            len = 0;
+
+            if (strncmp(line, "ACK ", 4) == 0) {
+                uint32_t crc = (uint32_t)strtoul(line + 4, NULL, 16);
+                if (crc != expected_crc) {
+                    fprintf(stderr, "ACK con CRC inesperado: %s\n", line);
+                    return 1;
+                }
+                printf("%s\n", line);
+                return 0;
+            }
+            if (strncmp(line, "NAK", 3) == 0) {
+                fprintf(stderr, "%s\n", line);
+                return 1;
+            }
+        }
+    }
+    fprintf(stderr, "Timeout esperando respuesta\n");
+    return 2;
+}
+
+
+int main(int argc, char **argv) {
+    const char *port = NULL;
+    long baud = 115200;
+    int timeout_s = 5;
+    int dry_run = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:b:t:f:n")) != -1) {
+        switch (opt) {
+            case 'p': port = optarg; break;
+            case 'b': baud = strtol(optarg, NULL, 10); break;
+            case 't': timeout_s = atoi(optarg); break;
+            case 'f': if (load_file(optarg) != 0) return 2; break;
+            case 'n': dry_run = 1; break;
+            default:
+                fprintf(stderr, "Uso: %s -p puerto [-b baudios] [-t seg] [-f archivo] [-n] [clave=valor ...]\n", argv[0]);
+                return 2;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (add_field(argv[i]) != 0) {
+            fprintf(stderr, "Campo invalido: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (field_count == 0 || (!dry_run && port == NULL)) {
+        fprintf(stderr, "Faltan campos o puerto\n");
+        return 2;
+    }
+
+    char line[PROV_LINE_MAX + 2];
+    int len = prov_build_line(fields, field_count, line, sizeof(line));
+    if (len < 0) {
+        fprintf(stderr, "La linea PROV excede el maximo del firmware (%d caracteres)\n", PROV_LINE_MAX);
+        return 2;
+    }
+    if (dry_run) {
+        fputs(line, stdout);
+        return 0;
+    }
+
+    int fd = open_port(port, baud);
+    if (fd < 0) return 2;
+
+    // Desactivar el eco para que la unica respuesta sea el ACK/NAK
+    static const char echo_off[] = "\r\nECHO 0\n";
+    uint32_t crc = (uint32_t)strtoul(strrchr(line, '*') + 1, NULL, 16);
+    int result = 2;
+    if (write_all(fd, echo_off, sizeof(echo_off) - 1) == 0) {
+        usleep(100000);
+        tcflush(fd, TCIFLUSH);
+        if (write_all(fd, line, (size_t)len) == 0) {
+            result = wait_reply(fd, timeout_s, crc);
+        }
+    }
+
+    close(fd);
+    return result;
+}